@@ -1044,6 +1044,71 @@ typedef struct UvmEventControlData_tag {
     NvU64 dropped[UvmEventNumTypesAll];
 } UvmToolsEventControlData;
 
+//------------------------------------------------------------------------------
+// Format of the records in an event queue buffer, selected with
+// UvmToolsEventQueueSetFormat before events are first enabled on the queue.
+//
+// UvmToolsEventFormatDefault: each event is stored in a UvmEventEntry, and the
+// get/put pointers in UvmToolsEventControlData are entry indices.
+//
+// UvmToolsEventFormatCompact: the queue buffer is a ring of 8-byte words, and
+// the get/put pointers are word indices. Each record starts with a
+// UvmEventCompactHeader, followed by the event structure of its type (for
+// example UvmEventGpuFaultInfo) padded to 8 bytes, followed by count delta
+// items. Each delta item describes one more event of the same type, relative
+// to the event preceding it in the record. Records never wrap around the end
+// of the ring: the remaining words are filled with a record of type
+// UvmEventTypeInvalid instead.
+//------------------------------------------------------------------------------
+typedef enum
+{
+    UvmToolsEventFormatDefault = 0,
+    UvmToolsEventFormatCompact = 1,
+
+    // ---- Add new values above this line
+    UvmToolsNumEventFormats
+} UvmToolsEventFormat;
+
+typedef struct
+{
+    NvU8  eventType;        // type of all the events in the record
+    NvU8  padding8bits;
+    NvU16 count;            // number of delta items after the first event
+    NvU32 size;             // size of the record in 8-byte words, including
+                            // this header
+} UvmEventCompactHeader;
+
+//------------------------------------------------------------------------------
+// Delta item for UvmEventTypeMigration records. srcIndex, dstIndex,
+// migrationCause, beginTimeStamp, endTimeStamp and rangeGroupId are the same as
+// in the first event of the record.
+//------------------------------------------------------------------------------
+typedef struct
+{
+    NvS32 addressDelta;            // address - previous event's address
+    NvU32 migratedBytes;
+    NvS32 beginTimeStampGpuDelta;  // beginTimeStampGpu - previous event's
+                                   // beginTimeStampGpu
+    NvU32 durationGpu;             // endTimeStampGpu - beginTimeStampGpu
+} UvmEventMigrationDeltaItem;
+
+//------------------------------------------------------------------------------
+// Delta item for UvmEventTypeGpuFault records. gpuIndex, timeStamp and batchId
+// are the same as in the first event of the record.
+//------------------------------------------------------------------------------
+typedef struct
+{
+    NvS32 addressDelta;            // address - previous event's address
+    NvS32 timeStampGpuDelta;       // timeStampGpu - previous event's
+                                   // timeStampGpu
+    NvU16 gpcId;                   // gpcId or channelId
+    NvU16 clientId;
+    NvU8  faultType;
+    NvU8  accessType;
+    NvU8  clientType;
+    NvU8  padding8bits;
+} UvmEventGpuFaultDeltaItem;
+
 //------------------------------------------------------------------------------
 // UVM Tools forward types (handles) definitions
 //------------------------------------------------------------------------------
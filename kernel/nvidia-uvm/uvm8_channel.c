@@ -54,10 +54,24 @@ static char *uvm_channel_gpput_loc = UVM_CHANNEL_GPPUT_LOC_DEFAULT;
 
 static char *uvm_channel_pushbuffer_loc = UVM_CHANNEL_PUSHBUFFER_LOC_DEFAULT;
 
+static unsigned uvm_channel_pushbuffer_chunks = UVM_PUSHBUFFER_CHUNKS_DEFAULT;
+
+static unsigned uvm_channel_pushbuffer_chunk_size = UVM_PUSHBUFFER_CHUNK_SIZE_DEFAULT;
+
+#define UVM_CHANNEL_LOAD_BALANCING_DEFAULT 1
+
+static unsigned uvm_channel_load_balancing = UVM_CHANNEL_LOAD_BALANCING_DEFAULT;
+
+// Weight of the existing estimate when a new CE bandwidth sample is averaged in
+#define UVM_CHANNEL_CE_BANDWIDTH_WEIGHT 8
+
 module_param(uvm_channel_num_gpfifo_entries, uint, S_IRUGO);
 module_param(uvm_channel_gpfifo_loc, charp, S_IRUGO);
 module_param(uvm_channel_gpput_loc, charp, S_IRUGO);
 module_param(uvm_channel_pushbuffer_loc, charp, S_IRUGO);
+module_param(uvm_channel_pushbuffer_chunks, uint, S_IRUGO);
+module_param(uvm_channel_pushbuffer_chunk_size, uint, S_IRUGO);
+module_param(uvm_channel_load_balancing, uint, S_IRUGO);
 
 static NV_STATUS manager_create_procfs_dirs(uvm_channel_manager_t *manager);
 static NV_STATUS manager_create_procfs(uvm_channel_manager_t *manager);
@@ -73,6 +87,55 @@ typedef enum
     UVM_CHANNEL_UPDATE_MODE_FORCE_ALL
 } uvm_channel_update_mode_t;
 
+// Remove the completion waiters that can be notified. In the forced mode all
+// the waiters are removed regardless of the value they are waiting for.
+static void channel_take_completed_waiters(uvm_channel_t *channel,
+                                           NvU64 completed_value,
+                                           uvm_channel_update_mode_t mode,
+                                           struct list_head *completed)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_tracker_completion_waiter_t *waiter, *next;
+
+    uvm_assert_spinlock_locked(&channel->pool->lock);
+
+    list_for_each_entry_safe(waiter, next, &channel->completion_waiters, channel_list_node) {
+        // The list is sorted so the remaining waiters are not completed either
+        if (mode == UVM_CHANNEL_UPDATE_MODE_COMPLETED && waiter->entry.value > completed_value)
+            break;
+
+        list_move_tail(&waiter->channel_list_node, completed);
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void channel_notify_completed_waiters(uvm_channel_t *channel,
+                                             NvU64 completed_value,
+                                             struct list_head *completed)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_tracker_completion_waiter_t *waiter, *next;
+    NV_STATUS forced_status = NV_OK;
+
+    list_for_each_entry_safe(waiter, next, completed, channel_list_node) {
+        NV_STATUS status = NV_OK;
+
+        list_del(&waiter->channel_list_node);
+
+        // Waiters removed in the forced mode might not be completed, report
+        // why they never will be.
+        if (waiter->entry.value > completed_value) {
+            if (forced_status == NV_OK) {
+                forced_status = uvm_global_get_status();
+                if (forced_status == NV_OK)
+                    forced_status = uvm_channel_get_status(channel);
+                if (forced_status == NV_OK)
+                    forced_status = NV_ERR_INVALID_STATE;
+            }
+            status = forced_status;
+        }
+
+        uvm_tracker_completion_waiter_done(waiter, status);
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 // Update channel progress, completing up to max_to_complete entries
 static NvU32 uvm_channel_update_progress_with_max(uvm_channel_t *channel,
                                                   NvU32 max_to_complete,
@@ -82,11 +145,17 @@ static NvU32 uvm_channel_update_progress_with_max(uvm_channel_t *channel,
     NvU32 cpu_put;
     NvU32 completed_count = 0;
     NvU32 pending_gpfifos;
+    NvU64 now = 0;
+    LIST_HEAD(completed_waiters);
 
     NvU64 completed_value = uvm_channel_update_completed_value(channel);
 
     uvm_spin_lock(&channel->pool->lock);
 
+    // Completion waiters only depend on the tracking semaphore value and not
+    // on the GPFIFO entries, so they are not limited by max_to_complete.
+    channel_take_completed_waiters(channel, completed_value, mode, &completed_waiters);
+
     cpu_put = channel->cpu_put;
     gpu_get = channel->gpu_get;
 
@@ -96,6 +165,25 @@ static NvU32 uvm_channel_update_progress_with_max(uvm_channel_t *channel,
         if (mode == UVM_CHANNEL_UPDATE_MODE_COMPLETED && entry->tracking_semaphore_value > completed_value)
             break;
 
+        UVM_ASSERT(channel->outstanding_bytes >= entry->transfer_bytes);
+        channel->outstanding_bytes -= entry->transfer_bytes;
+
+        // The completion is only noticed when polling, so the samples include
+        // some latency and underestimate the bandwidth for small transfers.
+        // Entries completed in the same update after the first sampled one
+        // have no measurable duration and are skipped.
+        if (entry->submit_time_ns != 0 && mode == UVM_CHANNEL_UPDATE_MODE_COMPLETED) {
+            NvU64 start = max(entry->submit_time_ns, channel->last_sample_completion_ns);
+
+            if (now == 0)
+                now = NV_GETTIME();
+
+            if (now > start)
+                uvm_channel_pool_record_transfer(channel->pool, entry->transfer_bytes, now - start);
+
+            channel->last_sample_completion_ns = now;
+        }
+
         uvm_pushbuffer_mark_completed(channel->pool->manager->pushbuffer, entry);
         list_add_tail(&entry->push_info->available_list_node, &channel->available_push_infos);
         gpu_get = (gpu_get + 1) % channel->num_gpfifo_entries;
@@ -106,6 +194,10 @@ static NvU32 uvm_channel_update_progress_with_max(uvm_channel_t *channel,
 
     uvm_spin_unlock(&channel->pool->lock);
 
+    // Notify the waiters without holding the pool lock so that completion
+    // callbacks can query the channel.
+    channel_notify_completed_waiters(channel, completed_value, &completed_waiters);
+
     if (cpu_put >= gpu_get)
         pending_gpfifos = cpu_put - gpu_get;
     else
@@ -171,78 +263,207 @@ static bool try_claim_channel(uvm_channel_t *channel)
     return claimed;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-// Reserve a channel in the given manager index range
-static NV_STATUS channel_reserve_in_range(uvm_channel_manager_t *manager,
-                                          unsigned start,
-                                          unsigned end,
-                                          uvm_channel_t **channel_out)
+static bool channel_manager_uses_ce(uvm_channel_manager_t *manager, NvU32 ce_index)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return manager->channel_pools[ce_index].manager != NULL;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_channel_pool_record_transfer(uvm_channel_pool_t *pool, NvU64 bytes, NvU64 duration_ns)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU64 sample;
+
+    uvm_assert_spinlock_locked(&pool->lock);
+    UVM_ASSERT(duration_ns > 0);
+
+    sample = max(bytes * 1000 / duration_ns, 1ULL);
+
+    if (pool->bandwidth == 0)
+        pool->bandwidth = sample;
+    else
+        pool->bandwidth = (pool->bandwidth * (UVM_CHANNEL_CE_BANDWIDTH_WEIGHT - 1) + sample) / UVM_CHANNEL_CE_BANDWIDTH_WEIGHT;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NvU64 uvm_channel_get_drain_time_ns(uvm_channel_t *channel)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU64 bandwidth;
+
+    uvm_assert_spinlock_locked(&channel->pool->lock);
+
+    bandwidth = channel->pool->bandwidth;
+    if (bandwidth == 0)
+        bandwidth = UVM_CHANNEL_CE_BANDWIDTH_DEFAULT;
+
+    return channel->outstanding_bytes * 1000 / bandwidth;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NvU32 channel_get_pending_entries(uvm_channel_t *channel)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 pending;
+
+    uvm_assert_spinlock_locked(&channel->pool->lock);
+
+    if (channel->cpu_put >= channel->gpu_get)
+        pending = channel->cpu_put - channel->gpu_get;
+    else
+        pending = channel->num_gpfifo_entries - channel->gpu_get + channel->cpu_put;
+
+    return pending + channel->current_pushes_count;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Try to claim a channel of one of the CEs in ce_mask. With load balancing
+// enabled the available channel with the lowest estimated drain time is picked,
+// otherwise the first available one. Returns NULL if no channel was claimed.
+static uvm_channel_t *channel_claim_in_ce_mask(uvm_channel_manager_t *manager, long unsigned ce_mask)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_channel_t *best_channel = NULL;
+    NvU64 best_drain_time = 0;
+    NvU32 best_pending = 0;
+    unsigned ce_index;
+
+    for_each_set_bit(ce_index, &ce_mask, UVM_COPY_ENGINE_COUNT_MAX) {
+        uvm_channel_pool_t *pool = manager->channel_pools + ce_index;
+        unsigned start = pool->channel_index;
+        uvm_channel_t *channel;
+
+        UVM_ASSERT(channel_manager_uses_ce(manager, ce_index));
+
+        uvm_for_each_channel_in_range(channel, manager, start, start + UVM_CHANNELS_PER_COPY_ENGINE) {
+            NvU64 drain_time;
+            NvU32 pending;
+            bool available;
+
+            if (!manager->conf.load_balancing) {
+                if (try_claim_channel(channel))
+                    return channel;
+
+                continue;
+            }
+
+            uvm_spin_lock(&pool->lock);
+
+            available = is_channel_available(channel);
+            drain_time = uvm_channel_get_drain_time_ns(channel);
+            pending = channel_get_pending_entries(channel);
+
+            uvm_spin_unlock(&pool->lock);
+
+            if (!available)
+                continue;
+
+            if (best_channel == NULL ||
+                drain_time < best_drain_time ||
+                (drain_time == best_drain_time && pending < best_pending)) {
+                best_channel = channel;
+                best_drain_time = drain_time;
+                best_pending = pending;
+            }
+        }
+    }
+
+    // The channel might have become unavailable since it was checked, in
+    // which case the caller updates the progress of the channels and retries.
+    if (best_channel != NULL && try_claim_channel(best_channel))
+        return best_channel;
+
+    return NULL;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Reserve a channel of one of the CEs in ce_mask
+static NV_STATUS channel_reserve_in_ce_mask(uvm_channel_manager_t *manager,
+                                            long unsigned ce_mask,
+                                            uvm_channel_t **channel_out)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     uvm_channel_t *channel;
     uvm_spin_loop_t spin;
 
-    uvm_for_each_channel_in_range(channel, manager, start, end) {
-        // TODO: Bug 1764953: Prefer idle/less busy channels
-        if (try_claim_channel(channel)) {
-            *channel_out = channel;
-            return NV_OK;
-        }
+    UVM_ASSERT(ce_mask != 0);
+
+    channel = channel_claim_in_ce_mask(manager, ce_mask);
+    if (channel != NULL) {
+        *channel_out = channel;
+        return NV_OK;
     }
 
     uvm_spin_loop_init(&spin);
     while (1) {
-        uvm_for_each_channel_in_range(channel, manager, start, end) {
-            NV_STATUS status;
+        unsigned ce_index;
 
-            uvm_channel_update_progress(channel);
+        for_each_set_bit(ce_index, &ce_mask, UVM_COPY_ENGINE_COUNT_MAX) {
+            unsigned start = manager->channel_pools[ce_index].channel_index;
 
-            if (try_claim_channel(channel)) {
-                *channel_out = channel;
-                return NV_OK;
-            }
+            uvm_for_each_channel_in_range(channel, manager, start, start + UVM_CHANNELS_PER_COPY_ENGINE) {
+                NV_STATUS status;
 
-            status = uvm_channel_check_errors(channel);
-            if (status != NV_OK)
-                return status;
+                uvm_channel_update_progress(channel);
 
-            UVM_SPIN_LOOP(&spin);
+                status = uvm_channel_check_errors(channel);
+                if (status != NV_OK)
+                    return status;
+            }
+        }
+
+        channel = channel_claim_in_ce_mask(manager, ce_mask);
+        if (channel != NULL) {
+            *channel_out = channel;
+            return NV_OK;
         }
+
+        UVM_SPIN_LOOP(&spin);
     }
 
     UVM_ASSERT_MSG(0, "Cannot get here?!\n");
     return NV_ERR_GENERIC;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-static bool channel_manager_uses_ce(uvm_channel_manager_t *manager, NvU32 ce_index)
+NV_STATUS uvm_channel_reserve_type(uvm_channel_manager_t *channel_manager,
+                                   uvm_channel_type_t type,
+                                   uvm_channel_t **channel_out)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    return manager->channel_pools[ce_index].manager != NULL;
+    long unsigned ce_mask;
+
+    UVM_ASSERT(type < UVM_CHANNEL_TYPE_COUNT);
+
+    if (channel_manager->conf.load_balancing || type == UVM_CHANNEL_TYPE_ANY)
+        ce_mask = channel_manager->ce_to_use.balanced_for_type[type];
+    else
+        ce_mask = 1UL << channel_manager->ce_to_use.default_for_type[type];
+
+    return channel_reserve_in_ce_mask(channel_manager, ce_mask, channel_out);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-static NV_STATUS channel_reserve_ce(uvm_channel_manager_t *channel_manager,
-                                    NvU32 ce_index,
-                                    uvm_channel_t **channel_out)
+NV_STATUS uvm_channel_try_reserve_type_excluding(uvm_channel_manager_t *manager,
+                                                 uvm_channel_type_t type,
+                                                 uvm_gpu_t *dst_gpu,
+                                                 long unsigned exclude_ce_mask,
+                                                 uvm_channel_t **channel_out)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    unsigned start, end;
+    long unsigned ce_mask;
+    uvm_channel_t *channel;
 
-    UVM_ASSERT(ce_index < UVM_COPY_ENGINE_COUNT_MAX);
-    UVM_ASSERT(channel_manager_uses_ce(channel_manager, ce_index));
+    UVM_ASSERT(type < UVM_CHANNEL_TYPE_COUNT);
 
-    start = channel_manager->channel_pools[ce_index].channel_index;
-    end = start + UVM_CHANNELS_PER_COPY_ENGINE;
+    ce_mask = manager->ce_to_use.balanced_for_type[type];
 
-    return channel_reserve_in_range(channel_manager, start, end, channel_out);
-pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+    if (type == UVM_CHANNEL_TYPE_GPU_TO_GPU) {
+        NvU32 ce_index;
 
-NV_STATUS uvm_channel_reserve_type(uvm_channel_manager_t *channel_manager,
-                                   uvm_channel_type_t type,
-                                   uvm_channel_t **channel_out)
-{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    unsigned ce_index;
+        UVM_ASSERT(dst_gpu);
+
+        ce_index = manager->ce_to_use.gpu_to_gpu[uvm_id_gpu_index(dst_gpu->id)];
+        if (ce_index != UVM_COPY_ENGINE_COUNT_MAX)
+            ce_mask |= 1UL << ce_index;
+    }
+
+    ce_mask &= ~exclude_ce_mask;
+    if (ce_mask == 0)
+        return NV_ERR_NOT_FOUND;
 
-    if (type == UVM_CHANNEL_TYPE_ANY)
-        return channel_reserve_in_range(channel_manager, 0, channel_manager->num_channels, channel_out);
+    channel = channel_claim_in_ce_mask(manager, ce_mask);
+    if (channel == NULL)
+        return NV_ERR_NOT_FOUND;
 
-    ce_index = channel_manager->ce_to_use.default_for_type[type];
-    return channel_reserve_ce(channel_manager, ce_index, channel_out);
+    *channel_out = channel;
+    return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 NV_STATUS uvm_channel_reserve_gpu_to_gpu(uvm_channel_manager_t *channel_manager,
@@ -252,11 +473,11 @@ NV_STATUS uvm_channel_reserve_gpu_to_gpu(uvm_channel_manager_t *channel_manager,
     const NvU32 dst_gpu_index = uvm_id_gpu_index(dst_gpu->id);
     NvU32 ce_index = channel_manager->ce_to_use.gpu_to_gpu[dst_gpu_index];
 
-    // No recommended CE for the given pair, use default
+    // No recommended CE for the given pair, use the CEs for the type
     if (ce_index == UVM_COPY_ENGINE_COUNT_MAX)
-        ce_index = channel_manager->ce_to_use.default_for_type[UVM_CHANNEL_TYPE_GPU_TO_GPU];
+        return uvm_channel_reserve_type(channel_manager, UVM_CHANNEL_TYPE_GPU_TO_GPU, channel_out);
 
-    return channel_reserve_ce(channel_manager, ce_index, channel_out);
+    return channel_reserve_in_ce_mask(channel_manager, 1UL << ce_index, channel_out);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 NV_STATUS uvm_channel_manager_wait(uvm_channel_manager_t *manager)
@@ -302,11 +523,13 @@ NV_STATUS uvm_channel_begin_push(uvm_channel_t *channel, uvm_push_t *push)
 
     manager = channel->pool->manager;
 
+    // The channel is used by the pushbuffer to pick a chunk for the push
+    push->channel = channel;
+
     status = uvm_pushbuffer_begin_push(manager->pushbuffer, push);
     if (status != NV_OK)
         return status;
 
-    push->channel = channel;
     push->channel_tracking_value = 0;
     push->push_info_index = channel_get_available_push_info_index(channel);
 
@@ -350,6 +573,11 @@ void uvm_channel_end_push(uvm_push_t *push)
     entry->pushbuffer_offset = uvm_pushbuffer_get_offset_for_push(pushbuffer, push);
     entry->pushbuffer_size = push_size;
     entry->push_info = &channel->push_infos[push->push_info_index];
+    entry->transfer_bytes = push->transfer_bytes;
+    entry->submit_time_ns = 0;
+    if (push->transfer_bytes >= UVM_CHANNEL_CE_BANDWIDTH_SAMPLE_MIN_BYTES)
+        entry->submit_time_ns = NV_GETTIME();
+    channel->outstanding_bytes += push->transfer_bytes;
     push->push_info_index = -1;
     pushbuffer_va = uvm_pushbuffer_get_gpu_va_for_push(pushbuffer, push);
 
@@ -499,6 +727,39 @@ bool uvm_channel_is_value_completed(uvm_channel_t *channel, NvU64 value)
     return uvm_gpu_tracking_semaphore_is_value_completed(&channel->tracking_sem, value);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+bool uvm_channel_add_completion_waiter(uvm_channel_t *channel, uvm_tracker_completion_waiter_t *waiter)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_tracker_completion_waiter_t *prev;
+    bool added = false;
+
+    UVM_ASSERT(waiter->entry.channel == channel);
+
+    uvm_spin_lock(&channel->pool->lock);
+
+    // Checking for completion with the pool lock held guarantees that a
+    // concurrent uvm_channel_update_progress() either already completed the
+    // value or will see the new waiter.
+    if (uvm_channel_is_value_completed(channel, waiter->entry.value))
+        goto done;
+
+    // Waiters are usually added in increasing value order, so search for the
+    // insertion point starting from the tail.
+    list_for_each_entry_reverse(prev, &channel->completion_waiters, channel_list_node) {
+        if (prev->entry.value <= waiter->entry.value)
+            break;
+    }
+
+    // If no waiter with a smaller or equal value was found, prev is the list
+    // head and the waiter is added at the front.
+    list_add(&waiter->channel_list_node, &prev->channel_list_node);
+    added = true;
+
+done:
+    uvm_spin_unlock(&channel->pool->lock);
+
+    return added;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 NvU64 uvm_channel_update_completed_value(uvm_channel_t *channel)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     return uvm_gpu_tracking_semaphore_update_completed_value(&channel->tracking_sem);
@@ -525,6 +786,7 @@ static NV_STATUS create_channel(uvm_channel_pool_t *pool, bool with_procfs, uvm_
     channel->pool = pool;
     manager->num_channels++;
     INIT_LIST_HEAD(&channel->available_push_infos);
+    INIT_LIST_HEAD(&channel->completion_waiters);
     channel->tools.pending_event_count = 0;
     INIT_LIST_HEAD(&channel->tools.channel_list_node);
 
@@ -625,6 +887,7 @@ static void destroy_channel(uvm_channel_manager_t *manager, uvm_channel_t *chann
 
     UVM_ASSERT(list_empty(&channel->tools.channel_list_node));
     UVM_ASSERT(channel->tools.pending_event_count == 0);
+    UVM_ASSERT(list_empty(&channel->completion_waiters));
 
     manager->num_channels--;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -718,22 +981,13 @@ static bool ce_usable_for_channel_type(uvm_channel_type_t type, const UvmGpuCopy
     }
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-// Returns negative if the first CE should be considered better than the second
-static int compare_ce_for_channel_type(const UvmGpuCopyEngineCaps *ce_caps,
-                                       uvm_channel_type_t type,
-                                       NvU32 ce_index0,
-                                       NvU32 ce_index1,
-                                       NvU32 *usage_count)
+// Compare the capabilities of two CEs that matter for the given channel type.
+// Returns negative if the first CE should be considered better than the second,
+// and 0 if they are equivalent for the type.
+static int compare_ce_caps_for_channel_type(const UvmGpuCopyEngineCaps *cap0,
+                                            const UvmGpuCopyEngineCaps *cap1,
+                                            uvm_channel_type_t type)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    const UvmGpuCopyEngineCaps *cap0 = ce_caps + ce_index0;
-    const UvmGpuCopyEngineCaps *cap1 = ce_caps + ce_index1;
-
-    UVM_ASSERT(ce_usable_for_channel_type(type, cap0));
-    UVM_ASSERT(ce_usable_for_channel_type(type, cap1));
-    UVM_ASSERT(ce_index0 < UVM_COPY_ENGINE_COUNT_MAX);
-    UVM_ASSERT(ce_index1 < UVM_COPY_ENGINE_COUNT_MAX);
-    UVM_ASSERT(ce_index0 != ce_index1);
-
     switch (type) {
         case UVM_CHANNEL_TYPE_CPU_TO_GPU:
             // For CPU to GPU fast sysmem read is the most important
@@ -797,6 +1051,30 @@ static int compare_ce_for_channel_type(const UvmGpuCopyEngineCaps *ce_caps,
             return 0;
     }
 
+    return 0;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Returns negative if the first CE should be considered better than the second
+static int compare_ce_for_channel_type(const UvmGpuCopyEngineCaps *ce_caps,
+                                       uvm_channel_type_t type,
+                                       NvU32 ce_index0,
+                                       NvU32 ce_index1,
+                                       NvU32 *usage_count)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    const UvmGpuCopyEngineCaps *cap0 = ce_caps + ce_index0;
+    const UvmGpuCopyEngineCaps *cap1 = ce_caps + ce_index1;
+    int caps_diff;
+
+    UVM_ASSERT(ce_usable_for_channel_type(type, cap0));
+    UVM_ASSERT(ce_usable_for_channel_type(type, cap1));
+    UVM_ASSERT(ce_index0 < UVM_COPY_ENGINE_COUNT_MAX);
+    UVM_ASSERT(ce_index1 < UVM_COPY_ENGINE_COUNT_MAX);
+    UVM_ASSERT(ce_index0 != ce_index1);
+
+    caps_diff = compare_ce_caps_for_channel_type(cap0, cap1, type);
+    if (caps_diff != 0)
+        return caps_diff;
+
     // By default, prefer less used CEs (within the UVM driver at least)
     if (usage_count[ce_index0] != usage_count[ce_index1])
         return usage_count[ce_index0] - usage_count[ce_index1];
@@ -849,6 +1127,26 @@ static NV_STATUS pick_ce_for_channel_type(uvm_channel_manager_t *manager,
     ++usage_count[best_ce];
     manager->ce_to_use.default_for_type[type] = best_ce;
 
+    // Transfers can be spread across the CEs that are as good as the default
+    // one for the type, except for MEMOPS that are latency sensitive and stay
+    // on their lightly used CE.
+    manager->ce_to_use.balanced_for_type[type] = 1UL << best_ce;
+    if (type == UVM_CHANNEL_TYPE_MEMOPS)
+        return NV_OK;
+
+    for (i = 0; i < UVM_COPY_ENGINE_COUNT_MAX; ++i) {
+        const UvmGpuCopyEngineCaps *cap = ce_caps + i;
+
+        if (i == best_ce || !ce_usable_for_channel_type(type, cap))
+            continue;
+
+        if (cap->shared != ce_caps[best_ce].shared)
+            continue;
+
+        if (compare_ce_caps_for_channel_type(cap, ce_caps + best_ce, type) == 0)
+            manager->ce_to_use.balanced_for_type[type] |= 1UL << i;
+    }
+
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
@@ -960,7 +1258,47 @@ static void init_channel_manager_conf(uvm_channel_manager_t *manager)
                 manager->conf.num_gpfifo_entries);
     }
 
-    // 2- Allocation locations
+    // 2- Pushbuffer chunks
+    manager->conf.num_pushbuffer_chunks = uvm_channel_pushbuffer_chunks;
+
+    if (uvm_channel_pushbuffer_chunks < UVM_PUSHBUFFER_CHUNKS_MIN)
+        manager->conf.num_pushbuffer_chunks = UVM_PUSHBUFFER_CHUNKS_MIN;
+    else if (uvm_channel_pushbuffer_chunks > UVM_PUSHBUFFER_CHUNKS_MAX)
+        manager->conf.num_pushbuffer_chunks = UVM_PUSHBUFFER_CHUNKS_MAX;
+
+    if (manager->conf.num_pushbuffer_chunks != uvm_channel_pushbuffer_chunks) {
+        pr_info("Invalid value for uvm_channel_pushbuffer_chunks = %u, using %u instead\n",
+                uvm_channel_pushbuffer_chunks,
+                manager->conf.num_pushbuffer_chunks);
+    }
+
+    manager->conf.pushbuffer_chunk_size = uvm_channel_pushbuffer_chunk_size;
+
+    if (uvm_channel_pushbuffer_chunk_size < UVM_PUSHBUFFER_CHUNK_SIZE_MIN)
+        manager->conf.pushbuffer_chunk_size = UVM_PUSHBUFFER_CHUNK_SIZE_MIN;
+    else if (uvm_channel_pushbuffer_chunk_size > UVM_PUSHBUFFER_CHUNK_SIZE_MAX)
+        manager->conf.pushbuffer_chunk_size = UVM_PUSHBUFFER_CHUNK_SIZE_MAX;
+
+    if (manager->conf.pushbuffer_chunk_size % UVM_MAX_PUSH_SIZE != 0)
+        manager->conf.pushbuffer_chunk_size = UVM_PUSHBUFFER_CHUNK_SIZE_DEFAULT;
+
+    if (manager->conf.pushbuffer_chunk_size != uvm_channel_pushbuffer_chunk_size) {
+        pr_info("Invalid value for uvm_channel_pushbuffer_chunk_size = %u, using %u instead\n",
+                uvm_channel_pushbuffer_chunk_size,
+                manager->conf.pushbuffer_chunk_size);
+    }
+
+    // 3- Load balancing
+    manager->conf.load_balancing = uvm_channel_load_balancing != 0;
+
+    if (uvm_channel_load_balancing > 1) {
+        pr_info("Invalid value for uvm_channel_load_balancing = %u, using %u instead\n",
+                uvm_channel_load_balancing,
+                UVM_CHANNEL_LOAD_BALANCING_DEFAULT);
+        manager->conf.load_balancing = UVM_CHANNEL_LOAD_BALANCING_DEFAULT;
+    }
+
+    // 4- Allocation locations
 
     // Override if the GPU doesn't have memory
     if (gpu->mem_info.size == 0) {
@@ -984,7 +1322,7 @@ static void init_channel_manager_conf(uvm_channel_manager_t *manager)
     if (strcmp(pushbuffer_loc_value, "vid") == 0)
         manager->conf.pushbuffer_loc = UVM_BUFFER_LOCATION_VID;
 
-    // 3- GPFIFO/GPPut location
+    // 5- GPFIFO/GPPut location
     // Only support the knobs for GPFIFO/GPPut on Volta+
     if (!gpu->gpfifo_in_vidmem_supported) {
         manager->conf.gpfifo_loc = UVM_BUFFER_LOCATION_DEFAULT;
@@ -1074,6 +1412,8 @@ NV_STATUS uvm_channel_manager_create_common(uvm_gpu_t *gpu, bool with_procfs, uv
             goto error;
     }
 
+    channel_manager->ce_to_use.balanced_for_type[UVM_CHANNEL_TYPE_ANY] = usable_ce_mask;
+
     channel_manager_init_p2p_ces(channel_manager);
 
     if (with_procfs) {
@@ -1137,6 +1477,8 @@ static void uvm_channel_print_info(uvm_channel_t *channel, struct seq_file *s)
     UVM_SEQ_OR_DBG_PRINT(s, "GPPUT location     %s\n", buffer_location_to_string(manager->conf.gpput_loc));
     UVM_SEQ_OR_DBG_PRINT(s, "get                %u\n", channel->gpu_get);
     UVM_SEQ_OR_DBG_PRINT(s, "put                %u\n", channel->cpu_put);
+    UVM_SEQ_OR_DBG_PRINT(s, "outstanding bytes  %llu\n", channel->outstanding_bytes);
+    UVM_SEQ_OR_DBG_PRINT(s, "CE bandwidth       %llu B/us\n", channel->pool->bandwidth);
     UVM_SEQ_OR_DBG_PRINT(s, "Semaphore GPU VA   0x%llx\n", uvm_gpu_semaphore_get_gpu_va(&channel->tracking_sem.semaphore,
                                                                                         uvm_channel_get_gpu(channel)));
 
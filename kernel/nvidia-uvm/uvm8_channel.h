@@ -38,6 +38,14 @@
 // Maximum number of channels to be created
 #define UVM_CHANNEL_COUNT_MAX (UVM_COPY_ENGINE_COUNT_MAX * UVM_CHANNELS_PER_COPY_ENGINE)
 
+// CE bandwidth (in bytes per microsecond) assumed by the load estimates until
+// the bandwidth of the CE has been measured.
+#define UVM_CHANNEL_CE_BANDWIDTH_DEFAULT (10 * 1024)
+
+// Only pushes transferring at least this many bytes are sampled to measure the
+// CE bandwidth. Smaller transfers are dominated by the submission latency.
+#define UVM_CHANNEL_CE_BANDWIDTH_SAMPLE_MIN_BYTES (256 * 1024)
+
 //
 // UVM channels
 //
@@ -97,6 +105,13 @@ struct uvm_gpfifo_entry_struct
 
     // Push info for the pending push that used this GPFIFO entry
     uvm_push_info_t *push_info;
+
+    // Number of bytes transferred by the push that used this entry
+    NvU64 transfer_bytes;
+
+    // Time the entry was submitted to the GPU. Only recorded for entries that
+    // are sampled by the CE bandwidth model, 0 otherwise.
+    NvU64 submit_time_ns;
 };
 
 // A channel pool is a set of channels that use the same (logical) Copy Engine
@@ -110,6 +125,12 @@ typedef struct
 
     // Lock protecting the state of channels in the pool
     uvm_spinlock_t lock;
+
+    // Estimated bandwidth of the CE in bytes per microsecond, as an
+    // exponential moving average of the samples passed to
+    // uvm_channel_pool_record_transfer(). 0 until the first sample. Protected
+    // by the pool lock.
+    NvU64 bandwidth;
 } uvm_channel_pool_t;
 
 struct uvm_channel_struct
@@ -141,6 +162,16 @@ struct uvm_channel_struct
     // GPFIFO entry for it.
     NvU32 current_pushes_count;
 
+    // Number of bytes transferred by the pushes submitted to the channel that
+    // have not completed yet. Together with the bandwidth of the CE this is
+    // used to estimate how long the channel will take to drain.
+    NvU64 outstanding_bytes;
+
+    // Time the last sampled GPFIFO entry was observed to complete. Used to
+    // avoid accounting the time an entry spends queued behind other sampled
+    // entries as transfer time.
+    NvU64 last_sample_completion_ns;
+
     // Array of uvm_push_info_t for all pending pushes on the channel
     uvm_push_info_t *push_infos;
 
@@ -159,6 +190,12 @@ struct uvm_channel_struct
     // uvm_channel_end_push().
     uvm_gpu_tracking_semaphore_t tracking_sem;
 
+    // List of uvm_tracker_completion_waiter_t waiting for tracking values of
+    // this channel to complete, sorted by the tracking value. Protected by the
+    // pool lock. Completed waiters are removed and notified by
+    // uvm_channel_update_progress().
+    struct list_head completion_waiters;
+
     // UVM-RM interface handle
     uvmGpuChannelHandle handle;
 
@@ -219,6 +256,12 @@ struct uvm_channel_manager_struct
         // the default Copy Engine (default_for_type[UVM_CHANNEL_GPU_TO_GPU])
         // must be used instead.
         NvU32 gpu_to_gpu[UVM_ID_MAX_GPUS];
+
+        // Masks of the CEs that transfers of each type can be spread across
+        // when load balancing is enabled. Besides the default CE, they include
+        // the CEs with the same capabilities relevant to the type. The mask for
+        // UVM_CHANNEL_TYPE_ANY includes all the CEs with channels.
+        long unsigned balanced_for_type[UVM_CHANNEL_TYPE_COUNT];
     } ce_to_use;
 
     struct
@@ -230,6 +273,9 @@ struct uvm_channel_manager_struct
     struct
     {
         NvU32 num_gpfifo_entries;
+        NvU32 num_pushbuffer_chunks;
+        NvU32 pushbuffer_chunk_size;
+        bool load_balancing;
         UVM_BUFFER_LOCATION gpfifo_loc;
         UVM_BUFFER_LOCATION gpput_loc;
         UVM_BUFFER_LOCATION pushbuffer_loc;
@@ -310,12 +356,38 @@ bool uvm_channel_is_value_completed(uvm_channel_t *channel, NvU64 value);
 // Update and get the latest completed value by the channel
 NvU64 uvm_channel_update_completed_value(uvm_channel_t *channel);
 
+// Add a waiter for the completion of waiter->entry.value on the channel.
+// Returns false, without adding the waiter, if the value is already completed.
+// Otherwise uvm_tracker_completion_waiter_done() is called for the waiter by
+// uvm_channel_update_progress() once the value completes.
+bool uvm_channel_add_completion_waiter(uvm_channel_t *channel, uvm_tracker_completion_waiter_t *waiter);
+
 // Select and reserve a channel with the specified type for a push
 // Channel type can be UVM_CHANNEL_TYPE_ANY to reserve any channel.
+//
+// With load balancing enabled, the available channel with the lowest estimated
+// drain time (outstanding bytes over the CE bandwidth) is picked among the
+// channels of the CEs in ce_to_use.balanced_for_type[type]. Ties are broken by
+// the number of pending GPFIFO entries. Otherwise the first available channel
+// of the default CE for the type is used.
 NV_STATUS uvm_channel_reserve_type(uvm_channel_manager_t *manager,
                                    uvm_channel_type_t type,
                                    uvm_channel_t **channel_out);
 
+// Try to reserve a channel with the specified type on a CE that is not in
+// exclude_ce_mask, without waiting for one to become available. The candidate
+// CEs are those in ce_to_use.balanced_for_type[type], regardless of whether
+// load balancing is enabled. For UVM_CHANNEL_TYPE_GPU_TO_GPU, dst_gpu is the
+// destination of the transfer and the CE recommended for the pair of GPUs, see
+// uvm_channel_reserve_gpu_to_gpu(), is also a candidate. dst_gpu is ignored for
+// other types. Used to spread a large transfer across several CEs. Returns
+// NV_ERR_NOT_FOUND if no channel could be reserved.
+NV_STATUS uvm_channel_try_reserve_type_excluding(uvm_channel_manager_t *manager,
+                                                 uvm_channel_type_t type,
+                                                 uvm_gpu_t *dst_gpu,
+                                                 long unsigned exclude_ce_mask,
+                                                 uvm_channel_t **channel_out);
+
 // Select and reserve a channel for a transfer from channel_manager->gpu to
 // dst_gpu.
 NV_STATUS uvm_channel_reserve_gpu_to_gpu(uvm_channel_manager_t *channel_manager,
@@ -325,6 +397,14 @@ NV_STATUS uvm_channel_reserve_gpu_to_gpu(uvm_channel_manager_t *channel_manager,
 // Reserve a specific channel for a push
 NV_STATUS uvm_channel_reserve(uvm_channel_t *channel);
 
+// Record a bandwidth sample of bytes transferred in duration_ns by the CE of
+// the pool. The pool lock must be held.
+void uvm_channel_pool_record_transfer(uvm_channel_pool_t *pool, NvU64 bytes, NvU64 duration_ns);
+
+// Estimated time in nanoseconds the channel needs to complete all of its
+// outstanding transfers. The pool lock must be held.
+NvU64 uvm_channel_get_drain_time_ns(uvm_channel_t *channel);
+
 // Set optimal CE for P2P transfers between manager->gpu and peer
 void uvm_channel_manager_set_p2p_ce(uvm_channel_manager_t *manager, uvm_gpu_t *peer, NvU32 optimal_ce);
 
@@ -344,6 +424,12 @@ const char *uvm_channel_type_to_string(uvm_channel_type_t channel_type);
 
 void uvm_channel_print_pending_pushes(uvm_channel_t *channel);
 
+// Index of the CE used by the channel
+static unsigned uvm_channel_get_ce_index(const uvm_channel_t *channel)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return channel->pool - channel->pool->manager->channel_pools;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 static uvm_gpu_t *uvm_channel_get_gpu(uvm_channel_t *channel)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     return channel->pool->manager->gpu;
@@ -36,6 +36,17 @@
 #define TEST_ORDERING_ITERS_PER_CHANNEL_TYPE_PER_GPU     1024
 #define TEST_ORDERING_ITERS_PER_CHANNEL_TYPE_PER_GPU_EMU 64
 
+#define TEST_LOAD_BALANCING_NUM_CES         2
+#define TEST_LOAD_BALANCING_NUM_CHANNELS    (TEST_LOAD_BALANCING_NUM_CES * UVM_CHANNELS_PER_COPY_ENGINE)
+#define TEST_LOAD_BALANCING_GPFIFO_ENTRIES  1024
+#define TEST_LOAD_BALANCING_PUSHES          512
+#define TEST_LOAD_BALANCING_MIN_PUSH_BYTES  (64 * 1024)
+#define TEST_LOAD_BALANCING_MAX_PUSH_BYTES  (2 * 1024 * 1024)
+
+// Bandwidth of the first CE in bytes per microsecond. Each following CE has
+// half the bandwidth of the previous one.
+#define TEST_LOAD_BALANCING_BANDWIDTH       (20 * 1024)
+
 // Schedule pushes one after another on all GPUs and channel types that copy and
 // increment a counter into an adjacent memory location in a buffer. And then
 // verify that all the values are correct on the CPU.
@@ -575,6 +586,252 @@ done:
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 
+// Channel manager with fake channels that are never submitted to HW. Pushes are
+// simulated by accounting their transfer size in the channel state, which is
+// all the channel selection looks at.
+typedef struct
+{
+    uvm_channel_manager_t *manager;
+
+    uvm_gpfifo_entry_t *gpfifo_entries;
+} test_sim_channels_t;
+
+static NV_STATUS test_sim_channels_init(test_sim_channels_t *sim, bool load_balancing)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_channel_manager_t *manager;
+    unsigned ce_index;
+
+    manager = uvm_kvmalloc_zero(sizeof(*manager));
+    if (!manager)
+        return NV_ERR_NO_MEMORY;
+
+    sim->gpfifo_entries = uvm_kvmalloc_zero(sizeof(*sim->gpfifo_entries) *
+                                            TEST_LOAD_BALANCING_NUM_CHANNELS *
+                                            TEST_LOAD_BALANCING_GPFIFO_ENTRIES);
+    if (!sim->gpfifo_entries) {
+        uvm_kvfree(manager);
+        return NV_ERR_NO_MEMORY;
+    }
+
+    manager->conf.load_balancing = load_balancing;
+    manager->conf.num_gpfifo_entries = TEST_LOAD_BALANCING_GPFIFO_ENTRIES;
+    manager->ce_to_use.default_for_type[UVM_CHANNEL_TYPE_GPU_INTERNAL] = 0;
+    manager->ce_to_use.balanced_for_type[UVM_CHANNEL_TYPE_GPU_INTERNAL] = (1UL << TEST_LOAD_BALANCING_NUM_CES) - 1;
+
+    for (ce_index = 0; ce_index < TEST_LOAD_BALANCING_NUM_CES; ++ce_index) {
+        uvm_channel_pool_t *pool = manager->channel_pools + ce_index;
+        unsigned i;
+
+        pool->manager = manager;
+        pool->channel_index = manager->num_channels;
+        uvm_spin_lock_init(&pool->lock, UVM_LOCK_ORDER_CHANNEL);
+
+        // A single sample of 1us sets the bandwidth of the CE
+        uvm_spin_lock(&pool->lock);
+        uvm_channel_pool_record_transfer(pool, TEST_LOAD_BALANCING_BANDWIDTH >> ce_index, 1000);
+        uvm_spin_unlock(&pool->lock);
+
+        for (i = 0; i < UVM_CHANNELS_PER_COPY_ENGINE; ++i) {
+            uvm_channel_t *channel = manager->channels + manager->num_channels;
+
+            channel->pool = pool;
+            channel->num_gpfifo_entries = TEST_LOAD_BALANCING_GPFIFO_ENTRIES;
+            channel->gpfifo_entries = sim->gpfifo_entries + manager->num_channels * TEST_LOAD_BALANCING_GPFIFO_ENTRIES;
+            manager->num_channels++;
+        }
+    }
+
+    sim->manager = manager;
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void test_sim_channels_deinit(test_sim_channels_t *sim)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_kvfree(sim->gpfifo_entries);
+    uvm_kvfree(sim->manager);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Simulate the end of a push transferring the given number of bytes on a
+// reserved channel, see uvm_channel_end_push().
+static void test_sim_channels_submit(uvm_channel_t *channel, NvU64 bytes)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_gpfifo_entry_t *entry;
+
+    uvm_spin_lock(&channel->pool->lock);
+
+    UVM_ASSERT(channel->current_pushes_count > 0);
+    --channel->current_pushes_count;
+
+    entry = &channel->gpfifo_entries[channel->cpu_put];
+    entry->transfer_bytes = bytes;
+    channel->outstanding_bytes += bytes;
+    channel->cpu_put = (channel->cpu_put + 1) % channel->num_gpfifo_entries;
+
+    uvm_spin_unlock(&channel->pool->lock);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Reserve channels for a stream of copies of random sizes and return the
+// lowest and highest estimated drain time of the channels afterwards.
+static NV_STATUS test_sim_channels_run(test_sim_channels_t *sim, NvU64 *min_drain_time, NvU64 *max_drain_time)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_test_rng_t rng;
+    uvm_channel_t *channel;
+    unsigned i;
+
+    uvm_test_rng_init(&rng, 0);
+
+    for (i = 0; i < TEST_LOAD_BALANCING_PUSHES; ++i) {
+        NvU64 bytes = uvm_test_rng_range_64(&rng, TEST_LOAD_BALANCING_MIN_PUSH_BYTES, TEST_LOAD_BALANCING_MAX_PUSH_BYTES);
+
+        TEST_NV_CHECK_RET(uvm_channel_reserve_type(sim->manager, UVM_CHANNEL_TYPE_GPU_INTERNAL, &channel));
+        test_sim_channels_submit(channel, bytes);
+    }
+
+    *min_drain_time = ULLONG_MAX;
+    *max_drain_time = 0;
+
+    uvm_for_each_channel(channel, sim->manager) {
+        NvU64 drain_time;
+
+        uvm_spin_lock(&channel->pool->lock);
+        drain_time = uvm_channel_get_drain_time_ns(channel);
+        uvm_spin_unlock(&channel->pool->lock);
+
+        *min_drain_time = min(*min_drain_time, drain_time);
+        *max_drain_time = max(*max_drain_time, drain_time);
+    }
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Spread a stream of copies over fake channels on CEs of different bandwidth
+// and check that the queues end up balanced in time: greedily picking the
+// channel with the lowest estimated drain time keeps all the channels within
+// one copy of each other. Without load balancing all the copies queue up on
+// the first channel of the default CE.
+static NV_STATUS test_load_balancing(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+    test_sim_channels_t sim;
+    NvU64 balanced_min, balanced_max;
+    NvU64 unbalanced_min, unbalanced_max;
+
+    // Slowest CE, see test_sim_channels_init()
+    const NvU64 max_copy_drain_time = TEST_LOAD_BALANCING_MAX_PUSH_BYTES * 1000ULL /
+                                      (TEST_LOAD_BALANCING_BANDWIDTH >> (TEST_LOAD_BALANCING_NUM_CES - 1));
+
+    TEST_NV_CHECK_RET(test_sim_channels_init(&sim, true));
+
+    TEST_CHECK_GOTO(sim.manager->channel_pools[0].bandwidth == TEST_LOAD_BALANCING_BANDWIDTH, done);
+
+    status = test_sim_channels_run(&sim, &balanced_min, &balanced_max);
+    if (status != NV_OK)
+        goto done;
+
+    TEST_CHECK_GOTO(balanced_min > 0, done);
+    TEST_CHECK_GOTO(balanced_max - balanced_min <= max_copy_drain_time, done);
+
+    test_sim_channels_deinit(&sim);
+
+    TEST_NV_CHECK_RET(test_sim_channels_init(&sim, false));
+
+    status = test_sim_channels_run(&sim, &unbalanced_min, &unbalanced_max);
+    if (status != NV_OK)
+        goto done;
+
+    TEST_CHECK_GOTO(unbalanced_min == 0, done);
+    TEST_CHECK_GOTO(balanced_max < unbalanced_max, done);
+
+done:
+    test_sim_channels_deinit(&sim);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Reserve channels excluding the CEs already used, as done when splitting a
+// copy into stripes, and check that each reservation lands on a new CE until
+// all of them are used.
+static NV_STATUS test_reserve_excluding(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    test_sim_channels_t sim;
+    long unsigned used_ce_mask = 0;
+    uvm_channel_t *channel;
+    uvm_gpu_t *peer;
+    unsigned i;
+
+    // Only the ID of the peer is used
+    peer = uvm_kvmalloc_zero(sizeof(*peer));
+    if (!peer)
+        return NV_ERR_NO_MEMORY;
+    peer->id = uvm_gpu_id_from_index(1);
+
+    // Exclusion is done even with load balancing disabled
+    status = test_sim_channels_init(&sim, false);
+    if (status != NV_OK) {
+        uvm_kvfree(peer);
+        return status;
+    }
+
+    for (i = 0; i < TEST_LOAD_BALANCING_NUM_CES; ++i) {
+        unsigned ce_index;
+
+        TEST_NV_CHECK_GOTO(uvm_channel_try_reserve_type_excluding(sim.manager,
+                                                                  UVM_CHANNEL_TYPE_GPU_INTERNAL,
+                                                                  NULL,
+                                                                  used_ce_mask,
+                                                                  &channel),
+                           done);
+
+        ce_index = uvm_channel_get_ce_index(channel);
+        TEST_CHECK_GOTO(ce_index < TEST_LOAD_BALANCING_NUM_CES, done);
+        TEST_CHECK_GOTO(!test_bit(ce_index, &used_ce_mask), done);
+
+        used_ce_mask |= 1UL << ce_index;
+        test_sim_channels_submit(channel, 0);
+    }
+
+    status = uvm_channel_try_reserve_type_excluding(sim.manager,
+                                                    UVM_CHANNEL_TYPE_GPU_INTERNAL,
+                                                    NULL,
+                                                    used_ce_mask,
+                                                    &channel);
+    TEST_CHECK_GOTO(status == NV_ERR_NOT_FOUND, done);
+
+    // Peer transfers can also use the CE recommended for the peer, even if it's
+    // not one of the CEs of the type
+    sim.manager->ce_to_use.balanced_for_type[UVM_CHANNEL_TYPE_GPU_TO_GPU] = 1UL << 0;
+    sim.manager->ce_to_use.gpu_to_gpu[uvm_id_gpu_index(peer->id)] = 1;
+
+    TEST_NV_CHECK_GOTO(uvm_channel_try_reserve_type_excluding(sim.manager,
+                                                              UVM_CHANNEL_TYPE_GPU_TO_GPU,
+                                                              peer,
+                                                              1UL << 0,
+                                                              &channel),
+                       done);
+    TEST_CHECK_GOTO(uvm_channel_get_ce_index(channel) == 1, done);
+    test_sim_channels_submit(channel, 0);
+
+    status = uvm_channel_try_reserve_type_excluding(sim.manager,
+                                                    UVM_CHANNEL_TYPE_GPU_TO_GPU,
+                                                    peer,
+                                                    (1UL << 0) | (1UL << 1),
+                                                    &channel);
+    TEST_CHECK_GOTO(status == NV_ERR_NOT_FOUND, done);
+
+    sim.manager->ce_to_use.gpu_to_gpu[uvm_id_gpu_index(peer->id)] = UVM_COPY_ENGINE_COUNT_MAX;
+    status = uvm_channel_try_reserve_type_excluding(sim.manager, UVM_CHANNEL_TYPE_GPU_TO_GPU, peer, 1UL << 0, &channel);
+    TEST_CHECK_GOTO(status == NV_ERR_NOT_FOUND, done);
+    status = NV_OK;
+
+done:
+    test_sim_channels_deinit(&sim);
+    uvm_kvfree(peer);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 NV_STATUS uvm8_test_channel_sanity(UVM_TEST_CHANNEL_SANITY_PARAMS *params, struct file *filp)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NV_STATUS status;
@@ -583,6 +840,14 @@ NV_STATUS uvm8_test_channel_sanity(UVM_TEST_CHANNEL_SANITY_PARAMS *params, struc
     uvm_mutex_lock(&g_uvm_global.global_lock);
     uvm_va_space_down_read_rm(va_space);
 
+    status = test_load_balancing();
+    if (status != NV_OK)
+        goto done;
+
+    status = test_reserve_excluding();
+    if (status != NV_OK)
+        goto done;
+
     status = test_ordering(va_space);
     if (status != NV_OK)
         goto done;
@@ -36,6 +36,7 @@
 #include "uvm8_pmm_sysmem.h"
 #include "uvm8_ats_ibm.h"
 #include "uvm8_migrate.h"
+#include "uvm8_push.h"
 #include "uvm8_gpu_access_counters.h"
 #include "nv_uvm_interface.h"
 
@@ -123,6 +124,18 @@ NV_STATUS uvm_global_init(void)
         goto error;
     }
 
+    status = uvm_kvmalloc_procfs_init();
+    if (status != NV_OK) {
+        UVM_ERR_PRINT("uvm_kvmalloc_procfs_init() failed: %s\n", nvstatusToString(status));
+        goto error;
+    }
+
+    status = uvm_lock_profile_init();
+    if (status != NV_OK) {
+        UVM_ERR_PRINT("uvm_lock_profile_init() failed: %s\n", nvstatusToString(status));
+        goto error;
+    }
+
     status = uvm_rm_locked_call(nvUvmInterfaceSessionCreate(&g_uvm_global.rm_session_handle, &platform_info));
     if (status != NV_OK) {
         UVM_ERR_PRINT("nvUvmInterfaceSessionCreate() failed: %s\n", nvstatusToString(status));
@@ -132,6 +145,12 @@ NV_STATUS uvm_global_init(void)
     ats_init(&platform_info);
     g_uvm_global.num_simulated_devices = 0;
 
+    status = uvm_push_capture_init();
+    if (status != NV_OK) {
+        UVM_ERR_PRINT("uvm_push_capture_init() failed: %s\n", nvstatusToString(status));
+        goto error;
+    }
+
     status = uvm_gpu_init();
     if (status != NV_OK) {
         UVM_ERR_PRINT("uvm_gpu_init() failed: %s\n", nvstatusToString(status));
@@ -219,10 +238,13 @@ void uvm_global_exit(void)
     uvm_mem_global_exit();
     uvm_pmm_sysmem_exit();
     uvm_gpu_exit();
+    uvm_push_capture_exit();
 
     if (g_uvm_global.rm_session_handle != 0)
         uvm_rm_locked_call_void(nvUvmInterfaceSessionDestroy(g_uvm_global.rm_session_handle));
 
+    uvm_lock_profile_exit();
+    uvm_kvmalloc_procfs_exit();
     uvm_procfs_exit();
 
     nv_kthread_q_stop(&g_uvm_global.deferred_release_q);
@@ -32,6 +32,7 @@
 #include "uvm8_procfs.h"
 #include "uvm8_pmm_gpu.h"
 #include "uvm8_pmm_sysmem.h"
+#include "uvm8_pte_batch.h"
 #include "uvm8_va_space.h"
 #include "uvm8_va_range.h"
 #include "uvm8_user_channel.h"
@@ -45,6 +46,14 @@
 
 #define UVM_PROC_GPUS_PEER_DIR_NAME "peers"
 
+// Negative values keep the stripe size picked by the arch HAL
+static int uvm_perf_copy_stripe_size_kb = -1;
+module_param(uvm_perf_copy_stripe_size_kb, int, S_IRUGO);
+MODULE_PARM_DESC(uvm_perf_copy_stripe_size_kb,
+                 "Size in KB of the stripes VA block copies are spread in across copy engines. "
+                 "Rounded up to the page size. 0 disables the splitting. "
+                 "Default: -1, which uses the default of the GPU architecture.");
+
 static void remove_gpu(uvm_gpu_t *gpu);
 static void disable_peer_access(uvm_gpu_t *gpu0, uvm_gpu_t *gpu1);
 static NV_STATUS discover_nvlink_peers(uvm_gpu_t *gpu);
@@ -339,6 +348,29 @@ static void gpu_info_print_common(uvm_gpu_t *gpu, struct seq_file *s)
     UVM_SEQ_OR_DBG_PRINT(s, "mapped_cpu_pages_dma                   %llu (%llu MB)\n", mapped_cpu_pages_size / PAGE_SIZE,
                          mapped_cpu_pages_size / (1024u * 1024u));
 
+    UVM_SEQ_OR_DBG_PRINT(s, "tlb_batch_va_flushes                   %llu (%llu ranges)\n",
+                         (NvU64)atomic64_read(&gpu->tlb_batch.stats.va_flushes),
+                         (NvU64)atomic64_read(&gpu->tlb_batch.stats.va_flush_ranges));
+    UVM_SEQ_OR_DBG_PRINT(s, "tlb_batch_all_flushes                  %llu unsupported, %llu overflow, %llu cost\n",
+                         (NvU64)atomic64_read(&gpu->tlb_batch.stats.all_flushes_unsupported),
+                         (NvU64)atomic64_read(&gpu->tlb_batch.stats.all_flushes_overflow),
+                         (NvU64)atomic64_read(&gpu->tlb_batch.stats.all_flushes_cost));
+    UVM_SEQ_OR_DBG_PRINT(s, "tlb_batch_merged_ranges                %llu\n",
+                         (NvU64)atomic64_read(&gpu->tlb_batch.stats.merged_ranges));
+    UVM_SEQ_OR_DBG_PRINT(s, "pte_batch_costs                        memset %u inline %u\n",
+                         gpu->pte_batch.memset_cost,
+                         gpu->pte_batch.inline_cost);
+    UVM_SEQ_OR_DBG_PRINT(s, "pte_batch_memsets                      %llu (%llu uniform)\n",
+                         (NvU64)atomic64_read(&gpu->pte_batch.stats.memsets),
+                         (NvU64)atomic64_read(&gpu->pte_batch.stats.uniform_memsets));
+    UVM_SEQ_OR_DBG_PRINT(s, "pte_batch_inline_copies                %llu (%llu bytes)\n",
+                         (NvU64)atomic64_read(&gpu->pte_batch.stats.inline_copies),
+                         (NvU64)atomic64_read(&gpu->pte_batch.stats.inline_bytes));
+    UVM_SEQ_OR_DBG_PRINT(s, "copy_stripe_size                       %llu\n", gpu->copy_stripes.stripe_size);
+    UVM_SEQ_OR_DBG_PRINT(s, "copy_stripes_split_copies              %llu (%llu extra pushes)\n",
+                         (NvU64)atomic64_read(&gpu->copy_stripes.stats.split_copies),
+                         (NvU64)atomic64_read(&gpu->copy_stripes.stats.stripe_pushes));
+
     gpu_info_print_ce_caps(gpu, s);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
@@ -401,6 +433,66 @@ static void gpu_access_counters_print_common(uvm_gpu_t *gpu, struct seq_file *s)
                          (num_pages_out * (NvU64)PAGE_SIZE) / (1024u * 1024u));
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+static void gpu_access_counters_batch_stats_print_common(uvm_gpu_t *gpu, struct seq_file *s)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU64 num_batches;
+    NvU64 num_windows;
+    NvU64 num_notifications;
+    NvU64 num_translations;
+    NvU64 num_lookups;
+    NvU64 num_block_locks;
+
+    UVM_ASSERT(uvm_procfs_is_debug_enabled());
+
+    num_batches = atomic64_read(&gpu->access_counter_buffer_info.stats.phys.num_batches);
+    num_windows = atomic64_read(&gpu->access_counter_buffer_info.stats.phys.num_windows);
+    num_notifications = atomic64_read(&gpu->access_counter_buffer_info.stats.phys.num_notifications);
+    num_translations = atomic64_read(&gpu->access_counter_buffer_info.stats.phys.num_translations);
+    num_lookups = atomic64_read(&gpu->access_counter_buffer_info.stats.phys.num_reverse_map_lookups);
+    num_block_locks = atomic64_read(&gpu->access_counter_buffer_info.stats.phys.num_block_locks);
+
+    UVM_SEQ_OR_DBG_PRINT(s, "phys_batches:\n");
+    UVM_SEQ_OR_DBG_PRINT(s, "  num_batches          %llu\n", num_batches);
+    UVM_SEQ_OR_DBG_PRINT(s, "  num_windows          %llu\n", num_windows);
+    UVM_SEQ_OR_DBG_PRINT(s, "  num_notifications    %llu\n", num_notifications);
+    UVM_SEQ_OR_DBG_PRINT(s, "  num_translations     %llu\n", num_translations);
+    UVM_SEQ_OR_DBG_PRINT(s, "  num_rmap_lookups     %llu\n", num_lookups);
+    UVM_SEQ_OR_DBG_PRINT(s, "  num_block_locks      %llu\n", num_block_locks);
+
+    if (num_batches == 0 || num_notifications == 0)
+        return;
+
+    // Averages are printed with two decimals
+    UVM_SEQ_OR_DBG_PRINT(s, "per_batch:\n");
+    UVM_SEQ_OR_DBG_PRINT(s, "  notifications        %llu.%02llu\n",
+                         num_notifications / num_batches,
+                         (num_notifications * 100 / num_batches) % 100);
+    UVM_SEQ_OR_DBG_PRINT(s, "  block_locks          %llu.%02llu\n",
+                         num_block_locks / num_batches,
+                         (num_block_locks * 100 / num_batches) % 100);
+    UVM_SEQ_OR_DBG_PRINT(s, "per_notification:\n");
+    UVM_SEQ_OR_DBG_PRINT(s, "  rmap_lookups         %llu.%02llu\n",
+                         num_lookups / num_notifications,
+                         (num_lookups * 100 / num_notifications) % 100);
+    UVM_SEQ_OR_DBG_PRINT(s, "  block_locks          %llu.%02llu\n",
+                         num_block_locks / num_notifications,
+                         (num_block_locks * 100 / num_notifications) % 100);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void gpu_pte_size_stats_print_common(uvm_gpu_t *gpu, struct seq_file *s)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ASSERT(uvm_procfs_is_debug_enabled());
+
+    UVM_SEQ_OR_DBG_PRINT(s, "promotion_scanner:\n");
+    UVM_SEQ_OR_DBG_PRINT(s, "  num_blocks_scanned   %llu\n", atomic64_read(&gpu->pte_size_stats.num_blocks_scanned));
+    UVM_SEQ_OR_DBG_PRINT(s, "promotions:\n");
+    UVM_SEQ_OR_DBG_PRINT(s, "  big                  %llu\n", atomic64_read(&gpu->pte_size_stats.num_big_promotions));
+    UVM_SEQ_OR_DBG_PRINT(s, "  2m                   %llu\n", atomic64_read(&gpu->pte_size_stats.num_2m_promotions));
+    UVM_SEQ_OR_DBG_PRINT(s, "demotions:\n");
+    UVM_SEQ_OR_DBG_PRINT(s, "  big                  %llu\n", atomic64_read(&gpu->pte_size_stats.num_big_demotions));
+    UVM_SEQ_OR_DBG_PRINT(s, "  2m                   %llu\n", atomic64_read(&gpu->pte_size_stats.num_2m_demotions));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 void uvm_gpu_print(uvm_gpu_t *gpu)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     gpu_info_print_common(gpu, NULL);
@@ -485,9 +577,49 @@ static int nv_procfs_read_gpu_access_counters_entry(struct seq_file *s, void *v)
     UVM_ENTRY_RET(nv_procfs_read_gpu_access_counters(s, v));
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+static int nv_procfs_read_gpu_access_counters_batch_stats(struct seq_file *s, void *v)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_gpu_t *gpu = (uvm_gpu_t *)s->private;
+
+    if (!uvm_down_read_trylock(&g_uvm_global.pm.lock))
+            return -EAGAIN;
+
+    gpu_access_counters_batch_stats_print_common(gpu, s);
+
+    uvm_up_read(&g_uvm_global.pm.lock);
+
+    return 0;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static int nv_procfs_read_gpu_access_counters_batch_stats_entry(struct seq_file *s, void *v)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ENTRY_RET(nv_procfs_read_gpu_access_counters_batch_stats(s, v));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static int nv_procfs_read_gpu_pte_size_stats(struct seq_file *s, void *v)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_gpu_t *gpu = (uvm_gpu_t *)s->private;
+
+    if (!uvm_down_read_trylock(&g_uvm_global.pm.lock))
+            return -EAGAIN;
+
+    gpu_pte_size_stats_print_common(gpu, s);
+
+    uvm_up_read(&g_uvm_global.pm.lock);
+
+    return 0;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static int nv_procfs_read_gpu_pte_size_stats_entry(struct seq_file *s, void *v)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ENTRY_RET(nv_procfs_read_gpu_pte_size_stats(s, v));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 UVM_DEFINE_SINGLE_PROCFS_FILE(gpu_info_entry);
 UVM_DEFINE_SINGLE_PROCFS_FILE(gpu_fault_stats_entry);
 UVM_DEFINE_SINGLE_PROCFS_FILE(gpu_access_counters_entry);
+UVM_DEFINE_SINGLE_PROCFS_FILE(gpu_access_counters_batch_stats_entry);
+UVM_DEFINE_SINGLE_PROCFS_FILE(gpu_pte_size_stats_entry);
 
 static NV_STATUS init_procfs_dirs(uvm_gpu_t *gpu)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
@@ -554,11 +686,27 @@ static NV_STATUS init_procfs_files(uvm_gpu_t *gpu)
     if (gpu->procfs.access_counters_file == NULL)
         return NV_ERR_OPERATING_SYSTEM;
 
+    gpu->procfs.access_counters_batch_stats_file = NV_CREATE_PROC_FILE("access_counters_batch_stats",
+                                                                       gpu->procfs.dir,
+                                                                       gpu_access_counters_batch_stats_entry,
+                                                                       gpu);
+    if (gpu->procfs.access_counters_batch_stats_file == NULL)
+        return NV_ERR_OPERATING_SYSTEM;
+
+    gpu->procfs.pte_size_stats_file = NV_CREATE_PROC_FILE("pte_size_stats",
+                                                          gpu->procfs.dir,
+                                                          gpu_pte_size_stats_entry,
+                                                          gpu);
+    if (gpu->procfs.pte_size_stats_file == NULL)
+        return NV_ERR_OPERATING_SYSTEM;
+
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 static void deinit_procfs_files(uvm_gpu_t *gpu)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_procfs_destroy_entry(gpu->procfs.pte_size_stats_file);
+    uvm_procfs_destroy_entry(gpu->procfs.access_counters_batch_stats_file);
     uvm_procfs_destroy_entry(gpu->procfs.access_counters_file);
     uvm_procfs_destroy_entry(gpu->procfs.fault_stats_file);
     uvm_procfs_destroy_entry(gpu->procfs.info_file);
@@ -837,6 +985,9 @@ static NV_STATUS add_gpu(const NvProcessorUuid *gpu_uuid,
     }
 
     gpu->arch_hal->init_properties(gpu);
+
+    if (uvm_perf_copy_stripe_size_kb >= 0)
+        gpu->copy_stripes.stripe_size = UVM_ALIGN_UP((NvU64)uvm_perf_copy_stripe_size_kb * 1024, PAGE_SIZE);
     uvm_mmu_init_gpu(gpu);
 
 
@@ -919,6 +1070,12 @@ static NV_STATUS add_gpu(const NvProcessorUuid *gpu_uuid,
         goto error;
     }
 
+    status = uvm_pte_batch_init_gpu(gpu);
+    if (status != NV_OK) {
+        UVM_ERR_PRINT("Failed to initialize the PTE batch costs: %s, GPU %s\n", nvstatusToString(status), gpu->name);
+        goto error;
+    }
+
     status = configure_address_space(gpu);
     if (status != NV_OK) {
         UVM_ERR_PRINT("Failed to configure the GPU address space: %s, GPU %s\n", nvstatusToString(status), gpu->name);
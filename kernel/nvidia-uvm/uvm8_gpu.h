@@ -358,6 +358,18 @@ typedef struct
     unsigned node_id;
 } uvm_numa_info_t;
 
+typedef struct
+{
+    // Translation obtained from the reverse map
+    uvm_reverse_map_t *reverse_map;
+
+    // Notification that the translation belongs to
+    uvm_access_counter_buffer_entry_t *notification;
+
+    // Processor that performed the accesses
+    uvm_processor_id_t processor;
+} uvm_access_counter_phys_ref_t;
+
 struct uvm_access_counter_service_batch_context_struct
 {
     uvm_access_counter_buffer_entry_t *notification_cache;
@@ -379,14 +391,34 @@ struct uvm_access_counter_service_batch_context_struct
     struct
     {
         uvm_access_counter_buffer_entry_t    **notifications;
-        uvm_reverse_map_t                      *translations;
 
         NvU32                              num_notifications;
 
-        // Boolean used to avoid sorting the fault batch by aperture if we
-        // determine at fetch time that all the access counter notifications in the
-        // batch report the same aperture
-        bool                              is_single_aperture;
+        // Physical notifications are sorted by address and serviced in
+        // windows. The translations of all the notifications in a window are
+        // grouped by VA block, so that each VA block is serviced once per
+        // window.
+        //
+        // Reverse map translations of the current window
+        uvm_reverse_map_t                      *translations;
+
+        NvU32                              num_translations;
+
+        // One reference per translation, sorted by VA block before servicing
+        uvm_access_counter_phys_ref_t          *refs;
+
+        NvU32                              num_refs;
+
+        // Sysmem translations are resolved in bulk when the window is
+        // serviced. query_notifications holds the notification of each query.
+        uvm_pmm_sysmem_mappings_query_t        *queries;
+
+        uvm_access_counter_buffer_entry_t    **query_notifications;
+
+        NvU32                              num_queries;
+
+        // Index in notifications of the first notification in the window
+        NvU32                              window_first;
     } phys;
 
     // Helper page mask to compute the accessed pages within a VA block
@@ -457,6 +489,25 @@ typedef struct
         atomic64_t num_pages_out;
 
         atomic64_t num_pages_in;
+
+        // Servicing of physical notifications
+        struct
+        {
+            atomic64_t num_batches;
+
+            atomic64_t num_windows;
+
+            atomic64_t num_notifications;
+
+            atomic64_t num_translations;
+
+            // Reverse map lookups: sysmem tree lookups plus vidmem chunk
+            // tree walks
+            atomic64_t num_reverse_map_lookups;
+
+            // VA block lock acquisitions to service the notifications
+            atomic64_t num_block_locks;
+        } phys;
     } stats;
 
     // Ignoring access counters means that notifications are left in the HW
@@ -712,18 +763,75 @@ struct uvm_gpu_struct
         // Is the VA range invalidate supported?
         NvBool va_range_invalidate_supported;
 
-        union
+        // Cost model used to choose between targeted VA invalidates and an
+        // invalidate all. A batch is flushed with an invalidate all if the
+        // number of targeted invalidate methods it needs (one per range if VA
+        // range invalidates are supported, one per page otherwise) times
+        // va_invalidate_cost is greater than invalidate_all_cost. The latter
+        // accounts for the TLB refills of the unrelated translations that are
+        // dropped.
+        NvU32 va_invalidate_cost;
+        NvU32 invalidate_all_cost;
+
+        struct
         {
-            // Maximum (inclusive) number of single page invalidations before
-            // falling back to invalidate all
-            NvU32 max_pages;
-
-            // Maximum (inclusive) number of range invalidations before falling
-            // back to invalidate all
-            NvU32 max_ranges;
-        };
+            // Number of batches flushed with targeted VA invalidates, and the
+            // total number of ranges they invalidated
+            atomic64_t va_flushes;
+            atomic64_t va_flush_ranges;
+
+            // Number of batches flushed with an invalidate all because
+            // targeted invalidates are not supported, because the ranges
+            // didn't fit in the batch, or because of the cost model
+            atomic64_t all_flushes_unsupported;
+            atomic64_t all_flushes_overflow;
+            atomic64_t all_flushes_cost;
+
+            // Number of ranges merged into adjacent or overlapping ranges
+            atomic64_t merged_ranges;
+        } stats;
     } tlb_batch;
 
+    // Parameters used by the PTE batching API
+    struct
+    {
+        // Cost model used to choose how PTE runs are written, in units of
+        // pushbuffer bytes. memset_cost is the cost of a single CE memset and
+        // inline_cost is the fixed cost of an inline memcopy, which also pays
+        // one unit per byte of PTE data. Set by uvm_pte_batch_init_gpu().
+        NvU32 memset_cost;
+        NvU32 inline_cost;
+
+        struct
+        {
+            // Number of memsets used for queued PTEs and for uniform runs
+            atomic64_t memsets;
+            atomic64_t uniform_memsets;
+
+            // Number of inline memcopies and the PTE bytes they wrote
+            atomic64_t inline_copies;
+            atomic64_t inline_bytes;
+        } stats;
+    } pte_batch;
+
+    // VA block copies done by this GPU are split in stripes across CEs, see
+    // block_copy_stripes_memcopy in uvm8_va_block.c
+    struct
+    {
+        // Size of the stripes in bytes, a multiple of PAGE_SIZE. 0 disables
+        // the splitting. Set by the arch HAL and overridden by the
+        // uvm_perf_copy_stripe_size_kb module parameter.
+        NvU64 stripe_size;
+
+        struct
+        {
+            // Number of copies that were split, and the number of additional
+            // pushes started on other CEs for them
+            atomic64_t split_copies;
+            atomic64_t stripe_pushes;
+        } stats;
+    } copy_stripes;
+
     // Largest VA (exclusive) which can be used for channel buffer mappings
     NvU64 max_channel_va;
 
@@ -814,6 +922,10 @@ struct uvm_gpu_struct
 
         struct proc_dir_entry *access_counters_file;
 
+        struct proc_dir_entry *access_counters_batch_stats_file;
+
+        struct proc_dir_entry *pte_size_stats_file;
+
         struct proc_dir_entry *dir_peers;
     } procfs;
 
@@ -909,6 +1021,22 @@ struct uvm_gpu_struct
         atomic64_t              num_pages_in;
     } stats;
 
+    // Statistics of the PTE sizes used by VA block mappings on this GPU.
+    // Promotions are done by the PTE promotion scanner. Demotions are the
+    // splits of 2M and big PTEs done by any PTE operation.
+    struct
+    {
+        atomic64_t num_blocks_scanned;
+
+        atomic64_t num_big_promotions;
+
+        atomic64_t num_2m_promotions;
+
+        atomic64_t num_big_demotions;
+
+        atomic64_t num_2m_demotions;
+    } pte_size_stats;
+
 #if UVM_IS_CONFIG_HMM()
     uvm_hmm_gpu_t hmm_gpu;
 #endif
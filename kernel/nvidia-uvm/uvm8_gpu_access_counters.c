@@ -34,6 +34,7 @@
 #include "uvm8_va_space_mm.h"
 #include "uvm8_pmm_sysmem.h"
 #include "uvm8_perf_module.h"
+#include "uvm8_perf_hotness.h"
 
 #define UVM_PERF_ACCESS_COUNTER_BATCH_COUNT_MIN     1
 #define UVM_PERF_ACCESS_COUNTER_BATCH_COUNT_DEFAULT 256
@@ -41,6 +42,8 @@
 #define UVM_PERF_ACCESS_COUNTER_THRESHOLD_MIN       1
 #define UVM_PERF_ACCESS_COUNTER_THRESHOLD_MAX       ((1 << 16) - 1)
 #define UVM_PERF_ACCESS_COUNTER_THRESHOLD_DEFAULT   256
+#define UVM_PERF_ACCESS_COUNTER_PROMOTION_BUDGET_MB_DEFAULT 64
+#define UVM_PERF_ACCESS_COUNTER_PROMOTION_PERIOD_MS_DEFAULT 10
 
 // Each page in a tracked physical range may belong to a different VA Block. We
 // preallocate an array of reverse map translations. However, access counter
@@ -51,6 +54,12 @@
 #define UVM_MAX_TRANSLATION_SIZE (2 * 1024 * 1024ULL)
 #define UVM_SUB_GRANULARITY_REGIONS 32
 
+// Physical notifications are serviced in windows that hold the translations of
+// several notifications. These are the maximum number of reverse map
+// translations and of sysmem reverse map queries in a window.
+#define UVM_PHYS_WINDOW_TRANSLATIONS (4 * (UVM_MAX_TRANSLATION_SIZE / PAGE_SIZE))
+#define UVM_PHYS_WINDOW_QUERIES      (4 * UVM_SUB_GRANULARITY_REGIONS)
+
 // The GPU offers the following tracking granularities: 64K, 2M, 16M, 16G
 //
 // Use the largest granularity to minimize the number of access counter
@@ -58,6 +67,8 @@
 // normal operation, and tests override these values.
 static UVM_ACCESS_COUNTER_GRANULARITY g_uvm_access_counter_granularity;
 static unsigned g_uvm_access_counter_threshold;
+static NvU64 g_uvm_access_counter_promotion_budget_bytes __read_mostly;
+static unsigned g_uvm_access_counter_promotion_period_ms __read_mostly;
 
 // Per-VA space access counters information
 typedef struct
@@ -69,8 +80,36 @@ typedef struct
         atomic_t enable_mimc_migrations;
 
         atomic_t enable_momc_migrations;
+
+        atomic_t enable_promotion;
     } params;
 
+    // Deferred promotion of the blocks reported by physical notifications.
+    // When enabled, notifications are aggregated in a hotness map instead of
+    // being serviced right away, and a helper thread periodically migrates
+    // the hottest blocks within the configured bandwidth budget.
+    struct
+    {
+        // Work descriptor that is executed asynchronously by a helper thread
+        struct delayed_work dwork;
+
+        // Hotness map of the remote accesses to VA blocks. Protected by lock.
+        uvm_perf_hotness_map_t map;
+
+        uvm_spinlock_t lock;
+
+        // Candidates selected for promotion in the current period. Only
+        // accessed by the dwork function.
+        uvm_perf_hotness_candidate_t selected[UVM_PERF_HOTNESS_CANDIDATES_MAX];
+
+        // Only accessed by the dwork function
+        uvm_service_block_context_t service_context;
+
+        // Flag used to avoid scheduling promotions after
+        // uvm_perf_access_counters_stop has been called. Protected by lock.
+        bool in_va_space_teardown;
+    } promotion;
+
     uvm_va_space_t *va_space;
 } va_space_access_counters_info_t;
 
@@ -87,6 +126,11 @@ static unsigned uvm_perf_access_counter_batch_count = UVM_PERF_ACCESS_COUNTER_BA
 static char *uvm_perf_access_counter_granularity = UVM_PERF_ACCESS_COUNTER_GRANULARITY_DEFAULT;
 static unsigned uvm_perf_access_counter_threshold = UVM_PERF_ACCESS_COUNTER_THRESHOLD_DEFAULT;
 
+// Deferred promotion of the hottest remotely-accessed blocks
+static unsigned uvm_perf_access_counter_promotion_enable = 0;
+static unsigned uvm_perf_access_counter_promotion_budget_mb = UVM_PERF_ACCESS_COUNTER_PROMOTION_BUDGET_MB_DEFAULT;
+static unsigned uvm_perf_access_counter_promotion_period_ms = UVM_PERF_ACCESS_COUNTER_PROMOTION_PERIOD_MS_DEFAULT;
+
 // Module parameters for the tunables
 module_param(uvm_perf_access_counter_mimc_migration_enable, int, S_IRUGO);
 MODULE_PARM_DESC(uvm_perf_access_counter_mimc_migration_enable,
@@ -105,6 +149,16 @@ module_param(uvm_perf_access_counter_threshold, uint, S_IRUGO);
 MODULE_PARM_DESC(uvm_perf_access_counter_threshold,
                  "Number of remote accesses on a region required to trigger a notification."
                  "Valid values: [1, 65535]");
+module_param(uvm_perf_access_counter_promotion_enable, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_perf_access_counter_promotion_enable,
+                 "Aggregate physical access counter notifications in a per-VA space hotness map "
+                 "and migrate the hottest blocks periodically, instead of on each notification.");
+module_param(uvm_perf_access_counter_promotion_budget_mb, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_perf_access_counter_promotion_budget_mb,
+                 "Maximum amount of memory in MB promoted per VA space in each promotion period.");
+module_param(uvm_perf_access_counter_promotion_period_ms, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_perf_access_counter_promotion_period_ms,
+                 "Time in ms between promotions of the hottest blocks.");
 
 static void access_counter_buffer_flush_locked(uvm_gpu_t *gpu, uvm_gpu_buffer_flush_mode_t flush_mode);
 
@@ -180,6 +234,7 @@ static va_space_access_counters_info_t *va_space_access_counters_info_create(uvm
                    is_migration_enabled(UVM_ACCESS_COUNTER_TYPE_MIMC));
         atomic_set(&va_space_access_counters->params.enable_momc_migrations,
                    is_migration_enabled(UVM_ACCESS_COUNTER_TYPE_MOMC));
+        atomic_set(&va_space_access_counters->params.enable_promotion, uvm_perf_access_counter_promotion_enable != 0);
         va_space_access_counters->va_space = va_space;
     }
 
@@ -465,13 +520,32 @@ NV_STATUS uvm_gpu_init_access_counters(uvm_gpu_t *gpu)
         goto fail;
     }
 
-    batch_context->phys.translations = uvm_kvmalloc_zero((UVM_MAX_TRANSLATION_SIZE / PAGE_SIZE) *
+    batch_context->phys.translations = uvm_kvmalloc_zero(UVM_PHYS_WINDOW_TRANSLATIONS *
                                                          sizeof(*batch_context->phys.translations));
     if (!batch_context->phys.translations) {
         status = NV_ERR_NO_MEMORY;
         goto fail;
     }
 
+    batch_context->phys.refs = uvm_kvmalloc_zero(UVM_PHYS_WINDOW_TRANSLATIONS * sizeof(*batch_context->phys.refs));
+    if (!batch_context->phys.refs) {
+        status = NV_ERR_NO_MEMORY;
+        goto fail;
+    }
+
+    batch_context->phys.queries = uvm_kvmalloc_zero(UVM_PHYS_WINDOW_QUERIES * sizeof(*batch_context->phys.queries));
+    if (!batch_context->phys.queries) {
+        status = NV_ERR_NO_MEMORY;
+        goto fail;
+    }
+
+    batch_context->phys.query_notifications = uvm_kvmalloc_zero(UVM_PHYS_WINDOW_QUERIES *
+                                                                sizeof(*batch_context->phys.query_notifications));
+    if (!batch_context->phys.query_notifications) {
+        status = NV_ERR_NO_MEMORY;
+        goto fail;
+    }
+
     return NV_OK;
 
 fail:
@@ -500,10 +574,16 @@ void uvm_gpu_deinit_access_counters(uvm_gpu_t *gpu)
     uvm_kvfree(batch_context->virt.notifications);
     uvm_kvfree(batch_context->phys.notifications);
     uvm_kvfree(batch_context->phys.translations);
+    uvm_kvfree(batch_context->phys.refs);
+    uvm_kvfree(batch_context->phys.queries);
+    uvm_kvfree(batch_context->phys.query_notifications);
     batch_context->notification_cache = NULL;
     batch_context->virt.notifications = NULL;
     batch_context->phys.notifications = NULL;
     batch_context->phys.translations = NULL;
+    batch_context->phys.refs = NULL;
+    batch_context->phys.queries = NULL;
+    batch_context->phys.query_notifications = NULL;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 bool uvm_gpu_access_counters_required(const uvm_gpu_t *gpu)
@@ -765,17 +845,22 @@ static int cmp_sort_virt_notifications_by_instance_ptr(const void *_a, const voi
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 // Sort comparator for pointers to GPA access counter notification buffer
-// entries that sorts by physical address' aperture
-static int cmp_sort_phys_notifications_by_processor_id(const void *_a, const void *_b)
+// entries that sorts by physical address' aperture, and then by address
+static int cmp_sort_phys_notifications_by_address(const void *_a, const void *_b)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     const uvm_access_counter_buffer_entry_t *a = *(const uvm_access_counter_buffer_entry_t **)_a;
     const uvm_access_counter_buffer_entry_t *b = *(const uvm_access_counter_buffer_entry_t **)_b;
+    int result;
 
     UVM_ASSERT(!a->address.is_virtual);
     UVM_ASSERT(!b->address.is_virtual);
 
-    return UVM_CMP_DEFAULT(uvm_id_value(a->physical_info.resident_id),
-                           uvm_id_value(b->physical_info.resident_id));
+    result = UVM_CMP_DEFAULT(uvm_id_value(a->physical_info.resident_id),
+                             uvm_id_value(b->physical_info.resident_id));
+    if (result != 0)
+        return result;
+
+    return UVM_CMP_DEFAULT(a->address.address, b->address.address);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 typedef enum
@@ -800,7 +885,6 @@ static NvU32 fetch_access_counter_buffer_entries(uvm_gpu_t *gpu,
     uvm_spin_loop_t spin;
     uvm_access_counter_buffer_info_t *access_counters = &gpu->access_counter_buffer_info;
     NvU32 last_instance_ptr_idx = 0;
-    uvm_aperture_t last_aperture = UVM_APERTURE_PEER_MAX;
 
     // TODO: Bug 1766600: right now uvm locks do not support the synchronization
     //       method used by top and bottom ISR. Add uvm lock assert when it's
@@ -826,7 +910,6 @@ static NvU32 fetch_access_counter_buffer_entries(uvm_gpu_t *gpu,
     batch_context->virt.num_notifications = 0;
 
     batch_context->virt.is_single_instance_ptr = true;
-    batch_context->phys.is_single_aperture = true;
 
     notification_index = 0;
 
@@ -872,13 +955,6 @@ static NvU32 fetch_access_counter_buffer_entries(uvm_gpu_t *gpu,
                 uvm_gpu_get_processor_id_by_address(gpu, uvm_gpu_phys_address(current_entry->address.aperture,
                                                                               current_entry->address.address));
 
-            if (batch_context->phys.is_single_aperture) {
-                if (batch_context->phys.num_notifications == 1)
-                    last_aperture = current_entry->address.aperture;
-                else if (current_entry->address.aperture != last_aperture)
-                    batch_context->phys.is_single_aperture = false;
-            }
-
             if (current_entry->counter_type == UVM_ACCESS_COUNTER_TYPE_MOMC)
                 UVM_ASSERT(uvm_id_equal(current_entry->physical_info.resident_id, gpu->id));
             else
@@ -962,18 +1038,16 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 // GPA notifications provide a physical address and an aperture. Sort
 // accesses by aperture to try to coalesce operations on the same target
-// processor.
+// processor, and then by address so that the sysmem reverse map can be
+// walked in order when resolving the translations in bulk.
 static void preprocess_phys_notifications(uvm_gpu_t *gpu,
                                           uvm_access_counter_service_batch_context_t *batch_context)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    if (!batch_context->phys.is_single_aperture) {
-        // Sort by instance_ptr
-        sort(batch_context->phys.notifications,
-             batch_context->phys.num_notifications,
-             sizeof(*batch_context->phys.notifications),
-             cmp_sort_phys_notifications_by_processor_id,
-             NULL);
-    }
+    sort(batch_context->phys.notifications,
+         batch_context->phys.num_notifications,
+         sizeof(*batch_context->phys.notifications),
+         cmp_sort_phys_notifications_by_address,
+         NULL);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 static NV_STATUS service_va_block_locked(uvm_processor_id_t processor,
@@ -1115,22 +1189,22 @@ static NV_STATUS service_va_block_locked(uvm_processor_id_t processor,
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 static void reverse_mappings_to_va_block_page_mask(uvm_va_block_t *va_block,
-                                                   const uvm_reverse_map_t *reverse_mappings,
-                                                   size_t num_reverse_mappings,
+                                                   const uvm_access_counter_phys_ref_t *refs,
+                                                   size_t num_refs,
                                                    uvm_page_mask_t *page_mask)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NvU32 index;
 
     UVM_ASSERT(page_mask);
 
-    if (num_reverse_mappings > 0)
-        UVM_ASSERT(reverse_mappings);
+    if (num_refs > 0)
+        UVM_ASSERT(refs);
 
     uvm_page_mask_zero(page_mask);
 
     // Populate the mask of accessed pages within the VA Block
-    for (index = 0; index < num_reverse_mappings; ++index) {
-        const uvm_reverse_map_t *reverse_map = &reverse_mappings[index];
+    for (index = 0; index < num_refs; ++index) {
+        const uvm_reverse_map_t *reverse_map = refs[index].reverse_map;
         uvm_va_block_region_t region = reverse_map->region;
 
         UVM_ASSERT(reverse_map->va_block == va_block);
@@ -1145,25 +1219,49 @@ static void reverse_mappings_to_va_block_page_mask(uvm_va_block_t *va_block,
     }
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Record the pages of va_block accessed by processor in the hotness map of the
+// VA space, and schedule the promotion worker if it is not pending already.
+static void promotion_record(va_space_access_counters_info_t *va_space_access_counters,
+                             uvm_va_block_t *va_block,
+                             uvm_processor_id_t processor,
+                             const uvm_page_mask_t *accessed_pages,
+                             NvU32 counter_value)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_assert_mutex_locked(&va_block->lock);
+
+    uvm_spin_lock(&va_space_access_counters->promotion.lock);
+
+    uvm_perf_hotness_map_record(&va_space_access_counters->promotion.map,
+                                va_block->start,
+                                processor,
+                                accessed_pages,
+                                max(counter_value, 1u));
+
+    // The work is only queued if it is not pending. Notifications received
+    // until it runs are aggregated in the map.
+    if (!va_space_access_counters->promotion.in_va_space_teardown) {
+        schedule_delayed_work(&va_space_access_counters->promotion.dwork,
+                              msecs_to_jiffies(g_uvm_access_counter_promotion_period_ms));
+    }
+
+    uvm_spin_unlock(&va_space_access_counters->promotion.lock);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 static NV_STATUS service_phys_single_va_block(uvm_gpu_t *gpu,
                                               uvm_access_counter_service_batch_context_t *batch_context,
-                                              const uvm_access_counter_buffer_entry_t *current_entry,
-                                              const uvm_reverse_map_t *reverse_mappings,
-                                              size_t num_reverse_mappings,
-                                              bool *clear_counter)
+                                              const uvm_access_counter_phys_ref_t *refs,
+                                              size_t num_refs)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     size_t index;
-    uvm_va_block_t *va_block = reverse_mappings[0].va_block;
+    uvm_va_block_t *va_block = refs[0].reverse_map->va_block;
     uvm_va_space_t *va_space = NULL;
     uvm_va_space_mm_t *va_space_mm = NULL;
     NV_STATUS status = NV_OK;
-    const uvm_processor_id_t processor = current_entry->counter_type == UVM_ACCESS_COUNTER_TYPE_MIMC?
-                                             gpu->id: UVM_ID_CPU;
-
-    *clear_counter = false;
+    const uvm_processor_id_t processor = refs[0].processor;
 
-    UVM_ASSERT(num_reverse_mappings > 0);
+    UVM_ASSERT(num_refs > 0);
 
+    atomic64_inc(&gpu->access_counter_buffer_info.stats.phys.num_block_locks);
     uvm_mutex_lock(&va_block->lock);
     if (va_block->va_range)
         va_space = va_block->va_range->va_space;
@@ -1201,21 +1299,39 @@ static NV_STATUS service_phys_single_va_block(uvm_gpu_t *gpu,
         service_context->num_retries = 0;
         service_context->block_context.mm = uvm_va_space_mm_get_mm(va_space_mm);
 
+        atomic64_inc(&gpu->access_counter_buffer_info.stats.phys.num_block_locks);
         uvm_mutex_lock(&va_block->lock);
 
-        reverse_mappings_to_va_block_page_mask(va_block, reverse_mappings, num_reverse_mappings, accessed_pages);
+        reverse_mappings_to_va_block_page_mask(va_block, refs, num_refs, accessed_pages);
 
-        status = UVM_VA_BLOCK_RETRY_LOCKED(va_block, &va_block_retry,
-                                           service_va_block_locked(processor,
-                                                                   va_block,
-                                                                   &va_block_retry,
-                                                                   service_context,
-                                                                   accessed_pages));
+        if (atomic_read(&va_space_access_counters->params.enable_promotion)) {
+            NvU32 counter_value = 0;
+
+            for (index = 0; index < num_refs; ++index)
+                counter_value = max(counter_value, refs[index].notification->counter_value);
+
+            // The migration is deferred to the promotion worker
+            promotion_record(va_space_access_counters,
+                             va_block,
+                             processor,
+                             accessed_pages,
+                             counter_value);
+        }
+        else {
+            status = UVM_VA_BLOCK_RETRY_LOCKED(va_block, &va_block_retry,
+                                               service_va_block_locked(processor,
+                                                                       va_block,
+                                                                       &va_block_retry,
+                                                                       service_context,
+                                                                       accessed_pages));
+        }
 
         uvm_mutex_unlock(&va_block->lock);
 
-        if (status == NV_OK)
-            *clear_counter = true;
+        if (status == NV_OK) {
+            for (index = 0; index < num_refs; ++index)
+                refs[index].notification->phys_service.clear_counter = true;
+        }
     }
 
 done:
@@ -1228,43 +1344,135 @@ done:
     }
 
     // Drop the refcounts taken by the reverse map translation routines
-    for (index = 0; index < num_reverse_mappings; ++index)
+    for (index = 0; index < num_refs; ++index)
         uvm_va_block_release(va_block);
 
     return status;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-static NV_STATUS service_phys_va_blocks(uvm_gpu_t *gpu,
-                                        uvm_access_counter_service_batch_context_t *batch_context,
-                                        const uvm_access_counter_buffer_entry_t *current_entry,
-                                        const uvm_reverse_map_t *reverse_mappings,
-                                        size_t num_reverse_mappings,
-                                        bool *clear_counter)
+// Migrate the accessed pages of a candidate selected from the hotness map. The
+// candidate is skipped if its VA block no longer exists, or if it changed since
+// the notifications were recorded.
+static NV_STATUS promotion_service_candidate(va_space_access_counters_info_t *va_space_access_counters,
+                                             uvm_va_space_mm_t *va_space_mm,
+                                             uvm_perf_hotness_candidate_t *candidate)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    NV_STATUS status = NV_OK;
-    size_t index;
+    NV_STATUS status;
+    uvm_va_block_t *va_block;
+    uvm_va_block_retry_t va_block_retry;
+    uvm_va_space_t *va_space = va_space_access_counters->va_space;
+    uvm_service_block_context_t *service_context = &va_space_access_counters->promotion.service_context;
+    const uvm_processor_id_t processor = candidate->processor;
 
-    *clear_counter = false;
+    uvm_assert_rwsem_locked(&va_space->lock);
 
-    for (index = 0; index < num_reverse_mappings; ++index) {
-        bool clear_counter_local = false;
-        status = service_phys_single_va_block(gpu,
-                                              batch_context,
-                                              current_entry,
-                                              reverse_mappings + index,
-                                              1,
-                                              &clear_counter_local);
+    // The GPU could have been unregistered since the notifications were
+    // received
+    if (UVM_ID_IS_GPU(processor) && !uvm_processor_mask_test(&va_space->registered_gpus, processor))
+        return NV_OK;
+
+    if (UVM_ID_IS_CPU(processor) && !atomic_read(&va_space_access_counters->params.enable_momc_migrations))
+        return NV_OK;
+
+    if (!UVM_ID_IS_CPU(processor) && !atomic_read(&va_space_access_counters->params.enable_mimc_migrations))
+        return NV_OK;
+
+    status = uvm_va_block_find(va_space, candidate->block_start, &va_block);
+    if (status != NV_OK)
+        return NV_OK;
+
+    // The page mask is relative to the block start
+    if (va_block->start != candidate->block_start)
+        return NV_OK;
+
+    service_context->operation = UVM_SERVICE_OPERATION_ACCESS_COUNTERS;
+    service_context->num_retries = 0;
+    service_context->block_context.mm = uvm_va_space_mm_get_mm(va_space_mm);
+
+    uvm_mutex_lock(&va_block->lock);
+
+    // The VA block could have been split since the notifications were
+    // received. Drop the pages beyond its end.
+    uvm_page_mask_region_clear(&candidate->accessed_pages,
+                               uvm_va_block_region(uvm_va_block_num_cpu_pages(va_block), PAGES_PER_UVM_VA_BLOCK));
+
+    status = UVM_VA_BLOCK_RETRY_LOCKED(va_block, &va_block_retry,
+                                       service_va_block_locked(processor,
+                                                               va_block,
+                                                               &va_block_retry,
+                                                               service_context,
+                                                               &candidate->accessed_pages));
+
+    uvm_mutex_unlock(&va_block->lock);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void promotion_service(struct work_struct *work)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    struct delayed_work *dwork = to_delayed_work(work);
+    va_space_access_counters_info_t *va_space_access_counters = container_of(dwork,
+                                                                             va_space_access_counters_info_t,
+                                                                             promotion.dwork);
+    uvm_va_space_t *va_space = va_space_access_counters->va_space;
+    uvm_va_space_mm_t *va_space_mm;
+    NvU32 num_selected = 0;
+    NvU32 index;
+
+    UVM_ASSERT(uvm_va_space_initialized(va_space) == NV_OK);
+
+    // If an mm is registered with the VA space, we have to retain it in order
+    // to lock it before locking the VA space.
+    va_space_mm = uvm_va_space_mm_retain(va_space);
+    if (va_space_mm)
+        uvm_down_read_mmap_sem(&va_space_mm->mm->mmap_sem);
+
+    uvm_va_space_down_read(va_space);
+
+    uvm_spin_lock(&va_space_access_counters->promotion.lock);
+
+    if (!va_space_access_counters->promotion.in_va_space_teardown) {
+        uvm_perf_hotness_map_t *map = &va_space_access_counters->promotion.map;
+
+        num_selected = uvm_perf_hotness_map_select(map,
+                                                   g_uvm_access_counter_promotion_budget_bytes,
+                                                   va_space_access_counters->promotion.selected,
+                                                   ARRAY_SIZE(va_space_access_counters->promotion.selected));
+
+        // Candidates that didn't fit in the budget of this period are
+        // retried in the next one, with their hotness decayed so that blocks
+        // that keep being accessed take precedence.
+        uvm_perf_hotness_map_age(map);
+        if (map->num_candidates > 0) {
+            schedule_delayed_work(&va_space_access_counters->promotion.dwork,
+                                  msecs_to_jiffies(g_uvm_access_counter_promotion_period_ms));
+        }
+    }
+
+    uvm_spin_unlock(&va_space_access_counters->promotion.lock);
+
+    for (index = 0; index < num_selected; ++index) {
+        NV_STATUS status = promotion_service_candidate(va_space_access_counters,
+                                                       va_space_mm,
+                                                       &va_space_access_counters->promotion.selected[index]);
+
+        // The candidates are dropped on error. New notifications will be
+        // received if the pages keep being accessed remotely.
         if (status != NV_OK)
             break;
-
-        *clear_counter = *clear_counter || clear_counter_local;
     }
 
-    // In the case of failure, drop the refcounts for the remaining reverse mappings
-    while (++index < num_reverse_mappings)
-        uvm_va_block_release(reverse_mappings[index].va_block);
+    uvm_va_space_up_read(va_space);
 
-    return status;
+    if (va_space_mm) {
+        uvm_up_read_mmap_sem(&va_space_mm->mm->mmap_sem);
+        uvm_va_space_mm_release(va_space_mm);
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void promotion_service_entry(struct work_struct *work)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ENTRY_VOID(promotion_service(work));
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 // Iterate over all regions set in the given sub_granularity mask
@@ -1281,104 +1489,155 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
                                            (config)->sub_granularity_regions_per_translation,                    \
                                            (region_start) + 1))
 
-static bool are_reverse_mappings_on_single_block(const uvm_reverse_map_t *reverse_mappings, size_t num_reverse_mappings)
+// Sort comparator for references to physical notification translations that
+// groups them by VA block and accessing processor
+static int cmp_sort_phys_refs_by_va_block(const void *_a, const void *_b)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    const uvm_access_counter_phys_ref_t *a = _a;
+    const uvm_access_counter_phys_ref_t *b = _b;
+    int result;
+
+    result = UVM_CMP_DEFAULT((uintptr_t)a->reverse_map->va_block, (uintptr_t)b->reverse_map->va_block);
+    if (result != 0)
+        return result;
+
+    result = UVM_CMP_DEFAULT(uvm_id_value(a->processor), uvm_id_value(b->processor));
+    if (result != 0)
+        return result;
+
+    return UVM_CMP_DEFAULT(a->reverse_map->region.first, b->reverse_map->region.first);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void phys_window_add_refs(uvm_gpu_t *gpu,
+                                 uvm_access_counter_service_batch_context_t *batch_context,
+                                 uvm_access_counter_buffer_entry_t *current_entry,
+                                 uvm_reverse_map_t *reverse_mappings,
+                                 size_t num_reverse_mappings)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     size_t index;
-    uvm_va_block_t *prev_va_block = NULL;
+    const uvm_processor_id_t processor = current_entry->counter_type == UVM_ACCESS_COUNTER_TYPE_MIMC?
+                                             gpu->id: UVM_ID_CPU;
 
     for (index = 0; index < num_reverse_mappings; ++index) {
-        uvm_va_block_t *va_block = reverse_mappings[index].va_block;
-        UVM_ASSERT(va_block);
-
-        if (prev_va_block && prev_va_block != va_block)
-            return false;
+        uvm_access_counter_phys_ref_t *ref = &batch_context->phys.refs[batch_context->phys.num_refs++];
 
-        prev_va_block = va_block;
+        ref->reverse_map = reverse_mappings + index;
+        ref->notification = current_entry;
+        ref->processor = processor;
     }
 
-    return true;
+    current_entry->phys_service.num_reverse_mappings += num_reverse_mappings;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-// Service the given translation range. It will return the count of the reverse
-// mappings found during servicing in num_reverse_mappings, even if the function
-// doesn't return NV_OK.
-static NV_STATUS service_phys_notification_translation(uvm_gpu_t *gpu,
-                                                       uvm_gpu_t *resident_gpu,
-                                                       uvm_access_counter_service_batch_context_t *batch_context,
-                                                       const uvm_gpu_access_counter_type_config_t *config,
-                                                       const uvm_access_counter_buffer_entry_t *current_entry,
-                                                       NvU64 address,
-                                                       unsigned long sub_granularity,
-                                                       size_t *num_reverse_mappings,
-                                                       bool *clear_counter)
+// Service the notifications in the current window:
+// 1) Resolve all the pending sysmem translations with a single batched query
+//    to the reverse map.
+// 2) Sort the translations by VA block and service each VA block once.
+// 3) Report and clear the notifications that are complete, i.e. those in
+//    [window_first, window_end). The remaining notification, if any, was only
+//    partially translated and will be completed in the next window.
+static NV_STATUS service_phys_window(uvm_gpu_t *gpu,
+                                     uvm_access_counter_service_batch_context_t *batch_context,
+                                     NvU32 window_end)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    NV_STATUS status;
-    NvU32 region_start, region_end;
-
-    *num_reverse_mappings = 0;
-
-    // Get the reverse_map translations for all the regions set in the
-    // sub_granularity field of the counter.
-    for_each_sub_granularity_region(region_start, region_end, sub_granularity, config) {
-        NvU64 local_address = address + region_start * config->sub_granularity_region_size;
-        NvU32 local_translation_size = (region_end - region_start) * config->sub_granularity_region_size;
-        uvm_reverse_map_t *local_reverse_mappings = batch_context->phys.translations + *num_reverse_mappings;
-
-        // Obtain the virtual addresses of the pages within the reported
-        // DMA range
-        if (resident_gpu) {
-            *num_reverse_mappings += uvm_pmm_gpu_phys_to_virt(&resident_gpu->pmm,
-                                                              local_address,
-                                                              local_translation_size,
-                                                              local_reverse_mappings);
+    NV_STATUS status = NV_OK;
+    NvU32 index;
+    NvU32 next;
+    uvm_access_counter_buffer_info_t *access_counters = &gpu->access_counter_buffer_info;
+
+    atomic64_inc(&access_counters->stats.phys.num_windows);
+
+    if (batch_context->phys.num_queries > 0) {
+        size_t num_lookups = uvm_pmm_sysmem_mappings_dma_to_virt_batch(&gpu->pmm_sysmem_mappings,
+                                                                       batch_context->phys.queries,
+                                                                       batch_context->phys.num_queries);
+
+        atomic64_add(num_lookups, &access_counters->stats.phys.num_reverse_map_lookups);
+
+        for (index = 0; index < batch_context->phys.num_queries; ++index) {
+            uvm_pmm_sysmem_mappings_query_t *query = &batch_context->phys.queries[index];
+
+            phys_window_add_refs(gpu,
+                                 batch_context,
+                                 batch_context->phys.query_notifications[index],
+                                 query->out_mappings,
+                                 query->num_mappings);
+        }
+    }
+
+    atomic64_add(batch_context->phys.num_refs, &access_counters->stats.phys.num_translations);
+
+    sort(batch_context->phys.refs,
+         batch_context->phys.num_refs,
+         sizeof(*batch_context->phys.refs),
+         cmp_sort_phys_refs_by_va_block,
+         NULL);
+
+    for (index = 0; index < batch_context->phys.num_refs; index = next) {
+        const uvm_access_counter_phys_ref_t *ref = &batch_context->phys.refs[index];
+
+        for (next = index + 1; next < batch_context->phys.num_refs; ++next) {
+            const uvm_access_counter_phys_ref_t *next_ref = &batch_context->phys.refs[next];
+
+            if (next_ref->reverse_map->va_block != ref->reverse_map->va_block ||
+                !uvm_id_equal(next_ref->processor, ref->processor))
+                break;
+        }
+
+        if (status == NV_OK) {
+            status = service_phys_single_va_block(gpu, batch_context, ref, next - index);
         }
         else {
-            *num_reverse_mappings += uvm_pmm_sysmem_mappings_dma_to_virt(&gpu->pmm_sysmem_mappings,
-                                                                         local_address,
-                                                                         local_translation_size,
-                                                                         local_reverse_mappings,
-                                                                         local_translation_size / PAGE_SIZE);
+            // In the case of failure, drop the refcounts for the remaining
+            // reverse mappings
+            for (; index < next; ++index)
+                uvm_va_block_release(batch_context->phys.refs[index].reverse_map->va_block);
         }
     }
 
-    if (*num_reverse_mappings == 0)
-        return NV_OK;
+    for (index = batch_context->phys.window_first; index < window_end; ++index) {
+        uvm_access_counter_buffer_entry_t *current_entry = batch_context->phys.notifications[index];
 
-    // Service all the translations
-    if (are_reverse_mappings_on_single_block(batch_context->phys.translations, *num_reverse_mappings)) {
-        status = service_phys_single_va_block(gpu,
-                                              batch_context,
-                                              current_entry,
-                                              batch_context->phys.translations,
-                                              *num_reverse_mappings,
-                                              clear_counter);
-    }
-    else {
-        status = service_phys_va_blocks(gpu,
-                                        batch_context,
-                                        current_entry,
-                                        batch_context->phys.translations,
-                                        *num_reverse_mappings,
-                                        clear_counter);
+        if (!current_entry->phys_service.translated)
+            continue;
+
+        // TODO: Bug 1990466: Here we already have virtual addresses and
+        // address spaces. Merge virtual and physical notification handling
+
+        // Currently we only report events for our tests, not for tools
+        if (uvm_enable_builtin_tests) {
+            const bool on_managed = current_entry->phys_service.num_reverse_mappings != 0;
+            uvm_tools_broadcast_access_counter(gpu, current_entry, on_managed);
+        }
+
+        if (status == NV_OK && current_entry->phys_service.clear_counter)
+            status = access_counter_clear_targeted(gpu, current_entry);
     }
 
+    batch_context->phys.num_translations = 0;
+    batch_context->phys.num_refs = 0;
+    batch_context->phys.num_queries = 0;
+    batch_context->phys.window_first = window_end;
+
     return status;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-static NV_STATUS service_phys_notification(uvm_gpu_t *gpu,
-                                           uvm_access_counter_service_batch_context_t *batch_context,
-                                           const uvm_access_counter_buffer_entry_t *current_entry)
+// Add the translations of the notification at the given index to the current
+// window. Vidmem translations are resolved right away, while sysmem ones are
+// queued to be resolved in bulk by service_phys_window. The window is serviced
+// whenever it doesn't have enough room for the next translation.
+static NV_STATUS phys_window_add_notification(uvm_gpu_t *gpu,
+                                              uvm_access_counter_service_batch_context_t *batch_context,
+                                              NvU32 notification_index)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NvU64 address;
     NvU64 translation_index;
+    uvm_access_counter_buffer_entry_t *current_entry = batch_context->phys.notifications[notification_index];
     uvm_access_counter_buffer_info_t *access_counters = &gpu->access_counter_buffer_info;
     uvm_access_counter_type_t counter_type = current_entry->counter_type;
     const uvm_gpu_access_counter_type_config_t *config = get_config_for_type(access_counters, counter_type);
     unsigned long sub_granularity;
-    size_t total_reverse_mappings = 0;
     uvm_gpu_t *resident_gpu = NULL;
-    NV_STATUS status = NV_OK;
-    bool clear_counter = false;
 
     address = current_entry->address.address;
     UVM_ASSERT(address % config->translation_size == 0);
@@ -1404,41 +1663,56 @@ static NV_STATUS service_phys_notification(uvm_gpu_t *gpu,
             return NV_OK;
     }
 
+    current_entry->phys_service.translated = true;
+
     for (translation_index = 0; translation_index < config->translations_per_counter; ++translation_index) {
-        size_t num_reverse_mappings;
-        bool clear_counter_local = false;
-        status = service_phys_notification_translation(gpu,
-                                                       resident_gpu,
-                                                       batch_context,
-                                                       config,
-                                                       current_entry,
-                                                       address,
-                                                       sub_granularity,
-                                                       &num_reverse_mappings,
-                                                       &clear_counter_local);
-        total_reverse_mappings += num_reverse_mappings;
-        clear_counter = clear_counter || clear_counter_local;
+        NvU32 region_start, region_end;
 
-        if (status != NV_OK)
-            break;
+        if (batch_context->phys.num_translations + config->translation_size / PAGE_SIZE > UVM_PHYS_WINDOW_TRANSLATIONS ||
+            batch_context->phys.num_queries + config->sub_granularity_regions_per_translation > UVM_PHYS_WINDOW_QUERIES) {
+            NV_STATUS status = service_phys_window(gpu, batch_context, notification_index);
+            if (status != NV_OK)
+                return status;
+        }
 
-        address += config->translation_size;
-        sub_granularity = sub_granularity >> config->sub_granularity_regions_per_translation;
-    }
+        // Get the reverse_map translations for all the regions set in the
+        // sub_granularity field of the counter.
+        for_each_sub_granularity_region(region_start, region_end, sub_granularity, config) {
+            NvU64 local_address = address + region_start * config->sub_granularity_region_size;
+            NvU32 local_translation_size = (region_end - region_start) * config->sub_granularity_region_size;
+            uvm_reverse_map_t *local_reverse_mappings = batch_context->phys.translations +
+                                                        batch_context->phys.num_translations;
+
+            // Obtain the virtual addresses of the pages within the reported
+            // DMA range
+            if (resident_gpu) {
+                NvU32 num_reverse_mappings = uvm_pmm_gpu_phys_to_virt(&resident_gpu->pmm,
+                                                                      local_address,
+                                                                      local_translation_size,
+                                                                      local_reverse_mappings);
+
+                atomic64_inc(&access_counters->stats.phys.num_reverse_map_lookups);
+                phys_window_add_refs(gpu, batch_context, current_entry, local_reverse_mappings, num_reverse_mappings);
+                batch_context->phys.num_translations += num_reverse_mappings;
+            }
+            else {
+                uvm_pmm_sysmem_mappings_query_t *query = &batch_context->phys.queries[batch_context->phys.num_queries];
 
-    // TODO: Bug 1990466: Here we already have virtual addresses and
-    // address spaces. Merge virtual and physical notification handling
+                query->dma_addr = local_address;
+                query->region_size = local_translation_size;
+                query->out_mappings = local_reverse_mappings;
+                batch_context->phys.query_notifications[batch_context->phys.num_queries++] = current_entry;
 
-    // Currently we only report events for our tests, not for tools
-    if (uvm_enable_builtin_tests) {
-        const bool on_managed = total_reverse_mappings != 0;
-        uvm_tools_broadcast_access_counter(gpu, current_entry, on_managed);
-    }
+                // Reserve the worst case until the query is resolved
+                batch_context->phys.num_translations += local_translation_size / PAGE_SIZE;
+            }
+        }
 
-    if (status == NV_OK && clear_counter)
-        status = access_counter_clear_targeted(gpu, current_entry);
+        address += config->translation_size;
+        sub_granularity = sub_granularity >> config->sub_granularity_regions_per_translation;
+    }
 
-    return status;
+    return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 // TODO: Bug 2018899: Add statistics for dropped access counter notifications
@@ -1446,21 +1720,36 @@ static NV_STATUS service_phys_notifications(uvm_gpu_t *gpu,
                                             uvm_access_counter_service_batch_context_t *batch_context)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NvU32 i;
+    uvm_access_counter_buffer_info_t *access_counters = &gpu->access_counter_buffer_info;
+
+    if (batch_context->phys.num_notifications == 0)
+        return NV_OK;
+
     preprocess_phys_notifications(gpu, batch_context);
 
+    atomic64_inc(&access_counters->stats.phys.num_batches);
+    atomic64_add(batch_context->phys.num_notifications, &access_counters->stats.phys.num_notifications);
+
+    batch_context->phys.num_translations = 0;
+    batch_context->phys.num_refs = 0;
+    batch_context->phys.num_queries = 0;
+    batch_context->phys.window_first = 0;
+
     for (i = 0; i < batch_context->phys.num_notifications; ++i) {
         NV_STATUS status;
         uvm_access_counter_buffer_entry_t *current_entry = batch_context->phys.notifications[i];
 
+        memset(&current_entry->phys_service, 0, sizeof(current_entry->phys_service));
+
         if (!UVM_ID_IS_VALID(current_entry->physical_info.resident_id))
             continue;
 
-        status = service_phys_notification(gpu, batch_context, current_entry);
+        status = phys_window_add_notification(gpu, batch_context, i);
         if (status != NV_OK)
             return status;
     }
 
-    return NV_OK;
+    return service_phys_window(gpu, batch_context, batch_context->phys.num_notifications);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 void uvm_gpu_service_access_counters(uvm_gpu_t *gpu)
@@ -1538,6 +1827,26 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 NV_STATUS uvm_perf_access_counters_init()
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (uvm_perf_access_counter_promotion_budget_mb == 0) {
+        pr_info("Invalid value %u for uvm_perf_access_counter_promotion_budget_mb, using %u instead\n",
+                uvm_perf_access_counter_promotion_budget_mb,
+                UVM_PERF_ACCESS_COUNTER_PROMOTION_BUDGET_MB_DEFAULT);
+        g_uvm_access_counter_promotion_budget_bytes = UVM_PERF_ACCESS_COUNTER_PROMOTION_BUDGET_MB_DEFAULT * 1024ULL * 1024;
+    }
+    else {
+        g_uvm_access_counter_promotion_budget_bytes = uvm_perf_access_counter_promotion_budget_mb * 1024ULL * 1024;
+    }
+
+    if (uvm_perf_access_counter_promotion_period_ms == 0) {
+        pr_info("Invalid value %u for uvm_perf_access_counter_promotion_period_ms, using %u instead\n",
+                uvm_perf_access_counter_promotion_period_ms,
+                UVM_PERF_ACCESS_COUNTER_PROMOTION_PERIOD_MS_DEFAULT);
+        g_uvm_access_counter_promotion_period_ms = UVM_PERF_ACCESS_COUNTER_PROMOTION_PERIOD_MS_DEFAULT;
+    }
+    else {
+        g_uvm_access_counter_promotion_period_ms = uvm_perf_access_counter_promotion_period_ms;
+    }
+
     uvm_perf_module_init("perf_access_counters",
                          UVM_PERF_MODULE_TYPE_ACCESS_COUNTERS,
                          g_callbacks_access_counters,
@@ -1564,9 +1873,36 @@ NV_STATUS uvm_perf_access_counters_load(uvm_va_space_t *va_space)
     if (!va_space_access_counters)
         return NV_ERR_NO_MEMORY;
 
+    uvm_spin_lock_init(&va_space_access_counters->promotion.lock, UVM_LOCK_ORDER_LEAF);
+    uvm_perf_hotness_map_init(&va_space_access_counters->promotion.map);
+    INIT_DELAYED_WORK(&va_space_access_counters->promotion.dwork, promotion_service_entry);
+
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+void uvm_perf_access_counters_stop(uvm_va_space_t *va_space)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    va_space_access_counters_info_t *va_space_access_counters;
+
+    uvm_va_space_down_write(va_space);
+    va_space_access_counters = va_space_access_counters_info_get_or_null(va_space);
+
+    // Prevent further promotions from being scheduled
+    if (va_space_access_counters) {
+        uvm_spin_lock(&va_space_access_counters->promotion.lock);
+        va_space_access_counters->promotion.in_va_space_teardown = true;
+        uvm_spin_unlock(&va_space_access_counters->promotion.lock);
+    }
+
+    uvm_va_space_up_write(va_space);
+
+    // Cancel any pending work. The tracking struct is only freed by
+    // uvm_perf_access_counters_unload, which is called later in the teardown
+    // path.
+    if (va_space_access_counters)
+        (void)cancel_delayed_work_sync(&va_space_access_counters->promotion.dwork);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 void uvm_perf_access_counters_unload(uvm_va_space_t *va_space)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     uvm_perf_module_unload(&g_module_access_counters, va_space);
@@ -61,6 +61,10 @@ void uvm_perf_access_counters_exit(void);
 NV_STATUS uvm_perf_access_counters_load(uvm_va_space_t *va_space);
 void uvm_perf_access_counters_unload(uvm_va_space_t *va_space);
 
+// Cancel the pending promotions of the hottest blocks in the VA space. See
+// comments in uvm8_perf_heuristics.h
+void uvm_perf_access_counters_stop(uvm_va_space_t *va_space);
+
 // Check whether access counters should be enabled when the given GPU is
 // registered on any VA space.
 bool uvm_gpu_access_counters_required(const uvm_gpu_t *gpu);
@@ -376,9 +376,16 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 // trackers after their owning GPUs have been destroyed.
 static bool tracking_semaphore_check_gpu(uvm_gpu_tracking_semaphore_t *tracking_sem)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    uvm_gpu_t *gpu = tracking_sem->semaphore.page->pool->gpu;
+    uvm_gpu_t *gpu;
     uvm_gpu_t *table_gpu;
 
+    // Mock tracking semaphores used by tests are backed by CPU memory not
+    // coming from any semaphore pool.
+    if (!tracking_sem->semaphore.page)
+        return true;
+
+    gpu = tracking_sem->semaphore.page->pool->gpu;
+
     UVM_ASSERT_MSG(gpu->magic == UVM_GPU_MAGIC_VALUE, "Corruption detected: magic number is 0x%llx\n", gpu->magic);
 
     // It's ok for the GPU to not be in the global table, since add_gpu operates
@@ -503,6 +503,21 @@ struct uvm_access_counter_buffer_entry_struct
     // Opaque fields provided by HW, required for targeted clear of a counter
     NvU32 bank;
     NvU32 tag;
+
+    // Software state used while servicing physical notifications. See
+    // service_phys_notifications in uvm8_gpu_access_counters.c.
+    struct
+    {
+        // Whether the notification was translated, i.e. it was not dropped
+        bool translated;
+
+        // Whether any of the VA blocks accessed by the notification was
+        // serviced, and the counter needs to be cleared
+        bool clear_counter;
+
+        // Number of reverse map translations found for the notification
+        NvU32 num_reverse_mappings;
+    } phys_service;
 };
 
 static uvm_prot_t uvm_fault_access_type_to_prot(uvm_fault_access_type_t access_type)
@@ -40,6 +40,10 @@ void uvm_hal_kepler_arch_init_properties(uvm_gpu_t *gpu)
 
     gpu->tlb_batch.va_invalidate_supported = false;
 
+    // Copies in each direction are done by a single CE, so there is nothing to
+    // spread them across.
+    gpu->copy_stripes.stripe_size = 0;
+
     gpu->uvm_mem_va_base = 768ull * 1024 * 1024 * 1024;
     gpu->uvm_mem_va_size = UVM_MEM_VA_SIZE;
 
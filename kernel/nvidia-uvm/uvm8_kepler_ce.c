@@ -221,6 +221,8 @@ void uvm_hal_kepler_ce_memcopy(uvm_push_t *push, uvm_gpu_address_t dst, uvm_gpu_
     NvU32 launch_dma_src_dst_type;
     bool first_operation = true;
 
+    push->transfer_bytes += size;
+
     launch_dma_src_dst_type = gpu->ce_hal->phys_mode(push, dst, src);
 
     do {
@@ -278,6 +280,8 @@ static void memset_common(uvm_push_t *push, uvm_gpu_address_t dst, size_t size,
     bool first_operation = true;
     NvU32 launch_dma_dst_type;
 
+    push->transfer_bytes += size * memset_element_size;
+
     launch_dma_dst_type = memset_push_phys_mode(push, dst);
 
     do {
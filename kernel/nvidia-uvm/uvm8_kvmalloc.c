@@ -25,6 +25,11 @@
 #include "uvm_common.h"
 #include "uvm_linux.h"
 #include "uvm8_kvmalloc.h"
+#include "uvm8_global.h"
+#include "uvm8_procfs.h"
+
+#include <linux/hash.h>
+#include <linux/sort.h>
 
 // To implement realloc for vmalloc-based allocations we need to track the size
 // of the original allocation. We can do that by allocating a header along with
@@ -38,6 +43,20 @@ typedef struct
     uint8_t ptr[0];
 } uvm_vmalloc_hdr_t;
 
+// Objects from the size class caches can't be freed with kfree nor sized with
+// ksize, so when size classes are enabled all kmalloc-based allocations carry a
+// header recording where they came from. The header has the same size as the
+// vmalloc one so the allocation pointer keeps the same alignment. Size classes
+// are disabled by default, in which case kmalloc-based allocations have no
+// header.
+typedef struct
+{
+    // Index of the size class of the allocation, or
+    // UVM_KVMALLOC_SIZE_CLASS_NONE if it was allocated with kmalloc
+    size_t class_index;
+    uint8_t ptr[0];
+} uvm_kmalloc_hdr_t;
+
 typedef struct
 {
     void *ptr;
@@ -89,15 +108,512 @@ MODULE_PARM_DESC(uvm_leak_checker,
                  "Enable uvm memory leak checking. "
                  "0 = disabled, 1 = count total bytes allocated and freed, 2 = per-allocation origin tracking.");
 
+// Size classes are dedicated slab caches for small allocation sizes which fall
+// between the generic kmalloc caches, so that a frequently allocated object
+// doesn't waste up to half of a power-of-two kmalloc bucket. The class of an
+// allocation is recorded in its uvm_kmalloc_hdr_t.
+//
+// No classes are configured by default: the header adds 8 bytes to every
+// kmalloc-based allocation, which only pays off for sizes which are allocated
+// often enough. The uvm_kvmalloc_profile mode reports the allocation sizes by
+// call site, which can be used to pick the classes for a given workload.
+#define UVM_KVMALLOC_MAX_SIZE_CLASSES 16
+#define UVM_KVMALLOC_SIZE_CLASS_GRANULARITY 8
+#define UVM_KVMALLOC_SIZE_CLASS_MAX_SIZE 2048
+#define UVM_KVMALLOC_SIZE_CLASS_NONE 0xff
+
+static unsigned uvm_kvmalloc_size_classes[UVM_KVMALLOC_MAX_SIZE_CLASSES];
+static int uvm_kvmalloc_num_size_classes = 0;
+module_param_array(uvm_kvmalloc_size_classes, uint, &uvm_kvmalloc_num_size_classes, S_IRUGO);
+MODULE_PARM_DESC(uvm_kvmalloc_size_classes,
+                 "Comma-separated list of allocation sizes, up to 2040 bytes, served by dedicated slab caches in "
+                 "uvm_kvmalloc. Default: none.");
+
+static struct
+{
+    struct
+    {
+        // Object size of the cache, including the uvm_kmalloc_hdr_t
+        size_t size;
+        struct kmem_cache *cache;
+
+        // Number of outstanding allocations from the cache. Caches with leaked
+        // allocations aren't destroyed, as the kernel would complain about
+        // them.
+        atomic_long_t num_objects;
+
+        // Some kernels keep a reference to the name of the cache, so it's
+        // allocated separately to outlive a leaked cache.
+        char *name;
+    } classes[UVM_KVMALLOC_MAX_SIZE_CLASSES];
+
+    unsigned count;
+
+    // Index of the class used for each object size, including the
+    // uvm_kmalloc_hdr_t, in UVM_KVMALLOC_SIZE_CLASS_GRANULARITY units, or
+    // UVM_KVMALLOC_SIZE_CLASS_NONE if the size is served by kmalloc.
+    NvU8 lookup[UVM_KVMALLOC_SIZE_CLASS_MAX_SIZE / UVM_KVMALLOC_SIZE_CLASS_GRANULARITY + 1];
+} g_uvm_kvmalloc_size_classes;
+
+// Allocation size profiling by call site. This is meant to be used to choose
+// the size classes, and it adds a hash table lookup to each allocation, so it
+// is disabled by default.
+static int uvm_kvmalloc_profile = 0;
+module_param(uvm_kvmalloc_profile, int, S_IRUGO);
+MODULE_PARM_DESC(uvm_kvmalloc_profile,
+                 "Report uvm_kvmalloc allocation size histograms by call site in "
+                 "/proc/driver/nvidia-uvm/kvmalloc_profile (1) or not (0). Default: 0.");
+
+// Must be a power of two
+#define UVM_KVMALLOC_PROFILE_MAX_SITES 1024
+
+// Bucket i accounts allocations in the (2^(i-1), 2^i] bytes range. The last
+// bucket also accounts all the larger allocations.
+#define UVM_KVMALLOC_PROFILE_BUCKETS 24
+
+#define UVM_KVMALLOC_PROFILE_FILE_NAME "kvmalloc_profile"
+
+typedef struct
+{
+    // Published last with release semantics, once the rest of the call site
+    // information is set.
+    const char *file;
+    const char *function;
+    int line;
+
+    atomic64_t num_allocations;
+    atomic64_t bytes_allocated;
+    atomic64_t histogram[UVM_KVMALLOC_PROFILE_BUCKETS];
+} uvm_kvmalloc_profile_site_t;
+
+static struct
+{
+    // Open-addressing hash table of call sites, indexed by file and line.
+    // Lookups are lock-free, the lock only serializes the insertions.
+    uvm_kvmalloc_profile_site_t *sites;
+    spinlock_t lock;
+
+    // Allocations which didn't fit in the table
+    atomic64_t num_untracked;
+
+    struct proc_dir_entry *procfs_file;
+} g_uvm_kvmalloc_profile;
+
+// Approximation of the size of the generic kmalloc cache used for the given
+// size
+static size_t kmalloc_bucket_size(size_t size)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (size <= 8)
+        return 8;
+    if (size > 64 && size <= 96)
+        return 96;
+    if (size > 128 && size <= 192)
+        return 192;
+    return roundup_pow_of_two(size);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static int size_class_cmp(const void *a, const void *b)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return *(const unsigned *)a - *(const unsigned *)b;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS size_classes_init(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    unsigned sizes[UVM_KVMALLOC_MAX_SIZE_CLASSES];
+    unsigned num_sizes = 0;
+    unsigned i;
+
+    size_t lookup_index;
+
+    memset(g_uvm_kvmalloc_size_classes.lookup, UVM_KVMALLOC_SIZE_CLASS_NONE, sizeof(g_uvm_kvmalloc_size_classes.lookup));
+
+    for (i = 0; i < uvm_kvmalloc_num_size_classes; ++i) {
+        unsigned class_size = uvm_kvmalloc_size_classes[i];
+
+        if (class_size == 0)
+            continue;
+
+        if (class_size > UVM_KVMALLOC_SIZE_CLASS_MAX_SIZE - sizeof(uvm_kmalloc_hdr_t)) {
+            pr_info("Invalid value %u for uvm_kvmalloc_size_classes, ignoring it\n", class_size);
+            continue;
+        }
+
+        // The objects of the caches are aligned like kmalloc allocations, so
+        // round the sizes up to that alignment to not waste the padding.
+        sizes[num_sizes++] = UVM_ALIGN_UP(class_size + sizeof(uvm_kmalloc_hdr_t),
+                                          max_t(unsigned, UVM_KVMALLOC_SIZE_CLASS_GRANULARITY, ARCH_KMALLOC_MINALIGN));
+    }
+
+    sort(sizes, num_sizes, sizeof(sizes[0]), size_class_cmp, NULL);
+
+    for (i = 0; i < num_sizes; ++i) {
+        unsigned class_index = g_uvm_kvmalloc_size_classes.count;
+
+        // Skip duplicates and sizes already served exactly by kmalloc
+        if (i > 0 && sizes[i] == sizes[i - 1])
+            continue;
+        if (kmalloc_bucket_size(sizes[i]) == sizes[i])
+            continue;
+
+        g_uvm_kvmalloc_size_classes.classes[class_index].name = kasprintf(NV_UVM_GFP_FLAGS, "uvm_kvmalloc_%u", sizes[i]);
+        if (!g_uvm_kvmalloc_size_classes.classes[class_index].name)
+            return NV_ERR_NO_MEMORY;
+
+        g_uvm_kvmalloc_size_classes.classes[class_index].size = sizes[i];
+        atomic_long_set(&g_uvm_kvmalloc_size_classes.classes[class_index].num_objects, 0);
+        g_uvm_kvmalloc_size_classes.classes[class_index].cache =
+            kmem_cache_create(g_uvm_kvmalloc_size_classes.classes[class_index].name,
+                              sizes[i],
+                              ARCH_KMALLOC_MINALIGN,
+                              0,
+                              NULL);
+
+        // Count the class even on failure, so its name is freed
+        ++g_uvm_kvmalloc_size_classes.count;
+
+        if (!g_uvm_kvmalloc_size_classes.classes[class_index].cache)
+            return NV_ERR_NO_MEMORY;
+    }
+
+    // Use the smallest class that fits the object, if it's smaller than the
+    // kmalloc cache that would be used otherwise.
+    for (lookup_index = 1; lookup_index < ARRAY_SIZE(g_uvm_kvmalloc_size_classes.lookup); ++lookup_index) {
+        size_t size = lookup_index * UVM_KVMALLOC_SIZE_CLASS_GRANULARITY;
+
+        for (i = 0; i < g_uvm_kvmalloc_size_classes.count; ++i) {
+            size_t class_size = g_uvm_kvmalloc_size_classes.classes[i].size;
+
+            if (class_size < size)
+                continue;
+
+            if (class_size < kmalloc_bucket_size(size))
+                g_uvm_kvmalloc_size_classes.lookup[lookup_index] = i;
+
+            break;
+        }
+    }
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void size_classes_exit(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    unsigned i;
+
+    for (i = 0; i < g_uvm_kvmalloc_size_classes.count; ++i) {
+        long num_objects = atomic_long_read(&g_uvm_kvmalloc_size_classes.classes[i].num_objects);
+
+        // Leaked allocations are only freed with uvm_leak_checker=2. Otherwise
+        // leave the cache and its name behind rather than destroying a cache
+        // which still has objects.
+        if (num_objects != 0) {
+            printk(KERN_ERR NVIDIA_UVM_PRETTY_PRINTING_PREFIX "Not destroying cache %s with %ld leaked allocations\n",
+                   g_uvm_kvmalloc_size_classes.classes[i].name,
+                   num_objects);
+            continue;
+        }
+
+        kmem_cache_destroy_safe(&g_uvm_kvmalloc_size_classes.classes[i].cache);
+        kfree(g_uvm_kvmalloc_size_classes.classes[i].name);
+    }
+
+    memset(g_uvm_kvmalloc_size_classes.classes, 0, sizeof(g_uvm_kvmalloc_size_classes.classes));
+    g_uvm_kvmalloc_size_classes.count = 0;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static bool size_classes_enabled(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return g_uvm_kvmalloc_size_classes.count != 0;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Index of the class used for an object of the given size, including the
+// uvm_kmalloc_hdr_t
+static NvU8 size_class_index(size_t size)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (size == 0 || size > UVM_KVMALLOC_SIZE_CLASS_MAX_SIZE)
+        return UVM_KVMALLOC_SIZE_CLASS_NONE;
+
+    return g_uvm_kvmalloc_size_classes.lookup[DIV_ROUND_UP(size, UVM_KVMALLOC_SIZE_CLASS_GRANULARITY)];
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static uvm_kmalloc_hdr_t *get_kmalloc_hdr(void *p)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_kmalloc_hdr_t *hdr;
+    UVM_ASSERT(size_classes_enabled());
+    hdr = container_of(p, uvm_kmalloc_hdr_t, ptr);
+    UVM_ASSERT(hdr->class_index == UVM_KVMALLOC_SIZE_CLASS_NONE || hdr->class_index < g_uvm_kvmalloc_size_classes.count);
+    return hdr;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static size_t kmalloc_object_size(void *p)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_kmalloc_hdr_t *hdr;
+
+    if (!size_classes_enabled() || ZERO_OR_NULL_PTR(p))
+        return ksize(p);
+
+    hdr = get_kmalloc_hdr(p);
+    if (hdr->class_index == UVM_KVMALLOC_SIZE_CLASS_NONE)
+        return ksize(hdr) - sizeof(*hdr);
+
+    return g_uvm_kvmalloc_size_classes.classes[hdr->class_index].size - sizeof(*hdr);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void kmalloc_object_free(void *p)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_kmalloc_hdr_t *hdr;
+    size_t class_index;
+
+    if (!size_classes_enabled() || ZERO_OR_NULL_PTR(p)) {
+        kfree(p);
+        return;
+    }
+
+    hdr = get_kmalloc_hdr(p);
+    class_index = hdr->class_index;
+    if (class_index == UVM_KVMALLOC_SIZE_CLASS_NONE) {
+        kfree(hdr);
+        return;
+    }
+
+    kmem_cache_free(g_uvm_kvmalloc_size_classes.classes[class_index].cache, hdr);
+    atomic_long_dec(&g_uvm_kvmalloc_size_classes.classes[class_index].num_objects);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void *kmalloc_object_alloc(size_t size, bool zero_memory)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_kmalloc_hdr_t *hdr;
+    NvU8 class_index;
+
+    if (!size_classes_enabled() || size == 0) {
+        if (zero_memory)
+            return kzalloc(size, NV_UVM_GFP_FLAGS);
+        return kmalloc(size, NV_UVM_GFP_FLAGS);
+    }
+
+    class_index = size_class_index(sizeof(*hdr) + size);
+    if (class_index == UVM_KVMALLOC_SIZE_CLASS_NONE) {
+        if (zero_memory)
+            hdr = kzalloc(sizeof(*hdr) + size, NV_UVM_GFP_FLAGS);
+        else
+            hdr = kmalloc(sizeof(*hdr) + size, NV_UVM_GFP_FLAGS);
+    }
+    else {
+        struct kmem_cache *cache = g_uvm_kvmalloc_size_classes.classes[class_index].cache;
+
+        if (zero_memory)
+            hdr = nv_kmem_cache_zalloc(cache, NV_UVM_GFP_FLAGS);
+        else
+            hdr = kmem_cache_alloc(cache, NV_UVM_GFP_FLAGS);
+
+        if (hdr)
+            atomic_long_inc(&g_uvm_kvmalloc_size_classes.classes[class_index].num_objects);
+    }
+
+    if (!hdr)
+        return NULL;
+
+    hdr->class_index = class_index;
+    return hdr->ptr;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+bool uvm_kvmalloc_size_classes_enabled(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return size_classes_enabled();
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+size_t uvm_kvmalloc_size_class(size_t size)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU8 class_index;
+
+    if (size == 0)
+        return 0;
+
+    class_index = size_class_index(sizeof(uvm_kmalloc_hdr_t) + size);
+    if (class_index == UVM_KVMALLOC_SIZE_CLASS_NONE)
+        return 0;
+
+    return g_uvm_kvmalloc_size_classes.classes[class_index].size - sizeof(uvm_kmalloc_hdr_t);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static unsigned profile_bucket(size_t size)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (size <= 1)
+        return 0;
+
+    return min_t(unsigned, fls_long(size - 1), UVM_KVMALLOC_PROFILE_BUCKETS - 1);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static uvm_kvmalloc_profile_site_t *profile_site_get(const char *file, int line, const char *function)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    size_t mask = UVM_KVMALLOC_PROFILE_MAX_SITES - 1;
+    size_t start = (hash_ptr((void *)file, 32) ^ hash_32(line, 32)) & mask;
+    uvm_kvmalloc_profile_site_t *site = NULL;
+    unsigned long irq_flags;
+    size_t i;
+
+    // Fast path: the call site is already in the table
+    for (i = 0; i < UVM_KVMALLOC_PROFILE_MAX_SITES; ++i) {
+        uvm_kvmalloc_profile_site_t *entry = &g_uvm_kvmalloc_profile.sites[(start + i) & mask];
+        const char *entry_file = smp_load_acquire(&entry->file);
+
+        if (!entry_file)
+            break;
+
+        if (entry_file == file && entry->line == line)
+            return entry;
+    }
+
+    if (i == UVM_KVMALLOC_PROFILE_MAX_SITES)
+        return NULL;
+
+    spin_lock_irqsave(&g_uvm_kvmalloc_profile.lock, irq_flags);
+
+    // Retry under the lock in case another thread inserted the same call site
+    for (; i < UVM_KVMALLOC_PROFILE_MAX_SITES; ++i) {
+        uvm_kvmalloc_profile_site_t *entry = &g_uvm_kvmalloc_profile.sites[(start + i) & mask];
+
+        if (!entry->file) {
+            entry->line = line;
+            entry->function = function;
+            smp_store_release(&entry->file, file);
+            site = entry;
+            break;
+        }
+
+        if (entry->file == file && entry->line == line) {
+            site = entry;
+            break;
+        }
+    }
+
+    spin_unlock_irqrestore(&g_uvm_kvmalloc_profile.lock, irq_flags);
+
+    return site;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void profile_record(size_t size, const char *file, int line, const char *function)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_kvmalloc_profile_site_t *site = profile_site_get(file, line, function);
+
+    if (!site) {
+        atomic64_inc(&g_uvm_kvmalloc_profile.num_untracked);
+        return;
+    }
+
+    atomic64_inc(&site->num_allocations);
+    atomic64_add(size, &site->bytes_allocated);
+    atomic64_inc(&site->histogram[profile_bucket(size)]);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static int nv_procfs_read_kvmalloc_profile(struct seq_file *s, void *v)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    size_t i;
+    unsigned j;
+
+    if (!uvm_down_read_trylock(&g_uvm_global.pm.lock))
+            return -EAGAIN;
+
+    for (i = 0; i < UVM_KVMALLOC_PROFILE_MAX_SITES; ++i) {
+        uvm_kvmalloc_profile_site_t *site = &g_uvm_kvmalloc_profile.sites[i];
+        const char *file = smp_load_acquire(&site->file);
+
+        if (!file)
+            continue;
+
+        UVM_SEQ_OR_DBG_PRINT(s, "%s:%d:%s allocations %llu bytes %llu\n",
+                             kbasename(file),
+                             site->line,
+                             site->function,
+                             (NvU64)atomic64_read(&site->num_allocations),
+                             (NvU64)atomic64_read(&site->bytes_allocated));
+
+        for (j = 0; j < UVM_KVMALLOC_PROFILE_BUCKETS; ++j) {
+            NvU64 count = atomic64_read(&site->histogram[j]);
+
+            if (count == 0)
+                continue;
+
+            if (j == UVM_KVMALLOC_PROFILE_BUCKETS - 1)
+                UVM_SEQ_OR_DBG_PRINT(s, "    > %llu: %llu\n", 1ULL << (j - 1), count);
+            else
+                UVM_SEQ_OR_DBG_PRINT(s, "    <= %llu: %llu\n", 1ULL << j, count);
+        }
+    }
+
+    UVM_SEQ_OR_DBG_PRINT(s, "untracked allocations %llu\n", (NvU64)atomic64_read(&g_uvm_kvmalloc_profile.num_untracked));
+
+    uvm_up_read(&g_uvm_global.pm.lock);
+
+    return 0;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static int nv_procfs_read_kvmalloc_profile_entry(struct seq_file *s, void *v)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ENTRY_RET(nv_procfs_read_kvmalloc_profile(s, v));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+UVM_DEFINE_SINGLE_PROCFS_FILE(kvmalloc_profile_entry);
+
+NV_STATUS uvm_kvmalloc_procfs_init(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (!g_uvm_kvmalloc_profile.sites || !uvm_procfs_is_enabled())
+        return NV_OK;
+
+    UVM_ASSERT(!g_uvm_kvmalloc_profile.procfs_file);
+    g_uvm_kvmalloc_profile.procfs_file = NV_CREATE_PROC_FILE(UVM_KVMALLOC_PROFILE_FILE_NAME,
+                                                             uvm_procfs_get_base_dir(),
+                                                             kvmalloc_profile_entry,
+                                                             NULL);
+    if (!g_uvm_kvmalloc_profile.procfs_file)
+        return NV_ERR_OPERATING_SYSTEM;
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_kvmalloc_procfs_exit(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (g_uvm_kvmalloc_profile.procfs_file) {
+        uvm_procfs_destroy_entry(g_uvm_kvmalloc_profile.procfs_file);
+        g_uvm_kvmalloc_profile.procfs_file = NULL;
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 NV_STATUS uvm_kvmalloc_init(void)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+
+    status = size_classes_init();
+    if (status != NV_OK) {
+        size_classes_exit();
+        return status;
+    }
+
+    if (uvm_kvmalloc_profile) {
+        spin_lock_init(&g_uvm_kvmalloc_profile.lock);
+
+        // The table is only allocated once, so there is no need to track it
+        // with the leak checker
+        g_uvm_kvmalloc_profile.sites = vzalloc(UVM_KVMALLOC_PROFILE_MAX_SITES * sizeof(*g_uvm_kvmalloc_profile.sites));
+        if (!g_uvm_kvmalloc_profile.sites) {
+            size_classes_exit();
+            return NV_ERR_NO_MEMORY;
+        }
+    }
+
     if (uvm_leak_checker >= UVM_KVMALLOC_LEAK_CHECK_ORIGIN) {
         spin_lock_init(&g_uvm_leak_checker.lock);
         uvm_init_radix_tree_preloadable(&g_uvm_leak_checker.allocation_info);
 
         g_uvm_leak_checker.info_cache = NV_KMEM_CACHE_CREATE("uvm_kvmalloc_info_t", uvm_kvmalloc_info_t);
-        if (!g_uvm_leak_checker.info_cache)
+        if (!g_uvm_leak_checker.info_cache) {
+            if (g_uvm_kvmalloc_profile.sites) {
+                vfree(g_uvm_kvmalloc_profile.sites);
+                g_uvm_kvmalloc_profile.sites = NULL;
+            }
+            size_classes_exit();
             return NV_ERR_NO_MEMORY;
+        }
     }
 
     g_malloc_initialized = true;
@@ -146,6 +662,16 @@ void uvm_kvmalloc_exit(void)
         kmem_cache_destroy_safe(&g_uvm_leak_checker.info_cache);
     }
 
+    if (g_uvm_kvmalloc_profile.sites) {
+        vfree(g_uvm_kvmalloc_profile.sites);
+        g_uvm_kvmalloc_profile.sites = NULL;
+    }
+
+    // Leaked allocations from the size classes are only freed above with
+    // uvm_leak_checker=2, size_classes_exit keeps the caches which still have
+    // some.
+    size_classes_exit();
+
     g_malloc_initialized = false;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
@@ -190,7 +716,8 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 static void alloc_tracking_add(void *p, const char *file, int line, const char *function)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     // Add uvm_kvsize(p) instead of size because uvm_kvsize might be larger (due
-    // to ksize), and uvm_kvfree only knows about uvm_kvsize
+    // to ksize or the size classes), and uvm_kvfree only knows about
+    // uvm_kvsize
     size_t size = uvm_kvsize(p);
     uvm_kvmalloc_info_t *info;
 
@@ -258,11 +785,11 @@ static void *alloc_internal(size_t size, bool zero_memory)
     // Make sure that (sizeof(hdr) + size) is what it should be
     BUILD_BUG_ON(sizeof(uvm_vmalloc_hdr_t) != offsetof(uvm_vmalloc_hdr_t, ptr));
 
-    if (size <= UVM_KMALLOC_THRESHOLD) {
-        if (zero_memory)
-            return kzalloc(size, NV_UVM_GFP_FLAGS);
-        return kmalloc(size, NV_UVM_GFP_FLAGS);
-    }
+    BUILD_BUG_ON(sizeof(uvm_kmalloc_hdr_t) != sizeof(uvm_vmalloc_hdr_t));
+    BUILD_BUG_ON(offsetof(uvm_kmalloc_hdr_t, ptr) != sizeof(uvm_kmalloc_hdr_t));
+
+    if (size <= UVM_KMALLOC_THRESHOLD)
+        return kmalloc_object_alloc(size, zero_memory);
 
     if (zero_memory)
         hdr = vzalloc(sizeof(*hdr) + size);
@@ -280,6 +807,9 @@ void *__uvm_kvmalloc(size_t size, const char *file, int line, const char *functi
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     void *p = alloc_internal(size, false);
 
+    if (g_uvm_kvmalloc_profile.sites)
+        profile_record(size, file, line, function);
+
     if (uvm_leak_checker && p)
         alloc_tracking_add(p, file, line, function);
 
@@ -290,6 +820,9 @@ void *__uvm_kvmalloc_zero(size_t size, const char *file, int line, const char *f
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     void *p = alloc_internal(size, true);
 
+    if (g_uvm_kvmalloc_profile.sites)
+        profile_record(size, file, line, function);
+
     if (uvm_leak_checker && p)
         alloc_tracking_add(p, file, line, function);
 
@@ -307,24 +840,43 @@ void uvm_kvfree(void *p)
     if (is_vmalloc_addr(p))
         vfree(get_hdr(p));
     else
-        kfree(p);
+        kmalloc_object_free(p);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 // Handle reallocs of kmalloc-based allocations
 static void *realloc_from_kmalloc(void *p, size_t new_size)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    size_t old_size;
     void *new_p;
 
     // Simple case: kmalloc -> kmalloc
-    if (new_size <= UVM_KMALLOC_THRESHOLD)
+    if (new_size <= UVM_KMALLOC_THRESHOLD && !size_classes_enabled())
         return krealloc(p, new_size, NV_UVM_GFP_FLAGS);
 
-    // kmalloc -> vmalloc
+    // krealloc only handles objects from the generic kmalloc caches. The
+    // header is copied along with the data, so its class index stays valid.
+    if (new_size != 0 &&
+        new_size <= UVM_KMALLOC_THRESHOLD &&
+        uvm_kvmalloc_size_class(new_size) == 0 &&
+        get_kmalloc_hdr(p)->class_index == UVM_KVMALLOC_SIZE_CLASS_NONE) {
+        uvm_kmalloc_hdr_t *new_hdr = krealloc(get_kmalloc_hdr(p), sizeof(*new_hdr) + new_size, NV_UVM_GFP_FLAGS);
+        if (!new_hdr)
+            return NULL;
+        return new_hdr->ptr;
+    }
+
+    if (new_size == 0) {
+        kmalloc_object_free(p);
+        return ZERO_SIZE_PTR; // What krealloc returns for this case
+    }
+
+    // Size classes and kmalloc -> vmalloc
+    old_size = kmalloc_object_size(p);
     new_p = alloc_internal(new_size, false);
     if (!new_p)
         return NULL;
-    memcpy(new_p, p, min(ksize(p), new_size));
-    kfree(p);
+    memcpy(new_p, p, min(old_size, new_size));
+    kmalloc_object_free(p);
     return new_p;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
@@ -364,6 +916,9 @@ void *__uvm_kvrealloc(void *p, size_t new_size, const char *file, int line, cons
 
     old_size = uvm_kvsize(p);
 
+    if (g_uvm_kvmalloc_profile.sites && new_size != 0)
+        profile_record(new_size, file, line, function);
+
     if (uvm_leak_checker) {
         // new_size == 0 is a free, so just remove everything
         if (new_size == 0) {
@@ -409,5 +964,5 @@ size_t uvm_kvsize(void *p)
     UVM_ASSERT(p);
     if (is_vmalloc_addr(p))
         return get_hdr(p)->alloc_size;
-    return ksize(p);
+    return kmalloc_object_size(p);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
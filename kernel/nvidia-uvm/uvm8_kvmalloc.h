@@ -46,6 +46,12 @@
 NV_STATUS uvm_kvmalloc_init(void);
 void uvm_kvmalloc_exit(void);
 
+// Create and destroy the procfs file of the allocation profiling mode. These
+// are separate from uvm_kvmalloc_init/uvm_kvmalloc_exit since the kvmalloc
+// layer is initialized before procfs.
+NV_STATUS uvm_kvmalloc_procfs_init(void);
+void uvm_kvmalloc_procfs_exit(void);
+
 // Allocating a size of 0 with any of these APIs returns ZERO_SIZE_PTR
 void *__uvm_kvmalloc(size_t size, const char *file, int line, const char *function);
 void *__uvm_kvmalloc_zero(size_t size, const char *file, int line, const char *function);
@@ -70,6 +76,16 @@ void *__uvm_kvrealloc(void *p, size_t new_size, const char *file, int line, cons
 // p must not be NULL.
 size_t uvm_kvsize(void *p);
 
+// Small allocations of frequently used sizes can be served from dedicated slab
+// caches (size classes) instead of the generic kmalloc caches, when a class
+// fits the size more tightly. The classes are configured with the
+// uvm_kvmalloc_size_classes module parameter, and there are none by default.
+bool uvm_kvmalloc_size_classes_enabled(void);
+
+// Returns the usable size of the class used for allocations of the given size,
+// or 0 if the allocation is served by kmalloc or vmalloc.
+size_t uvm_kvmalloc_size_class(size_t size);
+
 NV_STATUS uvm8_test_kvmalloc(UVM_TEST_KVMALLOC_PARAMS *params, struct file *filp);
 
 #endif // __UVM8_KVMALLOC_H__
@@ -42,6 +42,11 @@ static NV_STATUS check_alloc(void *p, size_t size)
         TEST_CHECK_RET(p == ZERO_SIZE_PTR);
         TEST_CHECK_RET(uvm_kvsize(p) == 0);
     }
+    else if (size <= UVM_KMALLOC_THRESHOLD && uvm_kvmalloc_size_class(size) != 0) {
+        // Objects from the size classes can't be sized with ksize
+        TEST_CHECK_RET(!is_vmalloc_addr(p));
+        TEST_CHECK_RET(uvm_kvsize(p) == uvm_kvmalloc_size_class(size));
+    }
     else if (size <= UVM_KMALLOC_THRESHOLD) {
         TEST_CHECK_RET(!is_vmalloc_addr(p));
 
@@ -49,7 +54,11 @@ static NV_STATUS check_alloc(void *p, size_t size)
         // than our arbitrary UVM_KMALLOC_THRESHOLD. In practice, as long as
         // UVM_KMALLOC_THRESHOLD is a multiple of PAGE_SIZE, that's highly
         // unlikely.
-        TEST_CHECK_RET(uvm_kvsize(p) == ksize(p));
+        //
+        // With size classes enabled the allocation starts after a header, so
+        // ksize doesn't apply to it.
+        if (!uvm_kvmalloc_size_classes_enabled())
+            TEST_CHECK_RET(uvm_kvsize(p) == ksize(p));
         TEST_CHECK_RET(uvm_kvsize(p) >= size);
     }
     else {
@@ -176,10 +185,144 @@ static NV_STATUS test_uvm_kvrealloc(void)
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Interleave allocations from the smallest class with PAGE_SIZE ones, which
+// are always served by kmalloc, and free half of them to check that every
+// allocation keeps its size and data regardless of where it came from.
+static NV_STATUS test_uvm_kvmalloc_size_class_mixed(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    size_t class_size = 0;
+    size_t num_objects;
+    size_t size;
+    size_t i, k;
+    uint8_t **objects;
+
+    for (size = 1; size <= UVM_KMALLOC_THRESHOLD && class_size == 0; ++size)
+        class_size = uvm_kvmalloc_size_class(size);
+
+    // Size classes are disabled
+    if (class_size == 0)
+        return NV_OK;
+
+    num_objects = 8 * PAGE_SIZE / class_size;
+    objects = uvm_kvmalloc_zero(num_objects * sizeof(*objects));
+    if (!objects)
+        return NV_ERR_NO_MEMORY;
+
+    for (i = 0; i < num_objects; ++i) {
+        size = (i % 2) ? PAGE_SIZE : class_size;
+        objects[i] = uvm_kvmalloc(size);
+        if (!objects[i]) {
+            status = NV_ERR_NO_MEMORY;
+            goto done;
+        }
+        TEST_NV_CHECK_GOTO(check_alloc(objects[i], size), done);
+        memset(objects[i], (uint8_t)i, size);
+    }
+
+    for (i = 0; i < num_objects; i += 4) {
+        uvm_kvfree(objects[i]);
+        objects[i] = NULL;
+        if (i + 1 < num_objects) {
+            uvm_kvfree(objects[i + 1]);
+            objects[i + 1] = NULL;
+        }
+    }
+
+    for (i = 0; i < num_objects; ++i) {
+        if (!objects[i])
+            continue;
+
+        size = (i % 2) ? PAGE_SIZE : class_size;
+        TEST_NV_CHECK_GOTO(check_alloc(objects[i], size), done);
+        for (k = 0; k < size; k++) {
+            if (objects[i][k] != (uint8_t)i) {
+                UVM_TEST_PRINT("objects[%zu][%zu] is 0x%x instead of expected value 0x%x\n",
+                               i,
+                               k,
+                               objects[i][k],
+                               (uint8_t)i);
+                status = NV_ERR_INVALID_STATE;
+                goto done;
+            }
+        }
+    }
+
+done:
+    for (i = 0; i < num_objects; ++i)
+        uvm_kvfree(objects[i]);
+    uvm_kvfree(objects);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS test_uvm_kvmalloc_size_classes(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    size_t size, new_size, class_size, k;
+    uint8_t *p, *new_p;
+    uint8_t expected = (uint8_t)current->pid;
+
+    for (size = 1; size <= 2 * PAGE_SIZE; size += (size < 1024 ? 7 : 97)) {
+        class_size = uvm_kvmalloc_size_class(size);
+        if (class_size != 0)
+            TEST_CHECK_RET(class_size >= size);
+
+        p = uvm_kvmalloc(size);
+        if (!p)
+            return NV_ERR_NO_MEMORY;
+        MEM_NV_CHECK_RET(check_alloc(p, size), NV_OK);
+
+        ++expected;
+        memset(p, expected, size);
+
+        // Grow the allocation out of its class, which has to preserve the data
+        new_size = 2 * size + 1;
+        new_p = uvm_kvrealloc(p, new_size);
+        if (!new_p) {
+            uvm_kvfree(p);
+            return NV_ERR_NO_MEMORY;
+        }
+        MEM_NV_CHECK_RET(check_alloc(new_p, new_size), NV_OK);
+
+        for (k = 0; k < size; k++) {
+            if (new_p[k] != expected) {
+                UVM_TEST_PRINT("new_p[%zu] is 0x%x instead of expected value 0x%x\n", k, new_p[k], expected);
+                uvm_kvfree(new_p);
+                TEST_CHECK_RET(0);
+            }
+        }
+
+        uvm_kvfree(new_p);
+
+        p = uvm_kvmalloc_zero(size);
+        if (!p)
+            return NV_ERR_NO_MEMORY;
+        MEM_NV_CHECK_RET(check_alloc(p, size), NV_OK);
+
+        for (k = 0; k < size; k++) {
+            if (p[k] != 0) {
+                UVM_TEST_PRINT("p[%zu] is 0x%x instead of 0\n", k, p[k]);
+                uvm_kvfree(p);
+                TEST_CHECK_RET(0);
+            }
+        }
+
+        uvm_kvfree(p);
+    }
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 NV_STATUS uvm8_test_kvmalloc(UVM_TEST_KVMALLOC_PARAMS *params, struct file *filp)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NV_STATUS status = test_uvm_kvmalloc();
     if (status != NV_OK)
         return status;
-    return test_uvm_kvrealloc();
+    status = test_uvm_kvrealloc();
+    if (status != NV_OK)
+        return status;
+    status = test_uvm_kvmalloc_size_classes();
+    if (status != NV_OK)
+        return status;
+    return test_uvm_kvmalloc_size_class_mixed();
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
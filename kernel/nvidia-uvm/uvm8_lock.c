@@ -26,6 +26,22 @@
 #include "uvm8_thread_context.h"
 #include "uvm8_kvmalloc.h"
 
+static int uvm_lock_tracking = UVM_IS_DEBUG();
+module_param(uvm_lock_tracking, int, S_IRUGO);
+MODULE_PARM_DESC(uvm_lock_tracking,
+                 "Track the locks held by each thread and validate the lock order (1) or not (0). "
+                 "Required by the lock tracking builtin tests. Default: 1 on debug builds, 0 otherwise.");
+
+UVM_DEFINE_STATIC_KEY_FALSE(g_uvm_lock_tracking_key);
+
+void uvm_lock_tracking_init(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ASSERT(!uvm_thread_context_global_initialized());
+
+    if (uvm_lock_tracking)
+        uvm_static_branch_enable(&g_uvm_lock_tracking_key);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 const char *uvm_lock_order_to_string(uvm_lock_order_t lock_order)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     BUILD_BUG_ON(UVM_LOCK_ORDER_COUNT != 26);
@@ -356,10 +372,8 @@ NV_STATUS uvm_bit_locks_init(uvm_bit_locks_t *bit_locks, size_t count, uvm_lock_
     if (!bit_locks->bits)
         return NV_ERR_NO_MEMORY;
 
-#if UVM_IS_DEBUG()
     uvm_locking_assert_initialized();
     bit_locks->lock_order = lock_order;
-#endif
 
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
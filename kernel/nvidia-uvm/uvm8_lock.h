@@ -454,106 +454,164 @@ bool __uvm_thread_check_all_unlocked(void);
 // Check that the locking infrastructure has been initialized
 bool __uvm_locking_initialized(void);
 
-#if UVM_IS_DEBUG()
-  // These macros are intended to be expanded on the call site directly and will print
-  // the precise location of the violation while the __uvm_record* functions will error print the details.
-  #define uvm_record_lock_raw(lock, lock_order, flags) \
-      UVM_ASSERT_MSG(__uvm_record_lock((lock), (lock_order), (flags)), "Locking violation\n")
-  #define uvm_record_unlock_raw(lock, lock_order, flags) \
-      UVM_ASSERT_MSG(__uvm_record_unlock((lock), (lock_order), (flags)), "Locking violation\n")
-  #define uvm_record_downgrade_raw(lock, lock_order) \
-      UVM_ASSERT_MSG(__uvm_record_downgrade((lock), (lock_order)), "Locking violation\n")
-
-  // Record UVM lock (a lock that has a lock_order member) operation and assert that it's correct
-  #define uvm_record_lock(lock, flags) \
-      uvm_record_lock_raw((lock), (lock)->lock_order, (flags))
-  #define uvm_record_unlock(lock, flags) uvm_record_unlock_raw((lock), (lock)->lock_order, (flags))
-  #define uvm_record_unlock_out_of_order(lock, flags) \
-            uvm_record_unlock_raw((lock), (lock)->lock_order, (flags) | UVM_LOCK_FLAGS_OUT_OF_ORDER)
-  #define uvm_record_downgrade(lock) uvm_record_downgrade_raw((lock), (lock)->lock_order)
-
-  // Check whether a UVM lock (a lock that has a lock_order member) is held in
-  // the given mode.
-  #define uvm_check_locked(lock, flags) __uvm_check_locked((lock), (lock)->lock_order, (flags))
-
-  // Helpers for recording and asserting mmap_sem state
-  #define uvm_record_lock_mmap_sem_read(mmap_sem) \
-          uvm_record_lock_raw((mmap_sem), UVM_LOCK_ORDER_MMAP_SEM, UVM_LOCK_FLAGS_MODE_SHARED)
-
-  #define uvm_record_unlock_mmap_sem_read(mmap_sem) \
-          uvm_record_unlock_raw((mmap_sem), UVM_LOCK_ORDER_MMAP_SEM, UVM_LOCK_FLAGS_MODE_SHARED)
-
-  #define uvm_record_unlock_mmap_sem_read_out_of_order(mmap_sem) \
-          uvm_record_unlock_raw((mmap_sem), UVM_LOCK_ORDER_MMAP_SEM, \
-                                UVM_LOCK_FLAGS_MODE_SHARED | UVM_LOCK_FLAGS_OUT_OF_ORDER)
-
-  #define uvm_record_lock_mmap_sem_write(mmap_sem) \
-          uvm_record_lock_raw((mmap_sem), UVM_LOCK_ORDER_MMAP_SEM, UVM_LOCK_FLAGS_MODE_EXCLUSIVE)
-
-  #define uvm_record_unlock_mmap_sem_write(mmap_sem) \
-          uvm_record_unlock_raw((mmap_sem), UVM_LOCK_ORDER_MMAP_SEM, UVM_LOCK_FLAGS_MODE_EXCLUSIVE)
-
-  #define uvm_record_unlock_mmap_sem_write_out_of_order(mmap_sem) \
-          uvm_record_unlock_raw((mmap_sem), UVM_LOCK_ORDER_MMAP_SEM, \
-                                UVM_LOCK_FLAGS_MODE_EXCLUSIVE | UVM_LOCK_FLAGS_OUT_OF_ORDER)
-
-  #define uvm_check_locked_mmap_sem(mmap_sem, flags) \
-           __uvm_check_locked((mmap_sem), UVM_LOCK_ORDER_MMAP_SEM, (flags))
-
-  // Helpers for recording RM API lock usage around UVM-RM interfaces
-  #define uvm_record_lock_rm_api() \
-          uvm_record_lock_raw((void*)UVM_LOCK_ORDER_RM_API, UVM_LOCK_ORDER_RM_API, \
-                              UVM_LOCK_FLAGS_MODE_EXCLUSIVE)
-  #define uvm_record_unlock_rm_api() \
-          uvm_record_unlock_raw((void*)UVM_LOCK_ORDER_RM_API, UVM_LOCK_ORDER_RM_API, \
-                                UVM_LOCK_FLAGS_MODE_EXCLUSIVE)
-
-  // Helpers for recording RM GPUS lock usage around UVM-RM interfaces
-  #define uvm_record_lock_rm_gpus() \
-          uvm_record_lock_raw((void*)UVM_LOCK_ORDER_RM_GPUS, UVM_LOCK_ORDER_RM_GPUS, \
-                              UVM_LOCK_FLAGS_MODE_EXCLUSIVE)
-  #define uvm_record_unlock_rm_gpus() \
-          uvm_record_unlock_raw((void*)UVM_LOCK_ORDER_RM_GPUS, UVM_LOCK_ORDER_RM_GPUS, \
-                                UVM_LOCK_FLAGS_MODE_EXCLUSIVE)
-
-  // Helpers for recording both RM locks usage around UVM-RM interfaces
-  #define uvm_record_lock_rm_all() ({ uvm_record_lock_rm_api(); uvm_record_lock_rm_gpus(); })
-  #define uvm_record_unlock_rm_all() ({ uvm_record_unlock_rm_gpus(); uvm_record_unlock_rm_api(); })
-
-#else
-  #define uvm_record_lock                               UVM_IGNORE_EXPR2
-  #define uvm_record_unlock                             UVM_IGNORE_EXPR2
-  #define uvm_record_unlock_out_of_order                UVM_IGNORE_EXPR2
-  #define uvm_record_downgrade                          UVM_IGNORE_EXPR
+// Lock tracking records the locks held by each thread and validates the
+// locking rules on every lock operation. It is enabled with the
+// uvm_lock_tracking module parameter, which defaults to enabled on debug builds
+// only, and is gated by a static key. When disabled, each record or check site
+// costs a single patched-out branch, so the same binary can be used for running
+// the builtin tests and in production. When enabled, violations are reported on
+// all build types.
+UVM_DECLARE_STATIC_KEY_FALSE(g_uvm_lock_tracking_key);
+
+#define uvm_lock_tracking_enabled() uvm_static_branch_unlikely(&g_uvm_lock_tracking_key)
+
+// Set up lock tracking according to the module parameter. Must be called
+// before the first thread context is added, since the thread context layout
+// depends on whether lock tracking is enabled, and it cannot be changed
+// afterwards.
+void uvm_lock_tracking_init(void);
+
+// Lock profiling accounts, per lock order, how many acquisitions of the
+// mutexes, rw semaphores and spinlocks of that order were contended, how long
+// they waited for the lock, how long the lock was held in exclusive mode and
+// which call sites contend the most. It is enabled with the uvm_lock_profiling
+// module parameter and gated by a static key, like lock tracking. The results
+// are dumped in the lock_contention procfs file.
+UVM_DECLARE_STATIC_KEY_FALSE(g_uvm_lock_profiling_key);
+
+#define uvm_lock_profiling_enabled() uvm_static_branch_unlikely(&g_uvm_lock_profiling_key)
+
+// Set up lock profiling according to the module parameter and create its procfs
+// file. Must be called after uvm_procfs_init().
+NV_STATUS uvm_lock_profile_init(void);
+void uvm_lock_profile_exit(void);
+
+// Record an acquisition of a lock of given lock_order from the ip call site.
+// wait_ns is the time spent waiting for the lock if the acquisition was
+// contended.
+void __uvm_lock_profile_acquired(uvm_lock_order_t lock_order, bool contended, NvU64 wait_ns, unsigned long ip);
+
+// Record the release of a lock of given lock_order held in exclusive mode for
+// hold_ns.
+void __uvm_lock_profile_released(uvm_lock_order_t lock_order, NvU64 hold_ns);
+
+// Acquire a UVM lock by evaluating lock_expr. When lock profiling is enabled,
+// trylock_expr is evaluated first and, only if it fails, the acquisition is
+// accounted as contended and the blocking lock_expr is timed.
+#define uvm_lock_profile_acquire(uvm_lock_, trylock_expr, lock_expr) ({          \
+        if (uvm_lock_profiling_enabled()) {                                      \
+            bool _contended = !(trylock_expr);                                   \
+            NvU64 _wait_ns = 0;                                                  \
+            if (_contended) {                                                    \
+                NvU64 _wait_start = NV_GETTIME();                                \
+                lock_expr;                                                       \
+                _wait_ns = NV_GETTIME() - _wait_start;                           \
+            }                                                                    \
+            __uvm_lock_profile_acquired((uvm_lock_)->lock_order,                 \
+                                        _contended,                              \
+                                        _wait_ns,                                \
+                                        _THIS_IP_);                              \
+        }                                                                        \
+        else {                                                                   \
+            lock_expr;                                                           \
+        }                                                                        \
+    })
 
-  static bool uvm_check_locked(void *lock, uvm_lock_flags_t flags)
-  {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-      return false;
-  pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+// Start and end the hold time accounting of a UVM lock acquired in exclusive
+// mode. The end has to be recorded while the lock is still held. Locks
+// acquired before profiling got enabled have no start time and are skipped.
+#define uvm_lock_profile_hold_start(uvm_lock_) ({                                \
+        if (uvm_lock_profiling_enabled())                                        \
+            (uvm_lock_)->profile_acquire_time = NV_GETTIME();                    \
+    })
 
-  #define uvm_record_lock_mmap_sem_read                 UVM_IGNORE_EXPR
-  #define uvm_record_unlock_mmap_sem_read               UVM_IGNORE_EXPR
-  #define uvm_record_unlock_mmap_sem_read_out_of_order  UVM_IGNORE_EXPR
-  #define uvm_record_lock_mmap_sem_write                UVM_IGNORE_EXPR
-  #define uvm_record_unlock_mmap_sem_write              UVM_IGNORE_EXPR
-  #define uvm_record_unlock_mmap_sem_write_out_of_order UVM_IGNORE_EXPR
+#define uvm_lock_profile_hold_end(uvm_lock_) ({                                            \
+        if (uvm_lock_profiling_enabled() && (uvm_lock_)->profile_acquire_time) {           \
+            __uvm_lock_profile_released((uvm_lock_)->lock_order,                           \
+                                        NV_GETTIME() - (uvm_lock_)->profile_acquire_time); \
+            (uvm_lock_)->profile_acquire_time = 0;                                         \
+        }                                                                                  \
+    })
 
-  #define uvm_check_locked_mmap_sem                     uvm_check_locked
+// These macros are intended to be expanded on the call site directly and will print
+// the precise location of the violation while the __uvm_record* functions will error print the details.
+#define uvm_record_lock_raw(lock, lock_order, flags) ({                                                     \
+      if (uvm_lock_tracking_enabled())                                                                    \
+          UVM_ASSERT_MSG_RELEASE(__uvm_record_lock((lock), (lock_order), (flags)), "Locking violation\n");  \
+  })
+#define uvm_record_unlock_raw(lock, lock_order, flags) ({                                                   \
+      if (uvm_lock_tracking_enabled())                                                                    \
+          UVM_ASSERT_MSG_RELEASE(__uvm_record_unlock((lock), (lock_order), (flags)), "Locking violation\n"); \
+  })
+#define uvm_record_downgrade_raw(lock, lock_order) ({                                                       \
+      if (uvm_lock_tracking_enabled())                                                                    \
+          UVM_ASSERT_MSG_RELEASE(__uvm_record_downgrade((lock), (lock_order)), "Locking violation\n");      \
+  })
 
-  #define uvm_record_lock_rm_api()
-  #define uvm_record_unlock_rm_api()
+// Record UVM lock (a lock that has a lock_order member) operation and assert that it's correct
+#define uvm_record_lock(lock, flags) \
+    uvm_record_lock_raw((lock), (lock)->lock_order, (flags))
+#define uvm_record_unlock(lock, flags) uvm_record_unlock_raw((lock), (lock)->lock_order, (flags))
+#define uvm_record_unlock_out_of_order(lock, flags) \
+          uvm_record_unlock_raw((lock), (lock)->lock_order, (flags) | UVM_LOCK_FLAGS_OUT_OF_ORDER)
+#define uvm_record_downgrade(lock) uvm_record_downgrade_raw((lock), (lock)->lock_order)
+
+// Check whether a UVM lock (a lock that has a lock_order member) is held in
+// the given mode. Always true if lock tracking is disabled.
+#define uvm_check_locked(lock, flags) \
+    (!uvm_lock_tracking_enabled() || __uvm_check_locked((lock), (lock)->lock_order, (flags)))
+
+// Helpers for recording and asserting mmap_sem state
+#define uvm_record_lock_mmap_sem_read(mmap_sem) \
+        uvm_record_lock_raw((mmap_sem), UVM_LOCK_ORDER_MMAP_SEM, UVM_LOCK_FLAGS_MODE_SHARED)
+
+#define uvm_record_unlock_mmap_sem_read(mmap_sem) \
+        uvm_record_unlock_raw((mmap_sem), UVM_LOCK_ORDER_MMAP_SEM, UVM_LOCK_FLAGS_MODE_SHARED)
+
+#define uvm_record_unlock_mmap_sem_read_out_of_order(mmap_sem) \
+        uvm_record_unlock_raw((mmap_sem), UVM_LOCK_ORDER_MMAP_SEM, \
+                              UVM_LOCK_FLAGS_MODE_SHARED | UVM_LOCK_FLAGS_OUT_OF_ORDER)
+
+#define uvm_record_lock_mmap_sem_write(mmap_sem) \
+        uvm_record_lock_raw((mmap_sem), UVM_LOCK_ORDER_MMAP_SEM, UVM_LOCK_FLAGS_MODE_EXCLUSIVE)
+
+#define uvm_record_unlock_mmap_sem_write(mmap_sem) \
+        uvm_record_unlock_raw((mmap_sem), UVM_LOCK_ORDER_MMAP_SEM, UVM_LOCK_FLAGS_MODE_EXCLUSIVE)
+
+#define uvm_record_unlock_mmap_sem_write_out_of_order(mmap_sem) \
+        uvm_record_unlock_raw((mmap_sem), UVM_LOCK_ORDER_MMAP_SEM, \
+                              UVM_LOCK_FLAGS_MODE_EXCLUSIVE | UVM_LOCK_FLAGS_OUT_OF_ORDER)
+
+#define uvm_check_locked_mmap_sem(mmap_sem, flags) \
+        (!uvm_lock_tracking_enabled() || __uvm_check_locked((mmap_sem), UVM_LOCK_ORDER_MMAP_SEM, (flags)))
+
+// Helpers for recording RM API lock usage around UVM-RM interfaces
+#define uvm_record_lock_rm_api() \
+        uvm_record_lock_raw((void*)UVM_LOCK_ORDER_RM_API, UVM_LOCK_ORDER_RM_API, \
+                            UVM_LOCK_FLAGS_MODE_EXCLUSIVE)
+#define uvm_record_unlock_rm_api() \
+        uvm_record_unlock_raw((void*)UVM_LOCK_ORDER_RM_API, UVM_LOCK_ORDER_RM_API, \
+                              UVM_LOCK_FLAGS_MODE_EXCLUSIVE)
 
-  #define uvm_record_lock_rm_gpus()
-  #define uvm_record_unlock_rm_gpus()
+// Helpers for recording RM GPUS lock usage around UVM-RM interfaces
+#define uvm_record_lock_rm_gpus() \
+        uvm_record_lock_raw((void*)UVM_LOCK_ORDER_RM_GPUS, UVM_LOCK_ORDER_RM_GPUS, \
+                            UVM_LOCK_FLAGS_MODE_EXCLUSIVE)
+#define uvm_record_unlock_rm_gpus() \
+        uvm_record_unlock_raw((void*)UVM_LOCK_ORDER_RM_GPUS, UVM_LOCK_ORDER_RM_GPUS, \
+                              UVM_LOCK_FLAGS_MODE_EXCLUSIVE)
 
-  #define uvm_record_lock_rm_all()
-  #define uvm_record_unlock_rm_all()
-#endif
+// Helpers for recording both RM locks usage around UVM-RM interfaces
+#define uvm_record_lock_rm_all() ({ uvm_record_lock_rm_api(); uvm_record_lock_rm_gpus(); })
+#define uvm_record_unlock_rm_all() ({ uvm_record_unlock_rm_gpus(); uvm_record_unlock_rm_api(); })
 
 #define uvm_locking_assert_initialized() UVM_ASSERT(__uvm_locking_initialized())
-#define uvm_thread_assert_all_unlocked() UVM_ASSERT(__uvm_thread_check_all_unlocked())
-#define uvm_assert_lockable_order(order) UVM_ASSERT(__uvm_check_lockable_order(order, UVM_LOCK_FLAGS_MODE_ANY))
-#define uvm_assert_unlocked_order(order) UVM_ASSERT(__uvm_check_unlocked_order(order))
+#define uvm_thread_assert_all_unlocked() \
+    UVM_ASSERT(!uvm_lock_tracking_enabled() || __uvm_thread_check_all_unlocked())
+#define uvm_assert_lockable_order(order) \
+    UVM_ASSERT(!uvm_lock_tracking_enabled() || __uvm_check_lockable_order(order, UVM_LOCK_FLAGS_MODE_ANY))
+#define uvm_assert_unlocked_order(order) \
+    UVM_ASSERT(!uvm_lock_tracking_enabled() || __uvm_check_unlocked_order(order))
 
 // Helpers for locking mmap_sem and recording its usage
 #define uvm_assert_mmap_sem_locked_mode(mmap_sem, flags) ({                          \
@@ -617,9 +675,11 @@ bool __uvm_locking_initialized(void);
 typedef struct
 {
     struct rw_semaphore sem;
-#if UVM_IS_DEBUG()
     uvm_lock_order_t lock_order;
-#endif
+
+    // Acquisition time in exclusive mode, only set when lock profiling is
+    // enabled
+    NvU64 profile_acquire_time;
 } uvm_rw_semaphore_t;
 
 //
@@ -647,18 +707,19 @@ typedef struct
 static void uvm_init_rwsem(uvm_rw_semaphore_t *uvm_sem, uvm_lock_order_t lock_order)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     init_rwsem(&uvm_sem->sem);
-#if UVM_IS_DEBUG()
     uvm_locking_assert_initialized();
     uvm_sem->lock_order = lock_order;
-#endif
+    uvm_sem->profile_acquire_time = 0;
     uvm_assert_rwsem_unlocked(uvm_sem);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-#define uvm_down_read(uvm_sem) ({                          \
-        typeof(uvm_sem) _sem = (uvm_sem);                  \
-        uvm_record_lock(_sem, UVM_LOCK_FLAGS_MODE_SHARED); \
-        down_read(&_sem->sem);                             \
-        uvm_assert_rwsem_locked_read(_sem);                \
+#define uvm_down_read(uvm_sem) ({                               \
+        typeof(uvm_sem) _sem = (uvm_sem);                       \
+        uvm_record_lock(_sem, UVM_LOCK_FLAGS_MODE_SHARED);      \
+        uvm_lock_profile_acquire(_sem,                          \
+                                 down_read_trylock(&_sem->sem), \
+                                 down_read(&_sem->sem));        \
+        uvm_assert_rwsem_locked_read(_sem);                     \
     })
 
 #define uvm_up_read(uvm_sem) ({                              \
@@ -678,11 +739,14 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
         up_read(&_sem->sem);                                 \
     })
 
-#define uvm_down_write(uvm_sem) ({                            \
-        typeof (uvm_sem) _sem = (uvm_sem);                    \
-        uvm_record_lock(_sem, UVM_LOCK_FLAGS_MODE_EXCLUSIVE); \
-        down_write(&_sem->sem);                               \
-        uvm_assert_rwsem_locked_write(_sem);                  \
+#define uvm_down_write(uvm_sem) ({                               \
+        typeof (uvm_sem) _sem = (uvm_sem);                       \
+        uvm_record_lock(_sem, UVM_LOCK_FLAGS_MODE_EXCLUSIVE);    \
+        uvm_lock_profile_acquire(_sem,                           \
+                                 down_write_trylock(&_sem->sem), \
+                                 down_write(&_sem->sem));        \
+        uvm_lock_profile_hold_start(_sem);                       \
+        uvm_assert_rwsem_locked_write(_sem);                     \
     })
 
 // trylock for reading: returns 1 if successful, 0 if not.  Out-of-order lock
@@ -724,14 +788,17 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
         locked = down_write_trylock(&_sem->sem);                                       \
         if (locked == 0)                                                               \
             uvm_record_unlock(_sem, UVM_LOCK_FLAGS_MODE_EXCLUSIVE);                    \
-        else                                                                           \
+        else {                                                                         \
+            uvm_lock_profile_hold_start(_sem);                                         \
             uvm_assert_rwsem_locked_write(_sem);                                       \
+        }                                                                              \
         locked;                                                                        \
     })
 
 #define uvm_up_write(uvm_sem) ({                                \
         typeof(uvm_sem) _sem = (uvm_sem);                       \
         uvm_assert_rwsem_locked_write(_sem);                    \
+        uvm_lock_profile_hold_end(_sem);                        \
         up_write(&_sem->sem);                                   \
         uvm_record_unlock(_sem, UVM_LOCK_FLAGS_MODE_EXCLUSIVE); \
     })
@@ -739,6 +806,7 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 #define uvm_downgrade_write(uvm_sem) ({                 \
         typeof(uvm_sem) _sem = (uvm_sem);               \
         uvm_assert_rwsem_locked_write(_sem);            \
+        uvm_lock_profile_hold_end(_sem);                \
         downgrade_write(&_sem->sem);                    \
         uvm_record_downgrade(_sem);                     \
     })
@@ -746,9 +814,10 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 typedef struct
 {
     struct mutex m;
-#if UVM_IS_DEBUG()
     uvm_lock_order_t lock_order;
-#endif
+
+    // Acquisition time, only set when lock profiling is enabled
+    NvU64 profile_acquire_time;
 } uvm_mutex_t;
 
 //
@@ -769,17 +838,19 @@ typedef struct
 static void uvm_mutex_init(uvm_mutex_t *mutex, uvm_lock_order_t lock_order)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     mutex_init(&mutex->m);
-#if UVM_IS_DEBUG()
     uvm_locking_assert_initialized();
     mutex->lock_order = lock_order;
-#endif
+    mutex->profile_acquire_time = 0;
     uvm_assert_mutex_unlocked(mutex);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 #define uvm_mutex_lock(mutex) ({                                \
         typeof(mutex) _mutex = (mutex);                         \
         uvm_record_lock(_mutex, UVM_LOCK_FLAGS_MODE_EXCLUSIVE); \
-        mutex_lock(&_mutex->m);                                 \
+        uvm_lock_profile_acquire(_mutex,                        \
+                                 mutex_trylock(&_mutex->m),     \
+                                 mutex_lock(&_mutex->m));       \
+        uvm_lock_profile_hold_start(_mutex);                    \
         uvm_assert_mutex_locked(_mutex);                        \
     })
 
@@ -790,12 +861,14 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 #define uvm_mutex_unlock(mutex) ({                                \
         typeof(mutex) _mutex = (mutex);                           \
         uvm_assert_mutex_locked(_mutex);                          \
+        uvm_lock_profile_hold_end(_mutex);                        \
         mutex_unlock(&_mutex->m);                                 \
         uvm_record_unlock(_mutex, UVM_LOCK_FLAGS_MODE_EXCLUSIVE); \
     })
 #define uvm_mutex_unlock_out_of_order(mutex) ({                                \
         typeof(mutex) _mutex = (mutex);                                        \
         uvm_assert_mutex_locked(_mutex);                                       \
+        uvm_lock_profile_hold_end(_mutex);                                     \
         mutex_unlock(&_mutex->m);                                              \
         uvm_record_unlock_out_of_order(_mutex, UVM_LOCK_FLAGS_MODE_EXCLUSIVE); \
     })
@@ -807,18 +880,14 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 typedef struct
 {
     struct semaphore sem;
-#if UVM_IS_DEBUG()
     uvm_lock_order_t lock_order;
-#endif
 } uvm_semaphore_t;
 
 static void uvm_sema_init(uvm_semaphore_t *semaphore, int val, uvm_lock_order_t lock_order)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     sema_init(&semaphore->sem, val);
-#if UVM_IS_DEBUG()
     uvm_locking_assert_initialized();
     semaphore->lock_order = lock_order;
-#endif
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 #define uvm_down(uvm_sem) ({                               \
@@ -843,9 +912,10 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 typedef struct
 {
     spinlock_t lock;
-#if UVM_IS_DEBUG()
     uvm_lock_order_t lock_order;
-#endif
+
+    // Acquisition time, only set when lock profiling is enabled
+    NvU64 profile_acquire_time;
 } uvm_spinlock_t;
 
 // A separate spinlock type for spinlocks that need to disable interrupts. For
@@ -856,9 +926,10 @@ typedef struct
 {
     spinlock_t lock;
     unsigned long irq_flags;
-#if UVM_IS_DEBUG()
     uvm_lock_order_t lock_order;
-#endif
+
+    // Acquisition time, only set when lock profiling is enabled
+    NvU64 profile_acquire_time;
 } uvm_spinlock_irqsave_t;
 
 // Asserts that the spinlock is held. Notably the macros below support both
@@ -880,23 +951,26 @@ typedef struct
 static void uvm_spin_lock_init(uvm_spinlock_t *spinlock, uvm_lock_order_t lock_order)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     spin_lock_init(&spinlock->lock);
-#if UVM_IS_DEBUG()
     uvm_locking_assert_initialized();
     spinlock->lock_order = lock_order;
-#endif
+    spinlock->profile_acquire_time = 0;
     uvm_assert_spinlock_unlocked(spinlock);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 #define uvm_spin_lock(uvm_lock) ({                             \
         typeof(uvm_lock) _lock = (uvm_lock);                   \
         uvm_record_lock(_lock, UVM_LOCK_FLAGS_MODE_EXCLUSIVE); \
-        spin_lock(&_lock->lock);                               \
+        uvm_lock_profile_acquire(_lock,                        \
+                                 spin_trylock(&_lock->lock),   \
+                                 spin_lock(&_lock->lock));     \
+        uvm_lock_profile_hold_start(_lock);                    \
         uvm_assert_spinlock_locked(_lock);                     \
     })
 
 #define uvm_spin_unlock(uvm_lock) ({                             \
         typeof(uvm_lock) _lock = (uvm_lock);                     \
         uvm_assert_spinlock_locked(_lock);                       \
+        uvm_lock_profile_hold_end(_lock);                        \
         spin_unlock(&_lock->lock);                               \
         uvm_record_unlock(_lock, UVM_LOCK_FLAGS_MODE_EXCLUSIVE); \
     })
@@ -904,21 +978,23 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 static void uvm_spin_lock_irqsave_init(uvm_spinlock_irqsave_t *spinlock, uvm_lock_order_t lock_order)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     spin_lock_init(&spinlock->lock);
-#if UVM_IS_DEBUG()
     uvm_locking_assert_initialized();
     spinlock->lock_order = lock_order;
-#endif
+    spinlock->profile_acquire_time = 0;
     uvm_assert_spinlock_unlocked(spinlock);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 // Use a temp to not rely on flags being written after acquiring the lock.
-#define uvm_spin_lock_irqsave(uvm_lock) ({                     \
-        typeof(uvm_lock) _lock = (uvm_lock);                   \
-        unsigned long irq_flags;                               \
-        uvm_record_lock(_lock, UVM_LOCK_FLAGS_MODE_EXCLUSIVE); \
-        spin_lock_irqsave(&_lock->lock, irq_flags);            \
-        _lock->irq_flags = irq_flags;                          \
-        uvm_assert_spinlock_locked(_lock);                     \
+#define uvm_spin_lock_irqsave(uvm_lock) ({                                      \
+        typeof(uvm_lock) _lock = (uvm_lock);                                    \
+        unsigned long irq_flags;                                                \
+        uvm_record_lock(_lock, UVM_LOCK_FLAGS_MODE_EXCLUSIVE);                  \
+        uvm_lock_profile_acquire(_lock,                                         \
+                                 spin_trylock_irqsave(&_lock->lock, irq_flags), \
+                                 spin_lock_irqsave(&_lock->lock, irq_flags));   \
+        _lock->irq_flags = irq_flags;                                           \
+        uvm_lock_profile_hold_start(_lock);                                     \
+        uvm_assert_spinlock_locked(_lock);                                      \
     })
 
 // Use a temp to not rely on flags being read before releasing the lock.
@@ -926,6 +1002,7 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
         typeof(uvm_lock) _lock = (uvm_lock);                     \
         unsigned long irq_flags = _lock->irq_flags;              \
         uvm_assert_spinlock_locked(_lock);                       \
+        uvm_lock_profile_hold_end(_lock);                        \
         spin_unlock_irqrestore(&_lock->lock, irq_flags);         \
         uvm_record_unlock(_lock, UVM_LOCK_FLAGS_MODE_EXCLUSIVE); \
     })
@@ -936,9 +1013,7 @@ typedef struct
 {
     unsigned long *bits;
 
-#if UVM_IS_DEBUG()
     uvm_lock_order_t lock_order;
-#endif
 } uvm_bit_locks_t;
 
 NV_STATUS uvm_bit_locks_init(uvm_bit_locks_t *bit_locks, size_t count, uvm_lock_order_t lock_order);
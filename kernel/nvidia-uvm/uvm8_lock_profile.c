@@ -0,0 +1,258 @@
+#include <linux/kernel.h>
+/*******************************************************************************
+    Copyright (c) 2019 NVIDIA Corporation
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+        The above copyright notice and this permission notice shall be
+        included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+
+*******************************************************************************/
+
+#include "uvm8_lock.h"
+#include "uvm8_global.h"
+#include "uvm8_procfs.h"
+#include "uvm_linux.h"
+
+static int uvm_lock_profiling = 0;
+module_param(uvm_lock_profiling, int, S_IRUGO);
+MODULE_PARM_DESC(uvm_lock_profiling,
+                 "Account contention, wait and hold times per lock order for UVM mutexes, rw semaphores and "
+                 "spinlocks, and report them in /proc/driver/nvidia-uvm/lock_contention (1) or not (0). Default: 0.");
+
+UVM_DEFINE_STATIC_KEY_FALSE(g_uvm_lock_profiling_key);
+
+// Bucket i of the histograms accounts times in the [2^(i-1), 2^i) ns range,
+// with bucket 0 for 0 ns. The last bucket also accounts all the longer times
+// (more than ~1s).
+#define UVM_LOCK_PROFILE_HISTOGRAM_BUCKETS 32
+
+// Number of call sites tracked per lock order
+#define UVM_LOCK_PROFILE_CALL_SITES 8
+
+#define UVM_LOCK_PROFILE_FILE_NAME "lock_contention"
+
+typedef struct
+{
+    // Return address of the contended lock acquisition
+    unsigned long ip;
+
+    NvU64 count;
+} lock_profile_call_site_t;
+
+typedef struct
+{
+    atomic64_t num_acquisitions;
+    atomic64_t num_contended;
+    atomic64_t num_holds;
+
+    atomic64_t total_wait_ns;
+    atomic64_t total_hold_ns;
+
+    atomic64_t wait_histogram[UVM_LOCK_PROFILE_HISTOGRAM_BUCKETS];
+    atomic64_t hold_histogram[UVM_LOCK_PROFILE_HISTOGRAM_BUCKETS];
+
+    // Top contending call sites. When the table is full, the entry with the
+    // lowest count is replaced and the new call site inherits its count, so
+    // frequent call sites are not missed although the counts are
+    // approximate. This is only updated on the contended path.
+    //
+    // This is a raw spinlock since it's taken while acquiring UVM locks.
+    spinlock_t call_sites_lock;
+    lock_profile_call_site_t call_sites[UVM_LOCK_PROFILE_CALL_SITES];
+} ____cacheline_aligned_in_smp lock_profile_order_stats_t;
+
+static lock_profile_order_stats_t g_lock_profile_stats[UVM_LOCK_ORDER_COUNT];
+
+static struct proc_dir_entry *g_lock_profile_procfs_file;
+
+static unsigned histogram_bucket(NvU64 ns)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return min_t(unsigned, fls64(ns), UVM_LOCK_PROFILE_HISTOGRAM_BUCKETS - 1);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void record_call_site(lock_profile_order_stats_t *stats, unsigned long ip)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    lock_profile_call_site_t *min_site = NULL;
+    unsigned long flags;
+    size_t i;
+
+    spin_lock_irqsave(&stats->call_sites_lock, flags);
+
+    for (i = 0; i < ARRAY_SIZE(stats->call_sites); ++i) {
+        lock_profile_call_site_t *site = &stats->call_sites[i];
+
+        if (site->ip == ip || site->ip == 0) {
+            site->ip = ip;
+            ++site->count;
+            min_site = NULL;
+            break;
+        }
+
+        if (!min_site || site->count < min_site->count)
+            min_site = site;
+    }
+
+    if (min_site) {
+        min_site->ip = ip;
+        ++min_site->count;
+    }
+
+    spin_unlock_irqrestore(&stats->call_sites_lock, flags);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void __uvm_lock_profile_acquired(uvm_lock_order_t lock_order, bool contended, NvU64 wait_ns, unsigned long ip)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    lock_profile_order_stats_t *stats;
+
+    UVM_ASSERT(lock_order < UVM_LOCK_ORDER_COUNT);
+
+    stats = &g_lock_profile_stats[lock_order];
+
+    atomic64_inc(&stats->num_acquisitions);
+    if (!contended)
+        return;
+
+    atomic64_inc(&stats->num_contended);
+    atomic64_add(wait_ns, &stats->total_wait_ns);
+    atomic64_inc(&stats->wait_histogram[histogram_bucket(wait_ns)]);
+
+    record_call_site(stats, ip);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void __uvm_lock_profile_released(uvm_lock_order_t lock_order, NvU64 hold_ns)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    lock_profile_order_stats_t *stats;
+
+    UVM_ASSERT(lock_order < UVM_LOCK_ORDER_COUNT);
+
+    stats = &g_lock_profile_stats[lock_order];
+
+    atomic64_inc(&stats->num_holds);
+    atomic64_add(hold_ns, &stats->total_hold_ns);
+    atomic64_inc(&stats->hold_histogram[histogram_bucket(hold_ns)]);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void print_histogram(struct seq_file *s, const char *name, atomic64_t *histogram)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    unsigned i;
+
+    for (i = 0; i < UVM_LOCK_PROFILE_HISTOGRAM_BUCKETS; ++i) {
+        NvU64 count = atomic64_read(&histogram[i]);
+
+        if (count == 0)
+            continue;
+
+        if (i == 0)
+            UVM_SEQ_OR_DBG_PRINT(s, "    %s_ns 0: %llu\n", name, count);
+        else if (i == UVM_LOCK_PROFILE_HISTOGRAM_BUCKETS - 1)
+            UVM_SEQ_OR_DBG_PRINT(s, "    %s_ns >= %llu: %llu\n", name, 1ULL << (i - 1), count);
+        else
+            UVM_SEQ_OR_DBG_PRINT(s, "    %s_ns %llu-%llu: %llu\n", name, 1ULL << (i - 1), (1ULL << i) - 1, count);
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void print_order_stats(struct seq_file *s, uvm_lock_order_t lock_order)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    lock_profile_order_stats_t *stats = &g_lock_profile_stats[lock_order];
+    lock_profile_call_site_t call_sites[UVM_LOCK_PROFILE_CALL_SITES];
+    NvU64 num_acquisitions = atomic64_read(&stats->num_acquisitions);
+    NvU64 num_contended = atomic64_read(&stats->num_contended);
+    NvU64 num_holds = atomic64_read(&stats->num_holds);
+    unsigned long flags;
+    size_t i;
+
+    if (num_acquisitions == 0)
+        return;
+
+    UVM_SEQ_OR_DBG_PRINT(s, "%s\n", uvm_lock_order_to_string(lock_order));
+    UVM_SEQ_OR_DBG_PRINT(s, "  acquisitions    %llu\n", num_acquisitions);
+    UVM_SEQ_OR_DBG_PRINT(s, "  contended       %llu\n", num_contended);
+    UVM_SEQ_OR_DBG_PRINT(s, "  wait_ns_total   %llu\n", (NvU64)atomic64_read(&stats->total_wait_ns));
+    UVM_SEQ_OR_DBG_PRINT(s, "  holds           %llu\n", num_holds);
+    UVM_SEQ_OR_DBG_PRINT(s, "  hold_ns_total   %llu\n", (NvU64)atomic64_read(&stats->total_hold_ns));
+
+    print_histogram(s, "wait", stats->wait_histogram);
+    print_histogram(s, "hold", stats->hold_histogram);
+
+    // Copy the call sites so that printing, which may sleep, is done outside
+    // of the spinlock.
+    spin_lock_irqsave(&stats->call_sites_lock, flags);
+    memcpy(call_sites, stats->call_sites, sizeof(call_sites));
+    spin_unlock_irqrestore(&stats->call_sites_lock, flags);
+
+    for (i = 0; i < ARRAY_SIZE(call_sites); ++i) {
+        if (call_sites[i].ip == 0)
+            break;
+
+        UVM_SEQ_OR_DBG_PRINT(s, "  contended_at %pS: %llu\n", (void *)call_sites[i].ip, call_sites[i].count);
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static int nv_procfs_read_lock_contention(struct seq_file *s, void *v)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_lock_order_t lock_order;
+
+    if (!uvm_down_read_trylock(&g_uvm_global.pm.lock))
+            return -EAGAIN;
+
+    for (lock_order = UVM_LOCK_ORDER_INVALID + 1; lock_order < UVM_LOCK_ORDER_COUNT; ++lock_order)
+        print_order_stats(s, lock_order);
+
+    uvm_up_read(&g_uvm_global.pm.lock);
+
+    return 0;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static int nv_procfs_read_lock_contention_entry(struct seq_file *s, void *v)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ENTRY_RET(nv_procfs_read_lock_contention(s, v));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+UVM_DEFINE_SINGLE_PROCFS_FILE(lock_contention_entry);
+
+NV_STATUS uvm_lock_profile_init(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(g_lock_profile_stats); ++i)
+        spin_lock_init(&g_lock_profile_stats[i].call_sites_lock);
+
+    if (!uvm_lock_profiling)
+        return NV_OK;
+
+    if (uvm_procfs_is_enabled()) {
+        UVM_ASSERT(!g_lock_profile_procfs_file);
+        g_lock_profile_procfs_file = NV_CREATE_PROC_FILE(UVM_LOCK_PROFILE_FILE_NAME,
+                                                         uvm_procfs_get_base_dir(),
+                                                         lock_contention_entry,
+                                                         NULL);
+        if (!g_lock_profile_procfs_file)
+            return NV_ERR_OPERATING_SYSTEM;
+    }
+
+    uvm_static_branch_enable(&g_uvm_lock_profiling_key);
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_lock_profile_exit(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (g_lock_profile_procfs_file) {
+        uvm_procfs_destroy_entry(g_lock_profile_procfs_file);
+        g_lock_profile_procfs_file = NULL;
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -445,6 +445,11 @@ NV_STATUS uvm8_test_lock_sanity(UVM_TEST_LOCK_SANITY_PARAMS *params, struct file
     NV_STATUS status;
     uvm_thread_context_wrapper_t thread_context_wrapper_backup;
 
+    // The tests record and check locks directly, which requires the lock
+    // information in the thread context
+    if (!uvm_thread_context_wrapper_is_used())
+        return NV_ERR_INVALID_STATE;
+
     // The global PM lock is acquired by the top-level UVM ioctl() entry point
     // and still held here, which confuses the (pre-existing) test logic that
     // assumes everything is unlocked at the beginning. Clearing the thread
@@ -32,6 +32,9 @@ void uvm_hal_maxwell_arch_init_properties(uvm_gpu_t *gpu)
 
     gpu->tlb_batch.va_invalidate_supported = false;
 
+    // Same CE layout as Kepler
+    gpu->copy_stripes.stripe_size = 0;
+
     // 128 GB should be enough for all current RM allocations and leaves enough
     // space for UVM internal mappings.
     // A single top level PDE covers 64 or 128 MB on Maxwell so 128 GB is fine to use.
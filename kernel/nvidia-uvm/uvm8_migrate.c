@@ -39,6 +39,7 @@
 #include "uvm8_tools.h"
 #include "uvm8_migrate.h"
 #include "uvm8_migrate_pageable.h"
+#include "uvm8_test.h"
 #include "nv_speculation_barrier.h"
 
 typedef enum
@@ -55,9 +56,65 @@ module_param(uvm_perf_migrate_cpu_preunmap_enable, int, S_IRUGO);
 static unsigned uvm_perf_migrate_cpu_preunmap_block_order = UVM_PERF_MIGRATE_CPU_PREUNMAP_BLOCK_ORDER_DEFAULT;
 module_param(uvm_perf_migrate_cpu_preunmap_block_order, uint, S_IRUGO);
 
+// Number of VA blocks kept in flight by multi-block migrations that add
+// mappings. The pages of each VA block are made resident as soon as the block
+// is reached, but its mappings are only added once that many newer VA blocks
+// have started their copies. This overlaps the copies of the newer VA blocks
+// with the PTE updates (or the wait for the copy, for CPU mappings) of the
+// older ones. A depth of 0 disables the pipeline and falls back to two passes
+// over the whole migration, see uvm_migrate.
+#define UVM_PERF_MIGRATE_PIPELINE_DEPTH_DEFAULT 4
+#define UVM_PERF_MIGRATE_PIPELINE_DEPTH_MAX     32
+static unsigned uvm_perf_migrate_pipeline_depth = UVM_PERF_MIGRATE_PIPELINE_DEPTH_DEFAULT;
+module_param(uvm_perf_migrate_pipeline_depth, uint, S_IRUGO);
+
+// Maximum number of UVM_MIGRATE_FLAG_DEFERRED migrations that can be pending
+// in a VA space. Further requests fail with NV_ERR_BUSY_RETRY until the worker
+// catches up.
+#define UVM_MIGRATE_DEFERRED_MAX_DEPTH_DEFAULT 64
+static unsigned uvm_migrate_deferred_max_depth = UVM_MIGRATE_DEFERRED_MAX_DEPTH_DEFAULT;
+module_param(uvm_migrate_deferred_max_depth, uint, S_IRUGO);
+
 // Global post-processed values of the module parameters
 static bool g_uvm_perf_migrate_cpu_preunmap_enable __read_mostly;
 static NvU64 g_uvm_perf_migrate_cpu_preunmap_size __read_mostly;
+static NvU32 g_uvm_perf_migrate_pipeline_depth __read_mostly;
+static NvU32 g_uvm_migrate_deferred_max_depth __read_mostly;
+
+// Queue executing the deferred migrations of all VA spaces. Each VA space has a
+// single queue item, so the deferred migrations of a VA space are serialized.
+// The queue is never flushed as a whole; waiting for the deferred migrations of
+// a VA space only waits for its own queue item, see migrate_deferred_wait_idle().
+static nv_kthread_q_t g_uvm_migrate_deferred_q;
+
+// Snapshot of the UVM_MIGRATE parameters of a deferred migration
+typedef struct
+{
+    UVM_MIGRATE_PARAMS params;
+
+    // Node in va_space->deferred_migrations.pending
+    struct list_head list_node;
+} uvm_migrate_deferred_t;
+
+// VA blocks whose pages have been made resident on the destination but that
+// still need their mappings to be added. The blocks are retained and kept in
+// FIFO order. Each block's work is tracked by its own tracker and its lock is
+// not held while it's in the pipeline.
+typedef struct
+{
+    struct
+    {
+        uvm_va_block_t *va_block;
+        uvm_va_block_region_t region;
+    } entries[UVM_PERF_MIGRATE_PIPELINE_DEPTH_MAX];
+
+    NvU32 head;
+    NvU32 count;
+
+    uvm_va_block_context_t *va_block_context;
+    uvm_processor_id_t dest_id;
+    uvm_tracker_t *out_tracker;
+} uvm_migrate_pipeline_t;
 
 static bool is_migration_single_block(uvm_va_range_t *first_va_range, NvU64 base, NvU64 length)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
@@ -407,12 +464,98 @@ static void preunmap_multi_block(uvm_va_range_t *va_range,
         unmap_mapping_range(&va_range->va_space->mapping, start, end - start + 1, 1);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Add the mappings of the oldest VA block in the pipeline and remove it
+static NV_STATUS migrate_pipeline_map_oldest(uvm_migrate_pipeline_t *pipeline)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+    uvm_va_block_retry_t va_block_retry;
+    uvm_va_block_t *va_block = pipeline->entries[pipeline->head].va_block;
+    uvm_va_block_region_t region = pipeline->entries[pipeline->head].region;
+
+    UVM_ASSERT(pipeline->count > 0);
+
+    pipeline->head = (pipeline->head + 1) % g_uvm_perf_migrate_pipeline_depth;
+    --pipeline->count;
+
+    // The make resident part is re-executed in case the pages were moved
+    // since they were copied
+    status = UVM_VA_BLOCK_LOCK_RETRY(va_block, &va_block_retry,
+                                     uvm_va_block_migrate_locked(va_block,
+                                                                 &va_block_retry,
+                                                                 pipeline->va_block_context,
+                                                                 region,
+                                                                 pipeline->dest_id,
+                                                                 UVM_MIGRATE_MODE_MAKE_RESIDENT_AND_MAP,
+                                                                 pipeline->out_tracker));
+
+    uvm_va_block_release(va_block);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Add a VA block whose pages have just been made resident to the pipeline,
+// adding the mappings of the oldest block first if the pipeline is full.
+static NV_STATUS migrate_pipeline_add(uvm_migrate_pipeline_t *pipeline,
+                                      uvm_va_block_t *va_block,
+                                      uvm_va_block_region_t region)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    NvU32 tail;
+
+    if (pipeline->count == g_uvm_perf_migrate_pipeline_depth) {
+        status = migrate_pipeline_map_oldest(pipeline);
+        if (status != NV_OK)
+            return status;
+    }
+
+    tail = (pipeline->head + pipeline->count) % g_uvm_perf_migrate_pipeline_depth;
+
+    uvm_va_block_retain(va_block);
+    pipeline->entries[tail].va_block = va_block;
+    pipeline->entries[tail].region = region;
+    ++pipeline->count;
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Add the mappings of all the VA blocks left in the pipeline. If add_mappings
+// is false, or adding them fails, the remaining blocks are just removed, but
+// their pending work is still added to the output tracker.
+static NV_STATUS migrate_pipeline_drain(uvm_migrate_pipeline_t *pipeline, bool add_mappings)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+
+    while (pipeline->count > 0) {
+        uvm_va_block_t *va_block;
+
+        if (add_mappings && status == NV_OK) {
+            status = migrate_pipeline_map_oldest(pipeline);
+            continue;
+        }
+
+        va_block = pipeline->entries[pipeline->head].va_block;
+        pipeline->head = (pipeline->head + 1) % g_uvm_perf_migrate_pipeline_depth;
+        --pipeline->count;
+
+        if (pipeline->out_tracker) {
+            uvm_mutex_lock(&va_block->lock);
+            uvm_tracker_add_tracker_safe(pipeline->out_tracker, &va_block->tracker);
+            uvm_mutex_unlock(&va_block->lock);
+        }
+
+        uvm_va_block_release(va_block);
+    }
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 static NV_STATUS uvm_va_range_migrate_multi_block(uvm_va_range_t *va_range,
                                                   uvm_va_block_context_t *va_block_context,
                                                   NvU64 start,
                                                   NvU64 end,
                                                   uvm_processor_id_t dest_id,
                                                   uvm_migrate_mode_t mode,
+                                                  uvm_migrate_pipeline_t *pipeline,
                                                   uvm_tracker_t *out_tracker)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     size_t i;
@@ -440,14 +583,34 @@ static NV_STATUS uvm_va_range_migrate_multi_block(uvm_va_range_t *va_range,
                                                     max(start, va_block->start),
                                                     min(end, va_block->end));
 
-        status = UVM_VA_BLOCK_LOCK_RETRY(va_block, &va_block_retry,
-                                         uvm_va_block_migrate_locked(va_block,
-                                                                     &va_block_retry,
-                                                                     va_block_context,
-                                                                     region,
-                                                                     dest_id,
-                                                                     mode,
-                                                                     out_tracker));
+        // With the pipeline, only the copies are started here and the block
+        // lock is dropped right after. The mappings are added once newer
+        // blocks have started their copies.
+        if (pipeline) {
+            UVM_ASSERT(mode == UVM_MIGRATE_MODE_MAKE_RESIDENT_AND_MAP);
+
+            status = UVM_VA_BLOCK_LOCK_RETRY(va_block, &va_block_retry,
+                                             uvm_va_block_migrate_locked(va_block,
+                                                                         &va_block_retry,
+                                                                         va_block_context,
+                                                                         region,
+                                                                         dest_id,
+                                                                         UVM_MIGRATE_MODE_MAKE_RESIDENT,
+                                                                         NULL));
+            if (status == NV_OK)
+                status = migrate_pipeline_add(pipeline, va_block, region);
+        }
+        else {
+            status = UVM_VA_BLOCK_LOCK_RETRY(va_block, &va_block_retry,
+                                             uvm_va_block_migrate_locked(va_block,
+                                                                         &va_block_retry,
+                                                                         va_block_context,
+                                                                         region,
+                                                                         dest_id,
+                                                                         mode,
+                                                                         out_tracker));
+        }
+
         if (status != NV_OK)
             return status;
     }
@@ -462,6 +625,7 @@ static NV_STATUS uvm_va_range_migrate(uvm_va_range_t *va_range,
                                       uvm_processor_id_t dest_id,
                                       uvm_migrate_mode_t mode,
                                       bool should_do_cpu_preunmap,
+                                      uvm_migrate_pipeline_t *pipeline,
                                       uvm_tracker_t *out_tracker)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NvU64 preunmap_range_start = start;
@@ -494,6 +658,7 @@ static NV_STATUS uvm_va_range_migrate(uvm_va_range_t *va_range,
                                                   preunmap_range_end,
                                                   dest_id,
                                                   mode,
+                                                  pipeline,
                                                   out_tracker);
         if (status != NV_OK)
             return status;
@@ -512,6 +677,7 @@ static NV_STATUS uvm_migrate_ranges(uvm_va_space_t *va_space,
                                     uvm_processor_id_t dest_id,
                                     uvm_migrate_mode_t mode,
                                     bool should_do_cpu_preunmap,
+                                    uvm_migrate_pipeline_t *pipeline,
                                     uvm_tracker_t *out_tracker)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     uvm_va_range_t *va_range, *va_range_last;
@@ -561,6 +727,7 @@ static NV_STATUS uvm_migrate_ranges(uvm_va_space_t *va_space,
                                               dest_id,
                                               mode,
                                               should_do_cpu_preunmap,
+                                              pipeline,
                                               out_tracker);
                 if (status != NV_OK)
                     break;
@@ -592,12 +759,16 @@ static NV_STATUS uvm_migrate(uvm_va_space_t *va_space,
     NV_STATUS status = NV_OK;
     uvm_va_range_t *first_va_range = uvm_va_space_iter_first(va_space, base, base);
     uvm_va_block_context_t *va_block_context;
+    uvm_migrate_pipeline_t *pipeline = NULL;
     bool do_mappings;
     bool do_two_passes;
     bool is_single_block;
     bool should_do_cpu_preunmap;
 
-    uvm_assert_mmap_sem_locked(&current->mm->mmap_sem);
+    // Deferred migrations are executed by a kthread without mm, in which case
+    // no CPU mappings are created. See uvm_va_range_vma_check.
+    if (current->mm)
+        uvm_assert_mmap_sem_locked(&current->mm->mmap_sem);
     uvm_assert_rwsem_locked(&va_space->lock);
 
     if (!first_va_range || first_va_range->type != UVM_VA_RANGE_TYPE_MANAGED)
@@ -630,10 +801,27 @@ static NV_STATUS uvm_migrate(uvm_va_space_t *va_space,
     // 1- Transfer all VA blocks (do not add mappings)
     // 2- Go block by block reexecuting the transfer (in case someone moved it
     // since the first pass), and adding the mappings.
+    //
+    // If the migration pipeline is enabled, a single pass is performed instead
+    // and the two passes are overlapped over a sliding window of VA blocks.
+    // This bounds the distance between the copy of a VA block and the addition
+    // of its mappings, instead of walking the whole migration twice.
     is_single_block = is_migration_single_block(first_va_range, base, length);
     do_mappings = UVM_ID_IS_GPU(dest_id) || !(migrate_flags & UVM_MIGRATE_FLAG_SKIP_CPU_MAP);
     do_two_passes = do_mappings && !is_single_block;
 
+    if (do_two_passes && g_uvm_perf_migrate_pipeline_depth > 0) {
+        pipeline = uvm_kvmalloc_zero(sizeof(*pipeline));
+
+        // Fall back to two passes if the allocation fails
+        if (pipeline) {
+            pipeline->va_block_context = va_block_context;
+            pipeline->dest_id = dest_id;
+            pipeline->out_tracker = out_tracker;
+            do_two_passes = false;
+        }
+    }
+
     if (do_two_passes) {
         should_do_cpu_preunmap = migration_should_do_cpu_preunmap(va_space, UVM_MIGRATE_PASS_FIRST, is_single_block);
 
@@ -645,6 +833,7 @@ static NV_STATUS uvm_migrate(uvm_va_space_t *va_space,
                                     dest_id,
                                     UVM_MIGRATE_MODE_MAKE_RESIDENT,
                                     should_do_cpu_preunmap,
+                                    NULL,
                                     out_tracker);
     }
 
@@ -663,9 +852,21 @@ static NV_STATUS uvm_migrate(uvm_va_space_t *va_space,
                                     dest_id,
                                     mode,
                                     should_do_cpu_preunmap,
+                                    pipeline,
                                     out_tracker);
     }
 
+    if (pipeline) {
+        // NV_WARN_MORE_PROCESSING_REQUIRED only means that some pages were
+        // skipped, so the blocks in the pipeline still need their mappings.
+        NV_STATUS drain_status = migrate_pipeline_drain(pipeline,
+                                                        status == NV_OK || status == NV_WARN_MORE_PROCESSING_REQUIRED);
+        if (drain_status != NV_OK)
+            status = drain_status;
+
+        uvm_kvfree(pipeline);
+    }
+
     uvm_va_block_context_free(va_block_context);
 
     return status;
@@ -793,6 +994,268 @@ static NV_STATUS uvm_migrate_release_user_sem(const UVM_MIGRATE_PARAMS *params,
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+static uvm_gpu_t *migrate_get_dest_gpu(uvm_va_space_t *va_space, const UVM_MIGRATE_PARAMS *params)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (params->flags & UVM_MIGRATE_FLAG_NO_GPU_VA_SPACE)
+        return uvm_va_space_get_gpu_by_uuid(va_space, &params->destinationUuid);
+
+    return uvm_va_space_get_gpu_by_uuid_with_gpu_va_space(va_space, &params->destinationUuid);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Release the semaphore of a deferred migration which failed or was canceled,
+// without waiting for any work. The VA space may have changed since the
+// migration was queued, so the semaphore pool is looked up again.
+static void migrate_deferred_release_user_sem(uvm_va_space_t *va_space, const UVM_MIGRATE_PARAMS *params)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_tracker_t tracker = UVM_TRACKER_INIT();
+    uvm_va_range_t *sema_va_range;
+    NV_STATUS status;
+    bool wait_for_tracker;
+
+    uvm_assert_rwsem_locked(&va_space->lock);
+
+    if (!params->semaphoreAddress)
+        return;
+
+    sema_va_range = uvm_va_range_find(va_space, params->semaphoreAddress);
+    if (!sema_va_range || sema_va_range->type != UVM_VA_RANGE_TYPE_SEMAPHORE_POOL)
+        return;
+
+    status = uvm_migrate_release_user_sem(params, va_space, sema_va_range, NULL, &tracker, &wait_for_tracker);
+    uvm_tracker_deinit(&tracker);
+    if (status != NV_OK)
+        UVM_ERR_PRINT("Failed to release the semaphore of a deferred migration: %s\n", nvstatusToString(status));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS migrate_deferred_execute(uvm_va_space_t *va_space, const UVM_MIGRATE_PARAMS *params)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_tracker_t tracker = UVM_TRACKER_INIT();
+    uvm_va_range_t *sema_va_range = NULL;
+    uvm_gpu_t *dest_gpu = NULL;
+    NV_STATUS status = NV_OK;
+    NV_STATUS tracker_status = NV_OK;
+    bool wait_for_tracker = true;
+
+    uvm_assert_rwsem_locked(&va_space->lock);
+
+    // GPUs may have been unregistered since the migration was queued
+    if (!uvm_uuid_is_cpu(&params->destinationUuid)) {
+        dest_gpu = migrate_get_dest_gpu(va_space, params);
+        if (!dest_gpu)
+            status = NV_ERR_INVALID_DEVICE;
+    }
+
+    if (status == NV_OK && params->length > 0) {
+        status = uvm_migrate(va_space,
+                             params->base,
+                             params->length,
+                             dest_gpu ? dest_gpu->id : UVM_ID_CPU,
+                             params->flags,
+                             &tracker);
+    }
+
+    if (status == NV_OK && params->semaphoreAddress) {
+        sema_va_range = uvm_va_range_find(va_space, params->semaphoreAddress);
+        if (sema_va_range && sema_va_range->type == UVM_VA_RANGE_TYPE_SEMAPHORE_POOL) {
+            status = uvm_migrate_release_user_sem(params, va_space, sema_va_range, dest_gpu, &tracker, &wait_for_tracker);
+        }
+    }
+
+    // Even if there was an error, we need to wait for work already dispatched
+    // to complete.
+    if (wait_for_tracker)
+        tracker_status = uvm_tracker_wait_deinit(&tracker);
+    else
+        uvm_tracker_deinit(&tracker);
+
+    if (status == NV_OK)
+        status = tracker_status;
+
+    // The ioctl has already returned, so the semaphore has to be released even
+    // if the migration failed. Otherwise, its waiters would hang.
+    if (status != NV_OK)
+        migrate_deferred_release_user_sem(va_space, params);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Take the next pending deferred migration off the list. When there are none
+// left, the queue item becomes idle and the VA space must not be accessed by
+// the caller anymore, as it may be destroyed as soon as idle is completed.
+static uvm_migrate_deferred_t *migrate_deferred_dequeue(uvm_va_space_t *va_space)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_migrate_deferred_t *deferred;
+
+    uvm_spin_lock(&va_space->deferred_migrations.lock);
+
+    deferred = list_first_entry_or_null(&va_space->deferred_migrations.pending, uvm_migrate_deferred_t, list_node);
+    if (deferred) {
+        list_del(&deferred->list_node);
+        --va_space->deferred_migrations.depth;
+    }
+    else {
+        va_space->deferred_migrations.scheduled = false;
+    }
+
+    uvm_spin_unlock(&va_space->deferred_migrations.lock);
+
+    if (!deferred)
+        complete_all(&va_space->deferred_migrations.idle);
+
+    return deferred;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void migrate_deferred_process(void *args)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_va_space_t *va_space = (uvm_va_space_t *)args;
+    uvm_migrate_deferred_t *deferred;
+
+    while ((deferred = migrate_deferred_dequeue(va_space)) != NULL) {
+        NV_STATUS status;
+
+        uvm_va_space_down_read(va_space);
+        status = migrate_deferred_execute(va_space, &deferred->params);
+        uvm_va_space_up_read(va_space);
+
+        if (status != NV_OK) {
+            uvm_spin_lock(&va_space->deferred_migrations.lock);
+            if (va_space->deferred_migrations.first_error == NV_OK)
+                va_space->deferred_migrations.first_error = status;
+            uvm_spin_unlock(&va_space->deferred_migrations.lock);
+        }
+
+        uvm_kvfree(deferred);
+    }
+
+    // The VA space can't be accessed anymore once migrate_deferred_dequeue()
+    // returns NULL.
+    uvm_tools_flush_events();
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void migrate_deferred_process_entry(void *args)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ENTRY_VOID(migrate_deferred_process(args));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS migrate_deferred_enqueue(uvm_va_space_t *va_space, const UVM_MIGRATE_PARAMS *params)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_migrate_deferred_t *deferred;
+    NV_STATUS status = NV_OK;
+    bool schedule = false;
+
+    deferred = uvm_kvmalloc(sizeof(*deferred));
+    if (!deferred)
+        return NV_ERR_NO_MEMORY;
+
+    deferred->params = *params;
+
+    uvm_spin_lock(&va_space->deferred_migrations.lock);
+
+    if (va_space->deferred_migrations.depth < g_uvm_migrate_deferred_max_depth) {
+        list_add_tail(&deferred->list_node, &va_space->deferred_migrations.pending);
+        ++va_space->deferred_migrations.depth;
+
+        // If the queue item is already scheduled, it will pick up this
+        // migration, too.
+        schedule = !va_space->deferred_migrations.scheduled;
+        va_space->deferred_migrations.scheduled = true;
+    }
+    else {
+        status = NV_ERR_BUSY_RETRY;
+    }
+
+    uvm_spin_unlock(&va_space->deferred_migrations.lock);
+
+    if (status != NV_OK) {
+        uvm_kvfree(deferred);
+        return status;
+    }
+
+    if (schedule) {
+        // The previous run of the queue item may have observed the empty list
+        // but not completed idle yet. Wait for it so that its completion
+        // doesn't satisfy waiters for the run being scheduled now.
+        wait_for_completion(&va_space->deferred_migrations.idle);
+        reinit_completion(&va_space->deferred_migrations.idle);
+
+        nv_kthread_q_schedule_q_item(&g_uvm_migrate_deferred_q, &va_space->deferred_migrations.q_item);
+    }
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Wait for the queue item of the VA space to become idle. This doesn't wait for
+// the deferred migrations of other VA spaces, unless they are ahead of this VA
+// space's queue item in the queue.
+static void migrate_deferred_wait_idle(uvm_va_space_t *va_space)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    wait_for_completion(&va_space->deferred_migrations.idle);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Drop all the pending deferred migrations of the VA space and release their
+// semaphores. The VA space lock must be held. Returns the number of canceled
+// migrations.
+static NvU64 migrate_deferred_cancel_pending(uvm_va_space_t *va_space)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_migrate_deferred_t *deferred, *deferred_next;
+    LIST_HEAD(canceled);
+    NvU64 canceled_count = 0;
+
+    uvm_assert_rwsem_locked(&va_space->lock);
+
+    uvm_spin_lock(&va_space->deferred_migrations.lock);
+    list_splice_init(&va_space->deferred_migrations.pending, &canceled);
+    va_space->deferred_migrations.depth = 0;
+    uvm_spin_unlock(&va_space->deferred_migrations.lock);
+
+    list_for_each_entry_safe(deferred, deferred_next, &canceled, list_node) {
+        migrate_deferred_release_user_sem(va_space, &deferred->params);
+        list_del(&deferred->list_node);
+        uvm_kvfree(deferred);
+        ++canceled_count;
+    }
+
+    return canceled_count;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Cancel all the pending deferred migrations of the VA space and wait for the
+// one in progress, if any. Returns the number of canceled migrations.
+static NvU64 migrate_deferred_cancel(uvm_va_space_t *va_space)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU64 canceled_count;
+
+    uvm_va_space_down_read(va_space);
+    canceled_count = migrate_deferred_cancel_pending(va_space);
+    uvm_va_space_up_read(va_space);
+
+    migrate_deferred_wait_idle(va_space);
+
+    return canceled_count;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_migrate_va_space_init(uvm_va_space_t *va_space)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_spin_lock_init(&va_space->deferred_migrations.lock, UVM_LOCK_ORDER_LEAF);
+    INIT_LIST_HEAD(&va_space->deferred_migrations.pending);
+    va_space->deferred_migrations.depth = 0;
+    va_space->deferred_migrations.first_error = NV_OK;
+    va_space->deferred_migrations.scheduled = false;
+
+    // The queue item starts out idle
+    init_completion(&va_space->deferred_migrations.idle);
+    complete_all(&va_space->deferred_migrations.idle);
+
+    nv_kthread_q_item_init(&va_space->deferred_migrations.q_item, migrate_deferred_process_entry, va_space);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_migrate_va_space_destroy(uvm_va_space_t *va_space)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    migrate_deferred_cancel(va_space);
+
+    UVM_ASSERT(list_empty(&va_space->deferred_migrations.pending));
+    UVM_ASSERT(!va_space->deferred_migrations.scheduled);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 NV_STATUS uvm_migrate_init()
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NV_STATUS status = uvm_migrate_pageable_init();
@@ -801,6 +1264,28 @@ NV_STATUS uvm_migrate_init()
 
     g_uvm_perf_migrate_cpu_preunmap_enable = uvm_perf_migrate_cpu_preunmap_enable != 0;
 
+    if (uvm_perf_migrate_pipeline_depth <= UVM_PERF_MIGRATE_PIPELINE_DEPTH_MAX) {
+        g_uvm_perf_migrate_pipeline_depth = uvm_perf_migrate_pipeline_depth;
+    }
+    else {
+        g_uvm_perf_migrate_pipeline_depth = UVM_PERF_MIGRATE_PIPELINE_DEPTH_DEFAULT;
+
+        pr_info("Invalid value %u for uvm_perf_migrate_pipeline_depth. Using %u instead\n",
+                uvm_perf_migrate_pipeline_depth,
+                UVM_PERF_MIGRATE_PIPELINE_DEPTH_DEFAULT);
+    }
+
+    if (uvm_migrate_deferred_max_depth > 0) {
+        g_uvm_migrate_deferred_max_depth = uvm_migrate_deferred_max_depth;
+    }
+    else {
+        g_uvm_migrate_deferred_max_depth = UVM_MIGRATE_DEFERRED_MAX_DEPTH_DEFAULT;
+
+        pr_info("Invalid value %u for uvm_migrate_deferred_max_depth. Using %u instead\n",
+                uvm_migrate_deferred_max_depth,
+                UVM_MIGRATE_DEFERRED_MAX_DEPTH_DEFAULT);
+    }
+
     BUILD_BUG_ON((UVM_VA_BLOCK_SIZE) & (UVM_VA_BLOCK_SIZE - 1));
 
     if (g_uvm_perf_migrate_cpu_preunmap_enable) {
@@ -816,11 +1301,19 @@ NV_STATUS uvm_migrate_init()
         }
     }
 
+    status = errno_to_nv_status(nv_kthread_q_init(&g_uvm_migrate_deferred_q, "UVM deferred migration queue"));
+    if (status != NV_OK) {
+        UVM_DBG_PRINT("nv_kthread_q_init() failed: %s\n", nvstatusToString(status));
+        uvm_migrate_pageable_exit();
+        return status;
+    }
+
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 void uvm_migrate_exit()
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    nv_kthread_q_stop(&g_uvm_migrate_deferred_q);
     uvm_migrate_pageable_exit();
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
@@ -834,7 +1327,9 @@ NV_STATUS uvm_api_migrate(UVM_MIGRATE_PARAMS *params, struct file *filp)
     NV_STATUS status = NV_OK;
     NV_STATUS tracker_status = NV_OK;
     bool wait_for_tracker = true;
+    bool is_queued = false;
     const bool is_async = params->flags & UVM_MIGRATE_FLAG_ASYNC;
+    const bool is_deferred = params->flags & UVM_MIGRATE_FLAG_DEFERRED;
 
     // We temporarily allow 0 length in the IOCTL parameters as a signal to
     // only release the semaphore. This is because user-space is in charge of
@@ -850,6 +1345,9 @@ NV_STATUS uvm_api_migrate(UVM_MIGRATE_PARAMS *params, struct file *filp)
     if (params->flags & ~UVM_MIGRATE_FLAGS_ALL)
         return NV_ERR_INVALID_ARGUMENT;
 
+    if (is_deferred && !is_async)
+        return NV_ERR_INVALID_ARGUMENT;
+
     if ((params->flags & UVM_MIGRATE_FLAGS_TEST_ALL) && !uvm_enable_builtin_tests) {
         UVM_INFO_PRINT("Test flag set for UVM_MIGRATE. Did you mean to insmod with uvm_enable_builtin_tests=1?\n");
         return NV_ERR_INVALID_ARGUMENT;
@@ -886,11 +1384,7 @@ NV_STATUS uvm_api_migrate(UVM_MIGRATE_PARAMS *params, struct file *filp)
         dest_gpu = NULL;
     }
     else {
-        if (params->flags & UVM_MIGRATE_FLAG_NO_GPU_VA_SPACE)
-            dest_gpu = uvm_va_space_get_gpu_by_uuid(va_space, &params->destinationUuid);
-        else
-            dest_gpu = uvm_va_space_get_gpu_by_uuid_with_gpu_va_space(va_space, &params->destinationUuid);
-
+        dest_gpu = migrate_get_dest_gpu(va_space, params);
         if (!dest_gpu) {
             status = NV_ERR_INVALID_DEVICE;
             goto done;
@@ -908,8 +1402,20 @@ NV_STATUS uvm_api_migrate(UVM_MIGRATE_PARAMS *params, struct file *filp)
     if (!is_async || params->semaphoreAddress)
         tracker_ptr = &tracker;
 
-    if (params->length > 0) {
+    if (params->length > 0)
         status = uvm_api_range_type_check(va_space, params->base, params->length);
+
+    // Pageable migrations need current->mm, so they are never deferred.
+    // Semaphore-only requests are queued so that the semaphore is released
+    // after all the previously-queued migrations.
+    if (is_deferred && status == NV_OK) {
+        status = migrate_deferred_enqueue(va_space, params);
+        if (status == NV_OK) {
+            is_queued = true;
+            wait_for_tracker = false;
+        }
+    }
+    else if (params->length > 0) {
         if (status == NV_OK) {
             status = uvm_migrate(va_space,
                                  params->base,
@@ -941,7 +1447,7 @@ done:
     uvm_up_read_mmap_sem_out_of_order(&current->mm->mmap_sem);
 
     if (tracker_ptr) {
-        if (params->semaphoreAddress && status == NV_OK) {
+        if (params->semaphoreAddress && status == NV_OK && !is_queued) {
             // Need to do a semaphore release.
             status = uvm_migrate_release_user_sem(params, va_space, sema_va_range,
                                                   dest_gpu, tracker_ptr, &wait_for_tracker);
@@ -971,6 +1477,105 @@ done:
     return status == NV_OK ? tracker_status : status;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+NV_STATUS uvm_api_migrate_cancel(UVM_MIGRATE_CANCEL_PARAMS *params, struct file *filp)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+
+    params->canceledCount = migrate_deferred_cancel(va_space);
+
+    uvm_spin_lock(&va_space->deferred_migrations.lock);
+    params->deferredStatus = va_space->deferred_migrations.first_error;
+    va_space->deferred_migrations.first_error = NV_OK;
+    uvm_spin_unlock(&va_space->deferred_migrations.lock);
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Returns the first deferred error and resets it
+static NV_STATUS migrate_deferred_take_first_error(uvm_va_space_t *va_space)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+
+    uvm_spin_lock(&va_space->deferred_migrations.lock);
+    status = va_space->deferred_migrations.first_error;
+    va_space->deferred_migrations.first_error = NV_OK;
+    uvm_spin_unlock(&va_space->deferred_migrations.lock);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NV_STATUS uvm8_test_migrate_deferred(UVM_TEST_MIGRATE_DEFERRED_PARAMS *params, struct file *filp)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    UVM_MIGRATE_PARAMS migrate_params;
+    NV_STATUS status = NV_OK;
+    NvU64 canceled_count = 0;
+    NvU32 accepted = 0;
+    NvU32 rejected = 0;
+    NvU32 i;
+
+    // Start with no pending migrations and no deferred error
+    migrate_deferred_cancel(va_space);
+    migrate_deferred_take_first_error(va_space);
+
+    // Empty migrations to the CPU, followed by one to a GPU which is not
+    // registered. All of them are executed once the queue item is idle, and
+    // the error of the last one is reported.
+    memset(&migrate_params, 0, sizeof(migrate_params));
+    migrate_params.destinationUuid = NV_PROCESSOR_UUID_CPU_DEFAULT;
+    migrate_params.flags = UVM_MIGRATE_FLAG_ASYNC | UVM_MIGRATE_FLAG_DEFERRED;
+    for (i = 0; i < 4; ++i)
+        TEST_NV_CHECK_RET(migrate_deferred_enqueue(va_space, &migrate_params));
+
+    memset(&migrate_params.destinationUuid, 0xff, sizeof(migrate_params.destinationUuid));
+    TEST_NV_CHECK_RET(migrate_deferred_enqueue(va_space, &migrate_params));
+
+    migrate_deferred_wait_idle(va_space);
+    TEST_CHECK_RET(list_empty(&va_space->deferred_migrations.pending));
+    TEST_CHECK_RET(va_space->deferred_migrations.depth == 0);
+    TEST_CHECK_RET(migrate_deferred_take_first_error(va_space) == NV_ERR_INVALID_DEVICE);
+
+    // Nothing is pending, so cancelling doesn't wait for anything
+    TEST_CHECK_RET(migrate_deferred_cancel(va_space) == 0);
+
+    // Holding the VA space lock in write mode blocks the queue item, which can
+    // take at most one migration off the list before blocking. Going over the
+    // maximum depth is then rejected and the rest is canceled.
+    migrate_params.destinationUuid = NV_PROCESSOR_UUID_CPU_DEFAULT;
+
+    uvm_va_space_down_write(va_space);
+
+    for (i = 0; i < g_uvm_migrate_deferred_max_depth + 2; ++i) {
+        status = migrate_deferred_enqueue(va_space, &migrate_params);
+        if (status == NV_OK)
+            ++accepted;
+        else if (status == NV_ERR_BUSY_RETRY)
+            ++rejected;
+        else
+            break;
+    }
+
+    canceled_count = migrate_deferred_cancel_pending(va_space);
+
+    uvm_va_space_up_write(va_space);
+
+    migrate_deferred_wait_idle(va_space);
+
+    if (status == NV_ERR_BUSY_RETRY)
+        status = NV_OK;
+
+    TEST_NV_CHECK_RET(status);
+    TEST_CHECK_RET(rejected >= 1);
+    TEST_CHECK_RET(accepted <= g_uvm_migrate_deferred_max_depth + 1);
+    TEST_CHECK_RET(canceled_count <= accepted);
+    TEST_CHECK_RET(canceled_count + 1 >= accepted);
+    TEST_CHECK_RET(list_empty(&va_space->deferred_migrations.pending));
+    TEST_CHECK_RET(va_space->deferred_migrations.depth == 0);
+    TEST_CHECK_RET(migrate_deferred_take_first_error(va_space) == NV_OK);
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 NV_STATUS uvm_api_migrate_range_group(UVM_MIGRATE_RANGE_GROUP_PARAMS *params, struct file *filp)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NV_STATUS status = NV_OK;
@@ -21,5 +21,16 @@
 
 *******************************************************************************/
 
+#include "uvm_common.h"
+#include "uvm8_forward_decl.h"
+
 NV_STATUS uvm_migrate_init(void);
 void uvm_migrate_exit(void);
+
+// Initialize the deferred migration state of the VA space
+void uvm_migrate_va_space_init(uvm_va_space_t *va_space);
+
+// Cancel all the pending deferred migrations of the VA space and wait for the
+// one in progress, if any, to complete. No new deferred migrations may be
+// queued on the VA space.
+void uvm_migrate_va_space_destroy(uvm_va_space_t *va_space);
@@ -34,6 +34,7 @@
 #include "uvm8_hal.h"
 #include "uvm8_migrate_pageable.h"
 #include "uvm8_populate_pageable.h"
+#include "uvm8_test.h"
 
 #include <linux/migrate.h>
 
@@ -49,6 +50,11 @@ static const gfp_t g_migrate_vma_gfp_flags = NV_UVM_GFP_FLAGS | GFP_HIGHUSER_MOV
 #define UVM_MIGRATE_VMA_MAX_SIZE (32UL * 1024 * 1024)
 #define UVM_MIGRATE_VMA_MAX_PAGES (UVM_MIGRATE_VMA_MAX_SIZE / PAGE_SIZE)
 
+// Order of the destination allocations used when the source pages are backed
+// by a huge page.
+#define UVM_MIGRATE_VMA_HUGE_PAGE_ORDER (PMD_SHIFT - PAGE_SHIFT)
+#define UVM_MIGRATE_VMA_HUGE_PAGE_PAGES (1UL << UVM_MIGRATE_VMA_HUGE_PAGE_ORDER)
+
 typedef struct
 {
     // Input parameters
@@ -96,13 +102,19 @@ typedef struct
 
     DECLARE_BITMAP(pending_page_mask, UVM_MIGRATE_VMA_MAX_PAGES);
 
+    // Destination pages allocated in bulk before issuing the copies. Entries
+    // are cleared as pages are handed over to migrate_vma in the dst array.
+    struct page *dst_pages[UVM_MIGRATE_VMA_MAX_PAGES];
+
     struct {
         // Array of page IOMMU mappings created during allocate_and_copy.
         // Required when using SYS aperture. They are freed in
         // finalize_and_map. Also keep an array with the GPUs for which the
-        // mapping was created.
+        // mapping was created, and the number of pages covered by each
+        // mapping. Mappings are indexed by their first page.
         NvU64              addrs[UVM_MIGRATE_VMA_MAX_PAGES];
         uvm_gpu_t    *addrs_gpus[UVM_MIGRATE_VMA_MAX_PAGES];
+        NvU32   addrs_num_pages[UVM_MIGRATE_VMA_MAX_PAGES];
 
         // Mask of pages with entries in the dma address arrays above
         DECLARE_BITMAP(page_mask, UVM_MIGRATE_VMA_MAX_PAGES);
@@ -127,10 +139,12 @@ typedef struct
     unsigned long num_populate_anon_pages;
 } migrate_vma_state_t;
 
-// Compute the address needed for copying_gpu to access the given page,
-// resident on resident_id.
+// Compute the address needed for copying_gpu to access the given
+// physically-contiguous run of num_pages pages starting at page, resident on
+// resident_id.
 static NV_STATUS migrate_vma_page_copy_address(struct page *page,
                                                unsigned long page_index,
+                                               unsigned long num_pages,
                                                uvm_processor_id_t resident_id,
                                                uvm_gpu_t *copying_gpu,
                                                migrate_vma_state_t *state,
@@ -145,7 +159,7 @@ static NV_STATUS migrate_vma_page_copy_address(struct page *page,
                              can_copy_from &&
                              !uvm_gpu_peer_caps(owning_gpu, copying_gpu)->is_indirect_peer;
 
-    UVM_ASSERT(page_index < state->num_pages);
+    UVM_ASSERT(page_index + num_pages <= state->num_pages);
 
     memset(gpu_addr, 0, sizeof(*gpu_addr));
 
@@ -162,16 +176,22 @@ static NV_STATUS migrate_vma_page_copy_address(struct page *page,
     }
     else {
         // Sysmem/Indirect Peer
-        NV_STATUS status = uvm_gpu_map_cpu_page(copying_gpu, page, &state->dma.addrs[page_index]);
+        NV_STATUS status = uvm_gpu_map_cpu_pages(copying_gpu,
+                                                 page,
+                                                 num_pages * PAGE_SIZE,
+                                                 &state->dma.addrs[page_index]);
 
         if (status != NV_OK)
             return status;
 
         state->dma.addrs_gpus[page_index] = copying_gpu;
+        state->dma.addrs_num_pages[page_index] = num_pages;
 
-        if (state->dma.num_pages++ == 0)
+        if (state->dma.num_pages == 0)
             bitmap_zero(state->dma.page_mask, state->num_pages);
 
+        state->dma.num_pages += num_pages;
+
         UVM_ASSERT(!test_bit(page_index, state->dma.page_mask));
 
         __set_bit(page_index, state->dma.page_mask);
@@ -420,6 +440,159 @@ static struct page *migrate_vma_alloc_page(migrate_vma_state_t *state)
     return dst_page;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Check whether the source pages of the huge-page-sized region starting at
+// page_index are naturally aligned and physically contiguous, i.e. they are
+// backed by a (possibly split) huge page, and all of them need to be copied.
+static bool migrate_vma_src_is_huge(const unsigned long *src,
+                                    const unsigned long *page_mask,
+                                    unsigned long page_index,
+                                    migrate_vma_state_t *state)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    const unsigned long first_pfn = page_to_pfn(migrate_pfn_to_page(src[page_index]));
+    unsigned long i;
+
+    if (UVM_MIGRATE_VMA_HUGE_PAGE_ORDER >= MAX_ORDER)
+        return false;
+
+    if (!IS_ALIGNED(first_pfn, UVM_MIGRATE_VMA_HUGE_PAGE_PAGES))
+        return false;
+
+    if (page_index + UVM_MIGRATE_VMA_HUGE_PAGE_PAGES > state->num_pages)
+        return false;
+
+    for (i = 1; i < UVM_MIGRATE_VMA_HUGE_PAGE_PAGES; ++i) {
+        if (!test_bit(page_index + i, page_mask))
+            return false;
+
+        if (page_to_pfn(migrate_pfn_to_page(src[page_index + i])) != first_pfn + i)
+            return false;
+    }
+
+    return true;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Allocate a huge page on the destination node and split it into base pages,
+// which are stored in dst_pages starting at page_index. Returns false if the
+// allocation failed, in which case the caller falls back to base pages.
+static bool migrate_vma_alloc_huge_page(unsigned long page_index, migrate_vma_state_t *state)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    struct page *dst_page;
+    unsigned long i;
+
+    // Allocation failure injection is done on a per-page basis
+    if (uvm_enable_builtin_tests && atomic_read(&state->va_space->test.migrate_vma_allocation_fail_nth) > 0)
+        return false;
+
+    dst_page = alloc_pages_node(state->dst_node_id,
+                                g_migrate_vma_gfp_flags | __GFP_NOWARN,
+                                UVM_MIGRATE_VMA_HUGE_PAGE_ORDER);
+    if (!dst_page)
+        return false;
+
+    // See the comment about __GFP_THISNODE in migrate_vma_alloc_page
+    if (page_to_nid(dst_page) != state->dst_node_id) {
+        __free_pages(dst_page, UVM_MIGRATE_VMA_HUGE_PAGE_ORDER);
+        return false;
+    }
+
+    // migrate_vma works on base pages, so each of them needs to be able to be
+    // migrated and freed independently.
+    split_page(dst_page, UVM_MIGRATE_VMA_HUGE_PAGE_ORDER);
+
+    for (i = 0; i < UVM_MIGRATE_VMA_HUGE_PAGE_PAGES; ++i)
+        state->dst_pages[page_index + i] = dst_page + i;
+
+    return true;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Allocate the destination pages for all the pages in page_mask before any
+// copy is pushed. If src is not NULL, huge-page-backed source regions get a
+// physically-contiguous destination, so that they can be copied with a single
+// CE operation. Pages that fail allocation are reported in
+// allocation_failed_mask and their dst_pages entry is left NULL.
+static void migrate_vma_alloc_pages(const unsigned long *src,
+                                    const unsigned long *page_mask,
+                                    migrate_vma_state_t *state)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    unsigned long i;
+
+    for_each_set_bit(i, page_mask, state->num_pages) {
+        // Already allocated as part of a huge page
+        if (state->dst_pages[i])
+            continue;
+
+        if (src && migrate_vma_src_is_huge(src, page_mask, i, state) && migrate_vma_alloc_huge_page(i, state))
+            continue;
+
+        state->dst_pages[i] = migrate_vma_alloc_page(state);
+        if (!state->dst_pages[i]) {
+            __set_bit(i, state->allocation_failed_mask);
+            state->allocation_failed = true;
+        }
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Free the destination pages that were allocated but not handed over to
+// migrate_vma, for example because of an error while pushing the copies.
+static void migrate_vma_free_dst_pages(migrate_vma_state_t *state)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    unsigned long i;
+
+    for (i = 0; i < state->num_pages; ++i) {
+        if (state->dst_pages[i]) {
+            __free_page(state->dst_pages[i]);
+            state->dst_pages[i] = NULL;
+        }
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Return the number of pages starting at page_index that can be processed
+// with a single CE operation. All the pages must be set in page_mask and their
+// destination pages must be physically contiguous. If src is not NULL, the
+// source pages must be physically contiguous, too.
+static unsigned long migrate_vma_run_num_pages(const unsigned long *src,
+                                               const unsigned long *page_mask,
+                                               unsigned long page_index,
+                                               migrate_vma_state_t *state)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    const unsigned long dst_pfn = page_to_pfn(state->dst_pages[page_index]);
+    const unsigned long src_pfn = src? page_to_pfn(migrate_pfn_to_page(src[page_index])) : 0;
+    unsigned long i;
+
+    for (i = page_index + 1; i < state->num_pages; ++i) {
+        const unsigned long offset = i - page_index;
+
+        if (!test_bit(i, page_mask) || !state->dst_pages[i])
+            break;
+
+        if (page_to_pfn(state->dst_pages[i]) != dst_pfn + offset)
+            break;
+
+        if (src && page_to_pfn(migrate_pfn_to_page(src[i])) != src_pfn + offset)
+            break;
+    }
+
+    return i - page_index;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Lock the destination pages of the given run and hand them over to
+// migrate_vma
+static void migrate_vma_set_dst_pages(unsigned long *dst,
+                                      unsigned long page_index,
+                                      unsigned long num_pages,
+                                      migrate_vma_state_t *state)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    unsigned long i;
+
+    for (i = page_index; i < page_index + num_pages; ++i) {
+        struct page *dst_page = state->dst_pages[i];
+
+        lock_page(dst_page);
+        dst[i] = migrate_pfn(page_to_pfn(dst_page)) | MIGRATE_PFN_LOCKED;
+        state->dst_pages[i] = NULL;
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 static NV_STATUS migrate_vma_populate_anon_pages(struct vm_area_struct *vma,
                                                  unsigned long *dst,
                                                  unsigned long start,
@@ -428,6 +601,7 @@ static NV_STATUS migrate_vma_populate_anon_pages(struct vm_area_struct *vma,
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NV_STATUS status = NV_OK;
     unsigned long i;
+    unsigned long run_num_pages;
     unsigned long *page_mask = state->processors[uvm_id_value(state->dst_id)].page_mask;
     uvm_push_t push;
     uvm_gpu_t *copying_gpu = NULL;
@@ -439,18 +613,21 @@ static NV_STATUS migrate_vma_populate_anon_pages(struct vm_area_struct *vma,
 
     UVM_ASSERT(state->num_populate_anon_pages == bitmap_weight(page_mask, state->num_pages));
 
-    for_each_set_bit(i, page_mask, state->num_pages) {
+    migrate_vma_alloc_pages(NULL, page_mask, state);
+
+    for (i = find_first_bit(page_mask, state->num_pages);
+         i < state->num_pages;
+         i = find_next_bit(page_mask, state->num_pages, i + run_num_pages)) {
         uvm_gpu_address_t dst_address;
-        struct page *dst_page;
 
+        run_num_pages = 1;
         __clear_bit(i, state->pending_page_mask);
 
-        dst_page = migrate_vma_alloc_page(state);
-        if (!dst_page) {
-            __set_bit(i, state->allocation_failed_mask);
-            state->allocation_failed = true;
+        if (!state->dst_pages[i])
             continue;
-        }
+
+        run_num_pages = migrate_vma_run_num_pages(NULL, page_mask, i, state);
+        bitmap_clear(state->pending_page_mask, i, run_num_pages);
 
         if (!copying_gpu) {
             // Try to get a GPU attached to the node being populated. If there
@@ -467,28 +644,28 @@ static NV_STATUS migrate_vma_populate_anon_pages(struct vm_area_struct *vma,
             UVM_ASSERT(copying_gpu);
 
             status = migrate_vma_zero_begin_push(va_space, state->dst_id, copying_gpu, start, outer - 1, &push);
-            if (status != NV_OK) {
-                __free_page(dst_page);
+            if (status != NV_OK)
                 return status;
-            }
         }
         else {
             uvm_push_set_flag(&push, UVM_PUSH_FLAG_CE_NEXT_PIPELINED);
         }
 
-        status = migrate_vma_page_copy_address(dst_page, i, state->dst_id, copying_gpu, state, &dst_address);
-        if (status != NV_OK) {
-            __free_page(dst_page);
+        status = migrate_vma_page_copy_address(state->dst_pages[i],
+                                               i,
+                                               run_num_pages,
+                                               state->dst_id,
+                                               copying_gpu,
+                                               state,
+                                               &dst_address);
+        if (status != NV_OK)
             break;
-        }
-
-        lock_page(dst_page);
 
         // We'll push one membar later for all memsets in this loop
         uvm_push_set_flag(&push, UVM_PUSH_FLAG_CE_NEXT_MEMBAR_NONE);
-        copying_gpu->ce_hal->memset_8(&push, dst_address, 0, PAGE_SIZE);
+        copying_gpu->ce_hal->memset_8(&push, dst_address, 0, run_num_pages * PAGE_SIZE);
 
-        dst[i] = migrate_pfn(page_to_pfn(dst_page)) | MIGRATE_PFN_LOCKED;
+        migrate_vma_set_dst_pages(dst, i, run_num_pages, state);
     }
 
     if (copying_gpu) {
@@ -516,36 +693,38 @@ static NV_STATUS migrate_vma_copy_pages_from(struct vm_area_struct *vma,
     uvm_push_t push;
     uvm_gpu_t *copying_gpu = NULL;
     unsigned long i;
+    unsigned long run_num_pages;
     unsigned long *page_mask = state->processors[uvm_id_value(src_id)].page_mask;
     uvm_va_space_t *va_space = state->va_space;
 
     UVM_ASSERT(!bitmap_empty(page_mask, state->num_pages));
 
-    for_each_set_bit(i, page_mask, state->num_pages) {
+    migrate_vma_alloc_pages(src, page_mask, state);
+
+    for (i = find_first_bit(page_mask, state->num_pages);
+         i < state->num_pages;
+         i = find_next_bit(page_mask, state->num_pages, i + run_num_pages)) {
         uvm_gpu_address_t src_address;
         uvm_gpu_address_t dst_address;
         struct page *src_page = migrate_pfn_to_page(src[i]);
-        struct page *dst_page;
 
         UVM_ASSERT(src[i] & MIGRATE_PFN_VALID);
         UVM_ASSERT(src_page);
         UVM_ASSERT(test_bit(i, state->pending_page_mask));
 
+        run_num_pages = 1;
         __clear_bit(i, state->pending_page_mask);
 
-        dst_page = migrate_vma_alloc_page(state);
-        if (!dst_page) {
-            __set_bit(i, state->allocation_failed_mask);
-            state->allocation_failed = true;
+        if (!state->dst_pages[i])
             continue;
-        }
+
+        run_num_pages = migrate_vma_run_num_pages(src, page_mask, i, state);
+        bitmap_clear(state->pending_page_mask, i, run_num_pages);
 
         if (!copying_gpu) {
             status = migrate_vma_copy_begin_push(va_space, state->dst_id, src_id, start, outer - 1, &push);
-            if (status != NV_OK) {
-                __free_page(dst_page);
+            if (status != NV_OK)
                 return status;
-            }
 
             copying_gpu = uvm_push_get_gpu(&push);
         }
@@ -555,22 +734,25 @@ static NV_STATUS migrate_vma_copy_pages_from(struct vm_area_struct *vma,
 
         // We don't have a case where both src and dst use the SYS aperture, so
         // the second call can't overwrite a dma addr set up by the first call.
-        status = migrate_vma_page_copy_address(src_page, i, src_id, copying_gpu, state, &src_address);
-        if (status == NV_OK)
-            status = migrate_vma_page_copy_address(dst_page, i, state->dst_id, copying_gpu, state, &dst_address);
-
-        if (status != NV_OK) {
-            __free_page(dst_page);
-            break;
+        status = migrate_vma_page_copy_address(src_page, i, run_num_pages, src_id, copying_gpu, state, &src_address);
+        if (status == NV_OK) {
+            status = migrate_vma_page_copy_address(state->dst_pages[i],
+                                                   i,
+                                                   run_num_pages,
+                                                   state->dst_id,
+                                                   copying_gpu,
+                                                   state,
+                                                   &dst_address);
         }
 
-        lock_page(dst_page);
+        if (status != NV_OK)
+            break;
 
         // We'll push one membar later for all copies in this loop
         uvm_push_set_flag(&push, UVM_PUSH_FLAG_CE_NEXT_MEMBAR_NONE);
-        copying_gpu->ce_hal->memcopy(&push, dst_address, src_address, PAGE_SIZE);
+        copying_gpu->ce_hal->memcopy(&push, dst_address, src_address, run_num_pages * PAGE_SIZE);
 
-        dst[i] = migrate_pfn(page_to_pfn(dst_page)) | MIGRATE_PFN_LOCKED;
+        migrate_vma_set_dst_pages(dst, i, run_num_pages, state);
     }
 
     // TODO: Bug 1766424: If the destination is a GPU and the copy was done by
@@ -626,6 +808,7 @@ static void migrate_vma_alloc_and_copy(struct vm_area_struct *vma,
     state->status = NV_OK;
     state->unpopulated_pages = false;
     state->allocation_failed = false;
+    memset(state->dst_pages, 0, state->num_pages * sizeof(state->dst_pages[0]));
 
     migrate_vma_compute_masks(vma, src, state);
 
@@ -634,6 +817,9 @@ static void migrate_vma_alloc_and_copy(struct vm_area_struct *vma,
     if (state->status == NV_OK)
         state->status = migrate_vma_copy_pages(vma, src, dst, start, outer, state);
 
+    // Pages that were not handed over to migrate_vma because of an error
+    migrate_vma_free_dst_pages(state);
+
     // Wait for tracker since all copies must have completed before returning
     tracker_status = uvm_tracker_wait_deinit(&state->tracker);
 
@@ -658,8 +844,11 @@ static void migrate_vma_finalize_and_map(struct vm_area_struct *vma,
     if (state->dma.num_pages > 0) {
         unsigned long i;
 
-        for_each_set_bit(i, state->dma.page_mask, state->num_pages)
-            uvm_gpu_unmap_cpu_page(state->dma.addrs_gpus[i], state->dma.addrs[i]);
+        for_each_set_bit(i, state->dma.page_mask, state->num_pages) {
+            uvm_gpu_unmap_cpu_pages(state->dma.addrs_gpus[i],
+                                    state->dma.addrs[i],
+                                    state->dma.addrs_num_pages[i] * PAGE_SIZE);
+        }
     }
 
     if (state->unpopulated_pages)
@@ -817,6 +1006,39 @@ static NV_STATUS migrate_pageable_vma_region(struct vm_area_struct *vma,
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Compute the size of the next migrate_vma window in [start, outer). The
+// windows are sized to the region, whatever its size, and the per-window
+// metadata work is proportional to the window:
+// - A region of up to UVM_MIGRATE_VMA_MAX_SIZE, including one smaller than a
+//   huge page, is migrated in a single window of exactly its size.
+// - A larger region is split in evenly-sized windows, rather than in
+//   maximum-sized windows followed by a small tail. It uses at most one window
+//   more than the minimum needed to cover it.
+// Window ends other than the region's are aligned to huge page boundaries, so
+// that huge source pages are not split across windows.
+static unsigned long migrate_pageable_vma_window_size(unsigned long start, unsigned long outer)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    const unsigned long size = outer - start;
+    const unsigned long num_windows = DIV_ROUND_UP(size, UVM_MIGRATE_VMA_MAX_SIZE);
+    unsigned long window_outer;
+
+    UVM_ASSERT(start < outer);
+
+    window_outer = min(ALIGN(start + DIV_ROUND_UP(size, num_windows), PMD_SIZE), outer);
+    if (window_outer - start > UVM_MIGRATE_VMA_MAX_SIZE) {
+        window_outer = (start + UVM_MIGRATE_VMA_MAX_SIZE) & PMD_MASK;
+
+        // Huge pages larger than the window cap can't be kept whole
+        if (window_outer <= start)
+            window_outer = start + PAGE_ALIGN(DIV_ROUND_UP(size, num_windows));
+    }
+
+    UVM_ASSERT(window_outer > start);
+    UVM_ASSERT(window_outer <= outer);
+
+    return window_outer - start;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 static NV_STATUS migrate_pageable_vma(struct vm_area_struct *vma,
                                       unsigned long start,
                                       unsigned long outer,
@@ -848,7 +1070,7 @@ static NV_STATUS migrate_pageable_vma(struct vm_area_struct *vma,
         return NV_WARN_NOTHING_TO_DO;
 
     while (start < outer) {
-        const size_t region_size = min(outer - start, UVM_MIGRATE_VMA_MAX_SIZE);
+        const size_t region_size = migrate_pageable_vma_window_size(start, outer);
 
         status = migrate_pageable_vma_region(vma,
                                              start,
@@ -987,4 +1209,92 @@ void uvm_migrate_pageable_exit()
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     kmem_cache_destroy_safe(&g_uvm_migrate_vma_state_cache);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Check the migrate_vma windows picked for the region of the given size
+// starting at start
+static NV_STATUS test_migrate_pageable_windows(unsigned long start, unsigned long size)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    const unsigned long outer = start + size;
+    const unsigned long min_windows = DIV_ROUND_UP(size, UVM_MIGRATE_VMA_MAX_SIZE);
+    unsigned long num_windows = 0;
+    unsigned long window_size = 0;
+    unsigned long addr = start;
+
+    while (addr < outer) {
+        window_size = migrate_pageable_vma_window_size(addr, outer);
+
+        TEST_CHECK_RET(window_size > 0);
+        TEST_CHECK_RET(PAGE_ALIGNED(window_size));
+        TEST_CHECK_RET(window_size <= UVM_MIGRATE_VMA_MAX_SIZE);
+        TEST_CHECK_RET(window_size <= outer - addr);
+
+        addr += window_size;
+        ++num_windows;
+
+        if (addr < outer && PMD_SIZE <= UVM_MIGRATE_VMA_MAX_SIZE)
+            TEST_CHECK_RET(IS_ALIGNED(addr, PMD_SIZE));
+    }
+
+    if (size <= UVM_MIGRATE_VMA_MAX_SIZE) {
+        // Small regions use a single window covering all of them
+        TEST_CHECK_RET(num_windows == 1);
+        TEST_CHECK_RET(window_size == size);
+    }
+    else {
+        // Large regions are split evenly, without a small tail window
+        TEST_CHECK_RET(num_windows >= min_windows);
+        TEST_CHECK_RET(num_windows <= min_windows + 1);
+        TEST_CHECK_RET(window_size >= size / num_windows / 2);
+    }
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NV_STATUS uvm8_test_migrate_pageable_windows(UVM_TEST_MIGRATE_PAGEABLE_WINDOWS_PARAMS *params, struct file *filp)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    static const unsigned long starts[] =
+    {
+        0,
+        PAGE_SIZE,
+        PMD_SIZE - PAGE_SIZE,
+        PMD_SIZE,
+        UVM_MIGRATE_VMA_MAX_SIZE + 3 * PAGE_SIZE,
+    };
+    static const unsigned long sizes[] =
+    {
+        PAGE_SIZE,
+        16 * PAGE_SIZE,
+        PMD_SIZE - PAGE_SIZE,
+        PMD_SIZE,
+        PMD_SIZE + PAGE_SIZE,
+        3 * PMD_SIZE,
+        UVM_MIGRATE_VMA_MAX_SIZE - PAGE_SIZE,
+        UVM_MIGRATE_VMA_MAX_SIZE,
+        UVM_MIGRATE_VMA_MAX_SIZE + PAGE_SIZE,
+        UVM_MIGRATE_VMA_MAX_SIZE + PMD_SIZE,
+        2 * UVM_MIGRATE_VMA_MAX_SIZE - PAGE_SIZE,
+        100UL * 1024 * 1024,
+        1UL * 1024 * 1024 * 1024 + 5 * PAGE_SIZE,
+        4UL * 1024 * 1024 * 1024,
+    };
+    size_t i, j;
+
+    for (i = 0; i < ARRAY_SIZE(starts); ++i) {
+        for (j = 0; j < ARRAY_SIZE(sizes); ++j) {
+            NV_STATUS status = test_migrate_pageable_windows(starts[i], sizes[j]);
+            if (status != NV_OK) {
+                UVM_TEST_PRINT("Windows of region [0x%lx, 0x%lx) failed\n", starts[i], starts[i] + sizes[j]);
+                return status;
+            }
+        }
+    }
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+#else
+NV_STATUS uvm8_test_migrate_pageable_windows(UVM_TEST_MIGRATE_PAGEABLE_WINDOWS_PARAMS *params, struct file *filp)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    // Pageable memory is migrated by user space, there are no windows to check
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 #endif
@@ -48,6 +48,8 @@
         status = uvm_push_begin_acquire(manager, UVM_CHANNEL_TYPE_GPU_INTERNAL, (tracker), (push), (format), ##__VA_ARGS__);    \
      else                                                                                                                       \
         status = uvm_push_begin_fake((tree)->gpu, (push));                                                                      \
+    if (status == NV_OK)                                                                                                        \
+        atomic64_inc(&(tree)->stats.num_pushes);                                                                                \
     status;                                                                                                                     \
 })
 
@@ -59,6 +61,18 @@ module_param(uvm_page_table_location, charp, S_IRUGO);
 MODULE_PARM_DESC(uvm_page_table_location,
                 "Set the location for UVM-allocated page tables. Choices are: vid, sys.");
 
+// Maximum number of page directories kept in the cache of each page tree after
+// they are removed from the tree. 0 disables the cache.
+#define UVM_PAGE_TABLE_DIR_CACHE_SIZE_DEFAULT 32
+static unsigned uvm_page_table_dir_cache_size = UVM_PAGE_TABLE_DIR_CACHE_SIZE_DEFAULT;
+module_param(uvm_page_table_dir_cache_size, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_page_table_dir_cache_size,
+                 "Number of unused page directories cached per page tree for reuse. 0 disables the cache.");
+
+// Directories that stay in the cache for longer than this are freed the next
+// time the cache is trimmed.
+#define UVM_PAGE_TABLE_DIR_CACHE_MAX_AGE_NS (1000ULL * 1000 * 1000)
+
 NV_STATUS uvm_mmu_init(void)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     UVM_ASSERT(page_table_aperture == UVM_APERTURE_SYS || page_table_aperture == UVM_APERTURE_VID);
@@ -231,24 +245,29 @@ static uvm_aperture_t page_tree_pick_location_for_dir(uvm_page_tree_t *tree, NvU
     return page_table_aperture;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+static NvU32 directory_num_entries(uvm_page_tree_t *tree, NvU32 page_size, NvU32 depth)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_mmu_mode_hal_t *hal = tree->hal;
+
+    // The page tree doesn't cache PTEs so space is not allocated for entries that are always PTEs.
+    // 2M PTEs may later become PDEs so pass UVM_PAGE_SIZE_AGNOSTIC, not page_size.
+    if (depth == hal->page_table_depth(UVM_PAGE_SIZE_AGNOSTIC))
+        return 0;
+
+    return hal->entries_per_index(depth) << hal->index_bits(depth, page_size);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 static uvm_page_directory_t *allocate_directory_with_location(uvm_page_tree_t *tree, NvU32 page_size, NvU32 depth,
         uvm_aperture_t location, uvm_pmm_alloc_flags_t pmm_flags)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NV_STATUS status;
     uvm_mmu_mode_hal_t *hal = tree->hal;
-    NvU32 entry_count;
+    NvU32 entry_count = directory_num_entries(tree, page_size, depth);
     NvLength phys_alloc_size = hal->allocation_size(depth, page_size);
     uvm_page_directory_t *dir;
 
     UVM_ASSERT(location == UVM_APERTURE_VID || location == UVM_APERTURE_SYS);
 
-    // The page tree doesn't cache PTEs so space is not allocated for entries that are always PTEs.
-    // 2M PTEs may later become PDEs so pass UVM_PAGE_SIZE_AGNOSTIC, not page_size.
-    if (depth == hal->page_table_depth(UVM_PAGE_SIZE_AGNOSTIC))
-        entry_count = 0;
-    else
-        entry_count = hal->entries_per_index(depth) << hal->index_bits(depth, page_size);
-
     dir = uvm_kvmalloc_zero(sizeof(uvm_page_directory_t) + sizeof(dir->entries[0]) * entry_count);
     if (dir == NULL)
         return NULL;
@@ -264,10 +283,99 @@ static uvm_page_directory_t *allocate_directory_with_location(uvm_page_tree_t *t
         return NULL;
     }
     dir->depth = depth;
+    dir->num_entries = entry_count;
+    INIT_LIST_HEAD(&dir->cache_node);
+
+    atomic64_inc(&tree->stats.num_dir_allocs);
 
     return dir;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+static void free_directory(uvm_page_tree_t *tree, uvm_page_directory_t *dir)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ASSERT(list_empty(&dir->cache_node));
+
+    phys_mem_deallocate(tree, &dir->phys_alloc);
+    uvm_kvfree(dir);
+
+    atomic64_inc(&tree->stats.num_dir_frees);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Free the directories in the cache that are beyond the cache capacity or
+// that have been cached for too long. If all is true, the whole cache is
+// freed.
+static void dir_cache_trim(uvm_page_tree_t *tree, bool all)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU64 now = NV_GETTIME();
+
+    uvm_assert_mutex_locked(&tree->lock);
+
+    while (!list_empty(&tree->dir_cache.list)) {
+        uvm_page_directory_t *dir = list_last_entry(&tree->dir_cache.list, uvm_page_directory_t, cache_node);
+
+        if (!all &&
+            tree->dir_cache.count <= tree->dir_cache.capacity &&
+            now - dir->cache_time < UVM_PAGE_TABLE_DIR_CACHE_MAX_AGE_NS)
+            break;
+
+        list_del_init(&dir->cache_node);
+        --tree->dir_cache.count;
+        free_directory(tree, dir);
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Add a directory that is not in the tree to the cache. The directory is
+// freed right away if the cache is disabled.
+static void dir_cache_add(uvm_page_tree_t *tree, uvm_page_directory_t *dir)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_assert_mutex_locked(&tree->lock);
+
+    // All the children must have been removed before the directory is removed
+    // from the tree, so all the host entries are NULL already.
+    UVM_ASSERT(dir->ref_count == 0);
+
+    if (tree->dir_cache.capacity == 0) {
+        free_directory(tree, dir);
+        return;
+    }
+
+    dir->host_parent = NULL;
+    dir->index_in_parent = 0;
+    dir->cache_time = NV_GETTIME();
+    list_add(&dir->cache_node, &tree->dir_cache.list);
+    ++tree->dir_cache.count;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Take a cached directory suitable for the given depth and page size from the
+// cache, or return NULL if there is none. The contents of the directory memory
+// are stale, so it needs to be initialized like a newly-allocated directory.
+static uvm_page_directory_t *dir_cache_get(uvm_page_tree_t *tree,
+                                           NvU32 page_size,
+                                           NvU32 depth,
+                                           uvm_pmm_alloc_flags_t pmm_flags)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_page_directory_t *dir;
+    uvm_aperture_t location = page_tree_pick_location_for_dir(tree, page_size, depth, pmm_flags);
+    NvU32 num_entries = directory_num_entries(tree, page_size, depth);
+    NvLength phys_alloc_size = tree->hal->allocation_size(depth, page_size);
+
+    uvm_assert_mutex_locked(&tree->lock);
+
+    list_for_each_entry(dir, &tree->dir_cache.list, cache_node) {
+        if (dir->depth == depth &&
+            dir->num_entries == num_entries &&
+            dir->phys_alloc.size == phys_alloc_size &&
+            dir->phys_alloc.addr.aperture == location) {
+            list_del_init(&dir->cache_node);
+            --tree->dir_cache.count;
+            atomic64_inc(&tree->stats.num_dir_cache_hits);
+            return dir;
+        }
+    }
+
+    return NULL;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 static uvm_page_directory_t *allocate_directory(uvm_page_tree_t *tree, NvU32 page_size, NvU32 depth,
         uvm_pmm_alloc_flags_t pmm_flags)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
@@ -435,6 +543,7 @@ static NV_STATUS write_gpu_state(uvm_page_tree_t *tree,
     uvm_membar_t membar_after_writes = UVM_MEMBAR_GPU;
 
     uvm_assert_mutex_locked(&tree->lock);
+    UVM_ASSERT(used_count <= UVM_PAGE_TABLE_RANGE_VEC_DIRS_PER_PUSH);
 
     if (used_count == 0)
         return NV_OK;
@@ -448,8 +557,11 @@ static NV_STATUS write_gpu_state(uvm_page_tree_t *tree,
     for (i = 0; i < used_count; i++) {
         // Appropriate membar will be done after all the writes. Pipelining can
         // be enabled as they are all initializing newly allocated memory that
-        // cannot have any writes pending.
-        uvm_push_set_flag(&push, UVM_PUSH_FLAG_CE_NEXT_PIPELINED);
+        // cannot have any writes pending. Directories reused from the cache
+        // may still have writes pending from the push that removed them from
+        // the tree, so they are not pipelined.
+        if (dirs_used[i]->cache_time == 0)
+            uvm_push_set_flag(&push, UVM_PUSH_FLAG_CE_NEXT_PIPELINED);
         uvm_push_set_flag(&push, UVM_PUSH_FLAG_CE_NEXT_MEMBAR_NONE);
 
         phys_mem_init(tree, page_size, dirs_used[i], &push);
@@ -524,10 +636,8 @@ static void free_unused_directories(uvm_page_tree_t *tree,
                     break;
             }
 
-            if (j == used_count) {
-                phys_mem_deallocate(tree, &dir->phys_alloc);
-                uvm_kvfree(dir);
-            }
+            if (j == used_count)
+                dir_cache_add(tree, dir);
         }
     }
 
@@ -561,6 +671,9 @@ NV_STATUS uvm_page_tree_init(uvm_gpu_t *gpu,
 
     uvm_tracker_init(&tree->tracker);
 
+    INIT_LIST_HEAD(&tree->dir_cache.list);
+    tree->dir_cache.capacity = uvm_page_table_dir_cache_size;
+
     tree->root = allocate_directory(tree, UVM_PAGE_SIZE_AGNOSTIC, 0, UVM_PMM_ALLOC_FLAGS_EVICT);
 
     if (tree->root == NULL)
@@ -608,6 +721,8 @@ void uvm_page_tree_deinit(uvm_page_tree_t *tree)
     }
 
     (void)uvm_tracker_wait(&tree->tracker);
+    dir_cache_trim(tree, true);
+    UVM_ASSERT(tree->dir_cache.count == 0);
     phys_mem_deallocate(tree, &tree->root->phys_alloc);
     uvm_mutex_unlock(&tree->lock);
 
@@ -704,11 +819,14 @@ void uvm_page_tree_put_ptes_async(uvm_page_tree_t *tree, uvm_page_table_range_t
     page_tree_end(tree, &push);
     page_tree_tracker_overwrite_with_push(tree, &push);
 
-    // now that we've traversed all the way up the tree, free everything
-    for (i = 0; i < free_count; i++) {
-        phys_mem_deallocate(tree, &free_queue[i]->phys_alloc);
-        uvm_kvfree(free_queue[i]);
-    }
+    // now that we've traversed all the way up the tree, release everything.
+    // The directories go to the cache first, and they are only freed if they
+    // are not reused soon enough. Reusing them is safe as any later GPU work
+    // on the tree acquires the tracker, which includes the push above.
+    for (i = 0; i < free_count; i++)
+        dir_cache_add(tree, free_queue[i]);
+
+    dir_cache_trim(tree, false);
 
     uvm_mutex_unlock(&tree->lock);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -829,6 +947,12 @@ NV_STATUS uvm_page_tree_get_ptes_async(uvm_page_tree_t *tree, NvU32 page_size, N
                                   range,
                                   &cur_depth,
                                   dir_cache)) == NV_ERR_MORE_PROCESSING_REQUIRED) {
+        // Reuse a directory from the tree's cache if possible, which doesn't
+        // require dropping the lock
+        dir_cache[cur_depth] = dir_cache_get(tree, page_size, cur_depth + 1, pmm_flags);
+        if (dir_cache[cur_depth] != NULL)
+            continue;
+
         uvm_mutex_unlock(&tree->lock);
 
         // try_get_ptes never needs depth 0, so store a directory at its parent's depth
@@ -844,6 +968,8 @@ NV_STATUS uvm_page_tree_get_ptes_async(uvm_page_tree_t *tree, NvU32 page_size, N
 
         uvm_mutex_lock(&tree->lock);
     }
+
+    dir_cache_trim(tree, false);
     uvm_mutex_unlock(&tree->lock);
     return status;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -1006,10 +1132,8 @@ NV_STATUS uvm_page_tree_alloc_table(uvm_page_tree_t *tree,
     children->table->ref_count += children->entry_count;
 
 out:
-    if (should_free || status != NV_OK) {
-        phys_mem_deallocate(tree, &dir->phys_alloc);
-        uvm_kvfree(dir);
-    }
+    if (should_free || status != NV_OK)
+        dir_cache_add(tree, dir);
     uvm_mutex_unlock(&tree->lock);
 
     return status;
@@ -1048,11 +1172,320 @@ static NvU64 range_vec_calc_range_size(uvm_page_table_range_vec_t *range_vec, si
     return range_vec_calc_range_end(range_vec, i) - range_vec_calc_range_start(range_vec, i);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Directories set aside for a batched get operation on a range vector. The
+// directories are indexed by the depth of their parent, like the dir_cache
+// used by try_get_ptes.
+typedef struct
+{
+    struct list_head dirs[MAX_OPERATION_DEPTH];
+
+    NvU32 count[MAX_OPERATION_DEPTH];
+} dir_pool_t;
+
+static void dir_pool_add(dir_pool_t *pool, NvU32 parent_depth, uvm_page_directory_t *dir)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    list_add(&dir->cache_node, &pool->dirs[parent_depth]);
+    ++pool->count[parent_depth];
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static uvm_page_directory_t *dir_pool_take(dir_pool_t *pool, NvU32 parent_depth)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_page_directory_t *dir;
+
+    UVM_ASSERT(pool->count[parent_depth] > 0);
+
+    dir = list_first_entry(&pool->dirs[parent_depth], uvm_page_directory_t, cache_node);
+    list_del_init(&dir->cache_node);
+    --pool->count[parent_depth];
+
+    return dir;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Move directories from the tree's cache to the pool until the pool has
+// needed[d] directories for each parent depth d. Returns whether the pool
+// could be filled.
+static bool dir_pool_fill_from_cache(uvm_page_tree_t *tree,
+                                     NvU32 page_size,
+                                     uvm_pmm_alloc_flags_t pmm_flags,
+                                     dir_pool_t *pool,
+                                     const NvU32 *needed)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 depth;
+    bool filled = true;
+
+    for (depth = 0; depth < MAX_OPERATION_DEPTH; ++depth) {
+        while (pool->count[depth] < needed[depth]) {
+            uvm_page_directory_t *dir = dir_cache_get(tree, page_size, depth + 1, pmm_flags);
+            if (!dir) {
+                filled = false;
+                break;
+            }
+
+            dir_pool_add(pool, depth, dir);
+        }
+    }
+
+    return filled;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Same as dir_pool_fill_from_cache, but the directories are newly allocated.
+// The tree lock must not be held.
+static NV_STATUS dir_pool_fill_allocate(uvm_page_tree_t *tree,
+                                        NvU32 page_size,
+                                        uvm_pmm_alloc_flags_t pmm_flags,
+                                        dir_pool_t *pool,
+                                        const NvU32 *needed)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 depth;
+
+    for (depth = 0; depth < MAX_OPERATION_DEPTH; ++depth) {
+        while (pool->count[depth] < needed[depth]) {
+            uvm_page_directory_t *dir = allocate_directory(tree, page_size, depth + 1, pmm_flags);
+            if (!dir)
+                return NV_ERR_NO_MEMORY;
+
+            dir_pool_add(pool, depth, dir);
+        }
+    }
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Return all the directories left in the pool to the tree's cache
+static void dir_pool_release(uvm_page_tree_t *tree, dir_pool_t *pool)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 depth;
+
+    for (depth = 0; depth < MAX_OPERATION_DEPTH; ++depth) {
+        while (pool->count[depth] > 0)
+            dir_cache_add(tree, dir_pool_take(pool, depth));
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Count the directories, per depth of their parent, that are missing in the
+// tree to get the PTEs of the ranges of range_vec starting at first_range.
+static void range_vec_count_missing_dirs(uvm_page_table_range_vec_t *range_vec, size_t first_range, NvU32 *missing)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_page_tree_t *tree = range_vec->tree;
+    uvm_mmu_mode_hal_t *hal = tree->hal;
+    NvU32 page_size = range_vec->page_size;
+    NvU32 pt_depth = hal->page_table_depth(page_size);
+    NvU64 last_missing[MAX_OPERATION_DEPTH];
+    NvU32 depth;
+    size_t i;
+
+    uvm_assert_mutex_locked(&tree->lock);
+
+    for (depth = 0; depth < MAX_OPERATION_DEPTH; ++depth) {
+        missing[depth] = 0;
+        last_missing[depth] = ~0ULL;
+    }
+
+    for (i = first_range; i < range_vec->range_count; ++i) {
+        NvU64 start = range_vec_calc_range_start(range_vec, i);
+        NvU32 addr_bit_shift = hal->num_va_bits();
+        uvm_page_directory_t *dir = tree->root;
+
+        for (depth = 0; depth < pt_depth; ++depth) {
+            NvU32 index_bits = hal->index_bits(depth, page_size);
+
+            addr_bit_shift -= index_bits;
+
+            if (dir) {
+                NvU32 index = entry_index_from_vaddr(start, addr_bit_shift, index_bits);
+                dir = dir->entries[index_to_entry(hal, index, depth, page_size)];
+            }
+
+            // Ranges are sorted by address, so consecutive ranges missing the
+            // same directory are next to each other.
+            if (!dir && last_missing[depth] != start >> addr_bit_shift) {
+                last_missing[depth] = start >> addr_bit_shift;
+                ++missing[depth];
+            }
+        }
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Get the PTEs for [start, start + size), which must be covered by a single
+// page table, with the missing directories taken from the pool. The GPU state
+// of the new directories, which are appended to dirs_used, is not written.
+// Returns false without modifying the tree if the pool doesn't have all the
+// directories that are needed.
+static bool get_ptes_from_pool(uvm_page_tree_t *tree,
+                               NvU32 page_size,
+                               NvU64 start,
+                               NvLength size,
+                               uvm_page_table_range_t *range,
+                               dir_pool_t *pool,
+                               uvm_page_directory_t **dirs_used,
+                               NvU32 *used_count,
+                               NvS32 *invalidate_depth)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_mmu_mode_hal_t *hal = tree->hal;
+    NvU32 pt_depth = hal->page_table_depth(page_size);
+    NvU32 addr_bit_shift = hal->num_va_bits();
+    uvm_page_directory_t *dir = tree->root;
+    NvU32 depth;
+
+    uvm_assert_mutex_locked(&tree->lock);
+
+    // Find the deepest existing directory. All the directories below it are
+    // missing.
+    while (dir->depth != pt_depth) {
+        NvU32 index_bits = hal->index_bits(dir->depth, page_size);
+        uvm_page_directory_t *child;
+
+        addr_bit_shift -= index_bits;
+        child = dir->entries[index_to_entry(hal, entry_index_from_vaddr(start, addr_bit_shift, index_bits), dir->depth, page_size)];
+        if (!child)
+            break;
+
+        dir = child;
+    }
+
+    for (depth = dir->depth; depth < pt_depth; ++depth) {
+        if (pool->count[depth] == 0)
+            return false;
+    }
+
+    addr_bit_shift = hal->num_va_bits();
+    dir = tree->root;
+
+    while (true) {
+        NvU32 start_index;
+        NvU32 end_index;
+        uvm_page_directory_t **entry;
+        NvU32 index_bits = hal->index_bits(dir->depth, page_size);
+
+        addr_bit_shift -= index_bits;
+        start_index = entry_index_from_vaddr(start, addr_bit_shift, index_bits);
+        end_index = entry_index_from_vaddr(start + size - 1, addr_bit_shift, index_bits);
+
+        UVM_ASSERT(start_index <= end_index && end_index < (1 << index_bits));
+
+        entry = dir->entries + index_to_entry(hal, start_index, dir->depth, page_size);
+
+        if (dir->depth == pt_depth) {
+            page_table_range_init(range, page_size, dir, start_index, end_index);
+            break;
+        }
+
+        UVM_ASSERT(start_index == end_index);
+
+        if (*entry == NULL) {
+            *entry = host_pde_write(dir_pool_take(pool, dir->depth), dir, start_index);
+            dirs_used[(*used_count)++] = *entry;
+
+            if (*invalidate_depth == -1 || dir->depth < *invalidate_depth)
+                *invalidate_depth = dir->depth;
+        }
+
+        dir = *entry;
+    }
+
+    return true;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Get the PTEs for all the ranges of range_vec. The missing directories of all
+// the ranges are gathered before inserting them in the tree. They are
+// initialized and written to the GPU in batches of at most
+// UVM_PAGE_TABLE_RANGE_VEC_DIRS_PER_PUSH directories, one push per batch.
+static NV_STATUS range_vec_get_ptes(uvm_page_table_range_vec_t *range_vec, uvm_pmm_alloc_flags_t pmm_flags)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    uvm_page_tree_t *tree = range_vec->tree;
+    NvU32 page_size = range_vec->page_size;
+    uvm_page_directory_t **dirs_used;
+    NvU32 used_count = 0;
+    NvS32 invalidate_depth = -1;
+    NvU32 missing[MAX_OPERATION_DEPTH];
+    dir_pool_t pool;
+    size_t next_range = 0;
+    NvU32 depth;
+
+    dirs_used = uvm_kvmalloc(sizeof(*dirs_used) * UVM_PAGE_TABLE_RANGE_VEC_DIRS_PER_PUSH);
+    if (!dirs_used)
+        return NV_ERR_NO_MEMORY;
+
+    for (depth = 0; depth < MAX_OPERATION_DEPTH; ++depth) {
+        INIT_LIST_HEAD(&pool.dirs[depth]);
+        pool.count[depth] = 0;
+    }
+
+    uvm_mutex_lock(&tree->lock);
+
+    while (true) {
+        for (; next_range < range_vec->range_count; ++next_range) {
+            // Each range needs at most one new directory per depth. Write the
+            // batch before it could overflow. A parent is always inserted
+            // before its children, so the parents of the directories of the
+            // next batch are valid on the GPU by the time it's written.
+            if (used_count + MAX_OPERATION_DEPTH > UVM_PAGE_TABLE_RANGE_VEC_DIRS_PER_PUSH) {
+                status = write_gpu_state(tree, page_size, invalidate_depth, used_count, dirs_used);
+                used_count = 0;
+                invalidate_depth = -1;
+                if (status != NV_OK)
+                    break;
+            }
+
+            if (!get_ptes_from_pool(tree,
+                                    page_size,
+                                    range_vec_calc_range_start(range_vec, next_range),
+                                    range_vec_calc_range_size(range_vec, next_range),
+                                    &range_vec->ranges[next_range],
+                                    &pool,
+                                    dirs_used,
+                                    &used_count,
+                                    &invalidate_depth))
+                break;
+        }
+
+        if (status != NV_OK || next_range == range_vec->range_count)
+            break;
+
+        // Get the directories missing for all the remaining ranges at once,
+        // reusing the cached ones first.
+        range_vec_count_missing_dirs(range_vec, next_range, missing);
+        if (dir_pool_fill_from_cache(tree, page_size, pmm_flags, &pool, missing))
+            continue;
+
+        // The lock needs to be dropped to allocate. The directories already
+        // inserted need their GPU state written first, so that the tree is
+        // consistent for other threads. This only happens if the tree changed
+        // while the lock was dropped before.
+        if (used_count > 0) {
+            status = write_gpu_state(tree, page_size, invalidate_depth, used_count, dirs_used);
+            used_count = 0;
+            invalidate_depth = -1;
+            if (status != NV_OK)
+                break;
+        }
+
+        uvm_mutex_unlock(&tree->lock);
+        status = dir_pool_fill_allocate(tree, page_size, pmm_flags, &pool, missing);
+        uvm_mutex_lock(&tree->lock);
+
+        if (status != NV_OK)
+            break;
+    }
+
+    if (used_count > 0 && status == NV_OK)
+        status = write_gpu_state(tree, page_size, invalidate_depth, used_count, dirs_used);
+
+    dir_pool_release(tree, &pool);
+    dir_cache_trim(tree, false);
+
+    uvm_mutex_unlock(&tree->lock);
+
+    uvm_kvfree(dirs_used);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 NV_STATUS uvm_page_table_range_vec_init(uvm_page_tree_t *tree, NvU64 start, NvU64 size, NvU32 page_size,
         uvm_page_table_range_vec_t *range_vec)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NV_STATUS status;
-    size_t i;
 
     UVM_ASSERT(size != 0);
     UVM_ASSERT_MSG(IS_ALIGNED(start, page_size), "start 0x%llx page_size 0x%x\n", start, page_size);
@@ -1070,19 +1503,11 @@ NV_STATUS uvm_page_table_range_vec_init(uvm_page_tree_t *tree, NvU64 start, NvU6
         goto error;
     }
 
-    for (i = 0; i < range_vec->range_count; ++i) {
-        uvm_page_table_range_t *range = &range_vec->ranges[i];
-
-        NvU64 range_start = range_vec_calc_range_start(range_vec, i);
-        NvU64 range_size = range_vec_calc_range_size(range_vec, i);
-
-        status = uvm_page_tree_get_ptes_async(tree, page_size, range_start, range_size, UVM_PMM_ALLOC_FLAGS_EVICT, range);
-        if (status != NV_OK) {
-            UVM_ERR_PRINT("Failed to get PTEs for subrange %zd [0x%llx, 0x%llx) size 0x%llx, part of [0x%llx, 0x%llx)\n",
-                    i, range_start, range_start + range_size, range_size,
-                    start, size);
-            goto error;
-        }
+    status = range_vec_get_ptes(range_vec, UVM_PMM_ALLOC_FLAGS_EVICT);
+    if (status != NV_OK) {
+        UVM_ERR_PRINT("Failed to get PTEs for [0x%llx, 0x%llx) with %zd subranges: %s\n",
+                start, start + size, range_vec->range_count, nvstatusToString(status));
+        goto error;
     }
     return uvm_page_tree_wait(tree);
 
@@ -83,6 +83,18 @@ struct uvm_page_directory_struct
     // depth from the root
     NvU32 depth;
 
+    // number of entries in the entries array below
+    NvU32 num_entries;
+
+    // Node in the page tree's dir_cache, or in a private list of directories
+    // allocated ahead of a batched get operation. Only used while the
+    // directory is not in the tree.
+    struct list_head cache_node;
+
+    // Time at which the directory was last added to the page tree's
+    // dir_cache, or 0 if it has never been cached.
+    NvU64 cache_time;
+
     // pointers to child directories on the host.
     // this array is variable length, so it needs to be last to allow it to take up extra space
     uvm_page_directory_t *entries[0];
@@ -174,8 +186,45 @@ struct uvm_page_tree_struct
 
     // Tracker for all GPU operations on the tree
     uvm_tracker_t tracker;
+
+    // Directories that have been removed from the tree are kept in this cache
+    // for a while, instead of being freed right away, so that they can be
+    // reused by later get_ptes calls without going through PMM or the page
+    // allocator. The most recently cached directories are at the head of the
+    // list. Directories are freed when the cache grows beyond capacity or
+    // when they have been in the cache for too long.
+    //
+    // Protected by lock.
+    struct
+    {
+        struct list_head list;
+
+        NvU32 count;
+
+        NvU32 capacity;
+    } dir_cache;
+
+    struct
+    {
+        // Number of directories allocated from/freed to PMM or the page
+        // allocator
+        atomic64_t num_dir_allocs;
+        atomic64_t num_dir_frees;
+
+        // Number of directories reused from dir_cache
+        atomic64_t num_dir_cache_hits;
+
+        // Number of pushes begun by page tree operations
+        atomic64_t num_pushes;
+    } stats;
 };
 
+// Maximum number of page directories initialized and written to the GPU by a
+// single push when getting the PTEs of a range vector. Each directory takes at
+// most three CE memsets, one to initialize it and up to two to write its PDE,
+// so the push stays well below UVM_MAX_PUSH_SIZE.
+#define UVM_PAGE_TABLE_RANGE_VEC_DIRS_PER_PUSH 128
+
 // A vector of page table ranges
 struct uvm_page_table_range_vec_struct
 {
@@ -308,7 +357,13 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 // Initialize a page table range vector covering the specified VA range [start, start + size)
 //
 // This splits the VA in the minimum amount of page table ranges required to
-// cover it and calls uvm_page_tree_get_ptes() for each of them.
+// cover it and gets the PTEs for each of them. All the page directories that
+// are missing in the range are allocated upfront, and then initialized and
+// written to the GPU with one push per UVM_PAGE_TABLE_RANGE_VEC_DIRS_PER_PUSH
+// directories, rather than one push per page table range. This can also be
+// used to pre-populate the directory levels of a VA
+// range, so that later uvm_page_tree_get_ptes() calls within the range don't
+// need to allocate nor push anything while the range vector is alive.
 //
 // Start and size are in bytes and need to be page_size aligned.
 NV_STATUS uvm_page_table_range_vec_init(uvm_page_tree_t *tree, NvU64 start, NvU64 size, NvU32 page_size,
@@ -849,39 +849,54 @@ static NV_STATUS test_tlb_batch_invalidates_case(uvm_page_tree_t *tree, NvU64 ba
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NV_STATUS status = NV_OK;
     uvm_push_t push;
-    uvm_tlb_batch_t batch;
+    uvm_tlb_batch_t *batch;
     uvm_gpu_t *gpu = tree->gpu;
     int i, j;
 
-    MEM_NV_CHECK_RET(uvm_push_begin_fake(gpu, &push), NV_OK);
+    batch = uvm_kvmalloc(sizeof(*batch));
+    if (!batch)
+        return NV_ERR_NO_MEMORY;
 
-    for (i = 1; i < 10; ++i) {
+    status = uvm_push_begin_fake(gpu, &push);
+    if (status != NV_OK) {
+        uvm_kvfree(batch);
+        return status;
+    }
+
+    // Go one range past the capacity of the batch. The ranges are disjoint so
+    // they can't be merged, and adding a range once the batch holds
+    // UVM_TLB_BATCH_MAX_ENTRIES of them overflows it.
+    for (i = 1; i <= UVM_TLB_BATCH_MAX_ENTRIES + 1; ++i) {
         // If invalidate all ends up being used, the expected depth is the
         // minimum depth across all the ranges. Start off with the min page size
         // as that's the deepest.
         NvU32 expected_inval_all_depth = tree->hal->page_table_depth(min_page_size);
         NvU32 total_pages = 0;
+        bool overflow = i > UVM_TLB_BATCH_MAX_ENTRIES;
 
         fake_tlb_invals_enable();
 
-        uvm_tlb_batch_begin(tree, &batch);
+        uvm_tlb_batch_begin(tree, batch);
 
         for (j = 0; j < i; ++j) {
             NvU32 used_max_page_size = (j & 1) ? max_page_size : min_page_size;
             NvU32 expected_range_depth = tree->hal->page_table_depth(used_max_page_size);
             expected_inval_all_depth = min(expected_inval_all_depth, expected_range_depth);
-            uvm_tlb_batch_invalidate(&batch, base + j * 2 * size, size, min_page_size | used_max_page_size, UVM_MEMBAR_NONE);
+            uvm_tlb_batch_invalidate(batch, base + j * 2 * size, size, min_page_size | used_max_page_size, UVM_MEMBAR_NONE);
             total_pages += size / min_page_size;
         }
 
-        uvm_tlb_batch_end(&batch, &push, UVM_MEMBAR_NONE);
+        uvm_tlb_batch_end(batch, &push, UVM_MEMBAR_NONE);
+
+        if (overflow)
+            TEST_CHECK_RET(assert_last_invalidate_all(expected_inval_all_depth, false));
 
         for (j = 0; j < i; ++j) {
             NvU32 used_max_page_size = (j & 1) ? max_page_size : min_page_size;
             NvU32 expected_range_depth = tree->hal->page_table_depth(used_max_page_size);
-            bool allow_inval_all = (total_pages > gpu->tlb_batch.max_pages) ||
+            bool allow_inval_all = (total_pages * gpu->tlb_batch.va_invalidate_cost > gpu->tlb_batch.invalidate_all_cost) ||
                                    !gpu->tlb_batch.va_invalidate_supported ||
-                                   (i > UVM_TLB_BATCH_MAX_ENTRIES);
+                                   overflow;
             TEST_CHECK_RET(assert_invalidate_range(base + j * 2 * size, size, min_page_size,
                     allow_inval_all, expected_range_depth, expected_inval_all_depth, false));
         }
@@ -890,6 +905,145 @@ static NV_STATUS test_tlb_batch_invalidates_case(uvm_page_tree_t *tree, NvU64 ba
     }
 
     uvm_push_end_fake(&push);
+    uvm_kvfree(batch);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Queue up count invalidates of size bytes of 4K pages, the i-th one at
+// i * stride. The ranges are queued up in decreasing address order so that the
+// batch needs to sort them before merging.
+static void tlb_batch_invalidate_ranges(uvm_tlb_batch_t *batch, NvU64 stride, NvU64 size, NvU32 count)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 i;
+
+    for (i = count; i > 0; --i)
+        uvm_tlb_batch_invalidate(batch, (i - 1) * stride, size, UVM_PAGE_SIZE_4K, UVM_MEMBAR_NONE);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Check the invalidates captured by the fake host HAL and the TLB batch
+// counters for batches that need to be coalesced, overflow, or cross the
+// invalidate all cost threshold.
+static NV_STATUS test_tlb_batch_coalescing(uvm_gpu_t *gpu)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    uvm_page_tree_t tree;
+    uvm_tlb_batch_t *batch;
+    uvm_push_t push;
+    NvU32 saved_invalidate_all_cost = gpu->tlb_batch.invalidate_all_cost;
+    NvU32 depth_4k;
+    NvU64 merged_ranges;
+    NvU64 va_flushes;
+    NvU64 all_flushes_overflow;
+    NvU64 all_flushes_cost;
+    NvU32 pages_per_range;
+    NvU32 max_va_ranges;
+
+    batch = uvm_kvmalloc(sizeof(*batch));
+    if (!batch)
+        return NV_ERR_NO_MEMORY;
+
+    status = test_page_tree_init(gpu, BIG_PAGE_SIZE_PASCAL, &tree);
+    if (status != NV_OK)
+        goto done_free;
+
+    status = uvm_push_begin_fake(gpu, &push);
+    if (status != NV_OK)
+        goto done_tree;
+
+    depth_4k = tree.hal->page_table_depth(UVM_PAGE_SIZE_4K);
+
+    fake_tlb_invals_enable();
+
+    // Out of order, adjacent and overlapping ranges end up in a single
+    // targeted invalidate.
+    merged_ranges = atomic64_read(&gpu->tlb_batch.stats.merged_ranges);
+    va_flushes = atomic64_read(&gpu->tlb_batch.stats.va_flushes);
+
+    uvm_tlb_batch_begin(&tree, batch);
+    uvm_tlb_batch_invalidate(batch, 8 * 1024, 8 * 1024, UVM_PAGE_SIZE_4K, UVM_MEMBAR_NONE);
+    uvm_tlb_batch_invalidate(batch, 0, 4 * 1024, UVM_PAGE_SIZE_4K, UVM_MEMBAR_NONE);
+    uvm_tlb_batch_invalidate(batch, 12 * 1024, 8 * 1024, UVM_PAGE_SIZE_4K, UVM_MEMBAR_NONE);
+    uvm_tlb_batch_invalidate(batch, 4 * 1024, 4 * 1024, UVM_PAGE_SIZE_4K, UVM_MEMBAR_NONE);
+    uvm_tlb_batch_end(batch, &push, UVM_MEMBAR_SYS);
+
+    TEST_CHECK_GOTO(g_fake_invals_count == 1, done);
+    TEST_CHECK_GOTO(assert_invalidate_range_specific(&g_fake_invals[0], 0, 20 * 1024, UVM_PAGE_SIZE_4K, depth_4k, true),
+                    done);
+    TEST_CHECK_GOTO(g_fake_invals[0].membar == UVM_MEMBAR_SYS, done);
+    TEST_CHECK_GOTO(atomic64_read(&gpu->tlb_batch.stats.merged_ranges) == merged_ranges + 3, done);
+    TEST_CHECK_GOTO(atomic64_read(&gpu->tlb_batch.stats.va_flushes) == va_flushes + 1, done);
+    fake_tlb_invals_reset();
+
+    // Make the invalidate all expensive enough to only be used on overflow
+    gpu->tlb_batch.invalidate_all_cost = 1024 * 1024;
+
+    // Twice as many adjacent pages as batch entries are merged when the batch
+    // fills up and end up in a single targeted invalidate.
+    all_flushes_overflow = atomic64_read(&gpu->tlb_batch.stats.all_flushes_overflow);
+
+    uvm_tlb_batch_begin(&tree, batch);
+    tlb_batch_invalidate_ranges(batch, UVM_PAGE_SIZE_4K, UVM_PAGE_SIZE_4K, 2 * UVM_TLB_BATCH_MAX_ENTRIES);
+    uvm_tlb_batch_end(batch, &push, UVM_MEMBAR_NONE);
+
+    TEST_CHECK_GOTO(g_fake_invals_count == 1, done);
+    TEST_CHECK_GOTO(assert_invalidate_range_specific(&g_fake_invals[0],
+                                                     0,
+                                                     2 * UVM_TLB_BATCH_MAX_ENTRIES * UVM_PAGE_SIZE_4K,
+                                                     UVM_PAGE_SIZE_4K,
+                                                     depth_4k,
+                                                     false),
+                    done);
+    TEST_CHECK_GOTO(atomic64_read(&gpu->tlb_batch.stats.all_flushes_overflow) == all_flushes_overflow, done);
+    fake_tlb_invals_reset();
+
+    // Disjoint pages that don't fit in the batch overflow it
+    uvm_tlb_batch_begin(&tree, batch);
+    tlb_batch_invalidate_ranges(batch, 2 * UVM_PAGE_SIZE_4K, UVM_PAGE_SIZE_4K, UVM_TLB_BATCH_MAX_ENTRIES + 1);
+    uvm_tlb_batch_end(batch, &push, UVM_MEMBAR_NONE);
+
+    TEST_CHECK_GOTO(assert_last_invalidate_all(depth_4k, false), done);
+    TEST_CHECK_GOTO(atomic64_read(&gpu->tlb_batch.stats.all_flushes_overflow) == all_flushes_overflow + 1, done);
+    fake_tlb_invals_reset();
+
+    gpu->tlb_batch.invalidate_all_cost = saved_invalidate_all_cost;
+
+    // Targeted invalidates are used as long as they are not more expensive
+    // than an invalidate all. Use two pages per range so that the batch doesn't
+    // overflow before reaching the cost threshold on GPUs without VA range
+    // invalidates.
+    pages_per_range = gpu->tlb_batch.va_range_invalidate_supported ? 1 : 2;
+    max_va_ranges = gpu->tlb_batch.invalidate_all_cost / (gpu->tlb_batch.va_invalidate_cost * pages_per_range);
+    TEST_CHECK_GOTO(max_va_ranges < UVM_TLB_BATCH_MAX_ENTRIES, done);
+
+    va_flushes = atomic64_read(&gpu->tlb_batch.stats.va_flushes);
+    all_flushes_cost = atomic64_read(&gpu->tlb_batch.stats.all_flushes_cost);
+
+    uvm_tlb_batch_begin(&tree, batch);
+    tlb_batch_invalidate_ranges(batch, 4 * UVM_PAGE_SIZE_4K, pages_per_range * UVM_PAGE_SIZE_4K, max_va_ranges);
+    uvm_tlb_batch_end(batch, &push, UVM_MEMBAR_NONE);
+
+    TEST_CHECK_GOTO(g_fake_invals_count == max_va_ranges, done);
+    TEST_CHECK_GOTO(atomic64_read(&gpu->tlb_batch.stats.va_flushes) == va_flushes + 1, done);
+    fake_tlb_invals_reset();
+
+    uvm_tlb_batch_begin(&tree, batch);
+    tlb_batch_invalidate_ranges(batch, 4 * UVM_PAGE_SIZE_4K, pages_per_range * UVM_PAGE_SIZE_4K, max_va_ranges + 1);
+    uvm_tlb_batch_end(batch, &push, UVM_MEMBAR_NONE);
+
+    TEST_CHECK_GOTO(assert_last_invalidate_all(depth_4k, false), done);
+    TEST_CHECK_GOTO(atomic64_read(&gpu->tlb_batch.stats.all_flushes_cost) == all_flushes_cost + 1, done);
+
+done:
+    gpu->tlb_batch.invalidate_all_cost = saved_invalidate_all_cost;
+    fake_tlb_invals_disable();
+    uvm_push_end_fake(&push);
+
+done_tree:
+    uvm_page_tree_deinit(&tree);
+
+done_free:
+    uvm_kvfree(batch);
 
     return status;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -1092,6 +1246,130 @@ static NV_STATUS test_range_vec(uvm_gpu_t *gpu, NvU32 big_page_size, NvU32 page_
     return status;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Test that directories removed from the tree are reused from the tree's cache
+static NV_STATUS dir_cache_reuse(uvm_gpu_t *gpu)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_page_tree_t tree;
+    uvm_page_table_range_t range;
+    NvU64 num_allocs;
+    NvU64 num_hits;
+
+    MEM_NV_CHECK_RET(test_page_tree_init(gpu, BIG_PAGE_SIZE_PASCAL, &tree), NV_OK);
+
+    // The cache can be disabled or made too small with a module parameter
+    if (tree.dir_cache.capacity < 4) {
+        uvm_page_tree_deinit(&tree);
+        return NV_OK;
+    }
+
+    // A single 64K page needs 4 new directories below the root
+    num_allocs = atomic64_read(&tree.stats.num_dir_allocs);
+    MEM_NV_CHECK_RET(test_page_tree_get_ptes(&tree, UVM_PAGE_SIZE_64K, 0, UVM_PAGE_SIZE_64K, &range), NV_OK);
+    TEST_CHECK_RET(atomic64_read(&tree.stats.num_dir_allocs) == num_allocs + 4);
+
+    uvm_page_tree_put_ptes(&tree, &range);
+    TEST_CHECK_RET(tree.root->ref_count == 0);
+    TEST_CHECK_RET(tree.dir_cache.count == 4);
+
+    num_allocs = atomic64_read(&tree.stats.num_dir_allocs);
+    num_hits = atomic64_read(&tree.stats.num_dir_cache_hits);
+    MEM_NV_CHECK_RET(test_page_tree_get_ptes(&tree, UVM_PAGE_SIZE_64K, 0, UVM_PAGE_SIZE_64K, &range), NV_OK);
+    TEST_CHECK_RET(atomic64_read(&tree.stats.num_dir_allocs) == num_allocs);
+    TEST_CHECK_RET(atomic64_read(&tree.stats.num_dir_cache_hits) == num_hits + 4);
+    TEST_CHECK_RET(tree.dir_cache.count == 0);
+    TEST_CHECK_RET(range.table == tree.root->entries[0]->entries[0]->entries[0]->entries[0]);
+
+    uvm_page_tree_put_ptes(&tree, &range);
+    uvm_page_tree_deinit(&tree);
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Test that all the directories needed by a range vector are written with a
+// single push, and that they are reused from the cache once the range vector
+// is destroyed.
+static NV_STATUS range_vec_batched_dirs(uvm_gpu_t *gpu)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_page_tree_t tree;
+    uvm_page_table_range_vec_t *range_vec;
+    NvU64 pde_coverage;
+    NvU64 start = 1024ULL * 1024 * 1024;
+    NvU64 num_allocs;
+    NvU64 num_hits;
+    NvU64 num_pushes;
+
+    MEM_NV_CHECK_RET(test_page_tree_init(gpu, BIG_PAGE_SIZE_PASCAL, &tree), NV_OK);
+
+    pde_coverage = uvm_mmu_pde_coverage(&tree, UVM_PAGE_SIZE_64K);
+
+    // Three page tables under a single directory at each of the upper levels
+    num_allocs = atomic64_read(&tree.stats.num_dir_allocs);
+    num_pushes = atomic64_read(&tree.stats.num_pushes);
+    TEST_CHECK_RET(uvm_page_table_range_vec_create(&tree, start, 3 * pde_coverage, UVM_PAGE_SIZE_64K, &range_vec) == NV_OK);
+    TEST_CHECK_RET(range_vec->range_count == 3);
+    TEST_CHECK_RET(atomic64_read(&tree.stats.num_dir_allocs) == num_allocs + 6);
+    TEST_CHECK_RET(atomic64_read(&tree.stats.num_pushes) == num_pushes + 1);
+    uvm_page_table_range_vec_destroy(range_vec);
+
+    if (tree.dir_cache.capacity >= 6) {
+        num_allocs = atomic64_read(&tree.stats.num_dir_allocs);
+        num_hits = atomic64_read(&tree.stats.num_dir_cache_hits);
+        num_pushes = atomic64_read(&tree.stats.num_pushes);
+        TEST_CHECK_RET(uvm_page_table_range_vec_create(&tree, start, 3 * pde_coverage, UVM_PAGE_SIZE_64K, &range_vec) == NV_OK);
+        TEST_CHECK_RET(atomic64_read(&tree.stats.num_dir_allocs) == num_allocs);
+        TEST_CHECK_RET(atomic64_read(&tree.stats.num_dir_cache_hits) == num_hits + 6);
+        TEST_CHECK_RET(atomic64_read(&tree.stats.num_pushes) == num_pushes + 1);
+        uvm_page_table_range_vec_destroy(range_vec);
+    }
+
+    TEST_CHECK_RET(tree.root->ref_count == 0);
+    uvm_page_tree_deinit(&tree);
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Test a range vector that needs more directories than can be written with a
+// single push
+static NV_STATUS range_vec_many_dirs(uvm_gpu_t *gpu)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_page_tree_t tree;
+    uvm_page_table_range_vec_t *range_vec;
+    NvU64 pde_coverage;
+    NvU64 start = 1024ULL * 1024 * 1024;
+    const size_t num_tables = 2 * UVM_PAGE_TABLE_RANGE_VEC_DIRS_PER_PUSH;
+    const NvU64 num_dirs = num_tables + 3;
+    NvU64 num_allocs;
+    NvU64 num_pushes;
+    size_t i;
+
+    MEM_NV_CHECK_RET(test_page_tree_init(gpu, BIG_PAGE_SIZE_PASCAL, &tree), NV_OK);
+
+    pde_coverage = uvm_mmu_pde_coverage(&tree, UVM_PAGE_SIZE_64K);
+
+    // The page tables are all under a single directory at each of the upper
+    // levels
+    num_allocs = atomic64_read(&tree.stats.num_dir_allocs);
+    num_pushes = atomic64_read(&tree.stats.num_pushes);
+    TEST_CHECK_RET(uvm_page_table_range_vec_create(&tree,
+                                                   start,
+                                                   num_tables * pde_coverage,
+                                                   UVM_PAGE_SIZE_64K,
+                                                   &range_vec) == NV_OK);
+    TEST_CHECK_RET(range_vec->range_count == num_tables);
+    TEST_CHECK_RET(atomic64_read(&tree.stats.num_dir_allocs) == num_allocs + num_dirs);
+    TEST_CHECK_RET(atomic64_read(&tree.stats.num_pushes) >=
+                   num_pushes + DIV_ROUND_UP(num_dirs, UVM_PAGE_TABLE_RANGE_VEC_DIRS_PER_PUSH));
+
+    for (i = 0; i < range_vec->range_count; ++i) {
+        TEST_CHECK_RET(range_vec->ranges[i].table != NULL);
+        TEST_CHECK_RET(range_vec->ranges[i].table->depth == tree.hal->page_table_depth(UVM_PAGE_SIZE_64K));
+    }
+
+    uvm_page_table_range_vec_destroy(range_vec);
+
+    TEST_CHECK_RET(tree.root->ref_count == 0);
+    uvm_page_tree_deinit(&tree);
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 static NV_STATUS alloc_64k_memory_kepler(uvm_gpu_t *gpu)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     uvm_page_tree_t tree;
@@ -1676,6 +1954,7 @@ static NV_STATUS volta_test_page_tree(uvm_gpu_t *volta)
     TEST_CHECK_RET(fake_gpu_init_volta(volta) == NV_OK);
 
     MEM_NV_CHECK_RET(entry_test_volta(volta, entry_test_page_size_volta), NV_OK);
+    MEM_NV_CHECK_RET(test_tlb_batch_coalescing(volta), NV_OK);
 
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -1683,7 +1962,7 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 static NV_STATUS pascal_test_page_tree(uvm_gpu_t *pascal)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     // create a fake Pascal GPU for this test.
-    NvU32 tlb_batch_saved_max_pages;
+    NvU32 tlb_batch_saved_invalidate_all_cost;
     static const NvU32 page_sizes[] = {UVM_PAGE_SIZE_4K, UVM_PAGE_SIZE_64K, UVM_PAGE_SIZE_2M};
     NvU32 i, page_size;
 
@@ -1709,12 +1988,16 @@ static NV_STATUS pascal_test_page_tree(uvm_gpu_t *pascal)
     MEM_NV_CHECK_RET(fast_split_double_backoff(pascal), NV_OK);
     MEM_NV_CHECK_RET(test_pascal_tlb_invalidates(pascal), NV_OK);
     MEM_NV_CHECK_RET(test_pascal_tlb_batch_invalidates(pascal), NV_OK);
-
-    // Run the test again with a bigger limit on max pages
-    tlb_batch_saved_max_pages = pascal->tlb_batch.max_pages;
-    pascal->tlb_batch.max_pages = 1024 * 1024;
+    MEM_NV_CHECK_RET(test_tlb_batch_coalescing(pascal), NV_OK);
+    MEM_NV_CHECK_RET(dir_cache_reuse(pascal), NV_OK);
+    MEM_NV_CHECK_RET(range_vec_batched_dirs(pascal), NV_OK);
+    MEM_NV_CHECK_RET(range_vec_many_dirs(pascal), NV_OK);
+
+    // Run the test again with a more expensive invalidate all
+    tlb_batch_saved_invalidate_all_cost = pascal->tlb_batch.invalidate_all_cost;
+    pascal->tlb_batch.invalidate_all_cost = 1024 * 1024;
     MEM_NV_CHECK_RET(test_pascal_tlb_batch_invalidates(pascal), NV_OK);
-    pascal->tlb_batch.max_pages = tlb_batch_saved_max_pages;
+    pascal->tlb_batch.invalidate_all_cost = tlb_batch_saved_invalidate_all_cost;
 
     // And with per VA invalidates disabled
     pascal->tlb_batch.va_invalidate_supported = false;
@@ -38,8 +38,16 @@ void uvm_hal_pascal_arch_init_properties(uvm_gpu_t *gpu)
 
     gpu->tlb_batch.va_range_invalidate_supported = false;
 
-    // TODO: Bug 1767241: Run benchmarks to figure out a good number
-    gpu->tlb_batch.max_pages = 32;
+    // Each page is invalidated with a separate method, so prefer targeted
+    // invalidates for up to 32 pages.
+    // TODO: Bug 1767241: Run benchmarks to figure out good costs
+    gpu->tlb_batch.va_invalidate_cost = 1;
+    gpu->tlb_batch.invalidate_all_cost = 32;
+
+    // A single CE can't saturate PCIe Gen3 x16 or NVLINK1 in both directions,
+    // so split the copy of a full VA block in two stripes.
+    // TODO: Bug 1767241: Run benchmarks to figure out good stripe sizes
+    gpu->copy_stripes.stripe_size = 1024 * 1024;
 
     gpu->utlb_per_gpc_count = uvm_pascal_get_utlbs_per_gpc(gpu);
 
@@ -27,6 +27,7 @@
 #include "uvm8_perf_thrashing.h"
 #include "uvm8_perf_prefetch.h"
 #include "uvm8_gpu_access_counters.h"
+#include "uvm8_perf_pte_promotion.h"
 #include "uvm8_va_space.h"
 
 NV_STATUS uvm_perf_heuristics_init()
@@ -45,11 +46,16 @@ NV_STATUS uvm_perf_heuristics_init()
     if (status != NV_OK)
         return status;
 
+    status = uvm_perf_pte_promotion_init();
+    if (status != NV_OK)
+        return status;
+
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 void uvm_perf_heuristics_exit()
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_perf_pte_promotion_exit();
     uvm_perf_access_counters_exit();
     uvm_perf_prefetch_exit();
     uvm_perf_thrashing_exit();
@@ -80,6 +86,9 @@ NV_STATUS uvm_perf_heuristics_load(uvm_va_space_t *va_space)
     if (status != NV_OK)
         return status;
     status = uvm_perf_access_counters_load(va_space);
+    if (status != NV_OK)
+        return status;
+    status = uvm_perf_pte_promotion_load(va_space);
     if (status != NV_OK)
         return status;
 
@@ -99,12 +108,15 @@ void uvm_perf_heuristics_stop(uvm_va_space_t *va_space)
 
     // Prefetch heuristics don't need a stop operation for now
     uvm_perf_thrashing_stop(va_space);
+    uvm_perf_access_counters_stop(va_space);
+    uvm_perf_pte_promotion_stop(va_space);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 void uvm_perf_heuristics_unload(uvm_va_space_t *va_space)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     uvm_assert_rwsem_locked_write(&va_space->lock);
 
+    uvm_perf_pte_promotion_unload(va_space);
     uvm_perf_access_counters_unload(va_space);
     uvm_perf_prefetch_unload(va_space);
     uvm_perf_thrashing_unload(va_space);
@@ -0,0 +1,196 @@
+#include <linux/kernel.h>
+/*******************************************************************************
+    Copyright (c) 2019 NVIDIA Corporation
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+        The above copyright notice and this permission notice shall be
+        included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+
+*******************************************************************************/
+
+
+#include "uvm8_perf_hotness.h"
+#include "uvm8_perf_utils.h"
+#include "uvm8_va_block.h"
+
+// Odd multipliers for the multiply-shift hash of each row of the sketch
+static const NvU64 g_hotness_sketch_seeds[UVM_PERF_HOTNESS_SKETCH_DEPTH] =
+{
+    0x9e3779b97f4a7c15ULL,
+    0xc2b2ae3d27d4eb4fULL,
+    0x165667b19e3779f9ULL,
+    0xd6e8feb86659fd93ULL,
+};
+
+static NvU64 hotness_key(NvU64 block_start, uvm_processor_id_t processor)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    // VA blocks are page-aligned, so the processor id fits in the low bits
+    BUILD_BUG_ON(UVM_ID_MAX_PROCESSORS > PAGE_SIZE);
+    UVM_ASSERT(IS_ALIGNED(block_start, PAGE_SIZE));
+
+    return block_start | uvm_id_value(processor);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NvU32 hotness_sketch_index(NvU64 key, NvU32 row)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return (NvU32)((key * g_hotness_sketch_seeds[row]) >> (64 - UVM_PERF_HOTNESS_SKETCH_WIDTH_SHIFT));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NvU32 hotness_sketch_estimate(const uvm_perf_hotness_map_t *map, NvU64 key)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 row;
+    NvU32 estimate = U32_MAX;
+
+    for (row = 0; row < UVM_PERF_HOTNESS_SKETCH_DEPTH; ++row)
+        estimate = min(estimate, map->counters[row][hotness_sketch_index(key, row)]);
+
+    return estimate;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Conservative update: only the counters that are below the new estimate are
+// raised, which keeps the overestimation caused by collisions low.
+static NvU32 hotness_sketch_add(uvm_perf_hotness_map_t *map, NvU64 key, NvU32 weight)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 row;
+    NvU32 estimate = hotness_sketch_estimate(map, key);
+
+    UVM_PERF_SATURATING_ADD(estimate, weight);
+
+    for (row = 0; row < UVM_PERF_HOTNESS_SKETCH_DEPTH; ++row) {
+        NvU32 *counter = &map->counters[row][hotness_sketch_index(key, row)];
+        *counter = max(*counter, estimate);
+    }
+
+    return estimate;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void hotness_candidate_remove(uvm_perf_hotness_map_t *map, NvU32 index)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ASSERT(index < map->num_candidates);
+
+    --map->num_candidates;
+    if (index != map->num_candidates)
+        map->candidates[index] = map->candidates[map->num_candidates];
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_perf_hotness_map_init(uvm_perf_hotness_map_t *map)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    memset(map, 0, sizeof(*map));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NvU32 uvm_perf_hotness_map_record(uvm_perf_hotness_map_t *map,
+                                  NvU64 block_start,
+                                  uvm_processor_id_t processor,
+                                  const uvm_page_mask_t *accessed_pages,
+                                  NvU32 weight)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 index;
+    NvU32 coldest = 0;
+    uvm_perf_hotness_candidate_t *candidate;
+    NvU64 key = hotness_key(block_start, processor);
+    NvU32 hotness = hotness_sketch_add(map, key, weight);
+
+    for (index = 0; index < map->num_candidates; ++index) {
+        candidate = &map->candidates[index];
+
+        if (candidate->block_start == block_start && uvm_id_equal(candidate->processor, processor)) {
+            candidate->hotness = hotness;
+            uvm_page_mask_or(&candidate->accessed_pages, &candidate->accessed_pages, accessed_pages);
+            return hotness;
+        }
+
+        if (candidate->hotness < map->candidates[coldest].hotness)
+            coldest = index;
+    }
+
+    if (map->num_candidates < UVM_PERF_HOTNESS_CANDIDATES_MAX) {
+        candidate = &map->candidates[map->num_candidates++];
+    }
+    else {
+        candidate = &map->candidates[coldest];
+        if (candidate->hotness >= hotness)
+            return hotness;
+    }
+
+    candidate->block_start = block_start;
+    candidate->processor = processor;
+    candidate->hotness = hotness;
+    uvm_page_mask_copy(&candidate->accessed_pages, accessed_pages);
+
+    return hotness;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NvU32 uvm_perf_hotness_map_estimate(const uvm_perf_hotness_map_t *map,
+                                    NvU64 block_start,
+                                    uvm_processor_id_t processor)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return hotness_sketch_estimate(map, hotness_key(block_start, processor));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NvU32 uvm_perf_hotness_map_select(uvm_perf_hotness_map_t *map,
+                                  NvU64 budget_bytes,
+                                  uvm_perf_hotness_candidate_t *candidates_out,
+                                  NvU32 max_candidates)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 num_selected = 0;
+    NvU64 selected_bytes = 0;
+
+    while (map->num_candidates > 0 && num_selected < max_candidates) {
+        NvU32 index;
+        NvU32 hottest = 0;
+        NvU64 bytes;
+
+        for (index = 1; index < map->num_candidates; ++index) {
+            if (map->candidates[index].hotness > map->candidates[hottest].hotness)
+                hottest = index;
+        }
+
+        bytes = (NvU64)uvm_page_mask_weight(&map->candidates[hottest].accessed_pages) * PAGE_SIZE;
+        if (num_selected > 0 && selected_bytes + bytes > budget_bytes)
+            break;
+
+        candidates_out[num_selected++] = map->candidates[hottest];
+        selected_bytes += bytes;
+
+        hotness_candidate_remove(map, hottest);
+    }
+
+    return num_selected;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_perf_hotness_map_age(uvm_perf_hotness_map_t *map)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 row;
+    NvU32 col;
+    NvU32 index;
+
+    for (row = 0; row < UVM_PERF_HOTNESS_SKETCH_DEPTH; ++row) {
+        for (col = 0; col < UVM_PERF_HOTNESS_SKETCH_WIDTH; ++col)
+            map->counters[row][col] /= 2;
+    }
+
+    // Candidates that cooled down completely are dropped
+    index = 0;
+    while (index < map->num_candidates) {
+        map->candidates[index].hotness /= 2;
+
+        if (map->candidates[index].hotness == 0)
+            hotness_candidate_remove(map, index);
+        else
+            ++index;
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
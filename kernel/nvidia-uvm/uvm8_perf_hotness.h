@@ -0,0 +1,112 @@
+#include <linux/kernel.h>
+/*******************************************************************************
+    Copyright (c) 2019 NVIDIA Corporation
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+        The above copyright notice and this permission notice shall be
+        included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+
+*******************************************************************************/
+
+
+#ifndef __UVM8_PERF_HOTNESS_H__
+#define __UVM8_PERF_HOTNESS_H__
+
+#include "uvm_common.h"
+#include "uvm8_processors.h"
+#include "uvm8_va_block_types.h"
+
+// Aggregation of access counter notifications into a per-VA space hotness map.
+//
+// Notifications are keyed by {VA block start, accessing processor} and
+// accumulated in a count-min sketch, which provides an estimate of the number
+// of remote accesses per key that never undercounts and uses a fixed amount of
+// memory regardless of the number of VA blocks being accessed. The sketch
+// cannot be enumerated, so the hottest keys are also tracked in a small
+// candidate table, together with the union of the pages reported for them.
+// When the table is full, a new key replaces the coldest candidate only if its
+// estimate is higher.
+//
+// The map does not do any locking. Callers are responsible for serializing
+// accesses to it.
+
+#define UVM_PERF_HOTNESS_SKETCH_DEPTH       4
+#define UVM_PERF_HOTNESS_SKETCH_WIDTH_SHIFT 8
+#define UVM_PERF_HOTNESS_SKETCH_WIDTH       (1 << UVM_PERF_HOTNESS_SKETCH_WIDTH_SHIFT)
+#define UVM_PERF_HOTNESS_CANDIDATES_MAX     32
+
+typedef struct
+{
+    // Start address of the VA block at the time of the notification. The VA
+    // block may have been split or destroyed since then, so users must look
+    // it up again.
+    NvU64 block_start;
+
+    // Processor that accessed the block remotely, and to which the pages are
+    // promoted
+    uvm_processor_id_t processor;
+
+    // Estimate of the number of accesses to the block the last time it was
+    // updated
+    NvU32 hotness;
+
+    // Pages reported as accessed by the notifications. The mask is relative
+    // to block_start.
+    uvm_page_mask_t accessed_pages;
+} uvm_perf_hotness_candidate_t;
+
+typedef struct
+{
+    NvU32 counters[UVM_PERF_HOTNESS_SKETCH_DEPTH][UVM_PERF_HOTNESS_SKETCH_WIDTH];
+
+    uvm_perf_hotness_candidate_t candidates[UVM_PERF_HOTNESS_CANDIDATES_MAX];
+
+    NvU32 num_candidates;
+} uvm_perf_hotness_map_t;
+
+void uvm_perf_hotness_map_init(uvm_perf_hotness_map_t *map);
+
+// Add weight accesses to the given pages of the block starting at block_start
+// by processor. Returns the updated hotness estimate for the block.
+NvU32 uvm_perf_hotness_map_record(uvm_perf_hotness_map_t *map,
+                                  NvU64 block_start,
+                                  uvm_processor_id_t processor,
+                                  const uvm_page_mask_t *accessed_pages,
+                                  NvU32 weight);
+
+// Return the hotness estimate for the block starting at block_start accessed by
+// processor. The estimate is never lower than the number of recorded accesses.
+NvU32 uvm_perf_hotness_map_estimate(const uvm_perf_hotness_map_t *map,
+                                    NvU64 block_start,
+                                    uvm_processor_id_t processor);
+
+// Remove candidates from the table in decreasing hotness order and copy them
+// to candidates_out, until budget_bytes worth of accessed pages have been
+// selected or max_candidates have been written. The hottest candidate is
+// always selected, even if it exceeds the budget on its own, so that large
+// blocks don't starve. Returns the number of candidates written.
+NvU32 uvm_perf_hotness_map_select(uvm_perf_hotness_map_t *map,
+                                  NvU64 budget_bytes,
+                                  uvm_perf_hotness_candidate_t *candidates_out,
+                                  NvU32 max_candidates);
+
+// Halve all the counters in the sketch and the candidate table, so that old
+// accesses weigh less than recent ones. Candidates whose hotness drops to 0 are
+// removed from the table.
+void uvm_perf_hotness_map_age(uvm_perf_hotness_map_t *map);
+
+#endif // __UVM8_PERF_HOTNESS_H__
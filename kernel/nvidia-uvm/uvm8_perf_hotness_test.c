@@ -0,0 +1,256 @@
+#include <linux/kernel.h>
+/*******************************************************************************
+    Copyright (c) 2019 NVIDIA Corporation
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+        The above copyright notice and this permission notice shall be
+        included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+
+*******************************************************************************/
+
+
+#include "uvm8_perf_hotness.h"
+#include "uvm8_va_block.h"
+#include "uvm8_kvmalloc.h"
+#include "uvm8_test.h"
+#include "uvm8_test_rng.h"
+
+#define HOTNESS_TEST_BASE_ADDR (1ULL << 40)
+
+// Number of distinct blocks in the synthetic notification stream. It is much
+// larger than the width of the sketch to force collisions.
+#define HOTNESS_TEST_NUM_BLOCKS (UVM_PERF_HOTNESS_SKETCH_WIDTH * 4)
+
+// Number of hottest blocks in the synthetic stream expected to be in the
+// candidate table
+#define HOTNESS_TEST_NUM_HOT_BLOCKS 4
+
+static NvU64 test_block_start(NvU32 index)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return HOTNESS_TEST_BASE_ADDR + index * UVM_VA_BLOCK_SIZE;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static bool test_is_candidate(const uvm_perf_hotness_map_t *map, NvU64 block_start, uvm_processor_id_t processor)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 index;
+
+    for (index = 0; index < map->num_candidates; ++index) {
+        const uvm_perf_hotness_candidate_t *candidate = &map->candidates[index];
+
+        if (candidate->block_start == block_start && uvm_id_equal(candidate->processor, processor))
+            return true;
+    }
+
+    return false;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS test_record(uvm_perf_hotness_map_t *map)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_page_mask_t pages;
+    const uvm_processor_id_t gpu_id = uvm_gpu_id_from_index(0);
+
+    uvm_perf_hotness_map_init(map);
+
+    uvm_page_mask_zero(&pages);
+    uvm_page_mask_region_fill(&pages, uvm_va_block_region(0, 4));
+    TEST_CHECK_RET(uvm_perf_hotness_map_record(map, test_block_start(0), gpu_id, &pages, 5) == 5);
+    TEST_CHECK_RET(uvm_perf_hotness_map_estimate(map, test_block_start(0), gpu_id) == 5);
+    TEST_CHECK_RET(map->num_candidates == 1);
+
+    // Notifications for the same block and processor are merged
+    uvm_page_mask_zero(&pages);
+    uvm_page_mask_region_fill(&pages, uvm_va_block_region(8, 12));
+    TEST_CHECK_RET(uvm_perf_hotness_map_record(map, test_block_start(0), gpu_id, &pages, 3) == 8);
+    TEST_CHECK_RET(map->num_candidates == 1);
+    TEST_CHECK_RET(map->candidates[0].hotness == 8);
+    TEST_CHECK_RET(uvm_page_mask_weight(&map->candidates[0].accessed_pages) == 8);
+
+    // The same block accessed by a different processor is tracked separately
+    TEST_CHECK_RET(uvm_perf_hotness_map_record(map, test_block_start(0), UVM_ID_CPU, &pages, 1) >= 1);
+    TEST_CHECK_RET(map->num_candidates == 2);
+    TEST_CHECK_RET(uvm_perf_hotness_map_estimate(map, test_block_start(0), gpu_id) >= 8);
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Feed a skewed stream of synthetic notifications, in which the i-th block is
+// accessed roughly HOTNESS_TEST_NUM_BLOCKS / (i + 1) times, in random order.
+// Check that the sketch never underestimates and that the hottest blocks are
+// kept in the candidate table.
+static NV_STATUS test_synthetic_stream(uvm_perf_hotness_map_t *map, NvU32 seed)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    NvU32 *remaining;
+    NvU32 *recorded;
+    NvU32 index;
+    NvU32 total = 0;
+    uvm_test_rng_t rng;
+    uvm_page_mask_t pages;
+    const uvm_processor_id_t gpu_id = uvm_gpu_id_from_index(0);
+
+    remaining = uvm_kvmalloc_zero(HOTNESS_TEST_NUM_BLOCKS * sizeof(*remaining));
+    recorded = uvm_kvmalloc_zero(HOTNESS_TEST_NUM_BLOCKS * sizeof(*recorded));
+    if (!remaining || !recorded) {
+        status = NV_ERR_NO_MEMORY;
+        goto done;
+    }
+
+    uvm_test_rng_init(&rng, seed);
+    uvm_perf_hotness_map_init(map);
+    uvm_page_mask_zero(&pages);
+    uvm_page_mask_set(&pages, 0);
+
+    for (index = 0; index < HOTNESS_TEST_NUM_BLOCKS; ++index) {
+        remaining[index] = HOTNESS_TEST_NUM_BLOCKS / (index + 1);
+        total += remaining[index];
+    }
+
+    while (total > 0) {
+        // Pick a random pending notification, weighted by the number of
+        // notifications left for each block
+        NvU32 pick = uvm_test_rng_range_32(&rng, 0, total - 1);
+        NvU32 weight = uvm_test_rng_range_32(&rng, 1, 4);
+
+        for (index = 0; pick >= remaining[index]; ++index)
+            pick -= remaining[index];
+
+        uvm_perf_hotness_map_record(map, test_block_start(index), gpu_id, &pages, weight);
+        recorded[index] += weight;
+        --remaining[index];
+        --total;
+    }
+
+    for (index = 0; index < HOTNESS_TEST_NUM_BLOCKS; ++index)
+        TEST_CHECK_GOTO(uvm_perf_hotness_map_estimate(map, test_block_start(index), gpu_id) >= recorded[index], done);
+
+    TEST_CHECK_GOTO(map->num_candidates == UVM_PERF_HOTNESS_CANDIDATES_MAX, done);
+
+    for (index = 0; index < HOTNESS_TEST_NUM_HOT_BLOCKS; ++index)
+        TEST_CHECK_GOTO(test_is_candidate(map, test_block_start(index), gpu_id), done);
+
+done:
+    uvm_kvfree(remaining);
+    uvm_kvfree(recorded);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS test_select(uvm_perf_hotness_map_t *map, uvm_perf_hotness_candidate_t *selected)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 index;
+    NvU32 num_selected;
+    uvm_page_mask_t pages;
+    const uvm_processor_id_t gpu_id = uvm_gpu_id_from_index(0);
+
+    uvm_perf_hotness_map_init(map);
+
+    // Block i has i + 1 accessed pages and hotness (i + 1) * 10
+    for (index = 0; index < 8; ++index) {
+        uvm_page_mask_zero(&pages);
+        uvm_page_mask_region_fill(&pages, uvm_va_block_region(0, index + 1));
+        uvm_perf_hotness_map_record(map, test_block_start(index), gpu_id, &pages, (index + 1) * 10);
+    }
+
+    // Candidates are selected in decreasing hotness order within the budget:
+    // 8 + 7 pages fit in 16 pages, 8 + 7 + 6 don't
+    num_selected = uvm_perf_hotness_map_select(map, 16 * PAGE_SIZE, selected, UVM_PERF_HOTNESS_CANDIDATES_MAX);
+    TEST_CHECK_RET(num_selected == 2);
+    TEST_CHECK_RET(selected[0].block_start == test_block_start(7));
+    TEST_CHECK_RET(selected[1].block_start == test_block_start(6));
+    TEST_CHECK_RET(map->num_candidates == 6);
+
+    // The hottest candidate is selected even if it doesn't fit in the budget
+    num_selected = uvm_perf_hotness_map_select(map, PAGE_SIZE, selected, UVM_PERF_HOTNESS_CANDIDATES_MAX);
+    TEST_CHECK_RET(num_selected == 1);
+    TEST_CHECK_RET(selected[0].block_start == test_block_start(5));
+    TEST_CHECK_RET(uvm_page_mask_weight(&selected[0].accessed_pages) == 6);
+
+    // Limit on the number of candidates
+    num_selected = uvm_perf_hotness_map_select(map, UVM_VA_BLOCK_SIZE, selected, 2);
+    TEST_CHECK_RET(num_selected == 2);
+    TEST_CHECK_RET(selected[0].block_start == test_block_start(4));
+    TEST_CHECK_RET(selected[1].block_start == test_block_start(3));
+
+    num_selected = uvm_perf_hotness_map_select(map, UVM_VA_BLOCK_SIZE, selected, UVM_PERF_HOTNESS_CANDIDATES_MAX);
+    TEST_CHECK_RET(num_selected == 3);
+    TEST_CHECK_RET(map->num_candidates == 0);
+
+    TEST_CHECK_RET(uvm_perf_hotness_map_select(map, UVM_VA_BLOCK_SIZE, selected, UVM_PERF_HOTNESS_CANDIDATES_MAX) == 0);
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS test_age(uvm_perf_hotness_map_t *map)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_page_mask_t pages;
+    const uvm_processor_id_t gpu_id = uvm_gpu_id_from_index(0);
+
+    uvm_perf_hotness_map_init(map);
+    uvm_page_mask_zero(&pages);
+    uvm_page_mask_set(&pages, 0);
+
+    uvm_perf_hotness_map_record(map, test_block_start(0), gpu_id, &pages, 100);
+    uvm_perf_hotness_map_record(map, test_block_start(1), gpu_id, &pages, 1);
+    TEST_CHECK_RET(map->num_candidates == 2);
+
+    uvm_perf_hotness_map_age(map);
+
+    // The cold block is dropped from the candidate table
+    TEST_CHECK_RET(map->num_candidates == 1);
+    TEST_CHECK_RET(map->candidates[0].block_start == test_block_start(0));
+    TEST_CHECK_RET(map->candidates[0].hotness == 50);
+    TEST_CHECK_RET(uvm_perf_hotness_map_estimate(map, test_block_start(0), gpu_id) == 50);
+
+    // New notifications build on the decayed estimate
+    TEST_CHECK_RET(uvm_perf_hotness_map_record(map, test_block_start(0), gpu_id, &pages, 10) == 60);
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NV_STATUS uvm8_test_perf_hotness_sanity(UVM_TEST_PERF_HOTNESS_SANITY_PARAMS *params, struct file *filp)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+    uvm_perf_hotness_map_t *map;
+    uvm_perf_hotness_candidate_t *selected;
+
+    map = uvm_kvmalloc(sizeof(*map));
+    selected = uvm_kvmalloc(sizeof(*selected) * UVM_PERF_HOTNESS_CANDIDATES_MAX);
+    if (!map || !selected) {
+        status = NV_ERR_NO_MEMORY;
+        goto done;
+    }
+
+    status = test_record(map);
+    if (status != NV_OK)
+        goto done;
+
+    status = test_synthetic_stream(map, params->seed);
+    if (status != NV_OK)
+        goto done;
+
+    status = test_select(map, selected);
+    if (status != NV_OK)
+        goto done;
+
+    status = test_age(map);
+
+done:
+    uvm_kvfree(map);
+    uvm_kvfree(selected);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
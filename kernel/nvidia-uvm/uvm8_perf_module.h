@@ -49,6 +49,8 @@
 // - UVM_PERF_MODULE_TYPE_PREFETCH: detects memory prefetching opportunities
 // - UVM_PERF_MODULE_TYPE_ACCESS_COUNTERS: migrates memory using access counter
 // notifications
+// - UVM_PERF_MODULE_TYPE_PTE_PROMOTION: re-maps VA blocks with larger GPU PTEs
+// after migrations and revocations
 typedef enum
 {
     UVM_PERF_MODULE_FIRST_TYPE     = 0,
@@ -57,6 +59,7 @@ typedef enum
     UVM_PERF_MODULE_TYPE_THRASHING,
     UVM_PERF_MODULE_TYPE_PREFETCH,
     UVM_PERF_MODULE_TYPE_ACCESS_COUNTERS,
+    UVM_PERF_MODULE_TYPE_PTE_PROMOTION,
 
     UVM_PERF_MODULE_TYPE_COUNT,
 } uvm_perf_module_type_t;
@@ -0,0 +1,337 @@
+#include <linux/kernel.h>
+/*******************************************************************************
+    Copyright (c) 2019 NVIDIA Corporation
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+        The above copyright notice and this permission notice shall be
+        included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+
+*******************************************************************************/
+
+
+#include "uvm8_perf_pte_promotion.h"
+#include "uvm8_perf_module.h"
+#include "uvm8_va_block.h"
+#include "uvm8_va_range.h"
+#include "uvm8_va_space.h"
+#include "uvm8_gpu.h"
+
+// Per-VA space state of the PTE promotion scanner
+typedef struct
+{
+    uvm_va_space_t *va_space;
+
+    // Work descriptor that is executed asynchronously by a helper thread
+    struct delayed_work dwork;
+
+    uvm_spinlock_t lock;
+
+    // Set by the events that may leave mappings eligible for promotion.
+    // Protected by lock.
+    bool pending_events;
+
+    // Flag used to avoid scheduling scans after uvm_perf_pte_promotion_stop
+    // has been called. Protected by lock.
+    bool in_va_space_teardown;
+
+    // Address from which the next scan resumes. Only accessed by the dwork
+    // function.
+    NvU64 next_address;
+
+    // Only accessed by the dwork function
+    uvm_va_block_context_t *block_context;
+} va_space_pte_promotion_info_t;
+
+#define UVM_PERF_PTE_PROMOTION_PERIOD_MS_DEFAULT 100
+#define UVM_PERF_PTE_PROMOTION_MAX_BLOCKS_DEFAULT 64
+
+static unsigned g_uvm_perf_pte_promotion_period_ms __read_mostly;
+static unsigned g_uvm_perf_pte_promotion_max_blocks __read_mostly;
+
+static unsigned uvm_perf_pte_promotion_enable = 0;
+static unsigned uvm_perf_pte_promotion_period_ms = UVM_PERF_PTE_PROMOTION_PERIOD_MS_DEFAULT;
+static unsigned uvm_perf_pte_promotion_max_blocks = UVM_PERF_PTE_PROMOTION_MAX_BLOCKS_DEFAULT;
+
+module_param(uvm_perf_pte_promotion_enable, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_perf_pte_promotion_enable,
+                 "Scan VA blocks in the background after migrations and revocations, and re-map them "
+                 "with larger GPU PTEs when their residency and permissions allow it.");
+module_param(uvm_perf_pte_promotion_period_ms, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_perf_pte_promotion_period_ms, "Time in ms between PTE promotion scans.");
+module_param(uvm_perf_pte_promotion_max_blocks, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_perf_pte_promotion_max_blocks, "Maximum number of VA blocks scanned per PTE promotion scan.");
+
+static void pte_promotion_event_cb(uvm_perf_event_t event_id, uvm_perf_event_data_t *event_data);
+
+static uvm_perf_module_event_callback_desc_t g_callbacks_pte_promotion[] = {
+    { UVM_PERF_EVENT_MIGRATION,  pte_promotion_event_cb },
+    { UVM_PERF_EVENT_REVOCATION, pte_promotion_event_cb }
+};
+
+// Performance heuristics module for PTE promotion
+static uvm_perf_module_t g_module_pte_promotion;
+
+// Get the PTE promotion tracking struct for the given VA space if it exists.
+// It only exists if the scanner is enabled.
+static va_space_pte_promotion_info_t *va_space_pte_promotion_info_get_or_null(uvm_va_space_t *va_space)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return uvm_perf_module_type_data(va_space->perf_modules_data, UVM_PERF_MODULE_TYPE_PTE_PROMOTION);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void pte_promotion_event_cb(uvm_perf_event_t event_id, uvm_perf_event_data_t *event_data)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_va_block_t *va_block;
+    va_space_pte_promotion_info_t *va_space_pte_promotion;
+
+    if (event_id == UVM_PERF_EVENT_MIGRATION) {
+        va_block = event_data->migration.block;
+    }
+    else {
+        UVM_ASSERT(event_id == UVM_PERF_EVENT_REVOCATION);
+        va_block = event_data->revocation.block;
+    }
+
+    va_space_pte_promotion = va_space_pte_promotion_info_get_or_null(va_block->va_range->va_space);
+    if (!va_space_pte_promotion)
+        return;
+
+    uvm_spin_lock(&va_space_pte_promotion->lock);
+
+    va_space_pte_promotion->pending_events = true;
+
+    // The work is only queued if it is not pending already
+    if (!va_space_pte_promotion->in_va_space_teardown) {
+        schedule_delayed_work(&va_space_pte_promotion->dwork,
+                              msecs_to_jiffies(g_uvm_perf_pte_promotion_period_ms));
+    }
+
+    uvm_spin_unlock(&va_space_pte_promotion->lock);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS pte_promotion_scan_block(va_space_pte_promotion_info_t *va_space_pte_promotion,
+                                          uvm_va_block_t *va_block)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    uvm_va_block_retry_t va_block_retry;
+    uvm_va_space_t *va_space = va_space_pte_promotion->va_space;
+    uvm_va_block_context_t *block_context = va_space_pte_promotion->block_context;
+    uvm_gpu_t *gpu;
+
+    uvm_mutex_lock(&va_block->lock);
+
+    for_each_va_space_gpu_in_mask(gpu, va_space, &va_block->mapped) {
+        atomic64_inc(&gpu->pte_size_stats.num_blocks_scanned);
+
+        status = UVM_VA_BLOCK_RETRY_LOCKED(va_block, &va_block_retry,
+                                           uvm_va_block_promote_gpu_ptes(va_block,
+                                                                         block_context,
+                                                                         gpu,
+                                                                         &va_block->tracker));
+        if (status != NV_OK)
+            break;
+    }
+
+    uvm_mutex_unlock(&va_block->lock);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void pte_promotion_scan(struct work_struct *work)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    struct delayed_work *dwork = to_delayed_work(work);
+    va_space_pte_promotion_info_t *va_space_pte_promotion = container_of(dwork,
+                                                                         va_space_pte_promotion_info_t,
+                                                                         dwork);
+    uvm_va_space_t *va_space = va_space_pte_promotion->va_space;
+    uvm_va_range_t *va_range;
+    NvU32 num_blocks = 0;
+    bool pass_done = true;
+
+    UVM_ASSERT(uvm_va_space_initialized(va_space) == NV_OK);
+
+    // Events received from now on require another pass over the whole VA
+    // space
+    if (va_space_pte_promotion->next_address == 0) {
+        uvm_spin_lock(&va_space_pte_promotion->lock);
+        va_space_pte_promotion->pending_events = false;
+        uvm_spin_unlock(&va_space_pte_promotion->lock);
+    }
+
+    uvm_va_space_down_read(va_space);
+
+    uvm_for_each_va_range_in(va_range, va_space, va_space_pte_promotion->next_address, ULLONG_MAX) {
+        size_t index;
+
+        if (va_range->type != UVM_VA_RANGE_TYPE_MANAGED)
+            continue;
+
+        index = uvm_va_range_block_index(va_range, max(va_range->node.start, va_space_pte_promotion->next_address));
+        for (; index < uvm_va_range_num_blocks(va_range); ++index) {
+            uvm_va_block_t *va_block = uvm_va_range_block(va_range, index);
+
+            if (!va_block)
+                continue;
+
+            if (num_blocks == g_uvm_perf_pte_promotion_max_blocks) {
+                pass_done = false;
+                break;
+            }
+
+            // Blocks that can't be promoted now are retried in the next pass
+            (void)pte_promotion_scan_block(va_space_pte_promotion, va_block);
+
+            ++num_blocks;
+            va_space_pte_promotion->next_address = va_block->end + 1;
+        }
+
+        if (!pass_done)
+            break;
+    }
+
+    uvm_va_space_up_read(va_space);
+
+    if (pass_done)
+        va_space_pte_promotion->next_address = 0;
+
+    uvm_spin_lock(&va_space_pte_promotion->lock);
+
+    if (!va_space_pte_promotion->in_va_space_teardown && (!pass_done || va_space_pte_promotion->pending_events)) {
+        schedule_delayed_work(&va_space_pte_promotion->dwork,
+                              msecs_to_jiffies(g_uvm_perf_pte_promotion_period_ms));
+    }
+
+    uvm_spin_unlock(&va_space_pte_promotion->lock);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void pte_promotion_scan_entry(struct work_struct *work)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ENTRY_VOID(pte_promotion_scan(work));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NV_STATUS uvm_perf_pte_promotion_init(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (uvm_perf_pte_promotion_period_ms == 0) {
+        pr_info("Invalid value %u for uvm_perf_pte_promotion_period_ms, using %u instead\n",
+                uvm_perf_pte_promotion_period_ms,
+                UVM_PERF_PTE_PROMOTION_PERIOD_MS_DEFAULT);
+        g_uvm_perf_pte_promotion_period_ms = UVM_PERF_PTE_PROMOTION_PERIOD_MS_DEFAULT;
+    }
+    else {
+        g_uvm_perf_pte_promotion_period_ms = uvm_perf_pte_promotion_period_ms;
+    }
+
+    if (uvm_perf_pte_promotion_max_blocks == 0) {
+        pr_info("Invalid value %u for uvm_perf_pte_promotion_max_blocks, using %u instead\n",
+                uvm_perf_pte_promotion_max_blocks,
+                UVM_PERF_PTE_PROMOTION_MAX_BLOCKS_DEFAULT);
+        g_uvm_perf_pte_promotion_max_blocks = UVM_PERF_PTE_PROMOTION_MAX_BLOCKS_DEFAULT;
+    }
+    else {
+        g_uvm_perf_pte_promotion_max_blocks = uvm_perf_pte_promotion_max_blocks;
+    }
+
+    uvm_perf_module_init("perf_pte_promotion",
+                         UVM_PERF_MODULE_TYPE_PTE_PROMOTION,
+                         g_callbacks_pte_promotion,
+                         ARRAY_SIZE(g_callbacks_pte_promotion),
+                         &g_module_pte_promotion);
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_perf_pte_promotion_exit(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NV_STATUS uvm_perf_pte_promotion_load(uvm_va_space_t *va_space)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    va_space_pte_promotion_info_t *va_space_pte_promotion;
+    NV_STATUS status;
+
+    uvm_assert_rwsem_locked_write(&va_space->lock);
+
+    // The module is not loaded at all when disabled, so that the events are
+    // not delivered
+    if (!uvm_perf_pte_promotion_enable)
+        return NV_OK;
+
+    va_space_pte_promotion = uvm_kvmalloc_zero(sizeof(*va_space_pte_promotion));
+    if (!va_space_pte_promotion)
+        return NV_ERR_NO_MEMORY;
+
+    va_space_pte_promotion->block_context = uvm_va_block_context_alloc();
+    if (!va_space_pte_promotion->block_context) {
+        uvm_kvfree(va_space_pte_promotion);
+        return NV_ERR_NO_MEMORY;
+    }
+
+    va_space_pte_promotion->va_space = va_space;
+    uvm_spin_lock_init(&va_space_pte_promotion->lock, UVM_LOCK_ORDER_LEAF);
+    INIT_DELAYED_WORK(&va_space_pte_promotion->dwork, pte_promotion_scan_entry);
+
+    uvm_perf_module_type_set_data(va_space->perf_modules_data,
+                                  va_space_pte_promotion,
+                                  UVM_PERF_MODULE_TYPE_PTE_PROMOTION);
+
+    status = uvm_perf_module_load(&g_module_pte_promotion, va_space);
+    if (status != NV_OK) {
+        uvm_perf_module_type_unset_data(va_space->perf_modules_data, UVM_PERF_MODULE_TYPE_PTE_PROMOTION);
+        uvm_va_block_context_free(va_space_pte_promotion->block_context);
+        uvm_kvfree(va_space_pte_promotion);
+    }
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_perf_pte_promotion_stop(uvm_va_space_t *va_space)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    va_space_pte_promotion_info_t *va_space_pte_promotion;
+
+    uvm_va_space_down_write(va_space);
+    va_space_pte_promotion = va_space_pte_promotion_info_get_or_null(va_space);
+
+    // Prevent further scans from being scheduled
+    if (va_space_pte_promotion) {
+        uvm_spin_lock(&va_space_pte_promotion->lock);
+        va_space_pte_promotion->in_va_space_teardown = true;
+        uvm_spin_unlock(&va_space_pte_promotion->lock);
+    }
+
+    uvm_va_space_up_write(va_space);
+
+    // Cancel any pending work. The tracking struct is only freed by
+    // uvm_perf_pte_promotion_unload, which is called later in the teardown
+    // path.
+    if (va_space_pte_promotion)
+        (void)cancel_delayed_work_sync(&va_space_pte_promotion->dwork);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_perf_pte_promotion_unload(uvm_va_space_t *va_space)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    va_space_pte_promotion_info_t *va_space_pte_promotion = va_space_pte_promotion_info_get_or_null(va_space);
+
+    uvm_assert_rwsem_locked_write(&va_space->lock);
+
+    if (!va_space_pte_promotion)
+        return;
+
+    uvm_perf_module_unload(&g_module_pte_promotion, va_space);
+
+    uvm_perf_module_type_unset_data(va_space->perf_modules_data, UVM_PERF_MODULE_TYPE_PTE_PROMOTION);
+    uvm_va_block_context_free(va_space_pte_promotion->block_context);
+    uvm_kvfree(va_space_pte_promotion);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
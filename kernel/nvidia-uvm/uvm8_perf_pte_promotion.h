@@ -0,0 +1,48 @@
+#include <linux/kernel.h>
+/*******************************************************************************
+    Copyright (c) 2019 NVIDIA Corporation
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+        The above copyright notice and this permission notice shall be
+        included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+
+*******************************************************************************/
+
+
+#ifndef __UVM8_PERF_PTE_PROMOTION_H__
+#define __UVM8_PERF_PTE_PROMOTION_H__
+
+#include "uvm_linux.h"
+#include "uvm8_forward_decl.h"
+
+// PTE promotion scanner. Mappings of VA blocks can be left with 4k or big PTEs
+// after their residency and permissions become uniform, for example when the
+// pages are migrated or revoked incrementally. When enabled, the scanner walks
+// the VA blocks of the VA space in the background after such events, and
+// re-maps them with the largest PTEs allowed using
+// uvm_va_block_promote_gpu_ptes. The number of blocks scanned per period is
+// limited to bound the overhead. Promotion and demotion counts are reported
+// in the pte_size_stats procfs file of each GPU.
+
+NV_STATUS uvm_perf_pte_promotion_init(void);
+void uvm_perf_pte_promotion_exit(void);
+
+NV_STATUS uvm_perf_pte_promotion_load(uvm_va_space_t *va_space);
+void uvm_perf_pte_promotion_stop(uvm_va_space_t *va_space);
+void uvm_perf_pte_promotion_unload(uvm_va_space_t *va_space);
+
+#endif
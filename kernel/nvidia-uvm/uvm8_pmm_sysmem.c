@@ -28,13 +28,44 @@
 #include "uvm8_va_block.h"
 #include "uvm8_va_range.h"
 
-static struct kmem_cache *g_reverse_page_map_cache __read_mostly;
+// Extent descriptor stored in the reverse map tree. The range tree node covers
+// the DMA address range [node.start, node.end] of the mapping, and
+// reverse_map contains the {va_block, region, owner} translation for the whole
+// extent.
+typedef struct
+{
+    uvm_range_tree_node_t node;
+
+    uvm_reverse_map_t reverse_map;
+} uvm_reverse_map_extent_t;
+
+static struct kmem_cache *g_reverse_map_extent_cache __read_mostly;
+
+static uvm_reverse_map_extent_t *reverse_map_extent_from_node(uvm_range_tree_node_t *node)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (!node)
+        return NULL;
+
+    return container_of(node, uvm_reverse_map_extent_t, node);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static uvm_reverse_map_extent_t *reverse_map_extent_find(uvm_pmm_sysmem_mappings_t *sysmem_mappings, NvU64 dma_addr)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_assert_spinlock_locked(&sysmem_mappings->reverse_map_lock);
+
+    return reverse_map_extent_from_node(uvm_range_tree_find(&sysmem_mappings->reverse_map_tree, dma_addr));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static size_t reverse_map_extent_num_pages(const uvm_reverse_map_extent_t *extent)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return uvm_va_block_region_num_pages(extent->reverse_map.region);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 NV_STATUS uvm_pmm_sysmem_init(void)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    g_reverse_page_map_cache = NV_KMEM_CACHE_CREATE("uvm_pmm_sysmem_page_reverse_map_t",
-                                                    uvm_reverse_map_t);
-    if (!g_reverse_page_map_cache)
+    g_reverse_map_extent_cache = NV_KMEM_CACHE_CREATE("uvm_pmm_sysmem_reverse_map_extent_t",
+                                                      uvm_reverse_map_extent_t);
+    if (!g_reverse_map_extent_cache)
         return NV_ERR_NO_MEMORY;
 
     return NV_OK;
@@ -42,7 +73,7 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 void uvm_pmm_sysmem_exit(void)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    kmem_cache_destroy_safe(&g_reverse_page_map_cache);
+    kmem_cache_destroy_safe(&g_reverse_map_extent_cache);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 NV_STATUS uvm_pmm_sysmem_mappings_init(uvm_gpu_t *gpu, uvm_pmm_sysmem_mappings_t *sysmem_mappings)
@@ -52,7 +83,7 @@ NV_STATUS uvm_pmm_sysmem_mappings_init(uvm_gpu_t *gpu, uvm_pmm_sysmem_mappings_t
     sysmem_mappings->gpu = gpu;
 
     uvm_spin_lock_init(&sysmem_mappings->reverse_map_lock, UVM_LOCK_ORDER_LEAF);
-    uvm_init_radix_tree_preloadable(&sysmem_mappings->reverse_map_tree);
+    uvm_range_tree_init(&sysmem_mappings->reverse_map_tree);
 
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -60,16 +91,14 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 void uvm_pmm_sysmem_mappings_deinit(uvm_pmm_sysmem_mappings_t *sysmem_mappings)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     if (sysmem_mappings->gpu) {
-        UVM_ASSERT_MSG(radix_tree_empty(&sysmem_mappings->reverse_map_tree),
-                       "radix_tree not empty for GPU %s\n",
+        UVM_ASSERT_MSG(list_empty(&sysmem_mappings->reverse_map_tree.head),
+                       "reverse map tree not empty for GPU %s\n",
                        sysmem_mappings->gpu->name);
     }
 
     sysmem_mappings->gpu = NULL;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-// TODO: Bug 1995015: use a more efficient data structure for
-// physically-contiguous allocations.
 NV_STATUS uvm_pmm_sysmem_mappings_add_gpu_mapping(uvm_pmm_sysmem_mappings_t *sysmem_mappings,
                                                   NvU64 dma_addr,
                                                   NvU64 virt_addr,
@@ -77,10 +106,8 @@ NV_STATUS uvm_pmm_sysmem_mappings_add_gpu_mapping(uvm_pmm_sysmem_mappings_t *sys
                                                   uvm_va_block_t *va_block,
                                                   uvm_processor_id_t owner)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    int ret;
-    uvm_reverse_map_t *new_reverse_map;
-    NvU64 key;
-    const NvU64 base_key = dma_addr / PAGE_SIZE;
+    NV_STATUS status;
+    uvm_reverse_map_extent_t *new_extent;
     const NvU32 num_pages = region_size / PAGE_SIZE;
     uvm_page_index_t page_index;
 
@@ -97,78 +124,61 @@ NV_STATUS uvm_pmm_sysmem_mappings_add_gpu_mapping(uvm_pmm_sysmem_mappings_t *sys
     if (!sysmem_mappings->gpu->access_counters_supported)
         return NV_OK;
 
-    new_reverse_map = nv_kmem_cache_zalloc(g_reverse_page_map_cache, NV_UVM_GFP_FLAGS);
-    if (!new_reverse_map)
+    // Allocate outside of the table lock, which is a spinlock
+    new_extent = nv_kmem_cache_zalloc(g_reverse_map_extent_cache, NV_UVM_GFP_FLAGS);
+    if (!new_extent)
         return NV_ERR_NO_MEMORY;
 
     page_index = uvm_va_block_cpu_page_index(va_block, virt_addr);
 
-    new_reverse_map->va_block = va_block;
-    new_reverse_map->region   = uvm_va_block_region(page_index, page_index + num_pages);
-    new_reverse_map->owner    = owner;
-
-    for (key = base_key; key < base_key + num_pages; ++key) {
-        // Pre-load the tree to allocate memory outside of the table lock. This
-        // returns with preemption disabled.
-        ret = radix_tree_preload(NV_UVM_GFP_FLAGS);
-        if (ret != 0) {
-            NvU64 remove_key;
-
-            uvm_spin_lock(&sysmem_mappings->reverse_map_lock);
-            for (remove_key = base_key; remove_key < key; ++remove_key)
-                (void *)radix_tree_delete(&sysmem_mappings->reverse_map_tree, remove_key);
-            uvm_spin_unlock(&sysmem_mappings->reverse_map_lock);
+    new_extent->node.start           = dma_addr;
+    new_extent->node.end             = dma_addr + region_size - 1;
+    new_extent->reverse_map.va_block = va_block;
+    new_extent->reverse_map.region   = uvm_va_block_region(page_index, page_index + num_pages);
+    new_extent->reverse_map.owner    = owner;
 
-            kmem_cache_free(g_reverse_page_map_cache, new_reverse_map);
-
-            return NV_ERR_NO_MEMORY;
-        }
-
-        uvm_spin_lock(&sysmem_mappings->reverse_map_lock);
-        ret = radix_tree_insert(&sysmem_mappings->reverse_map_tree, key, new_reverse_map);
-        uvm_spin_unlock(&sysmem_mappings->reverse_map_lock);
-        UVM_ASSERT(ret == 0);
-
-        // This re-enables preemption
-        radix_tree_preload_end();
-    }
+    uvm_spin_lock(&sysmem_mappings->reverse_map_lock);
+    status = uvm_range_tree_add(&sysmem_mappings->reverse_map_tree, &new_extent->node);
+    uvm_spin_unlock(&sysmem_mappings->reverse_map_lock);
 
+    // Overlapping DMA mappings are a bug in the caller
+    UVM_ASSERT_MSG(status == NV_OK, "DMA range [0x%llx, 0x%llx] already mapped\n",
+                   new_extent->node.start, new_extent->node.end);
+    if (status != NV_OK)
+        kmem_cache_free(g_reverse_map_extent_cache, new_extent);
 
-    return NV_OK;
+    return status;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 static void pmm_sysmem_mappings_remove_gpu_mapping(uvm_pmm_sysmem_mappings_t *sysmem_mappings,
                                                    NvU64 dma_addr,
                                                    bool check_mapping)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    uvm_reverse_map_t *reverse_map;
-    NvU64 key;
-    const NvU64 base_key = dma_addr / PAGE_SIZE;
+    uvm_reverse_map_extent_t *extent;
 
     if (!sysmem_mappings->gpu->access_counters_supported)
         return;
 
     uvm_spin_lock(&sysmem_mappings->reverse_map_lock);
 
-    reverse_map = radix_tree_delete(&sysmem_mappings->reverse_map_tree, base_key);
+    extent = reverse_map_extent_find(sysmem_mappings, dma_addr);
     if (check_mapping)
-        UVM_ASSERT(reverse_map);
+        UVM_ASSERT(extent);
 
-    if (!reverse_map) {
+    if (!extent) {
         uvm_spin_unlock(&sysmem_mappings->reverse_map_lock);
         return;
     }
 
-    uvm_assert_mutex_locked(&reverse_map->va_block->lock);
+    // Mappings are always removed using the address they were registered with
+    UVM_ASSERT(extent->node.start == dma_addr);
+    uvm_assert_mutex_locked(&extent->reverse_map.va_block->lock);
 
-    for (key = base_key + 1; key < base_key + uvm_va_block_region_num_pages(reverse_map->region); ++key) {
-        uvm_reverse_map_t *curr_reverse_map = radix_tree_delete(&sysmem_mappings->reverse_map_tree, key);
-        UVM_ASSERT(curr_reverse_map == reverse_map);
-    }
+    uvm_range_tree_remove(&sysmem_mappings->reverse_map_tree, &extent->node);
 
     uvm_spin_unlock(&sysmem_mappings->reverse_map_lock);
 
-    kmem_cache_free(g_reverse_page_map_cache, reverse_map);
+    kmem_cache_free(g_reverse_map_extent_cache, extent);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 void uvm_pmm_sysmem_mappings_remove_gpu_mapping(uvm_pmm_sysmem_mappings_t *sysmem_mappings, NvU64 dma_addr)
@@ -186,8 +196,8 @@ void uvm_pmm_sysmem_mappings_reparent_gpu_mapping(uvm_pmm_sysmem_mappings_t *sys
                                                   uvm_va_block_t *va_block)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NvU64 virt_addr;
+    uvm_reverse_map_extent_t *extent;
     uvm_reverse_map_t *reverse_map;
-    const NvU64 base_key = dma_addr / PAGE_SIZE;
     uvm_page_index_t new_start_page;
 
     UVM_ASSERT(PAGE_ALIGNED(dma_addr));
@@ -199,8 +209,11 @@ void uvm_pmm_sysmem_mappings_reparent_gpu_mapping(uvm_pmm_sysmem_mappings_t *sys
 
     uvm_spin_lock(&sysmem_mappings->reverse_map_lock);
 
-    reverse_map = radix_tree_lookup(&sysmem_mappings->reverse_map_tree, base_key);
-    UVM_ASSERT(reverse_map);
+    extent = reverse_map_extent_find(sysmem_mappings, dma_addr);
+    UVM_ASSERT(extent);
+    UVM_ASSERT(extent->node.start == dma_addr);
+
+    reverse_map = &extent->reverse_map;
 
     // Compute virt address by hand since the old VA block may be messed up
     // during split
@@ -221,12 +234,11 @@ NV_STATUS uvm_pmm_sysmem_mappings_split_gpu_mappings(uvm_pmm_sysmem_mappings_t *
                                                      NvU64 dma_addr,
                                                      NvU64 new_region_size)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    uvm_reverse_map_t *orig_reverse_map;
-    const NvU64 base_key = dma_addr / PAGE_SIZE;
+    uvm_reverse_map_extent_t *orig_extent;
     const size_t num_pages = new_region_size / PAGE_SIZE;
     size_t old_num_pages;
     size_t subregion, num_subregions;
-    uvm_reverse_map_t **new_reverse_maps;
+    uvm_reverse_map_extent_t **new_extents;
 
     UVM_ASSERT(IS_ALIGNED(dma_addr, new_region_size));
     UVM_ASSERT(new_region_size <= UVM_VA_BLOCK_SIZE);
@@ -236,65 +248,65 @@ NV_STATUS uvm_pmm_sysmem_mappings_split_gpu_mappings(uvm_pmm_sysmem_mappings_t *
         return NV_OK;
 
     uvm_spin_lock(&sysmem_mappings->reverse_map_lock);
-    orig_reverse_map = radix_tree_lookup(&sysmem_mappings->reverse_map_tree, base_key);
+    orig_extent = reverse_map_extent_find(sysmem_mappings, dma_addr);
     uvm_spin_unlock(&sysmem_mappings->reverse_map_lock);
 
-    // We can access orig_reverse_map outside the tree lock because we hold the
-    // VA block lock so we cannot have concurrent modifications in the tree for
+    // We can access orig_extent outside the tree lock because we hold the VA
+    // block lock so we cannot have concurrent modifications in the tree for
     // the mappings of the chunks that belong to that VA block.
-    UVM_ASSERT(orig_reverse_map);
-    UVM_ASSERT(orig_reverse_map->va_block);
-    uvm_assert_mutex_locked(&orig_reverse_map->va_block->lock);
-    old_num_pages = uvm_va_block_region_num_pages(orig_reverse_map->region);
+    UVM_ASSERT(orig_extent);
+    UVM_ASSERT(orig_extent->node.start == dma_addr);
+    UVM_ASSERT(orig_extent->reverse_map.va_block);
+    uvm_assert_mutex_locked(&orig_extent->reverse_map.va_block->lock);
+    old_num_pages = reverse_map_extent_num_pages(orig_extent);
     UVM_ASSERT(num_pages < old_num_pages);
 
     num_subregions = old_num_pages / num_pages;
 
-    new_reverse_maps = uvm_kvmalloc_zero(sizeof(*new_reverse_maps) * (num_subregions - 1));
-    if (!new_reverse_maps)
+    new_extents = uvm_kvmalloc_zero(sizeof(*new_extents) * (num_subregions - 1));
+    if (!new_extents)
         return NV_ERR_NO_MEMORY;
 
     // Allocate the descriptors for the new subregions
     for (subregion = 1; subregion < num_subregions; ++subregion) {
-        uvm_reverse_map_t *new_reverse_map = nv_kmem_cache_zalloc(g_reverse_page_map_cache, NV_UVM_GFP_FLAGS);
-        uvm_page_index_t page_index = orig_reverse_map->region.first + num_pages * subregion;
+        uvm_reverse_map_extent_t *new_extent = nv_kmem_cache_zalloc(g_reverse_map_extent_cache, NV_UVM_GFP_FLAGS);
+        uvm_page_index_t page_index = orig_extent->reverse_map.region.first + num_pages * subregion;
 
-        if (new_reverse_map == NULL) {
+        if (new_extent == NULL) {
             // On error, free the previously-created descriptors
             while (--subregion != 0)
-                kmem_cache_free(g_reverse_page_map_cache, new_reverse_maps[subregion - 1]);
+                kmem_cache_free(g_reverse_map_extent_cache, new_extents[subregion - 1]);
 
-            uvm_kvfree(new_reverse_maps);
+            uvm_kvfree(new_extents);
             return NV_ERR_NO_MEMORY;
         }
 
-        new_reverse_map->va_block = orig_reverse_map->va_block;
-        new_reverse_map->region   = uvm_va_block_region(page_index, page_index + num_pages);
-        new_reverse_map->owner    = orig_reverse_map->owner;
+        new_extent->reverse_map.va_block = orig_extent->reverse_map.va_block;
+        new_extent->reverse_map.region   = uvm_va_block_region(page_index, page_index + num_pages);
+        new_extent->reverse_map.owner    = orig_extent->reverse_map.owner;
 
-        new_reverse_maps[subregion - 1] = new_reverse_map;
+        new_extents[subregion - 1] = new_extent;
     }
 
     uvm_spin_lock(&sysmem_mappings->reverse_map_lock);
 
-    for (subregion = 1; subregion < num_subregions; ++subregion) {
-        NvU64 key;
-
-        for (key = base_key + num_pages * subregion; key < base_key + num_pages * (subregion + 1); ++key) {
-            void **slot = radix_tree_lookup_slot(&sysmem_mappings->reverse_map_tree, key);
-            UVM_ASSERT(slot);
-            UVM_ASSERT(radix_tree_deref_slot(slot) == orig_reverse_map);
+    // Peel the subregions off the tail of the original extent. Each split only
+    // updates the bounds of the existing node and inserts the new one.
+    for (subregion = num_subregions - 1; subregion > 0; --subregion) {
+        uvm_reverse_map_extent_t *new_extent = new_extents[subregion - 1];
 
-            NV_RADIX_TREE_REPLACE_SLOT(&sysmem_mappings->reverse_map_tree, slot, new_reverse_maps[subregion - 1]);
-        }
+        new_extent->node.start = dma_addr + new_region_size * subregion;
+        uvm_range_tree_split(&sysmem_mappings->reverse_map_tree, &orig_extent->node, &new_extent->node);
+        UVM_ASSERT(new_extent->node.end == new_extent->node.start + new_region_size - 1);
     }
 
-    orig_reverse_map->region = uvm_va_block_region(orig_reverse_map->region.first,
-                                                   orig_reverse_map->region.first + num_pages);
+    UVM_ASSERT(orig_extent->node.end == dma_addr + new_region_size - 1);
+    orig_extent->reverse_map.region = uvm_va_block_region(orig_extent->reverse_map.region.first,
+                                                          orig_extent->reverse_map.region.first + num_pages);
 
     uvm_spin_unlock(&sysmem_mappings->reverse_map_lock);
 
-    uvm_kvfree(new_reverse_maps);
+    uvm_kvfree(new_extents);
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
@@ -302,12 +314,13 @@ void uvm_pmm_sysmem_mappings_merge_gpu_mappings(uvm_pmm_sysmem_mappings_t *sysme
                                                 NvU64 dma_addr,
                                                 NvU64 new_region_size)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    uvm_reverse_map_t *first_reverse_map;
+    uvm_reverse_map_extent_t *first_extent;
     uvm_page_index_t running_page_index;
-    NvU64 key;
-    const NvU64 base_key = dma_addr / PAGE_SIZE;
     const size_t num_pages = new_region_size / PAGE_SIZE;
+    const NvU64 region_end = dma_addr + new_region_size - 1;
     size_t num_mapping_pages;
+    LIST_HEAD(merged_extents);
+    uvm_reverse_map_extent_t *extent, *next;
 
     UVM_ASSERT(IS_ALIGNED(dma_addr, new_region_size));
     UVM_ASSERT(new_region_size <= UVM_VA_BLOCK_SIZE);
@@ -319,58 +332,66 @@ void uvm_pmm_sysmem_mappings_merge_gpu_mappings(uvm_pmm_sysmem_mappings_t *sysme
     uvm_spin_lock(&sysmem_mappings->reverse_map_lock);
 
     // Find the first mapping in the region
-    first_reverse_map = radix_tree_lookup(&sysmem_mappings->reverse_map_tree, base_key);
-    UVM_ASSERT(first_reverse_map);
-    num_mapping_pages = uvm_va_block_region_num_pages(first_reverse_map->region);
+    first_extent = reverse_map_extent_find(sysmem_mappings, dma_addr);
+    UVM_ASSERT(first_extent);
+    UVM_ASSERT(first_extent->node.start == dma_addr);
+    num_mapping_pages = reverse_map_extent_num_pages(first_extent);
     UVM_ASSERT(num_pages >= num_mapping_pages);
-    UVM_ASSERT(IS_ALIGNED(base_key, num_mapping_pages));
 
     // The region in the tree matches the size of the merged region, just return
     if (num_pages == num_mapping_pages)
         goto unlock_no_update;
 
-    // Otherwise update the rest of slots to point at the same reverse map
-    // descriptor
-    key = base_key + uvm_va_block_region_num_pages(first_reverse_map->region);
-    running_page_index = first_reverse_map->region.outer;
-    while (key < base_key + num_pages) {
-        uvm_reverse_map_t *reverse_map = NULL;
-        void **slot = radix_tree_lookup_slot(&sysmem_mappings->reverse_map_tree, key);
-        size_t slot_index;
-        UVM_ASSERT(slot);
-
-        reverse_map = radix_tree_deref_slot(slot);
-        UVM_ASSERT(reverse_map);
-        UVM_ASSERT(reverse_map != first_reverse_map);
-        UVM_ASSERT(reverse_map->va_block == first_reverse_map->va_block);
-        UVM_ASSERT(uvm_id_equal(reverse_map->owner, first_reverse_map->owner));
-        UVM_ASSERT(reverse_map->region.first == running_page_index);
-
-        NV_RADIX_TREE_REPLACE_SLOT(&sysmem_mappings->reverse_map_tree, slot, first_reverse_map);
-
-        num_mapping_pages = uvm_va_block_region_num_pages(reverse_map->region);
-        UVM_ASSERT(IS_ALIGNED(key, num_mapping_pages));
-        UVM_ASSERT(key + num_mapping_pages <= base_key + num_pages);
-
-        for (slot_index = 1; slot_index < num_mapping_pages; ++slot_index) {
-            slot = radix_tree_lookup_slot(&sysmem_mappings->reverse_map_tree, key + slot_index);
-            UVM_ASSERT(slot);
-            UVM_ASSERT(reverse_map == radix_tree_deref_slot(slot));
-
-            NV_RADIX_TREE_REPLACE_SLOT(&sysmem_mappings->reverse_map_tree, slot, first_reverse_map);
-        }
+    // Otherwise absorb the rest of extents in the region into the first one
+    running_page_index = first_extent->reverse_map.region.outer;
+    while (first_extent->node.end < region_end) {
+        uvm_range_tree_node_t *node = uvm_range_tree_merge_next(&sysmem_mappings->reverse_map_tree,
+                                                                &first_extent->node);
+        UVM_ASSERT(node);
+
+        extent = reverse_map_extent_from_node(node);
+        UVM_ASSERT(extent->reverse_map.va_block == first_extent->reverse_map.va_block);
+        UVM_ASSERT(uvm_id_equal(extent->reverse_map.owner, first_extent->reverse_map.owner));
+        UVM_ASSERT(extent->reverse_map.region.first == running_page_index);
+        UVM_ASSERT(IS_ALIGNED(extent->node.start - dma_addr, reverse_map_extent_num_pages(extent) * PAGE_SIZE));
+        UVM_ASSERT(first_extent->node.end <= region_end);
 
-        key += num_mapping_pages;
-        running_page_index = reverse_map->region.outer;
+        running_page_index = extent->reverse_map.region.outer;
 
-        kmem_cache_free(g_reverse_page_map_cache, reverse_map);
+        // Free the descriptors outside of the spinlock
+        list_add(&extent->node.list, &merged_extents);
     }
 
     // Grow the first mapping to cover the whole region
-    first_reverse_map->region.outer = first_reverse_map->region.first + num_pages;
+    first_extent->reverse_map.region.outer = first_extent->reverse_map.region.first + num_pages;
 
 unlock_no_update:
     uvm_spin_unlock(&sysmem_mappings->reverse_map_lock);
+
+    list_for_each_entry_safe(extent, next, &merged_extents, node.list)
+        kmem_cache_free(g_reverse_map_extent_cache, extent);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Write the translation of the part of the extent in node that intersects
+// [dma_addr, region_end] to out_mapping, and retain its VA block. Sysmem
+// mappings are removed during VA block destruction. Therefore, we can safely
+// retain the VA blocks as long as they are in the reverse map and we hold the
+// reverse map lock.
+static void reverse_map_extent_to_mapping(uvm_range_tree_node_t *node,
+                                          NvU64 dma_addr,
+                                          NvU64 region_end,
+                                          uvm_reverse_map_t *out_mapping)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_reverse_map_extent_t *extent = reverse_map_extent_from_node(node);
+    NvU64 start = max(node->start, dma_addr);
+    NvU64 end = min(node->end, region_end);
+    NvU32 page_offset = (start - node->start) / PAGE_SIZE;
+    NvU32 num_mapping_pages = (end - start + 1) / PAGE_SIZE;
+
+    uvm_va_block_retain(extent->reverse_map.va_block);
+    *out_mapping               = extent->reverse_map;
+    out_mapping->region.first += page_offset;
+    out_mapping->region.outer  = out_mapping->region.first + num_mapping_pages;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 size_t uvm_pmm_sysmem_mappings_dma_to_virt(uvm_pmm_sysmem_mappings_t *sysmem_mappings,
@@ -379,10 +400,9 @@ size_t uvm_pmm_sysmem_mappings_dma_to_virt(uvm_pmm_sysmem_mappings_t *sysmem_map
                                            uvm_reverse_map_t *out_mappings,
                                            size_t max_out_mappings)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    NvU64 key;
+    uvm_range_tree_node_t *node;
     size_t num_mappings = 0;
-    const NvU64 base_key = dma_addr / PAGE_SIZE;
-    NvU32 num_pages = region_size / PAGE_SIZE;
+    const NvU64 region_end = dma_addr + region_size - 1;
 
     UVM_ASSERT(region_size >= PAGE_SIZE);
     UVM_ASSERT(PAGE_ALIGNED(region_size));
@@ -391,37 +411,74 @@ size_t uvm_pmm_sysmem_mappings_dma_to_virt(uvm_pmm_sysmem_mappings_t *sysmem_map
 
     uvm_spin_lock(&sysmem_mappings->reverse_map_lock);
 
-    key = base_key;
-    do {
-        uvm_reverse_map_t *reverse_map = radix_tree_lookup(&sysmem_mappings->reverse_map_tree, key);
+    // A single range query returns all the extents that intersect the region,
+    // in DMA address order
+    uvm_range_tree_for_each_in(node, &sysmem_mappings->reverse_map_tree, dma_addr, region_end) {
+        reverse_map_extent_to_mapping(node, dma_addr, region_end, out_mappings + num_mappings);
 
-        if (reverse_map) {
-            size_t num_chunk_pages = uvm_va_block_region_num_pages(reverse_map->region);
-            NvU32 page_offset = key & (num_chunk_pages - 1);
-            NvU32 num_mapping_pages = min(num_pages, (NvU32)num_chunk_pages - page_offset);
+        if (++num_mappings == max_out_mappings)
+            break;
+    }
+
+    uvm_spin_unlock(&sysmem_mappings->reverse_map_lock);
 
-            // Sysmem mappings are removed during VA block destruction.
-            // Therefore, we can safely retain the VA blocks as long as they
-            // are in the reverse map and we hold the reverse map lock.
-            uvm_va_block_retain(reverse_map->va_block);
-            out_mappings[num_mappings]               = *reverse_map;
-            out_mappings[num_mappings].region.first += page_offset;
-            out_mappings[num_mappings].region.outer  = out_mappings[num_mappings].region.first + num_mapping_pages;
+    return num_mappings;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+size_t uvm_pmm_sysmem_mappings_dma_to_virt_batch(uvm_pmm_sysmem_mappings_t *sysmem_mappings,
+                                                 uvm_pmm_sysmem_mappings_query_t *queries,
+                                                 size_t num_queries)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    size_t query_index;
+    size_t num_lookups = 0;
+    uvm_range_tree_t *tree = &sysmem_mappings->reverse_map_tree;
 
-            if (++num_mappings == max_out_mappings)
-                break;
+    // Last extent that intersected a query
+    uvm_range_tree_node_t *last = NULL;
 
-            num_pages -= num_mapping_pages;
-            key       += num_mapping_pages;
+    UVM_ASSERT(sysmem_mappings->gpu->access_counters_supported);
+
+    uvm_spin_lock(&sysmem_mappings->reverse_map_lock);
+
+    for (query_index = 0; query_index < num_queries; ++query_index) {
+        uvm_pmm_sysmem_mappings_query_t *query = &queries[query_index];
+        const NvU64 region_end = query->dma_addr + query->region_size - 1;
+        uvm_range_tree_node_t *node;
+
+        UVM_ASSERT(query->region_size >= PAGE_SIZE);
+        UVM_ASSERT(PAGE_ALIGNED(query->dma_addr));
+        UVM_ASSERT(PAGE_ALIGNED(query->region_size));
+
+        query->num_mappings = 0;
+
+        // Extents are sorted and don't overlap. If the last extent starts at
+        // or before the query, all the extents before it end before the
+        // query, so the walk can resume from the last extent or the one
+        // following it. Otherwise, look up the tree.
+        node = NULL;
+        if (last && last->start <= query->dma_addr) {
+            node = last;
+
+            if (node->end < query->dma_addr)
+                node = uvm_range_tree_next(tree, node);
         }
-        else {
-            --num_pages;
-            ++key;
+
+        if (!last || last->start > query->dma_addr || (node && node->end < query->dma_addr)) {
+            node = uvm_range_tree_iter_first(tree, query->dma_addr, region_end);
+            ++num_lookups;
+        }
+
+        for (; node && node->start <= region_end; node = uvm_range_tree_next(tree, node)) {
+            UVM_ASSERT(query->num_mappings < query->region_size / PAGE_SIZE);
+
+            reverse_map_extent_to_mapping(node, query->dma_addr, region_end, query->out_mappings + query->num_mappings);
+            ++query->num_mappings;
+
+            last = node;
         }
     }
-    while (num_pages > 0);
 
     uvm_spin_unlock(&sysmem_mappings->reverse_map_lock);
 
-    return num_mappings;
+    return num_lookups;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
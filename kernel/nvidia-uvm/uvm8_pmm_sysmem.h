@@ -29,32 +29,31 @@
 #include "uvm_linux.h"
 #include "uvm8_forward_decl.h"
 #include "uvm8_lock.h"
+#include "uvm8_range_tree.h"
 
 // Module to keep handle per-GPU mappings to sysmem physical memory. Notably,
 // this implements a reverse map of the DMA address to {va_block, virt_addr}.
 // This is required by the GPU access counters feature since they may provide a
 // physical address in the notification packet (GPA notifications). We use the
 // table to obtain the VAs of the memory regions being accessed remotely. The
-// reverse map is implemented by a radix tree, which is indexed using the
-// DMA address. For now, only PAGE_SIZE translations are supported (i.e. no
-// big/huge pages).
-//
-// TODO: Bug 1995015: add support for physically-contiguous mappings.
+// reverse map is implemented by a range tree of extents, which is indexed using
+// the DMA address range of each mapping. A physically-contiguous mapping (up to
+// UVM_VA_BLOCK_SIZE) is tracked by a single node regardless of its size, so
+// adding, removing, splitting or merging a 2MB chunk costs O(log n) tree
+// operations instead of one radix tree slot update per base page.
 struct uvm_pmm_sysmem_mappings_struct
 {
     uvm_gpu_t                                      *gpu;
 
-    struct radix_tree_root             reverse_map_tree;
+    uvm_range_tree_t                   reverse_map_tree;
 
     uvm_spinlock_t                     reverse_map_lock;
 };
 
-// See comments in uvm_linux.h
-#ifdef NV_RADIX_TREE_REPLACE_SLOT_PRESENT
+// The extent-based reverse map does not rely on radix_tree_replace_slot, so
+// indirect (split/merge) mappings are supported on all kernels. The macro is
+// kept so that callers don't need to special-case older kernels.
 #define uvm_pmm_sysmem_mappings_indirect_supported() true
-#else
-#define uvm_pmm_sysmem_mappings_indirect_supported() false
-#endif
 
 // Global initialization/exit functions, that need to be called during driver
 // initialization/tear-down. These are needed to allocate/free global internal
@@ -178,4 +177,30 @@ size_t uvm_pmm_sysmem_mappings_dma_to_virt(uvm_pmm_sysmem_mappings_t *sysmem_map
                                            uvm_reverse_map_t *out_mappings,
                                            size_t max_out_mappings);
 
+// Query for uvm_pmm_sysmem_mappings_dma_to_virt_batch
+typedef struct
+{
+    // DMA address range to translate. Both must be page-aligned.
+    NvU64 dma_addr;
+    NvU64 region_size;
+
+    // Output array for the translations of the range. The caller must provide
+    // region_size / PAGE_SIZE entries.
+    uvm_reverse_map_t *out_mappings;
+
+    // Number of translations written to out_mappings
+    size_t num_mappings;
+} uvm_pmm_sysmem_mappings_query_t;
+
+// Same as uvm_pmm_sysmem_mappings_dma_to_virt for a batch of queries. The
+// reverse map lock is taken once for the whole batch, and the walk of the
+// reverse map resumes from the last extent found by the previous queries
+// whenever possible, instead of looking up the tree again. Queries should be
+// sorted by dma_addr to benefit from this.
+//
+// Returns the number of tree lookups performed.
+size_t uvm_pmm_sysmem_mappings_dma_to_virt_batch(uvm_pmm_sysmem_mappings_t *sysmem_mappings,
+                                                 uvm_pmm_sysmem_mappings_query_t *queries,
+                                                 size_t num_queries);
+
 #endif
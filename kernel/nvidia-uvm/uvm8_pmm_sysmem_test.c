@@ -169,6 +169,65 @@ static NV_STATUS check_reverse_map_two_blocks_batch(NvU64 base_dma_addr,
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Check that a batch of two queries, one per VA block, returns the same
+// translations as check_reverse_map_two_blocks_batch, and that the walk of the
+// reverse map only looks up the tree once since the queries are sorted.
+static NV_STATUS check_reverse_map_two_blocks_query_batch(NvU64 base_dma_addr0,
+                                                          NvU64 base_dma_addr1,
+                                                          uvm_va_block_t *va_block0,
+                                                          uvm_va_block_t *va_block1)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    uvm_pmm_sysmem_mappings_query_t queries[2];
+    size_t num_lookups;
+    size_t query_index;
+    size_t reverse_map_index;
+    size_t num_block1_pages = uvm_va_block_num_cpu_pages(va_block1);
+
+    memset(g_sysmem_translations, 0, sizeof(g_sysmem_translations));
+    TEST_CHECK_RET(uvm_va_block_num_cpu_pages(va_block0) + num_block1_pages <= PAGES_PER_UVM_VA_BLOCK);
+
+    queries[0].dma_addr = base_dma_addr0;
+    queries[0].region_size = uvm_va_block_size(va_block0);
+    queries[0].out_mappings = g_sysmem_translations;
+    queries[1].dma_addr = base_dma_addr1;
+    queries[1].region_size = uvm_va_block_size(va_block1);
+    queries[1].out_mappings = g_sysmem_translations + (PAGES_PER_UVM_VA_BLOCK - num_block1_pages);
+
+    // Every returned mapping holds a reference on its block, which is dropped
+    // once all the queries have been checked, even if a check fails.
+    num_lookups = uvm_pmm_sysmem_mappings_dma_to_virt_batch(&g_reverse_map, queries, ARRAY_SIZE(queries));
+    TEST_CHECK_GOTO(num_lookups == 1, done);
+
+    for (query_index = 0; query_index < ARRAY_SIZE(queries); ++query_index) {
+        uvm_va_block_t *block = query_index == 0? va_block0 : va_block1;
+        size_t num_pages = 0;
+
+        TEST_CHECK_GOTO(queries[query_index].num_mappings == 1, done);
+
+        for (reverse_map_index = 0; reverse_map_index < queries[query_index].num_mappings; ++reverse_map_index) {
+            uvm_reverse_map_t *reverse_map = &queries[query_index].out_mappings[reverse_map_index];
+
+            TEST_CHECK_GOTO(reverse_map->va_block == block, done);
+            TEST_CHECK_GOTO(nv_kref_read(&block->kref) >= 2, done);
+            TEST_CHECK_GOTO(uvm_reverse_map_start(reverse_map) == block->start, done);
+            TEST_CHECK_GOTO(UVM_ID_IS_CPU(reverse_map->owner), done);
+
+            num_pages += uvm_va_block_region_num_pages(reverse_map->region);
+        }
+
+        TEST_CHECK_GOTO(num_pages == uvm_va_block_num_cpu_pages(block), done);
+    }
+
+done:
+    for (query_index = 0; query_index < ARRAY_SIZE(queries); ++query_index) {
+        for (reverse_map_index = 0; reverse_map_index < queries[query_index].num_mappings; ++reverse_map_index)
+            uvm_va_block_release(queries[query_index].out_mappings[reverse_map_index].va_block);
+    }
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 static const NvU64 g_base_dma_addr = UVM_VA_BLOCK_SIZE;
 
 // This function adds the mappings for all the subregions in va_block defined
@@ -368,6 +427,10 @@ static NV_STATUS test_pmm_sysmem_reverse_map_many_blocks(uvm_va_space_t *va_spac
 
         // Check both VA blocks at the same time
         TEST_CHECK_GOTO(check_reverse_map_two_blocks_batch(g_base_dma_addr, va_block0, va_block1) == NV_OK, error);
+        TEST_CHECK_GOTO(check_reverse_map_two_blocks_query_batch(base_dma_addr0,
+                                                                 base_dma_addr1,
+                                                                 va_block0,
+                                                                 va_block1) == NV_OK, error);
 
 error:
         uvm_mutex_lock(&va_block1->lock);
@@ -509,7 +572,106 @@ static NV_STATUS test_pmm_sysmem_reverse_map_remove_on_eviction(uvm_va_space_t *
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-static NV_STATUS test_pmm_sysmem_reverse_map(uvm_va_space_t *va_space, NvU64 addr1, NvU64 addr2)
+// Benchmark the reverse map operations on UVM_VA_BLOCK_SIZE mappings, which
+// are the most common ones for sysmem backed by huge pages. All the mappings
+// point at the same VA block, which is fine since the reverse map is indexed
+// by DMA address.
+static NV_STATUS test_pmm_sysmem_reverse_map_large(uvm_va_space_t *va_space,
+                                                   NvU64 addr,
+                                                   UVM_TEST_PMM_SYSMEM_PARAMS *params)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+    uvm_va_block_t *va_block;
+    NvU32 i;
+    NvU32 num_added = 0;
+    NvU32 num_split = 0;
+    NvU64 start;
+    const NvU32 num_mappings = params->large_mappings;
+
+    if (num_mappings == 0)
+        return NV_OK;
+
+    status = uvm_va_block_find(va_space, addr, &va_block);
+    if (status != NV_OK)
+        return status;
+
+    TEST_CHECK_RET(uvm_va_block_size(va_block) == UVM_VA_BLOCK_SIZE);
+
+    uvm_mutex_lock(&va_block->lock);
+
+    start = NV_GETTIME();
+    for (i = 0; i < num_mappings; ++i) {
+        status = uvm_pmm_sysmem_mappings_add_gpu_mapping(&g_reverse_map,
+                                                         g_base_dma_addr + i * UVM_VA_BLOCK_SIZE,
+                                                         va_block->start,
+                                                         UVM_VA_BLOCK_SIZE,
+                                                         va_block,
+                                                         UVM_ID_CPU);
+        if (status != NV_OK)
+            goto done;
+
+        ++num_added;
+    }
+    params->large_add_ns = (NV_GETTIME() - start) / num_mappings;
+
+    start = NV_GETTIME();
+    for (i = 0; i < num_mappings; ++i) {
+        status = uvm_pmm_sysmem_mappings_split_gpu_mappings(&g_reverse_map,
+                                                            g_base_dma_addr + i * UVM_VA_BLOCK_SIZE,
+                                                            UVM_CHUNK_SIZE_64K);
+        if (status != NV_OK)
+            goto done;
+
+        ++num_split;
+    }
+    params->large_split_ns = (NV_GETTIME() - start) / num_mappings;
+
+    start = NV_GETTIME();
+    for (i = 0; i < num_mappings; ++i) {
+        uvm_pmm_sysmem_mappings_merge_gpu_mappings(&g_reverse_map,
+                                                   g_base_dma_addr + i * UVM_VA_BLOCK_SIZE,
+                                                   UVM_VA_BLOCK_SIZE);
+    }
+    params->large_merge_ns = (NV_GETTIME() - start) / num_mappings;
+    num_split = 0;
+
+    start = NV_GETTIME();
+    for (i = 0; i < num_mappings; ++i) {
+        size_t num_translations = uvm_pmm_sysmem_mappings_dma_to_virt(&g_reverse_map,
+                                                                      g_base_dma_addr + i * UVM_VA_BLOCK_SIZE,
+                                                                      UVM_VA_BLOCK_SIZE,
+                                                                      g_sysmem_translations,
+                                                                      PAGES_PER_UVM_VA_BLOCK);
+        TEST_CHECK_GOTO(num_translations == 1, done);
+        TEST_CHECK_GOTO(g_sysmem_translations[0].va_block == va_block, done);
+        TEST_CHECK_GOTO(uvm_va_block_region_num_pages(g_sysmem_translations[0].region) == PAGES_PER_UVM_VA_BLOCK, done);
+        uvm_va_block_release(g_sysmem_translations[0].va_block);
+    }
+    params->large_dma_to_virt_ns = (NV_GETTIME() - start) / num_mappings;
+
+done:
+    // Mappings are removed using the address they were registered with, which
+    // only covers the first subregion of a split mapping. Merge the mappings
+    // split before a failure so that they are removed entirely.
+    for (i = 0; i < num_split; ++i) {
+        uvm_pmm_sysmem_mappings_merge_gpu_mappings(&g_reverse_map,
+                                                   g_base_dma_addr + i * UVM_VA_BLOCK_SIZE,
+                                                   UVM_VA_BLOCK_SIZE);
+    }
+
+    start = NV_GETTIME();
+    for (i = 0; i < num_added; ++i)
+        uvm_pmm_sysmem_mappings_remove_gpu_mapping(&g_reverse_map, g_base_dma_addr + i * UVM_VA_BLOCK_SIZE);
+    if (status == NV_OK)
+        params->large_remove_ns = (NV_GETTIME() - start) / num_mappings;
+
+    uvm_mutex_unlock(&va_block->lock);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS test_pmm_sysmem_reverse_map(uvm_va_space_t *va_space, NvU64 addr1, NvU64 addr2,
+                                              UVM_TEST_PMM_SYSMEM_PARAMS *params)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NV_STATUS status = NV_OK;
     uvm_gpu_t *gpu;
@@ -547,6 +709,9 @@ static NV_STATUS test_pmm_sysmem_reverse_map(uvm_va_space_t *va_space, NvU64 add
     if (status == NV_OK)
         status = test_pmm_sysmem_reverse_map_remove_on_eviction(va_space, addr1);
 
+    if (status == NV_OK)
+        status = test_pmm_sysmem_reverse_map_large(va_space, addr1, params);
+
     uvm_pmm_sysmem_mappings_deinit(&g_reverse_map);
 
     return status;
@@ -564,13 +729,7 @@ NV_STATUS uvm8_test_pmm_sysmem(UVM_TEST_PMM_SYSMEM_PARAMS *params, struct file *
     uvm_mutex_lock(&g_uvm_global.global_lock);
     uvm_va_space_down_write(va_space);
 
-    if (uvm_pmm_sysmem_mappings_indirect_supported()) {
-        status = test_pmm_sysmem_reverse_map(va_space, params->range_address1, params->range_address2);
-    }
-    else {
-        UVM_TEST_PRINT("Skipping kernel_driver_pmm_sysmem test due to lack of support for radix_tree_replace_slot in Linux 4.10");
-        status = NV_OK;
-    }
+    status = test_pmm_sysmem_reverse_map(va_space, params->range_address1, params->range_address2, params);
 
     uvm_va_space_up_write(va_space);
     uvm_mutex_unlock(&g_uvm_global.global_lock);
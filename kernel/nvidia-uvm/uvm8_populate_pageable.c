@@ -30,6 +30,58 @@
 #include "uvm8_va_range.h"
 #include "uvm8_va_space.h"
 #include "uvm8_populate_pageable.h"
+#include "uvm8_test.h"
+
+#include <linux/cpuset.h>
+
+// Maximum number of threads, including the calling thread, that populate a
+// UVM_POPULATE_PAGEABLE_FLAG_PARALLEL request. The helper threads are created
+// for each request on the CPUs of the NUMA node of the calling thread, and
+// stopped once the request is done, so no threads are kept around while the
+// feature is unused.
+// The value is capped to the number of CPUs in the node. 0 or 1 disable
+// parallel population.
+#define UVM_POPULATE_PAGEABLE_MAX_THREADS_DEFAULT 8
+static unsigned uvm_populate_pageable_max_threads = UVM_POPULATE_PAGEABLE_MAX_THREADS_DEFAULT;
+module_param(uvm_populate_pageable_max_threads, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_populate_pageable_max_threads,
+                 "Maximum number of threads used to populate pageable memory in parallel, including the calling thread");
+
+// Size of the chunks in which parallel populate requests are split. Threads
+// grab chunks from the request until all of them have been populated, which
+// balances the work even if some chunks take longer (e.g. due to reclaim).
+#define UVM_POPULATE_PAGEABLE_CHUNK_SIZE (64UL * 1024 * 1024)
+
+typedef struct
+{
+    struct mm_struct *mm;
+
+    // If not NULL, chunks overlapping any VA range of va_space are rejected
+    uvm_va_space_t *va_space;
+
+    unsigned long start;
+
+    unsigned long outer;
+
+    int min_prot;
+
+    // Offset from start of the next chunk to be populated
+    atomic64_t next_chunk_offset;
+
+    atomic64_t num_pages;
+
+    // First error found by any of the threads. Threads stop grabbing chunks
+    // once an error is found.
+    atomic_t status;
+
+    // Helper threads created for the request
+    unsigned num_helpers;
+    struct
+    {
+        nv_kthread_q_t q;
+        nv_kthread_q_item_t q_item;
+    } helpers[];
+} populate_pageable_request_t;
 
 NV_STATUS uvm_populate_pageable_vma(struct vm_area_struct *vma,
                                     unsigned long start,
@@ -69,7 +121,11 @@ NV_STATUS uvm_populate_pageable_vma(struct vm_area_struct *vma,
     if (uvm_managed_vma)
         uvm_record_unlock_mmap_sem_read(&mm->mmap_sem);
 
-    ret = NV_GET_USER_PAGES(start, vma_num_pages, is_writable, 0, NULL, NULL);
+    // Parallel population runs in kernel threads, which don't have an mm
+    if (mm == current->mm)
+        ret = NV_GET_USER_PAGES(start, vma_num_pages, is_writable, 0, NULL, NULL);
+    else
+        ret = NV_GET_USER_PAGES_REMOTE(NULL, mm, start, vma_num_pages, is_writable, 0, NULL, NULL);
 
     if (uvm_managed_vma)
         uvm_record_lock_mmap_sem_read(&mm->mmap_sem);
@@ -118,6 +174,169 @@ NV_STATUS uvm_populate_pageable(struct mm_struct *mm,
     return NV_ERR_INVALID_ADDRESS;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+static void populate_pageable_worker(populate_pageable_request_t *request)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    struct mm_struct *mm = request->mm;
+
+    while (atomic_read(&request->status) == NV_OK) {
+        NV_STATUS status;
+        unsigned long chunk_start;
+        unsigned long chunk_size;
+        NvU64 offset = atomic64_add_return(UVM_POPULATE_PAGEABLE_CHUNK_SIZE, &request->next_chunk_offset) -
+                       UVM_POPULATE_PAGEABLE_CHUNK_SIZE;
+
+        if (offset >= request->outer - request->start)
+            break;
+
+        chunk_start = request->start + offset;
+        chunk_size = min(request->outer - chunk_start, UVM_POPULATE_PAGEABLE_CHUNK_SIZE);
+
+        // Managed VA ranges are created and destroyed with mmap_sem held in
+        // write mode, so the check is only valid while mmap_sem is held.
+        uvm_down_read_mmap_sem(&mm->mmap_sem);
+        if (request->va_space && !uvm_va_space_range_empty(request->va_space, chunk_start, chunk_start + chunk_size - 1))
+            status = NV_ERR_INVALID_ADDRESS;
+        else
+            status = uvm_populate_pageable(mm, chunk_start, chunk_size, request->min_prot);
+        uvm_up_read_mmap_sem(&mm->mmap_sem);
+
+        if (status != NV_OK) {
+            atomic_cmpxchg(&request->status, NV_OK, status);
+            break;
+        }
+
+        atomic64_add(chunk_size / PAGE_SIZE, &request->num_pages);
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void populate_pageable_worker_entry(void *args)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ENTRY_VOID(populate_pageable_worker((populate_pageable_request_t *)args));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Create a helper thread on the given NUMA node, or on any node if node is
+// NUMA_NO_NODE or thread affinity is not supported
+static NV_STATUS populate_pageable_helper_init(nv_kthread_q_t *q, int node, unsigned index)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+    char name[TASK_COMM_LEN + 1];
+
+    snprintf(name, sizeof(name), "UVM populate %d/%u", node, index);
+
+    if (UVM_THREAD_AFFINITY_SUPPORTED() && node != NUMA_NO_NODE) {
+        status = errno_to_nv_status(nv_kthread_q_init_on_node(q, name, node));
+        if (status != NV_OK)
+            return status;
+
+        status = errno_to_nv_status(set_cpus_allowed_ptr(q->q_kthread, uvm_cpumask_of_node(node)));
+    }
+    else {
+        status = errno_to_nv_status(nv_kthread_q_init(q, name));
+    }
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Helper threads fault the pages in with their own memory policy and cpuset.
+// Like the calling thread, they follow the policies of the VMAs, but otherwise
+// they allocate from the node they run on without any restriction. That only
+// places the pages as the calling thread would if it has no memory policy of
+// its own and its cpuset allows allocating from its node.
+static bool populate_pageable_helpers_match_caller(int node)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+#if defined(CONFIG_NUMA)
+    if (current->mempolicy)
+        return false;
+#endif
+
+    return node == NUMA_NO_NODE || node_isset(node, cpuset_current_mems_allowed);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Threads, including the calling thread, that can be used for a request split
+// in num_chunks chunks
+static unsigned populate_pageable_num_threads(int node, unsigned long num_chunks)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    unsigned num_cpus;
+
+    if (!populate_pageable_helpers_match_caller(node))
+        return 1;
+
+    if (UVM_THREAD_AFFINITY_SUPPORTED() && node != NUMA_NO_NODE)
+        num_cpus = cpumask_weight(uvm_cpumask_of_node(node));
+    else
+        num_cpus = num_online_cpus();
+
+    return min_t(unsigned long, min(uvm_populate_pageable_max_threads, num_cpus), num_chunks);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NV_STATUS uvm_populate_pageable_parallel(struct mm_struct *mm,
+                                         uvm_va_space_t *va_space,
+                                         unsigned long start,
+                                         unsigned long length,
+                                         int min_prot,
+                                         NvU64 *num_pages,
+                                         unsigned *num_threads_out)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+    populate_pageable_request_t *request;
+    const int node = numa_node_id();
+    unsigned num_threads;
+    unsigned i;
+
+    UVM_ASSERT(PAGE_ALIGNED(start));
+    UVM_ASSERT(PAGE_ALIGNED(length));
+
+    num_threads = populate_pageable_num_threads(node, DIV_ROUND_UP(length, UVM_POPULATE_PAGEABLE_CHUNK_SIZE));
+    num_threads = max(num_threads, 1u);
+
+    request = uvm_kvmalloc_zero(sizeof(*request) + (num_threads - 1) * sizeof(request->helpers[0]));
+    if (!request)
+        return NV_ERR_NO_MEMORY;
+
+    // The calling thread stops all the helper threads before returning, so mm
+    // and va_space stay alive for the duration of the request.
+    request->mm = mm;
+    request->va_space = va_space;
+    request->start = start;
+    request->outer = start + length;
+    request->min_prot = min_prot;
+    atomic64_set(&request->next_chunk_offset, 0);
+    atomic64_set(&request->num_pages, 0);
+    atomic_set(&request->status, NV_OK);
+
+    // Failing to create a helper thread is not fatal, the request is just
+    // populated by fewer threads
+    for (i = 0; i < num_threads - 1; ++i) {
+        status = populate_pageable_helper_init(&request->helpers[i].q, node, i);
+        if (status != NV_OK) {
+            // nv_kthread_q_stop can be called on queues that failed
+            // initialization
+            nv_kthread_q_stop(&request->helpers[i].q);
+            UVM_DBG_PRINT("Failed to create populate thread: %s\n", nvstatusToString(status));
+            break;
+        }
+
+        request->num_helpers++;
+
+        nv_kthread_q_item_init(&request->helpers[i].q_item, populate_pageable_worker_entry, request);
+        nv_kthread_q_schedule_q_item(&request->helpers[i].q, &request->helpers[i].q_item);
+    }
+
+    populate_pageable_worker(request);
+
+    // Stopping the queues flushes the pending work
+    for (i = 0; i < request->num_helpers; ++i)
+        nv_kthread_q_stop(&request->helpers[i].q);
+
+    status = atomic_read(&request->status);
+    *num_pages = atomic64_read(&request->num_pages);
+    *num_threads_out = request->num_helpers + 1;
+
+    uvm_kvfree(request);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 NV_STATUS uvm_api_populate_pageable(const UVM_POPULATE_PAGEABLE_PARAMS *params, struct file *filp)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NV_STATUS status;
@@ -154,15 +373,91 @@ NV_STATUS uvm_api_populate_pageable(const UVM_POPULATE_PAGEABLE_PARAMS *params,
     if (uvm_api_range_invalid(params->base, params->length))
         return NV_ERR_INVALID_ADDRESS;
 
-    // mmap_sem is needed to traverse the vmas in the input range and call into
-    // get_user_pages
-    uvm_down_read_mmap_sem(&current->mm->mmap_sem);
+    if (params->flags & UVM_POPULATE_PAGEABLE_FLAG_PARALLEL) {
+        NvU64 num_pages;
+        unsigned num_threads;
+
+        // The threads populating the range acquire mmap_sem and validate their
+        // chunks themselves. Holding it here while they wait for it could
+        // deadlock with a writer queued in between.
+        status = uvm_populate_pageable_parallel(current->mm,
+                                                allow_managed? NULL : va_space,
+                                                params->base,
+                                                params->length,
+                                                min_prot,
+                                                &num_pages,
+                                                &num_threads);
+    }
+    else {
+        // mmap_sem is needed to traverse the vmas in the input range and call
+        // into get_user_pages
+        uvm_down_read_mmap_sem(&current->mm->mmap_sem);
 
-    if (allow_managed || uvm_va_space_range_empty(va_space, params->base, params->base + params->length - 1))
-        status = uvm_populate_pageable(current->mm, params->base, params->length, min_prot);
-    else
-        status = NV_ERR_INVALID_ADDRESS;
+        if (allow_managed || uvm_va_space_range_empty(va_space, params->base, params->base + params->length - 1))
+            status = uvm_populate_pageable(current->mm, params->base, params->length, min_prot);
+        else
+            status = NV_ERR_INVALID_ADDRESS;
 
+        uvm_up_read_mmap_sem(&current->mm->mmap_sem);
+    }
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NV_STATUS uvm8_test_populate_pageable_parallel(UVM_TEST_POPULATE_PAGEABLE_PARALLEL_PARAMS *params, struct file *filp)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+    NvU64 start_time;
+    NvU64 elapsed;
+    NvU64 remainder;
+    NvU64 num_pages = 0;
+    unsigned num_threads = 0;
+    unsigned long num_chunks;
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+
+    if (uvm_api_range_invalid(params->base, params->length))
+        return NV_ERR_INVALID_ADDRESS;
+
+    num_chunks = DIV_ROUND_UP(params->length, UVM_POPULATE_PAGEABLE_CHUNK_SIZE);
+
+    start_time = NV_GETTIME();
+
+    status = uvm_populate_pageable_parallel(current->mm,
+                                            va_space,
+                                            params->base,
+                                            params->length,
+                                            VM_READ | VM_WRITE,
+                                            &num_pages,
+                                            &num_threads);
+
+    elapsed = NV_GETTIME() - start_time;
+
+    params->numPages = num_pages;
+    params->numThreads = num_threads;
+    params->pagesPerSec = 0;
+    if (elapsed > 0)
+        params->pagesPerSec = NV_DIV64(num_pages * NSEC_PER_SEC, elapsed, &remainder);
+
+    if (status != NV_OK)
+        return status;
+
+    // Every chunk was populated exactly once
+    TEST_CHECK_RET(num_pages == params->length / PAGE_SIZE);
+
+    // The calling thread always takes part. Helpers are never created for
+    // more threads than there are chunks, or than allowed by the module
+    // parameter.
+    TEST_CHECK_RET(num_threads >= 1);
+    TEST_CHECK_RET(num_threads <= num_chunks);
+    TEST_CHECK_RET(num_threads <= max(uvm_populate_pageable_max_threads, 1u));
+
+    if (!populate_pageable_helpers_match_caller(numa_node_id()))
+        TEST_CHECK_RET(num_threads == 1);
+
+    // All the pages are populated, so populating the range again in the
+    // calling thread only must succeed
+    uvm_down_read_mmap_sem(&current->mm->mmap_sem);
+    status = uvm_populate_pageable(current->mm, params->base, params->length, VM_READ | VM_WRITE);
     uvm_up_read_mmap_sem(&current->mm->mmap_sem);
 
     return status;
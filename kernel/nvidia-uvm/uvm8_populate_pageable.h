@@ -24,9 +24,12 @@
 #ifndef __UVM8_POPULATE_PAGEABLE_H__
 #define __UVM8_POPULATE_PAGEABLE_H__
 
+#include "uvm8_forward_decl.h"
+
 // Populate the pages of the given vma that overlap with the
 // [start:start+length) range. If any of the pages was not populated, we return
-// NV_ERR_NO_MEMORY.
+// NV_ERR_NO_MEMORY. vma->vm_mm does not need to be the mm of the calling
+// thread, but the caller must guarantee that it stays alive.
 //
 // Locking: vma->vm_mm->mmap_sem must be held in read or write mode
 NV_STATUS uvm_populate_pageable_vma(struct vm_area_struct *vma,
@@ -44,4 +47,28 @@ NV_STATUS uvm_populate_pageable(struct mm_struct *mm,
                                 unsigned long length,
                                 int min_prot);
 
+// Same as uvm_populate_pageable, but the range is split in chunks that are
+// populated concurrently by the calling thread and by helper threads created
+// for the request on the NUMA node of the calling thread. Each thread acquires
+// mmap_sem in read mode for each chunk. If va_space is not NULL, chunks that
+// overlap any VA range of va_space fail with NV_ERR_INVALID_ADDRESS. The check
+// is done under mmap_sem by the thread populating the chunk.
+//
+// The range is populated by the calling thread only if it's too small to be
+// split, or if the helper threads wouldn't place the pages like the calling
+// thread: when it has its own memory policy or its cpuset doesn't allow memory
+// from its node.
+//
+// The number of populated pages and the number of threads that populated them,
+// including the calling thread, are returned in num_pages and num_threads.
+//
+// Locking: mm->mmap_sem must not be held
+NV_STATUS uvm_populate_pageable_parallel(struct mm_struct *mm,
+                                         uvm_va_space_t *va_space,
+                                         unsigned long start,
+                                         unsigned long length,
+                                         int min_prot,
+                                         NvU64 *num_pages,
+                                         unsigned *num_threads);
+
 #endif
@@ -96,6 +96,11 @@ void uvm_procfs_destroy_entry(struct proc_dir_entry *entry)
     procfs_destroy_entry_with_root(entry, entry);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+struct proc_dir_entry *uvm_procfs_get_base_dir()
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return uvm_proc_dir;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 struct proc_dir_entry *uvm_procfs_get_gpu_base_dir()
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     return uvm_proc_gpus;
@@ -51,6 +51,7 @@ static bool uvm_procfs_is_debug_enabled(void)
     return uvm_enable_debug_procfs != 0;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+struct proc_dir_entry *uvm_procfs_get_base_dir(void);
 struct proc_dir_entry *uvm_procfs_get_gpu_base_dir(void);
 struct proc_dir_entry *uvm_procfs_get_cpu_base_dir(void);
 
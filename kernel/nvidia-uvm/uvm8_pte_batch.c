@@ -24,12 +24,73 @@
 
 #include "uvm8_pte_batch.h"
 #include "uvm8_hal.h"
+#include "uvm8_channel.h"
+
+// PTE runs are written with three kinds of CE operations:
+//  - A uniform run of identical PTEs is written with a single memset.
+//  - A short run of PTEs is written with one memset per PTE.
+//  - A longer run of PTEs is written with an inline memcopy.
+//
+// The choice between them is made with the costs in gpu->pte_batch, which are
+// expressed in pushbuffer bytes. A memset costs memset_cost and an inline
+// memcopy costs inline_cost plus the size of the PTE data. Both are measured
+// from the CE HAL of the GPU at initialization, see uvm_pte_batch_init_gpu().
+//
+// Runs with a constant stride between the physical addresses in the PTEs are
+// written with an inline memcopy as the CE can't generate them.
 
 static bool uvm_gpu_phys_address_eq(uvm_gpu_phys_address_t pa1, uvm_gpu_phys_address_t pa2)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     return pa1.address == pa2.address && pa1.aperture == pa2.aperture;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Extra cost of an inline memcopy when the pushbuffer is in sysmem. The CE has
+// to read the inline data back over the bus before it can write any PTE, which
+// memsets don't have to do. With the CE method sizes of all the supported
+// architectures this makes 4 single-PTE memsets the cutover point for 8-byte
+// PTEs. Vidmem pushbuffers don't pay it, and a single memset is the cutover
+// point then.
+#define UVM_PTE_BATCH_SYSMEM_INLINE_READ_COST 144
+
+NV_STATUS uvm_pte_batch_init_gpu(uvm_gpu_t *gpu)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+    uvm_push_t push;
+    uvm_push_inline_data_t inline_data;
+    uvm_gpu_address_t pte_address = uvm_gpu_address_physical(UVM_APERTURE_VID, 0);
+    uvm_gpu_address_t inline_data_addr;
+    NvU32 memset_size;
+
+    // Measure the size of the methods the PTE writes use by pushing them to a
+    // fake push.
+    status = uvm_push_begin_fake(gpu, &push);
+    if (status != NV_OK)
+        return status;
+
+    uvm_push_set_flag(&push, UVM_PUSH_FLAG_CE_NEXT_MEMBAR_NONE);
+    uvm_push_set_flag(&push, UVM_PUSH_FLAG_CE_NEXT_PIPELINED);
+    gpu->ce_hal->memset_8(&push, pte_address, 0, sizeof(NvU64));
+    memset_size = uvm_push_get_size(&push);
+
+    uvm_push_inline_data_begin(&push, &inline_data);
+    memset(uvm_push_inline_data_get(&inline_data, sizeof(NvU64)), 0, sizeof(NvU64));
+    inline_data_addr = uvm_push_inline_data_end(&inline_data);
+
+    uvm_push_set_flag(&push, UVM_PUSH_FLAG_CE_NEXT_MEMBAR_NONE);
+    uvm_push_set_flag(&push, UVM_PUSH_FLAG_CE_NEXT_PIPELINED);
+    gpu->ce_hal->memcopy(&push, pte_address, inline_data_addr, sizeof(NvU64));
+
+    gpu->pte_batch.memset_cost = memset_size;
+    gpu->pte_batch.inline_cost = uvm_push_get_size(&push) - memset_size - sizeof(NvU64);
+
+    if (gpu->channel_manager->conf.pushbuffer_loc == UVM_BUFFER_LOCATION_SYS)
+        gpu->pte_batch.inline_cost += UVM_PTE_BATCH_SYSMEM_INLINE_READ_COST;
+
+    uvm_push_end_fake(&push);
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 void uvm_pte_batch_begin(uvm_push_t *push, uvm_pte_batch_t *batch)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     memset(batch, 0, sizeof(*batch));
@@ -38,6 +99,44 @@ void uvm_pte_batch_begin(uvm_push_t *push, uvm_pte_batch_t *batch)
     batch->push = push;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Max PTEs to queue up for memsets before switching to inline memcopy. PTEs
+// are queued up only as long as a memset per PTE is cheaper than an inline
+// memcopy of all of them.
+static NvU32 pte_batch_max_queued_ptes(uvm_pte_batch_t *batch)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_gpu_t *gpu = uvm_push_get_gpu(batch->push);
+    NvU32 memset_cost = gpu->pte_batch.memset_cost;
+
+    if (memset_cost <= batch->pte_entry_size)
+        return UVM_PTE_BATCH_MAX_QUEUED_PTES;
+
+    return min(gpu->pte_batch.inline_cost / (memset_cost - batch->pte_entry_size),
+               (NvU32)UVM_PTE_BATCH_MAX_QUEUED_PTES);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Whether the uniform run is cheaper to write with its own memset than by
+// appending it to the stored PTEs. If more PTEs follow the uniform run, they
+// will need a new inline memcopy once the run is split out, so that's
+// accounted for too.
+static bool pte_batch_uniform_is_long(uvm_pte_batch_t *batch, bool followed)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_gpu_t *gpu = uvm_push_get_gpu(batch->push);
+    NvU32 cost = gpu->pte_batch.memset_cost;
+
+    // Only 8-byte PTEs are ever appended as entries larger than that are only
+    // partially written by uvm_pte_batch_write_pte().
+    if (batch->pte_entry_size != sizeof(NvU64))
+        return true;
+
+    if (!followed && batch->pte_count == 0)
+        return true;
+
+    if (followed && batch->pte_count != 0)
+        cost += gpu->pte_batch.inline_cost;
+
+    return batch->uniform_count * batch->pte_entry_size >= cost;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 static void uvm_pte_batch_flush_ptes_inline(uvm_pte_batch_t *batch)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     uvm_gpu_address_t inline_data_addr;
@@ -55,6 +154,9 @@ static void uvm_pte_batch_flush_ptes_inline(uvm_pte_batch_t *batch)
     uvm_push_set_flag(batch->push, UVM_PUSH_FLAG_CE_NEXT_MEMBAR_NONE);
     uvm_push_set_flag(batch->push, UVM_PUSH_FLAG_CE_NEXT_PIPELINED);
     gpu->ce_hal->memcopy(batch->push, uvm_gpu_address_from_phys(batch->pte_first_address), inline_data_addr, ptes_size);
+
+    atomic64_inc(&gpu->pte_batch.stats.inline_copies);
+    atomic64_add(ptes_size, &gpu->pte_batch.stats.inline_bytes);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 static void uvm_pte_batch_flush_ptes_memset(uvm_pte_batch_t *batch)
@@ -72,8 +174,11 @@ static void uvm_pte_batch_flush_ptes_memset(uvm_pte_batch_t *batch)
         gpu->ce_hal->memset_8(batch->push, addr, batch->pte_bits_queue[i], sizeof(NvU64));
         addr.address += batch->pte_entry_size;
     }
+
+    atomic64_add(batch->pte_count, &gpu->pte_batch.stats.memsets);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Flush the stored PTEs. The run continues after them.
 static void uvm_pte_batch_flush_ptes(uvm_pte_batch_t *batch)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     if (batch->pte_count == 0)
@@ -84,6 +189,7 @@ static void uvm_pte_batch_flush_ptes(uvm_pte_batch_t *batch)
     else
         uvm_pte_batch_flush_ptes_memset(batch);
 
+    batch->pte_first_address.address += batch->pte_count * batch->pte_entry_size;
     batch->pte_count = 0;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
@@ -108,7 +214,7 @@ static void uvm_pte_batch_write_consecutive(uvm_pte_batch_t *batch, NvU64 pte_bi
         uvm_pte_batch_write_consecutive_inline(batch, pte_bits);
     }
     else {
-        UVM_ASSERT_MSG(batch->pte_count < UVM_PTE_BATCH_MAX_PTES, "pte_count %u\n", batch->pte_count);
+        UVM_ASSERT_MSG(batch->pte_count < UVM_PTE_BATCH_MAX_QUEUED_PTES, "pte_count %u\n", batch->pte_count);
         batch->pte_bits_queue[batch->pte_count] = pte_bits;
     }
     ++batch->pte_count;
@@ -127,26 +233,99 @@ static void pte_batch_begin_inline(uvm_pte_batch_t *batch)
         uvm_pte_batch_write_consecutive_inline(batch, batch->pte_bits_queue[i]);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-void uvm_pte_batch_write_ptes(uvm_pte_batch_t *batch, uvm_gpu_phys_address_t first_pte, NvU64 *pte_bits, NvU32 entry_size, NvU32 entry_count)
+// Store a PTE at the end of the stored PTEs
+static void pte_batch_store(uvm_pte_batch_t *batch, NvU64 pte_bits)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    NvU32 max_entries = UVM_PUSH_INLINE_DATA_MAX_SIZE / entry_size;
+    if (batch->inlining && (batch->pte_count + 1) * batch->pte_entry_size > UVM_PUSH_INLINE_DATA_MAX_SIZE)
+        uvm_pte_batch_flush_ptes(batch);
 
-    // Updating PTEs in sysmem requires a sysmembar after writing them and
-    // before any TLB invalidates.
-    if (first_pte.aperture == UVM_APERTURE_SYS)
-        batch->membar = UVM_MEMBAR_SYS;
+    if (!batch->inlining && batch->pte_count == pte_batch_max_queued_ptes(batch))
+        pte_batch_begin_inline(batch);
+
+    uvm_pte_batch_write_consecutive(batch, pte_bits);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// End the uniform run, if any. followed indicates whether more PTEs of the
+// current run will follow it.
+static void pte_batch_end_uniform(uvm_pte_batch_t *batch, bool followed)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_gpu_t *gpu = uvm_push_get_gpu(batch->push);
+    NvU32 i;
+
+    if (batch->uniform_count == 0)
+        return;
+
+    if (!pte_batch_uniform_is_long(batch, followed)) {
+        for (i = 0; i < batch->uniform_count; ++i)
+            pte_batch_store(batch, batch->uniform_bits);
+
+        batch->uniform_count = 0;
+        return;
+    }
+
+    uvm_pte_batch_flush_ptes(batch);
+
+    uvm_push_set_flag(batch->push, UVM_PUSH_FLAG_CE_NEXT_PIPELINED);
+    uvm_push_set_flag(batch->push, UVM_PUSH_FLAG_CE_NEXT_MEMBAR_NONE);
+    gpu->ce_hal->memset_8(batch->push,
+                          uvm_gpu_address_from_phys(batch->pte_first_address),
+                          batch->uniform_bits,
+                          batch->uniform_count * batch->pte_entry_size);
+
+    atomic64_inc(&gpu->pte_batch.stats.uniform_memsets);
+
+    batch->pte_first_address.address += batch->uniform_count * batch->pte_entry_size;
+    batch->uniform_count = 0;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void pte_batch_flush(uvm_pte_batch_t *batch)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    pte_batch_end_uniform(batch, false);
+    uvm_pte_batch_flush_ptes(batch);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Whether the PTE continues the current run
+static bool pte_batch_is_next(uvm_pte_batch_t *batch, uvm_gpu_phys_address_t pte, NvU32 entry_size)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_gpu_phys_address_t consecutive_pte_address = batch->pte_first_address;
+
+    if (batch->pte_count == 0 && batch->uniform_count == 0)
+        return false;
+
+    if (batch->pte_entry_size != entry_size)
+        return false;
+
+    consecutive_pte_address.address += (batch->pte_count + batch->uniform_count) * entry_size;
+
+    return uvm_gpu_phys_address_eq(pte, consecutive_pte_address);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Flush the current run and start a new one at the given PTE
+static void pte_batch_restart(uvm_pte_batch_t *batch, uvm_gpu_phys_address_t pte, NvU32 entry_size)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    pte_batch_flush(batch);
+
+    batch->pte_first_address = pte;
+    batch->pte_entry_size = entry_size;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void pte_batch_write_ptes_inline(uvm_pte_batch_t *batch,
+                                        uvm_gpu_phys_address_t first_pte,
+                                        NvU64 *pte_bits,
+                                        NvU32 entry_size,
+                                        NvU32 entry_count)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 max_entries = UVM_PUSH_INLINE_DATA_MAX_SIZE / entry_size;
 
     while (entry_count > 0) {
         NvU32 entries_this_time;
 
-        uvm_pte_batch_flush_ptes(batch);
+        pte_batch_restart(batch, first_pte, entry_size);
         pte_batch_begin_inline(batch);
 
         entries_this_time = min(max_entries, entry_count);
         uvm_push_inline_data_add(&batch->inline_data, pte_bits, entries_this_time * entry_size);
 
-        batch->pte_entry_size = entry_size;
-        batch->pte_first_address = first_pte;
         batch->pte_count = entries_this_time;
 
         pte_bits += entries_this_time * (entry_size / sizeof(*pte_bits));
@@ -155,57 +334,107 @@ void uvm_pte_batch_write_ptes(uvm_pte_batch_t *batch, uvm_gpu_phys_address_t fir
     }
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-void uvm_pte_batch_write_pte(uvm_pte_batch_t *batch, uvm_gpu_phys_address_t pte, NvU64 pte_bits, NvU32 pte_size)
+void uvm_pte_batch_write_ptes(uvm_pte_batch_t *batch, uvm_gpu_phys_address_t first_pte, NvU64 *pte_bits, NvU32 entry_size, NvU32 entry_count)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    uvm_gpu_phys_address_t consecutive_pte_address = batch->pte_first_address;
-    bool needs_flush = false;
-    consecutive_pte_address.address += batch->pte_count * pte_size;
+    uvm_gpu_t *gpu = uvm_push_get_gpu(batch->push);
+    NvU32 long_uniform_count;
 
     // Updating PTEs in sysmem requires a sysmembar after writing them and
     // before any TLB invalidates.
-    if (pte.aperture == UVM_APERTURE_SYS)
+    if (first_pte.aperture == UVM_APERTURE_SYS)
         batch->membar = UVM_MEMBAR_SYS;
 
-    // Note that pte_count and pte_entry_size can be zero for the first PTE.
-    // That's ok as the first PTE will never need a flush.
-    if ((batch->pte_count + 1) * batch->pte_entry_size > UVM_PUSH_INLINE_DATA_MAX_SIZE)
-        needs_flush = true;
+    if (entry_size != sizeof(*pte_bits)) {
+        pte_batch_write_ptes_inline(batch, first_pte, pte_bits, entry_size, entry_count);
+        return;
+    }
 
-    if (!uvm_gpu_phys_address_eq(pte, consecutive_pte_address))
-        needs_flush = true;
+    // Uniform runs in the buffer are split out of the inline memcopies only if
+    // that saves both the memset and the fixed cost of the inline memcopy that
+    // follows them.
+    long_uniform_count = max(1u, (gpu->pte_batch.memset_cost + gpu->pte_batch.inline_cost) / entry_size);
 
-    if (batch->pte_entry_size != pte_size)
-        needs_flush = true;
+    while (entry_count > 0) {
+        NvU32 dense_count = 0;
+        NvU32 uniform_count = 0;
 
-    if (needs_flush) {
-        uvm_pte_batch_flush_ptes(batch);
-        batch->pte_first_address = pte;
-        batch->pte_entry_size = pte_size;
-    }
+        while (dense_count < entry_count) {
+            uniform_count = 1;
+            while (dense_count + uniform_count < entry_count &&
+                   pte_bits[dense_count + uniform_count] == pte_bits[dense_count])
+                ++uniform_count;
 
-    if (!batch->inlining && batch->pte_count == UVM_PTE_BATCH_MAX_PTES)
-        pte_batch_begin_inline(batch);
+            if (uniform_count >= long_uniform_count)
+                break;
 
-    uvm_pte_batch_write_consecutive(batch, pte_bits);
+            dense_count += uniform_count;
+            uniform_count = 0;
+        }
+
+        if (dense_count != 0) {
+            pte_batch_write_ptes_inline(batch, first_pte, pte_bits, entry_size, dense_count);
+
+            pte_bits += dense_count;
+            first_pte.address += dense_count * entry_size;
+            entry_count -= dense_count;
+        }
+
+        if (uniform_count != 0) {
+            uvm_pte_batch_clear_ptes(batch, first_pte, pte_bits[0], entry_size, uniform_count);
+
+            pte_bits += uniform_count;
+            first_pte.address += uniform_count * entry_size;
+            entry_count -= uniform_count;
+        }
+    }
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-void uvm_pte_batch_clear_ptes(uvm_pte_batch_t *batch, uvm_gpu_phys_address_t first_pte, NvU64 empty_pte_bits, NvU32 entry_size, NvU32 entry_count)
+void uvm_pte_batch_write_pte(uvm_pte_batch_t *batch, uvm_gpu_phys_address_t pte, NvU64 pte_bits, NvU32 pte_size)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    uvm_gpu_t *gpu = uvm_push_get_gpu(batch->push);
+    // Updating PTEs in sysmem requires a sysmembar after writing them and
+    // before any TLB invalidates.
+    if (pte.aperture == UVM_APERTURE_SYS)
+        batch->membar = UVM_MEMBAR_SYS;
 
-    // TODO: Bug 1767241: Allow small clears to batch
-    uvm_pte_batch_flush_ptes(batch);
+    // Entries larger than 8 bytes are not tracked in uniform runs so they
+    // can't follow one.
+    if (!pte_batch_is_next(batch, pte, pte_size) || (pte_size != sizeof(pte_bits) && batch->uniform_count != 0))
+        pte_batch_restart(batch, pte, pte_size);
 
-    uvm_push_set_flag(batch->push, UVM_PUSH_FLAG_CE_NEXT_PIPELINED);
-    uvm_push_set_flag(batch->push, UVM_PUSH_FLAG_CE_NEXT_MEMBAR_NONE);
-    gpu->ce_hal->memset_8(batch->push, uvm_gpu_address_from_phys(first_pte), empty_pte_bits, entry_size * entry_count);
+    if (pte_size != sizeof(pte_bits)) {
+        pte_batch_store(batch, pte_bits);
+        return;
+    }
+
+    if (batch->uniform_count != 0) {
+        if (batch->uniform_bits == pte_bits) {
+            ++batch->uniform_count;
+            return;
+        }
+
+        pte_batch_end_uniform(batch, true);
+    }
 
+    batch->uniform_bits = pte_bits;
+    batch->uniform_count = 1;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_pte_batch_clear_ptes(uvm_pte_batch_t *batch, uvm_gpu_phys_address_t first_pte, NvU64 empty_pte_bits, NvU32 entry_size, NvU32 entry_count)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     if (first_pte.aperture == UVM_APERTURE_SYS)
         batch->membar = UVM_MEMBAR_SYS;
+
+    if (!pte_batch_is_next(batch, first_pte, entry_size))
+        pte_batch_restart(batch, first_pte, entry_size);
+    else if (batch->uniform_count != 0 && batch->uniform_bits != empty_pte_bits)
+        pte_batch_end_uniform(batch, true);
+
+    batch->uniform_bits = empty_pte_bits;
+    batch->uniform_count += entry_count;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 void uvm_pte_batch_end(uvm_pte_batch_t *batch)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    uvm_pte_batch_flush_ptes(batch);
+    pte_batch_flush(batch);
     uvm_hal_wfi_membar(batch->push, batch->membar);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -29,19 +29,19 @@
 #include "uvm8_hal_types.h"
 #include "uvm8_push.h"
 
-// Max PTEs to queue up for memsets before switching to inline memcopy.
-// Currently inline memcopy has to read the data from sysmem (that's where the
-// pushbuffer is) adding some latency so it's not obvious that it's better than
-// a memset that can just write the PTE bits to local vidmem. On the other hand,
-// launching a CE memset operation per each PTE also adds latency and takes a
-// lot of pushbuffer space.
+// Max PTEs that can be queued up for memsets before switching to inline
+// memcopy. Currently inline memcopy has to read the data from sysmem (that's
+// where the pushbuffer is) adding some latency so it's not obvious that it's
+// better than a memset that can just write the PTE bits to local vidmem. On the
+// other hand, launching a CE memset operation per each PTE also adds latency
+// and takes a lot of pushbuffer space.
 //
-// TODO: Bug 1767241: Benchmark the two approaches to see whether the current
-//       number makes sense.
+// The actual cutover is picked from the per-architecture costs in
+// gpu->pte_batch and is clamped to this value.
 //
 // TODO: Bug 1767241: If pushbuffer is ever moved to vidmem the tradeoffs can
 //       change as inline memcopy would have lower latency.
-#define UVM_PTE_BATCH_MAX_PTES 4
+#define UVM_PTE_BATCH_MAX_QUEUED_PTES 16
 
 struct uvm_pte_batch_struct
 {
@@ -50,17 +50,31 @@ struct uvm_pte_batch_struct
     uvm_push_inline_data_t inline_data;
     bool inlining;
 
+    // The batch accumulates a single run of PTEs at consecutive addresses
+    // starting at pte_first_address. The first pte_count PTEs of the run are
+    // stored either in pte_bits_queue or, once inlining, in the inline data.
     uvm_gpu_phys_address_t pte_first_address;
     NvU32 pte_entry_size;
-    NvU64 pte_bits_queue[UVM_PTE_BATCH_MAX_PTES];
+    NvU64 pte_bits_queue[UVM_PTE_BATCH_MAX_QUEUED_PTES];
     NvU32 pte_count;
 
+    // The stored PTEs are followed by a uniform run of uniform_count PTEs with
+    // every 8 bytes set to uniform_bits. The uniform run is not stored. When it
+    // ends it's either written with a single memset or, if short, appended to
+    // the stored PTEs.
+    NvU64 uniform_bits;
+    NvU32 uniform_count;
+
     // A membar to be applied after all the PTE writes.
     // Starts out as UVM_MEMBAR_GPU and is promoted to UVM_MEMBAR_SYS if any of
     // the written PTEs are in sysmem.
     uvm_membar_t membar;
 };
 
+// Initialize the PTE batch costs in gpu->pte_batch. The channel manager needs
+// to be created already as the costs depend on the pushbuffer location.
+NV_STATUS uvm_pte_batch_init_gpu(uvm_gpu_t *gpu);
+
 // Begin a PTE batch
 void uvm_pte_batch_begin(uvm_push_t *push, uvm_pte_batch_t *batch);
 
@@ -73,15 +87,21 @@ void uvm_pte_batch_begin(uvm_push_t *push, uvm_pte_batch_t *batch);
 // TLB invalidate.
 void uvm_pte_batch_end(uvm_pte_batch_t *batch);
 
-// Queue up a write of PTEs from a buffer
+// Queue up a write of PTEs from a buffer. Long runs of identical 8-byte PTEs
+// in the buffer are written with memsets and the rest with inline memcopies.
 void uvm_pte_batch_write_ptes(uvm_pte_batch_t *batch,
         uvm_gpu_phys_address_t first_pte, NvU64 *pte_bits, NvU32 entry_size, NvU32 entry_count);
 
-// Queue up a single PTE write
+// Queue up a single PTE write. Consecutive writes are coalesced across calls:
+// identical 8-byte PTEs are merged into uniform runs that can be written with a
+// single memset, and the remaining PTEs are written with either one memset per
+// PTE or an inline memcopy, whichever is cheaper according to gpu->pte_batch.
 void uvm_pte_batch_write_pte(uvm_pte_batch_t *batch,
         uvm_gpu_phys_address_t pte, NvU64 pte_bits, NvU32 entry_size);
 
-// Queue up a clear of PTEs
+// Queue up a clear of PTEs. All 8-byte words of the entries are set to
+// pte_bits. Consecutive clears with the same bits, and for 8-byte entries
+// consecutive writes of the same bits, are merged into a single memset.
 void uvm_pte_batch_clear_ptes(uvm_pte_batch_t *batch,
         uvm_gpu_phys_address_t first_pte, NvU64 pte_bits, NvU32 entry_size, NvU32 entry_count);
 
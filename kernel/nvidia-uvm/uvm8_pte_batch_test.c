@@ -0,0 +1,386 @@
+#include <linux/kernel.h>
+/*******************************************************************************
+    Copyright (c) 2019 NVIDIA Corporation
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+        The above copyright notice and this permission notice shall be
+        included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+
+*******************************************************************************/
+
+
+#include "uvm8_global.h"
+#include "uvm8_gpu.h"
+#include "uvm8_hal.h"
+#include "uvm8_mem.h"
+#include "uvm8_pte_batch.h"
+#include "uvm8_push.h"
+#include "uvm8_test.h"
+#include "uvm8_va_block_types.h"
+#include "uvm8_va_space.h"
+
+// Each pattern covers 2MB of VA mapped with 4K PTEs
+#define TEST_PTE_COUNT (UVM_VA_BLOCK_SIZE / UVM_PAGE_SIZE_4K)
+#define TEST_PTE_SIZE sizeof(NvU64)
+#define TEST_PTES_MB (UVM_VA_BLOCK_SIZE / (1024 * 1024))
+
+// 256K chunks for the mixed pattern
+#define TEST_PTE_MIXED_CHUNK_COUNT 64
+
+// Get the bits of the PTE at the given index in the pattern. Mapped PTEs point
+// at consecutive physical pages with the low bit standing in for the valid bit.
+// Returns whether the PTE is mapped.
+static bool test_pte_bits(NvU32 pattern, NvU32 index, NvU64 *pte_bits)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    bool mapped;
+
+    switch (pattern) {
+        case 0:
+            mapped = true;
+            break;
+        case 1:
+            mapped = false;
+            break;
+        case 2:
+            mapped = (index / TEST_PTE_MIXED_CHUNK_COUNT) % 2 == 0;
+            break;
+        default:
+            mapped = index % 2 == 0;
+            break;
+    }
+
+    *pte_bits = mapped ? ((1ULL << 32) + index * UVM_PAGE_SIZE_4K) | 1 : 0;
+
+    return mapped;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void test_write_pattern(uvm_pte_batch_t *batch, uvm_gpu_phys_address_t first_pte, NvU32 pattern)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 i;
+
+    for (i = 0; i < TEST_PTE_COUNT; ++i) {
+        uvm_gpu_phys_address_t pte = first_pte;
+        NvU64 pte_bits;
+
+        pte.address += i * TEST_PTE_SIZE;
+
+        if (test_pte_bits(pattern, i, &pte_bits))
+            uvm_pte_batch_write_pte(batch, pte, pte_bits, TEST_PTE_SIZE);
+        else
+            uvm_pte_batch_clear_ptes(batch, pte, 0, TEST_PTE_SIZE, 1);
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Reference implementation of PTE batching. Up to 4 consecutive PTEs are
+// queued up for memsets before switching to inline memcopy, and each clear is
+// written with a separate memset.
+typedef struct
+{
+    uvm_push_t *push;
+
+    uvm_push_inline_data_t inline_data;
+    bool inlining;
+
+    uvm_gpu_phys_address_t first_pte;
+    NvU64 queue[4];
+    NvU32 count;
+} reference_pte_batch_t;
+
+static void reference_pte_batch_flush(reference_pte_batch_t *batch)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_gpu_t *gpu = uvm_push_get_gpu(batch->push);
+    uvm_gpu_address_t addr = uvm_gpu_address_from_phys(batch->first_pte);
+    NvU32 i;
+
+    if (batch->inlining) {
+        uvm_gpu_address_t inline_data_addr = uvm_push_inline_data_end(&batch->inline_data);
+
+        uvm_push_set_flag(batch->push, UVM_PUSH_FLAG_CE_NEXT_MEMBAR_NONE);
+        uvm_push_set_flag(batch->push, UVM_PUSH_FLAG_CE_NEXT_PIPELINED);
+        gpu->ce_hal->memcopy(batch->push, addr, inline_data_addr, batch->count * TEST_PTE_SIZE);
+
+        batch->inlining = false;
+    }
+    else {
+        for (i = 0; i < batch->count; ++i) {
+            uvm_push_set_flag(batch->push, UVM_PUSH_FLAG_CE_NEXT_MEMBAR_NONE);
+            uvm_push_set_flag(batch->push, UVM_PUSH_FLAG_CE_NEXT_PIPELINED);
+            gpu->ce_hal->memset_8(batch->push, addr, batch->queue[i], TEST_PTE_SIZE);
+            addr.address += TEST_PTE_SIZE;
+        }
+    }
+
+    batch->count = 0;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void reference_pte_batch_write_pte(reference_pte_batch_t *batch, uvm_gpu_phys_address_t pte, NvU64 pte_bits)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (batch->count == 0 || (batch->inlining && (batch->count + 1) * TEST_PTE_SIZE > UVM_PUSH_INLINE_DATA_MAX_SIZE)) {
+        reference_pte_batch_flush(batch);
+        batch->first_pte = pte;
+    }
+
+    if (!batch->inlining && batch->count == ARRAY_SIZE(batch->queue)) {
+        batch->inlining = true;
+        uvm_push_inline_data_begin(batch->push, &batch->inline_data);
+        uvm_push_inline_data_add(&batch->inline_data, batch->queue, sizeof(batch->queue));
+    }
+
+    if (batch->inlining)
+        uvm_push_inline_data_add_8(&batch->inline_data, pte_bits);
+    else
+        batch->queue[batch->count] = pte_bits;
+
+    ++batch->count;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void reference_pte_batch_clear_pte(reference_pte_batch_t *batch, uvm_gpu_phys_address_t pte)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_gpu_t *gpu = uvm_push_get_gpu(batch->push);
+
+    reference_pte_batch_flush(batch);
+
+    uvm_push_set_flag(batch->push, UVM_PUSH_FLAG_CE_NEXT_PIPELINED);
+    uvm_push_set_flag(batch->push, UVM_PUSH_FLAG_CE_NEXT_MEMBAR_NONE);
+    gpu->ce_hal->memset_8(batch->push, uvm_gpu_address_from_phys(pte), 0, TEST_PTE_SIZE);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void reference_write_pattern(uvm_push_t *push, uvm_gpu_phys_address_t first_pte, NvU32 pattern)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    reference_pte_batch_t batch;
+    NvU32 i;
+
+    memset(&batch, 0, sizeof(batch));
+    batch.push = push;
+
+    for (i = 0; i < TEST_PTE_COUNT; ++i) {
+        uvm_gpu_phys_address_t pte = first_pte;
+        NvU64 pte_bits;
+
+        pte.address += i * TEST_PTE_SIZE;
+
+        if (test_pte_bits(pattern, i, &pte_bits))
+            reference_pte_batch_write_pte(&batch, pte, pte_bits);
+        else
+            reference_pte_batch_clear_pte(&batch, pte);
+    }
+
+    reference_pte_batch_flush(&batch);
+    uvm_hal_wfi_membar(push, UVM_MEMBAR_GPU);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Get the pushbuffer bytes used to write the pattern, using a fake push with
+// the real HALs of the GPU.
+static NV_STATUS test_pattern_push_size(uvm_gpu_t *gpu, NvU32 pattern, bool reference, NvU32 *push_size)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+    uvm_push_t push;
+    uvm_pte_batch_t batch;
+    uvm_gpu_phys_address_t first_pte = uvm_gpu_phys_address(UVM_APERTURE_VID, 0);
+
+    status = uvm_push_begin_fake(gpu, &push);
+    if (status != NV_OK)
+        return status;
+
+    if (reference) {
+        reference_write_pattern(&push, first_pte, pattern);
+    }
+    else {
+        uvm_pte_batch_begin(&push, &batch);
+        test_write_pattern(&batch, first_pte, pattern);
+        uvm_pte_batch_end(&batch);
+    }
+
+    *push_size = uvm_push_get_size(&push);
+
+    uvm_push_end_fake(&push);
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS test_pattern_push_sizes(uvm_gpu_t *gpu, UVM_TEST_PTE_BATCH_PARAMS *params)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 pattern;
+
+    for (pattern = 0; pattern < UVM_TEST_PTE_BATCH_PATTERN_COUNT; ++pattern) {
+        NvU32 push_size;
+        NvU32 reference_push_size;
+
+        MEM_NV_CHECK_RET(test_pattern_push_size(gpu, pattern, false, &push_size), NV_OK);
+        MEM_NV_CHECK_RET(test_pattern_push_size(gpu, pattern, true, &reference_push_size), NV_OK);
+
+        params->bytes_per_mb[pattern] = push_size / TEST_PTES_MB;
+        params->reference_bytes_per_mb[pattern] = reference_push_size / TEST_PTES_MB;
+
+        // The reference implementation is one of the choices available to the
+        // cost model so it should never be beaten by it.
+        TEST_CHECK_RET(push_size <= reference_push_size);
+
+        // Clearing all the PTEs takes a single memset
+        if (pattern == 1)
+            TEST_CHECK_RET(push_size < reference_push_size);
+    }
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS test_pattern_ptes(uvm_gpu_t *gpu, uvm_mem_t *mem, NvU64 *buffer, NvU32 pattern, bool use_buffer)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+    uvm_push_t push;
+    uvm_pte_batch_t batch;
+    NvU64 *cpu_ptes = (NvU64 *)uvm_mem_get_cpu_addr_kernel(mem);
+    uvm_gpu_phys_address_t first_pte = uvm_mem_gpu_physical(mem, gpu, 0, TEST_PTE_COUNT * TEST_PTE_SIZE);
+    NvU32 i;
+
+    memset(cpu_ptes, 0xff, TEST_PTE_COUNT * TEST_PTE_SIZE);
+
+    status = uvm_push_begin(gpu->channel_manager, UVM_CHANNEL_TYPE_GPU_INTERNAL, &push,
+                            "PTE batch pattern %u%s", pattern, use_buffer ? " from buffer" : "");
+    if (status != NV_OK)
+        return status;
+
+    uvm_pte_batch_begin(&push, &batch);
+
+    if (use_buffer) {
+        for (i = 0; i < TEST_PTE_COUNT; ++i)
+            test_pte_bits(pattern, i, &buffer[i]);
+
+        uvm_pte_batch_write_ptes(&batch, first_pte, buffer, TEST_PTE_SIZE, TEST_PTE_COUNT);
+    }
+    else {
+        test_write_pattern(&batch, first_pte, pattern);
+    }
+
+    uvm_pte_batch_end(&batch);
+
+    status = uvm_push_end_and_wait(&push);
+    if (status != NV_OK)
+        return status;
+
+    for (i = 0; i < TEST_PTE_COUNT; ++i) {
+        NvU64 expected;
+
+        test_pte_bits(pattern, i, &expected);
+        if (cpu_ptes[i] != expected) {
+            UVM_TEST_PRINT("Pattern %u%s PTE %u is 0x%llx instead of 0x%llx\n",
+                           pattern, use_buffer ? " from buffer" : "", i, cpu_ptes[i], expected);
+            return NV_ERR_INVALID_STATE;
+        }
+    }
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Clear consecutive 16-byte entries one at a time, which should clear both
+// halves of all of them.
+static NV_STATUS test_clear_dual_ptes(uvm_gpu_t *gpu, uvm_mem_t *mem)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+    uvm_push_t push;
+    uvm_pte_batch_t batch;
+    NvU64 *cpu_ptes = (NvU64 *)uvm_mem_get_cpu_addr_kernel(mem);
+    uvm_gpu_phys_address_t pte = uvm_mem_gpu_physical(mem, gpu, 0, 2 * TEST_PTE_COUNT * TEST_PTE_SIZE);
+    NvU32 i;
+
+    memset(cpu_ptes, 0xff, 2 * TEST_PTE_COUNT * TEST_PTE_SIZE);
+
+    status = uvm_push_begin(gpu->channel_manager, UVM_CHANNEL_TYPE_GPU_INTERNAL, &push, "PTE batch dual clears");
+    if (status != NV_OK)
+        return status;
+
+    uvm_pte_batch_begin(&push, &batch);
+
+    for (i = 0; i < TEST_PTE_COUNT; ++i) {
+        uvm_pte_batch_clear_ptes(&batch, pte, 0, 2 * TEST_PTE_SIZE, 1);
+        pte.address += 2 * TEST_PTE_SIZE;
+    }
+
+    uvm_pte_batch_end(&batch);
+
+    status = uvm_push_end_and_wait(&push);
+    if (status != NV_OK)
+        return status;
+
+    for (i = 0; i < 2 * TEST_PTE_COUNT; ++i)
+        TEST_CHECK_RET(cpu_ptes[i] == 0);
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS test_pte_batch_gpu(uvm_gpu_t *gpu, UVM_TEST_PTE_BATCH_PARAMS *params)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+    uvm_mem_t *mem = NULL;
+    uvm_mem_alloc_params_t mem_params = {0};
+    NvU64 *buffer;
+    NvU32 pattern;
+
+    buffer = uvm_kvmalloc(TEST_PTE_COUNT * TEST_PTE_SIZE);
+    if (!buffer)
+        return NV_ERR_NO_MEMORY;
+
+    // Physically contiguous sysmem big enough for TEST_PTE_COUNT 16-byte
+    // entries
+    mem_params.page_size = 2 * TEST_PTE_COUNT * TEST_PTE_SIZE;
+    mem_params.size = 2 * TEST_PTE_COUNT * TEST_PTE_SIZE;
+    status = uvm_mem_alloc(&mem_params, &mem);
+    if (status != NV_OK)
+        goto done;
+
+    status = uvm_mem_map_cpu(mem, NULL);
+    if (status != NV_OK)
+        goto done;
+
+    status = uvm_mem_map_gpu_phys(mem, gpu);
+    if (status != NV_OK)
+        goto done;
+
+    for (pattern = 0; pattern < UVM_TEST_PTE_BATCH_PATTERN_COUNT; ++pattern) {
+        TEST_NV_CHECK_GOTO(test_pattern_ptes(gpu, mem, buffer, pattern, false), done);
+        TEST_NV_CHECK_GOTO(test_pattern_ptes(gpu, mem, buffer, pattern, true), done);
+    }
+
+    TEST_NV_CHECK_GOTO(test_clear_dual_ptes(gpu, mem), done);
+
+    TEST_NV_CHECK_GOTO(test_pattern_push_sizes(gpu, params), done);
+
+done:
+    uvm_mem_free(mem);
+    uvm_kvfree(buffer);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NV_STATUS uvm8_test_pte_batch(UVM_TEST_PTE_BATCH_PARAMS *params, struct file *filp)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    uvm_gpu_t *gpu;
+
+    uvm_va_space_down_read_rm(va_space);
+
+    for_each_va_space_gpu(gpu, va_space) {
+        status = test_pte_batch_gpu(gpu, params);
+        if (status != NV_OK)
+            break;
+    }
+
+    uvm_va_space_up_read_rm(va_space);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -25,9 +25,11 @@
 #include "uvm8_extern_decl.h"
 #include "uvm8_forward_decl.h"
 #include "uvm8_push.h"
+#include "uvm8_push_decode.h"
 #include "uvm8_channel.h"
 #include "uvm8_hal.h"
 #include "uvm8_kvmalloc.h"
+#include "uvm8_test.h"
 #include "uvm_linux.h"
 
 // This parameter enables push description tracking in push info. It's enabled
@@ -40,6 +42,29 @@ static unsigned uvm_debug_enable_push_acquire_info = 0;
 module_param(uvm_debug_enable_push_acquire_info, uint, S_IRUGO|S_IWUSR);
 MODULE_PARM_DESC(uvm_debug_enable_push_acquire_info, "Enable push acquire information tracking");
 
+// Size of the push capture buffer in KB. 0 disables push capture, see
+// uvm_push_capture_init().
+static unsigned uvm_debug_push_capture_size_kb = 0;
+module_param(uvm_debug_push_capture_size_kb, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_debug_push_capture_size_kb, "Size in KB of the buffer capturing the methods of every push, 0 to disable");
+
+static struct
+{
+    // Captured records, see uvm_push_capture_record_t
+    char *buffer;
+    NvU64 size;
+
+    // Bytes of the buffer used by records
+    NvU64 used;
+
+    // Number of pushes that didn't fit in the buffer
+    NvU64 dropped_pushes;
+
+    // Lock protecting the state above, except for buffer and size that are
+    // only set on init and exit.
+    uvm_spinlock_t lock;
+} g_uvm_push_capture;
+
 static uvm_push_acquire_info_t *push_acquire_info_from_push(uvm_push_t *push)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     uvm_channel_t *channel = push->channel;
@@ -131,6 +156,7 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 // Internal helper to fill info push info as part of beginning a push.
 static void push_fill_info(uvm_push_t *push,
+                           uvm_channel_type_t channel_type,
                            const char *filename,
                            const char *function,
                            int line,
@@ -148,6 +174,7 @@ static void push_fill_info(uvm_push_t *push,
     push_info->filename = kbasename(filename);
     push_info->function = function;
     push_info->line = line;
+    push_info->channel_type = channel_type;
 
     push_acquire_info = push_acquire_info_from_push(push);
     if (push_acquire_info)
@@ -158,6 +185,7 @@ static void push_fill_info(uvm_push_t *push,
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 static NV_STATUS push_begin_acquire_with_info(uvm_channel_t *channel,
+                                              uvm_channel_type_t channel_type,
                                               uvm_tracker_t *tracker,
                                               uvm_push_t *push,
                                               const char *filename,
@@ -176,7 +204,7 @@ static NV_STATUS push_begin_acquire_with_info(uvm_channel_t *channel,
     if (status != NV_OK)
         return status;
 
-    push_fill_info(push, filename, function, line, format, args);
+    push_fill_info(push, channel_type, filename, function, line, format, args);
 
     uvm_push_acquire_tracker(push, tracker);
 
@@ -210,7 +238,34 @@ NV_STATUS __uvm_push_begin_acquire_with_info(uvm_channel_manager_t *manager,
     UVM_ASSERT(channel);
 
     va_start(args, format);
-    status = push_begin_acquire_with_info(channel, tracker, push, filename, function, line, format, args);
+    status = push_begin_acquire_with_info(channel, type, tracker, push, filename, function, line, format, args);
+    va_end(args);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+__attribute__ ((format(printf, 10, 11)))
+NV_STATUS __uvm_push_try_begin_acquire_excluding_ce_with_info(uvm_channel_manager_t *manager,
+                                                             uvm_channel_type_t type,
+                                                             uvm_gpu_t *dst_gpu,
+                                                             long unsigned exclude_ce_mask,
+                                                             uvm_tracker_t *tracker,
+                                                             uvm_push_t *push,
+                                                             const char *filename,
+                                                             const char *function,
+                                                             int line,
+                                                             const char *format, ...)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    va_list args;
+    NV_STATUS status;
+    uvm_channel_t *channel;
+
+    status = uvm_channel_try_reserve_type_excluding(manager, type, dst_gpu, exclude_ce_mask, &channel);
+    if (status != NV_OK)
+        return status;
+
+    va_start(args, format);
+    status = push_begin_acquire_with_info(channel, type, tracker, push, filename, function, line, format, args);
     va_end(args);
 
     return status;
@@ -233,7 +288,15 @@ NV_STATUS __uvm_push_begin_acquire_on_channel_with_info(uvm_channel_t *channel,
         return status;
 
     va_start(args, format);
-    status = push_begin_acquire_with_info(channel, tracker, push, filename, function, line, format, args);
+    status = push_begin_acquire_with_info(channel,
+                                          UVM_CHANNEL_TYPE_ANY,
+                                          tracker,
+                                          push,
+                                          filename,
+                                          function,
+                                          line,
+                                          format,
+                                          args);
     va_end(args);
 
     return status;
@@ -249,9 +312,127 @@ bool uvm_push_info_is_tracking_acquires()
     return uvm_debug_enable_push_acquire_info != 0;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+NV_STATUS uvm_push_capture_init(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_spin_lock_init(&g_uvm_push_capture.lock, UVM_LOCK_ORDER_LEAF);
+
+    if (uvm_debug_push_capture_size_kb == 0)
+        return NV_OK;
+
+    g_uvm_push_capture.size = (NvU64)uvm_debug_push_capture_size_kb * 1024;
+    g_uvm_push_capture.buffer = uvm_kvmalloc(g_uvm_push_capture.size);
+    if (!g_uvm_push_capture.buffer)
+        return NV_ERR_NO_MEMORY;
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_push_capture_exit(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_kvfree(g_uvm_push_capture.buffer);
+    g_uvm_push_capture.buffer = NULL;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+bool uvm_push_capture_enabled(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return g_uvm_push_capture.buffer != NULL;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Copy the methods of the push into a record in the capture buffer. This has to
+// happen before uvm_channel_end_push() as the pushbuffer space can be reused as
+// soon as the push is submitted.
+static void push_capture(uvm_push_t *push)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_push_info_t *push_info = uvm_push_info_from_push(push);
+    uvm_push_capture_record_t *record;
+    NvU32 push_size = uvm_push_get_size(push);
+    NvU32 record_size = UVM_ALIGN_UP(sizeof(*record) + push_size, UVM_PUSH_CAPTURE_RECORD_ALIGNMENT);
+
+    uvm_spin_lock(&g_uvm_push_capture.lock);
+
+    if (g_uvm_push_capture.used + record_size > g_uvm_push_capture.size) {
+        ++g_uvm_push_capture.dropped_pushes;
+        goto done;
+    }
+
+    record = (uvm_push_capture_record_t *)(g_uvm_push_capture.buffer + g_uvm_push_capture.used);
+    memset(record, 0, record_size);
+
+    record->record_size = record_size;
+    record->push_size = push_size;
+    record->host_class = push->gpu->rm_info.hostClass;
+    record->channel_type = push_info->channel_type;
+    record->line = push_info->line;
+    snprintf(record->filename, sizeof(record->filename), "%s", push_info->filename);
+    snprintf(record->function, sizeof(record->function), "%s", push_info->function);
+    if (uvm_push_info_is_tracking_descriptions())
+        snprintf(record->description, sizeof(record->description), "%s", push_info->description);
+
+    memcpy(record + 1, push->begin, push_size);
+
+    g_uvm_push_capture.used += record_size;
+
+done:
+    uvm_spin_unlock(&g_uvm_push_capture.lock);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NV_STATUS uvm8_test_push_capture(UVM_TEST_PUSH_CAPTURE_PARAMS *params, struct file *filp)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    const uvm_push_capture_record_t *record;
+    NvU64 copy_size;
+    NvU64 offset = 0;
+    char *copy = NULL;
+    NV_STATUS status = NV_OK;
+
+    if (!uvm_push_capture_enabled())
+        return NV_ERR_INVALID_STATE;
+
+    copy_size = min(params->buffer_size, g_uvm_push_capture.size);
+    if (copy_size > 0) {
+        copy = uvm_kvmalloc(copy_size);
+        if (!copy)
+            return NV_ERR_NO_MEMORY;
+    }
+
+    uvm_spin_lock(&g_uvm_push_capture.lock);
+
+    // Only copy whole records
+    while ((record = uvm_push_capture_next_record(g_uvm_push_capture.buffer, g_uvm_push_capture.used, &offset))) {
+        if (offset > copy_size) {
+            offset -= record->record_size;
+            break;
+        }
+    }
+
+    if (offset > 0)
+        memcpy(copy, g_uvm_push_capture.buffer, offset);
+
+    params->capture_size = g_uvm_push_capture.used;
+    params->copied_size = offset;
+    params->dropped_pushes = g_uvm_push_capture.dropped_pushes;
+
+    if (params->reset && offset == g_uvm_push_capture.used) {
+        g_uvm_push_capture.used = 0;
+        g_uvm_push_capture.dropped_pushes = 0;
+    }
+
+    uvm_spin_unlock(&g_uvm_push_capture.lock);
+
+    if (offset > 0 && nv_copy_to_user((void *)params->buffer, copy, offset) != 0)
+        status = NV_ERR_INVALID_ADDRESS;
+
+    uvm_kvfree(copy);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 void uvm_push_end(uvm_push_t *push)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     uvm_push_flag_t flag;
+
+    if (uvm_push_capture_enabled())
+        push_capture(push);
+
     uvm_channel_end_push(push);
 
     flag = find_first_bit(push->flags, UVM_PUSH_FLAG_COUNT);
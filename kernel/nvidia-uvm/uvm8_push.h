@@ -79,6 +79,11 @@ struct uvm_push_struct
     // above. It will be 0 for an on-going push.
     NvU64 channel_tracking_value;
 
+    // Number of bytes copied or memset by the CE methods in the push.
+    // Accumulated by the CE HAL and used to estimate the load of the channel,
+    // see uvm_channel_reserve_type().
+    NvU64 transfer_bytes;
+
     // Index for the push info stored within the channel.
     // Only valid for an on-going push (after uvm_push_begin*(), but before
     // uvm_push_end()).
@@ -123,6 +128,10 @@ struct uvm_push_info_struct
     // arguments.
     char description[128];
 
+    // Channel type the push was begun with, UVM_CHANNEL_TYPE_ANY for pushes
+    // begun on a specific channel
+    uvm_channel_type_t channel_type;
+
     // Procedure to be called when the corresponding push is complete.
     // This procedure is called with the UVM_LOCK_ORDER_CHANNEL spin lock held.
     void (*on_complete)(void *);
@@ -144,6 +153,20 @@ bool uvm_push_info_is_tracking_descriptions(void);
 // Is tracking of values acquired by the push enabled?
 bool uvm_push_info_is_tracking_acquires(void);
 
+// Push capture
+//
+// When enabled with the uvm_debug_push_capture_size_kb module parameter, the
+// method stream of every push is copied into a capture buffer by uvm_push_end()
+// together with its call site, description and channel type. The buffer can be
+// read with UVM_TEST_PUSH_CAPTURE and decoded with the kernel-independent
+// decoder in uvm8_push_decode.h. Pushes that don't fit in the buffer are
+// dropped.
+NV_STATUS uvm_push_capture_init(void);
+void uvm_push_capture_exit(void);
+
+// Is push capture enabled?
+bool uvm_push_capture_enabled(void);
+
 // Internal helper for the uvm_push_begin* family of macros
 __attribute__ ((format(printf, 9, 10)))
 NV_STATUS __uvm_push_begin_acquire_with_info(uvm_channel_manager_t *manager,
@@ -156,6 +179,20 @@ NV_STATUS __uvm_push_begin_acquire_with_info(uvm_channel_manager_t *manager,
                                              int line,
                                              const char *format, ...);
 
+// Internal helper for uvm_push_try_begin_acquire_excluding_ce and
+// uvm_push_try_begin_acquire_gpu_to_gpu_excluding_ce
+__attribute__ ((format(printf, 10, 11)))
+NV_STATUS __uvm_push_try_begin_acquire_excluding_ce_with_info(uvm_channel_manager_t *manager,
+                                                             uvm_channel_type_t type,
+                                                             uvm_gpu_t *dst_gpu,
+                                                             long unsigned exclude_ce_mask,
+                                                             uvm_tracker_t *tracker,
+                                                             uvm_push_t *push,
+                                                             const char *filename,
+                                                             const char *function,
+                                                             int line,
+                                                             const char *format, ...);
+
 // Internal helper for uvm_push_begin_on_channel and
 // uvm_push_begin_acquire_on_channel
 __attribute__ ((format(printf, 7, 8)))
@@ -208,6 +245,24 @@ NV_STATUS __uvm_push_begin_acquire_on_channel_with_info(uvm_channel_t *channel,
     __uvm_push_begin_acquire_with_info((manager), UVM_CHANNEL_TYPE_GPU_TO_GPU, (dst_gpu), (tracker), (push), \
         __FILE__, __FUNCTION__, __LINE__, (format), ##__VA_ARGS__)
 
+// Begin a push on a channel of channel_type type whose CE is not in
+// exclude_ce_mask, and acquire the input tracker. Unlike the other
+// uvm_push_begin variants this doesn't wait for a channel to become available,
+// and returns NV_ERR_NOT_FOUND instead. See
+// uvm_channel_try_reserve_type_excluding().
+//
+// Locking: on success acquires the concurrent push semaphore until uvm_push_end()
+#define uvm_push_try_begin_acquire_excluding_ce(manager, type, exclude_ce_mask, tracker, push, format, ...)             \
+    __uvm_push_try_begin_acquire_excluding_ce_with_info((manager), (type), NULL, (exclude_ce_mask), (tracker), (push), \
+        __FILE__, __FUNCTION__, __LINE__, (format), ##__VA_ARGS__)
+
+// Same as uvm_push_try_begin_acquire_excluding_ce but for a transfer from the
+// GPU of the manager to dst_gpu. The CE recommended for the pair of GPUs is
+// also a candidate, see uvm_channel_try_reserve_type_excluding().
+#define uvm_push_try_begin_acquire_gpu_to_gpu_excluding_ce(manager, dst_gpu, exclude_ce_mask, tracker, push, format, ...) \
+    __uvm_push_try_begin_acquire_excluding_ce_with_info((manager), UVM_CHANNEL_TYPE_GPU_TO_GPU, (dst_gpu),                \
+        (exclude_ce_mask), (tracker), (push), __FILE__, __FUNCTION__, __LINE__, (format), ##__VA_ARGS__)
+
 // Begin a push on a specific channel
 // If the channel is busy, spin wait for it to become available.
 //
@@ -0,0 +1,319 @@
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/string.h>
+#else
+// Userspace builds of the decoder have no kernel log to trace to
+#include <string.h>
+#define pr_info(...)
+#define dump_stack()
+#endif
+/*******************************************************************************
+    Copyright (c) 2019 NVIDIA Corporation
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+        The above copyright notice and this permission notice shall be
+        included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+
+*******************************************************************************/
+
+
+#include "uvm8_push_decode.h"
+#include "nvmisc.h"
+#include "cla06f.h"
+#include "cla06fsubch.h"
+#include "cla0b5.h"
+#include "cla16f.h"
+#include "clb06f.h"
+#include "clc06f.h"
+#include "clc46f.h"
+
+NvBool uvm_push_decode_header(NvU32 header, uvm_push_decode_header_t *out)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    out->subchannel = DRF_VAL(A06F, _DMA, _METHOD_SUBCHANNEL, header);
+    out->address = DRF_VAL(A06F, _DMA, _METHOD_ADDRESS, header) << 2;
+    out->count = DRF_VAL(A06F, _DMA, _METHOD_COUNT, header);
+    out->immediate = 0;
+
+    switch (DRF_VAL(A06F, _DMA, _SEC_OP, header)) {
+        case NVA06F_DMA_SEC_OP_INC_METHOD:
+            out->type = UVM_PUSH_DECODE_HEADER_INC;
+            return NV_TRUE;
+        case NVA06F_DMA_SEC_OP_NON_INC_METHOD:
+            out->type = UVM_PUSH_DECODE_HEADER_NON_INC;
+            return NV_TRUE;
+        case NVB06F_DMA_ONEINCR_OPCODE_VALUE:
+            out->type = UVM_PUSH_DECODE_HEADER_ONE_INC;
+            return NV_TRUE;
+        case NVA06F_DMA_IMMD_OPCODE_VALUE:
+            out->type = UVM_PUSH_DECODE_HEADER_IMMD;
+            out->immediate = DRF_VAL(A06F, _DMA, _IMMD_DATA, header);
+            out->count = 0;
+            return NV_TRUE;
+        default:
+            return NV_FALSE;
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NvU32 uvm_push_decode_method_address(const uvm_push_decode_header_t *header, NvU32 index)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    switch (header->type) {
+        case UVM_PUSH_DECODE_HEADER_INC:
+            return header->address + index * 4;
+        case UVM_PUSH_DECODE_HEADER_ONE_INC:
+            return index == 0 ? header->address : header->address + 4;
+        default:
+            return header->address;
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void decode_host_method(NvU32 host_class, NvU32 address, NvU32 data, uvm_push_decode_stats_t *stats)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 operation;
+
+    switch (address) {
+        case NVA06F_SEMAPHORED:
+            ++stats->semaphore_ops;
+            break;
+        case NVA16F_WFI:
+            ++stats->wait_for_idles;
+            break;
+        case NVC46F_SEM_EXECUTE:
+            // Turing+ semaphores are executed by SEM_EXECUTE. Earlier classes
+            // don't use the address.
+            if (host_class >= TURING_CHANNEL_GPFIFO_A)
+                ++stats->semaphore_ops;
+            break;
+        case NVA06F_MEM_OP_B:
+            // Kepler and Maxwell membars and VA invalidates select the
+            // operation in MEM_OP_B. Pascal+ reuse the method for the
+            // invalidate target address.
+            if (host_class >= PASCAL_CHANNEL_GPFIFO_A)
+                break;
+
+            operation = DRF_VAL(A06F, _MEM_OP_B, _OPERATION, data);
+            if (operation == NVA06F_MEM_OP_B_OPERATION_SYSMEMBAR_FLUSH)
+                ++stats->membars;
+            else if (operation == NVA06F_MEM_OP_B_OPERATION_MMU_TLB_INVALIDATE)
+                ++stats->tlb_invalidates;
+            break;
+        case NVB06F_MEM_OP_D:
+            // MEM_OP_C and MEM_OP_D were added in Maxwell
+            if (host_class < MAXWELL_CHANNEL_GPFIFO_A)
+                break;
+
+            operation = DRF_VAL(C06F, _MEM_OP_D, _OPERATION, data);
+            if (operation == NVC06F_MEM_OP_D_OPERATION_MEMBAR)
+                ++stats->membars;
+            else if (operation == NVC06F_MEM_OP_D_OPERATION_MMU_TLB_INVALIDATE ||
+                     operation == NVC06F_MEM_OP_D_OPERATION_MMU_TLB_INVALIDATE_TARGETED)
+                ++stats->tlb_invalidates;
+            break;
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// The LAUNCH_DMA fields looked at are the same in all the CE classes, from
+// KEPLER_DMA_COPY_A to VOLTA_DMA_COPY_A.
+static void decode_ce_launch_dma(NvU32 data, uvm_push_decode_stats_t *stats)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    ++stats->ce_launches;
+
+    if (DRF_VAL(A0B5, _LAUNCH_DMA, _DATA_TRANSFER_TYPE, data) != NVA0B5_LAUNCH_DMA_DATA_TRANSFER_TYPE_NONE)
+        ++stats->ce_transfers;
+
+    if (DRF_VAL(A0B5, _LAUNCH_DMA, _SEMAPHORE_TYPE, data) != NVA0B5_LAUNCH_DMA_SEMAPHORE_TYPE_NONE)
+        ++stats->semaphore_ops;
+
+    if (DRF_VAL(A0B5, _LAUNCH_DMA, _FLUSH_ENABLE, data) == NVA0B5_LAUNCH_DMA_FLUSH_ENABLE_TRUE)
+        ++stats->membars;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void decode_method(NvU32 host_class,
+                          NvU32 subchannel,
+                          NvU32 address,
+                          NvU32 data,
+                          uvm_push_decode_stats_t *stats)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    ++stats->methods;
+
+    if (address < UVM_PUSH_DECODE_HOST_METHODS_END) {
+        ++stats->engine_methods[UVM_PUSH_DECODE_ENGINE_HOST];
+        decode_host_method(host_class, address, data, stats);
+    }
+    else if (subchannel == NVA06F_SUBCHANNEL_COPY_ENGINE) {
+        ++stats->engine_methods[UVM_PUSH_DECODE_ENGINE_CE];
+        if (address == NVA0B5_LAUNCH_DMA)
+            decode_ce_launch_dma(data, stats);
+    }
+    else {
+        ++stats->engine_methods[UVM_PUSH_DECODE_ENGINE_OTHER];
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NvBool uvm_push_decode(const NvU32 *methods, NvU32 size, NvU32 host_class, uvm_push_decode_stats_t *stats)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 num_words = size / 4;
+    NvU32 i = 0;
+
+    stats->size += size;
+    stats->undecoded_bytes += size % 4;
+
+    while (i < num_words) {
+        uvm_push_decode_header_t header;
+        NvU32 j;
+
+        if (!uvm_push_decode_header(methods[i], &header) || i + 1 + header.count > num_words) {
+            stats->undecoded_bytes += (num_words - i) * 4;
+            return NV_FALSE;
+        }
+
+        ++stats->headers;
+        ++i;
+
+        if (header.type == UVM_PUSH_DECODE_HEADER_IMMD) {
+            decode_method(host_class, header.subchannel, header.address, header.immediate, stats);
+            continue;
+        }
+
+        // The data following a NOP is never executed, which is what makes room
+        // for inline data.
+        if (header.address == NVA06F_NOP) {
+            ++stats->methods;
+            ++stats->engine_methods[UVM_PUSH_DECODE_ENGINE_HOST];
+            stats->inline_data_bytes += header.count * 4;
+            i += header.count;
+            continue;
+        }
+
+        for (j = 0; j < header.count; ++j)
+            decode_method(host_class, header.subchannel, uvm_push_decode_method_address(&header, j), methods[i + j], stats);
+
+        i += header.count;
+    }
+
+    return stats->undecoded_bytes == 0;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+const uvm_push_capture_record_t *uvm_push_capture_next_record(const void *capture,
+                                                              NvU64 capture_size,
+                                                              NvU64 *offset)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    const uvm_push_capture_record_t *record;
+
+    if (*offset + sizeof(*record) > capture_size)
+        return NULL;
+
+    record = (const uvm_push_capture_record_t *)((const char *)capture + *offset);
+    if (record->record_size < sizeof(*record) + record->push_size ||
+        record->record_size % UVM_PUSH_CAPTURE_RECORD_ALIGNMENT != 0 ||
+        record->record_size > capture_size - *offset)
+        return NULL;
+
+    *offset += record->record_size;
+
+    return record;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_push_decode_report_init(uvm_push_decode_report_t *report, uvm_push_decode_site_t *sites, NvU32 max_sites)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    memset(report, 0, sizeof(*report));
+    memset(sites, 0, sizeof(*sites) * max_sites);
+    report->sites = sites;
+    report->max_sites = max_sites;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void stats_add(uvm_push_decode_stats_t *stats, const uvm_push_decode_stats_t *other)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 i;
+
+    stats->size += other->size;
+    stats->headers += other->headers;
+    stats->methods += other->methods;
+    for (i = 0; i < UVM_PUSH_DECODE_ENGINE_COUNT; ++i)
+        stats->engine_methods[i] += other->engine_methods[i];
+    stats->inline_data_bytes += other->inline_data_bytes;
+    stats->semaphore_ops += other->semaphore_ops;
+    stats->membars += other->membars;
+    stats->wait_for_idles += other->wait_for_idles;
+    stats->tlb_invalidates += other->tlb_invalidates;
+    stats->ce_launches += other->ce_launches;
+    stats->ce_transfers += other->ce_transfers;
+    stats->undecoded_bytes += other->undecoded_bytes;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static uvm_push_decode_site_t *report_find_site(uvm_push_decode_report_t *report,
+                                                const uvm_push_capture_record_t *record)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_push_decode_site_t *site;
+    NvU32 i;
+
+    for (i = 0; i < report->num_sites; ++i) {
+        site = &report->sites[i];
+        if (site->line == record->line &&
+            strncmp(site->filename, record->filename, sizeof(record->filename)) == 0)
+            return site;
+    }
+
+    if (report->num_sites == report->max_sites)
+        return NULL;
+
+    site = &report->sites[report->num_sites++];
+    site->filename = record->filename;
+    site->function = record->function;
+    site->line = record->line;
+
+    return site;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_push_decode_report_add(uvm_push_decode_report_t *report, const uvm_push_capture_record_t *record)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_push_decode_stats_t stats;
+    uvm_push_decode_site_t *site;
+
+    memset(&stats, 0, sizeof(stats));
+
+    // The strings are copied with truncation and hence are expected to be
+    // terminated. Don't trust dumps that aren't.
+    if (record->filename[sizeof(record->filename) - 1] != '\0' ||
+        record->function[sizeof(record->function) - 1] != '\0' ||
+        !uvm_push_decode(UVM_PUSH_CAPTURE_RECORD_METHODS(record), record->push_size, record->host_class, &stats)) {
+        ++report->skipped_records;
+        return;
+    }
+
+    site = report_find_site(report, record);
+    if (!site) {
+        ++report->skipped_records;
+        return;
+    }
+
+    ++report->records;
+    ++site->pushes;
+
+    stats_add(&site->stats, &stats);
+    stats_add(&report->total, &stats);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NvBool uvm_push_decode_report_capture(uvm_push_decode_report_t *report, const void *capture, NvU64 capture_size)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    const uvm_push_capture_record_t *record;
+    NvU64 offset = 0;
+
+    while ((record = uvm_push_capture_next_record(capture, capture_size, &offset)))
+        uvm_push_decode_report_add(report, record);
+
+    return offset == capture_size;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
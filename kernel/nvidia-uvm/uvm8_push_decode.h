@@ -0,0 +1,233 @@
+/*******************************************************************************
+    Copyright (c) 2019 NVIDIA Corporation
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+        The above copyright notice and this permission notice shall be
+        included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+
+*******************************************************************************/
+
+
+#ifndef __UVM8_PUSH_DECODE_H__
+#define __UVM8_PUSH_DECODE_H__
+
+#include "nvtypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Decoder for the method streams written into pushbuffers by the host and CE
+// HALs, and the format of the push captures (see uvm_debug_push_capture_size_kb
+// in uvm8_push.c and UVM_TEST_PUSH_CAPTURE).
+//
+// The decoder only depends on nvtypes.h and the class headers. The same
+// uvm8_push_decode.c is built into the driver and can be built into userspace
+// tools that analyze capture dumps, no GPU is needed.
+
+// Methods with an address below this one are executed by host, regardless of
+// the subchannel they are sent on.
+#define UVM_PUSH_DECODE_HOST_METHODS_END 0x100
+
+typedef enum
+{
+    UVM_PUSH_DECODE_ENGINE_HOST,
+    UVM_PUSH_DECODE_ENGINE_CE,
+
+    // Any other subchannel, e.g. the SW object
+    UVM_PUSH_DECODE_ENGINE_OTHER,
+
+    UVM_PUSH_DECODE_ENGINE_COUNT
+} uvm_push_decode_engine_t;
+
+typedef enum
+{
+    // The header is followed by count methods with incrementing addresses
+    UVM_PUSH_DECODE_HEADER_INC,
+
+    // The header is followed by count methods, all to the same address
+    UVM_PUSH_DECODE_HEADER_NON_INC,
+
+    // The first method goes to the address, the rest to the next address
+    UVM_PUSH_DECODE_HEADER_ONE_INC,
+
+    // The data of the single method is stored in the header
+    UVM_PUSH_DECODE_HEADER_IMMD,
+} uvm_push_decode_header_type_t;
+
+typedef struct
+{
+    uvm_push_decode_header_type_t type;
+
+    NvU32 subchannel;
+
+    // Method address in bytes
+    NvU32 address;
+
+    // Number of method data words following the header. 0 for immediate
+    // headers.
+    NvU32 count;
+
+    // Method data of immediate headers
+    NvU32 immediate;
+} uvm_push_decode_header_t;
+
+typedef struct
+{
+    // Size of the decoded method streams in bytes
+    NvU64 size;
+
+    // Number of method headers
+    NvU64 headers;
+
+    // Number of methods written. A NOP counts as a single method no matter
+    // how much data it skips.
+    NvU64 methods;
+
+    // Methods per uvm_push_decode_engine_t
+    NvU64 engine_methods[UVM_PUSH_DECODE_ENGINE_COUNT];
+
+    // Bytes skipped over by NOP methods. This is how inline data is embedded
+    // in a push, see uvm_push_inline_data_begin().
+    NvU64 inline_data_bytes;
+
+    // Host semaphore acquires and releases, and CE semaphore releases
+    NvU64 semaphore_ops;
+
+    // Host membars and CE launches with a flush
+    NvU64 membars;
+
+    // Host wait for idle methods
+    NvU64 wait_for_idles;
+
+    // Host TLB invalidates, targeted or not
+    NvU64 tlb_invalidates;
+
+    // CE launches, and how many of them transfer any data. The others only
+    // release a semaphore.
+    NvU64 ce_launches;
+    NvU64 ce_transfers;
+
+    // Bytes at the end of a stream that couldn't be decoded
+    NvU64 undecoded_bytes;
+} uvm_push_decode_stats_t;
+
+#define UVM_PUSH_CAPTURE_STRING_SIZE 64
+#define UVM_PUSH_CAPTURE_DESCRIPTION_SIZE 128
+
+// Records are stored back to back in a capture. Each record is followed by
+// push_size bytes of methods, padded so that the next record is 8-byte
+// aligned.
+typedef struct
+{
+    // Size of the record in bytes, including this header, the methods and the
+    // padding
+    NvU32 record_size;
+
+    // Size of the method stream of the push in bytes. This doesn't include the
+    // semaphore release added by uvm_push_end(), which is the same for every
+    // push, see UVM_PUSH_END_SIZE.
+    NvU32 push_size;
+
+    // Host class of the GPU the push was done on, e.g.
+    // PASCAL_CHANNEL_GPFIFO_A. Needed to decode the host methods.
+    NvU32 host_class;
+
+    // Channel type (uvm_channel_type_t) the push was begun with.
+    // UVM_CHANNEL_TYPE_ANY for pushes begun on a specific channel.
+    NvU32 channel_type;
+
+    // Call site of uvm_push_begin*()
+    NvU32 line;
+    NvU32 padding;
+    char filename[UVM_PUSH_CAPTURE_STRING_SIZE];
+    char function[UVM_PUSH_CAPTURE_STRING_SIZE];
+
+    // Empty unless push descriptions are being tracked, see
+    // uvm_push_info_is_tracking_descriptions()
+    char description[UVM_PUSH_CAPTURE_DESCRIPTION_SIZE];
+} uvm_push_capture_record_t;
+
+#define UVM_PUSH_CAPTURE_RECORD_ALIGNMENT 8
+
+// Method stream following a capture record
+#define UVM_PUSH_CAPTURE_RECORD_METHODS(record) ((const NvU32 *)((const uvm_push_capture_record_t *)(record) + 1))
+
+// Per call site results of decoding a capture
+typedef struct
+{
+    // Point to the strings in the first record of the call site, and hence
+    // are only valid as long as the capture is.
+    const char *filename;
+    const char *function;
+    NvU32 line;
+
+    NvU64 pushes;
+    uvm_push_decode_stats_t stats;
+} uvm_push_decode_site_t;
+
+typedef struct
+{
+    // Caller provided array of max_sites entries
+    uvm_push_decode_site_t *sites;
+    NvU32 max_sites;
+    NvU32 num_sites;
+
+    // Records decoded, and records skipped because they were malformed or
+    // their call site didn't fit in sites
+    NvU64 records;
+    NvU64 skipped_records;
+
+    // Stats of all the decoded records
+    uvm_push_decode_stats_t total;
+} uvm_push_decode_report_t;
+
+// Decode a single method header. Returns NV_FALSE if the header uses an
+// opcode UVM never pushes.
+NvBool uvm_push_decode_header(NvU32 header, uvm_push_decode_header_t *out);
+
+// Address of the method carrying the index-th data word of the header
+NvU32 uvm_push_decode_method_address(const uvm_push_decode_header_t *header, NvU32 index);
+
+// Decode the method stream of size bytes at methods, pushed on a channel of
+// the given host class, and accumulate the results into stats. Returns
+// NV_FALSE if the stream is malformed, in which case the remaining bytes are
+// accounted in undecoded_bytes.
+NvBool uvm_push_decode(const NvU32 *methods, NvU32 size, NvU32 host_class, uvm_push_decode_stats_t *stats);
+
+// Return the record at *offset in a capture of capture_size bytes and advance
+// *offset to the next one. Returns NULL at the end of the capture or if the
+// record is malformed.
+const uvm_push_capture_record_t *uvm_push_capture_next_record(const void *capture,
+                                                              NvU64 capture_size,
+                                                              NvU64 *offset);
+
+// Initialize a report that aggregates records into the given sites array
+void uvm_push_decode_report_init(uvm_push_decode_report_t *report, uvm_push_decode_site_t *sites, NvU32 max_sites);
+
+// Decode a single record and add it to its call site in the report
+void uvm_push_decode_report_add(uvm_push_decode_report_t *report, const uvm_push_capture_record_t *record);
+
+// Decode all the records of a capture into the report. Returns NV_FALSE if the
+// capture ends with a malformed record.
+NvBool uvm_push_decode_report_capture(uvm_push_decode_report_t *report, const void *capture, NvU64 capture_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __UVM8_PUSH_DECODE_H__
@@ -24,11 +24,13 @@
 
 #include <asm/atomic.h>
 
+#include "uvm8_api.h"
 #include "uvm8_global.h"
 #include "uvm8_channel.h"
 #include "uvm8_hal.h"
 #include "uvm8_mem.h"
 #include "uvm8_push.h"
+#include "uvm8_push_decode.h"
 #include "uvm8_test.h"
 #include "uvm8_test_rng.h"
 #include "uvm8_thread_context.h"
@@ -172,8 +174,8 @@ static NV_STATUS test_push_inline_data(uvm_va_space_t *va_space)
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-// Test that begins UVM_PUSH_MAX_CONCURRENT_PUSHES number of pushes before
-// ending any of them on each GPU.
+// Test that begins the max number of concurrent pushes supported by the
+// pushbuffer before ending any of them on each GPU.
 // Notably starting more than a single push is not safe to do outside of a test
 // as if multiple threads tried doing so, it could easily deadlock.
 static NV_STATUS test_concurrent_pushes(uvm_va_space_t *va_space)
@@ -195,12 +197,16 @@ static NV_STATUS test_concurrent_pushes(uvm_va_space_t *va_space)
     }
 
     for_each_va_space_gpu(gpu, va_space) {
-        for (i = 0; i < UVM_PUSH_MAX_CONCURRENT_PUSHES; ++i) {
+        NvU32 max_pushes = uvm_pushbuffer_max_concurrent_pushes(gpu->channel_manager->pushbuffer);
+
+        UVM_ASSERT(max_pushes <= UVM_PUSH_MAX_CONCURRENT_PUSHES);
+
+        for (i = 0; i < max_pushes; ++i) {
             uvm_push_t *push = &pushes[i];
             status = uvm_push_begin(gpu->channel_manager, UVM_CHANNEL_TYPE_CPU_TO_GPU, push, "concurrent push %u", i);
             TEST_CHECK_GOTO(status == NV_OK, done);
         }
-        for (i = 0; i < UVM_PUSH_MAX_CONCURRENT_PUSHES; ++i) {
+        for (i = 0; i < max_pushes; ++i) {
             uvm_push_t *push = &pushes[i];
             uvm_push_end(push);
             status = uvm_tracker_add_push(&tracker, push);
@@ -363,7 +369,7 @@ static NV_STATUS test_push_interleaving(uvm_va_space_t *va_space)
     NV_STATUS status;
     uvm_gpu_t *gpu;
 
-    BUILD_BUG_ON(TEST_PUSH_INTERLEAVING_NUM_PAUSED_PUSHES >= UVM_PUSH_MAX_CONCURRENT_PUSHES);
+    BUILD_BUG_ON(TEST_PUSH_INTERLEAVING_NUM_PAUSED_PUSHES >= UVM_PUSHBUFFER_CHUNKS_MIN);
 
     // GK110+ is required for the CE semaphore reduction method used in the test.
     for_each_va_space_gpu(gpu, va_space) {
@@ -410,7 +416,7 @@ static NvU32 test_count_idle_chunks(uvm_pushbuffer_t *pushbuffer)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NvU32 i;
     NvU32 count = 0;
-    for (i = 0; i < UVM_PUSHBUFFER_CHUNKS; ++i)
+    for (i = 0; i < pushbuffer->num_chunks; ++i)
         count += test_bit(i, pushbuffer->idle_chunks) ? 1 : 0;
     return count;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -419,13 +425,13 @@ static NvU32 test_count_available_chunks(uvm_pushbuffer_t *pushbuffer)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NvU32 i;
     NvU32 count = 0;
-    for (i = 0; i < UVM_PUSHBUFFER_CHUNKS; ++i)
+    for (i = 0; i < pushbuffer->num_chunks; ++i)
         count += test_bit(i, pushbuffer->available_chunks) ? 1 : 0;
     return count;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 // Reuse the whole pushbuffer 4 times, one UVM_MAX_PUSH_SIZE at a time
-#define EXTRA_MAX_PUSHES_WHILE_FULL (4 * UVM_PUSHBUFFER_SIZE / UVM_MAX_PUSH_SIZE)
+#define EXTRA_MAX_PUSHES_WHILE_FULL(pushbuffer) (4 * uvm_pushbuffer_get_size(pushbuffer) / UVM_MAX_PUSH_SIZE)
 
 // Test doing pushes of exactly UVM_MAX_PUSH_SIZE size and only allowing them to
 // complete one by one.
@@ -433,6 +439,7 @@ static NV_STATUS test_max_pushes_on_gpu(uvm_gpu_t *gpu)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NV_STATUS status;
 
+    uvm_pushbuffer_t *pushbuffer = gpu->channel_manager->pushbuffer;
     uvm_tracker_t tracker;
     uvm_gpu_semaphore_t sema;
     NvU32 total_push_size = 0;
@@ -463,7 +470,7 @@ static NV_STATUS test_max_pushes_on_gpu(uvm_gpu_t *gpu)
         uvm_tracker_add_push(&tracker, &push);
     }
 
-    if (total_push_size != UVM_PUSHBUFFER_SIZE) {
+    if (total_push_size != uvm_pushbuffer_get_size(pushbuffer)) {
         UVM_TEST_PRINT("Unexpected space in the pushbuffer, total push %u\n", total_push_size);
         uvm_pushbuffer_print(gpu->channel_manager->pushbuffer);
         status = NV_ERR_INVALID_STATE;
@@ -473,7 +480,7 @@ static NV_STATUS test_max_pushes_on_gpu(uvm_gpu_t *gpu)
     TEST_CHECK_GOTO(test_count_available_chunks(gpu->channel_manager->pushbuffer) == 0, done);
     TEST_CHECK_GOTO(test_count_idle_chunks(gpu->channel_manager->pushbuffer) == 0, done);
 
-    for (i = 0; i < EXTRA_MAX_PUSHES_WHILE_FULL; ++i) {
+    for (i = 0; i < EXTRA_MAX_PUSHES_WHILE_FULL(pushbuffer); ++i) {
         uvm_push_t push;
 
         // There should be no space for another push until the sema is
@@ -508,12 +515,13 @@ done:
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 
-// Test doing UVM_PUSHBUFFER_CHUNKS independent pushes expecting each one to use
+// Test doing as many independent pushes as there are pushbuffer chunks expecting each one to use
 // a different chunk in the pushbuffer.
 static NV_STATUS test_idle_chunks_on_gpu(uvm_gpu_t *gpu)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NV_STATUS status;
 
+    uvm_pushbuffer_t *pushbuffer = gpu->channel_manager->pushbuffer;
     uvm_gpu_semaphore_t sema;
     uvm_tracker_t tracker = UVM_TRACKER_INIT();
     NvU32 i;
@@ -530,7 +538,7 @@ static NV_STATUS test_idle_chunks_on_gpu(uvm_gpu_t *gpu)
     status = uvm_channel_manager_wait(gpu->channel_manager);
     TEST_CHECK_GOTO(status == NV_OK, done);
 
-    for (i = 0; i < UVM_PUSHBUFFER_CHUNKS; ++i) {
+    for (i = 0; i < pushbuffer->num_chunks; ++i) {
         uvm_push_t push;
         status = uvm_push_begin(gpu->channel_manager, UVM_CHANNEL_TYPE_ANY, &push, "Push using chunk %u", i);
         TEST_CHECK_GOTO(status == NV_OK, done);
@@ -540,20 +548,20 @@ static NV_STATUS test_idle_chunks_on_gpu(uvm_gpu_t *gpu)
 
         uvm_tracker_add_push(&tracker, &push);
 
-        if (test_count_idle_chunks(gpu->channel_manager->pushbuffer) != UVM_PUSHBUFFER_CHUNKS - i - 1) {
+        if (test_count_idle_chunks(pushbuffer) != pushbuffer->num_chunks - i - 1) {
             UVM_TEST_PRINT("Unexpected count of idle chunks in the pushbuffer %u instead of %u\n",
-                    test_count_idle_chunks(gpu->channel_manager->pushbuffer), UVM_PUSHBUFFER_CHUNKS - i - 1);
+                    test_count_idle_chunks(pushbuffer), pushbuffer->num_chunks - i - 1);
             uvm_pushbuffer_print(gpu->channel_manager->pushbuffer);
             status = NV_ERR_INVALID_STATE;
             goto done;
         }
     }
-    uvm_gpu_semaphore_set_payload(&sema, UVM_PUSHBUFFER_CHUNKS + 1);
+    uvm_gpu_semaphore_set_payload(&sema, pushbuffer->num_chunks + 1);
 
     status = uvm_channel_manager_wait(gpu->channel_manager);
     TEST_CHECK_GOTO(status == NV_OK, done);
 
-    if (test_count_idle_chunks(gpu->channel_manager->pushbuffer) != UVM_PUSHBUFFER_CHUNKS) {
+    if (test_count_idle_chunks(pushbuffer) != pushbuffer->num_chunks) {
         UVM_TEST_PRINT("Unexpected count of idle chunks in the pushbuffer %u\n", test_count_idle_chunks(gpu->channel_manager->pushbuffer));
         uvm_pushbuffer_print(gpu->channel_manager->pushbuffer);
         status = NV_ERR_INVALID_STATE;
@@ -561,7 +569,7 @@ static NV_STATUS test_idle_chunks_on_gpu(uvm_gpu_t *gpu)
     }
 
 done:
-    uvm_gpu_semaphore_set_payload(&sema, UVM_PUSHBUFFER_CHUNKS + 1);
+    uvm_gpu_semaphore_set_payload(&sema, pushbuffer->num_chunks + 1);
     uvm_tracker_wait(&tracker);
 
     uvm_gpu_semaphore_free(&sema);
@@ -570,6 +578,139 @@ done:
     return status;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+#define TEST_CONTENTION_MAX_CHANNELS 32
+#define TEST_CONTENTION_PUSHES_PER_CHANNEL 256
+#define TEST_CONTENTION_TIMEOUT_NS (10 * 1000 * 1000 * 1000ULL)
+
+typedef struct
+{
+    uvm_channel_t *channel;
+
+    // Pushes done by the worker, and the longest time it took to begin one
+    NvU32 num_pushes;
+    NvU64 max_begin_ns;
+
+    NV_STATUS status;
+
+    nv_kthread_q_t q;
+    nv_kthread_q_item_t q_item;
+} test_contention_worker_t;
+
+// Do back-to-back pushes of UVM_MAX_PUSH_SIZE on the worker's channel, so that
+// the pushes of all the workers keep competing for the same chunks.
+static void test_contention_worker(test_contention_worker_t *worker)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_gpu_t *gpu = uvm_channel_get_gpu(worker->channel);
+    uvm_tracker_t tracker = UVM_TRACKER_INIT();
+    NvU64 start = NV_GETTIME();
+    NV_STATUS status = NV_OK;
+
+    while (worker->num_pushes < TEST_CONTENTION_PUSHES_PER_CHANNEL) {
+        uvm_push_t push;
+        NvU64 begin_start = NV_GETTIME();
+        NvU64 begin_ns;
+
+        status = uvm_push_begin_on_channel(worker->channel, &push, "Contention push %u", worker->num_pushes);
+        if (status != NV_OK)
+            break;
+
+        begin_ns = NV_GETTIME() - begin_start;
+        worker->max_begin_ns = max(worker->max_begin_ns, begin_ns);
+
+        gpu->host_hal->noop(&push, UVM_MAX_PUSH_SIZE - uvm_push_get_size(&push) - UVM_PUSH_END_SIZE);
+        uvm_push_end(&push);
+
+        // Pushes on a channel complete in order, so tracking the last one is
+        // enough
+        uvm_tracker_overwrite_with_push(&tracker, &push);
+        ++worker->num_pushes;
+
+        if (NV_GETTIME() - start > TEST_CONTENTION_TIMEOUT_NS) {
+            status = NV_ERR_TIMEOUT;
+            break;
+        }
+    }
+
+    if (status == NV_OK)
+        status = uvm_tracker_wait_deinit(&tracker);
+    else
+        uvm_tracker_wait_deinit(&tracker);
+
+    worker->status = status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void test_contention_worker_entry(void *args)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ENTRY_VOID(test_contention_worker((test_contention_worker_t *)args));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Have pushes on many channels contend for the pushbuffer chunks at the same
+// time, and check that every channel gets all its pushes done in time. A push
+// losing the race for chunks to the other channels on every attempt would
+// never complete without the starvation tickets.
+static NV_STATUS test_contention_on_gpu(uvm_gpu_t *gpu)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    uvm_channel_manager_t *manager = gpu->channel_manager;
+    test_contention_worker_t *workers;
+    NvU32 num_workers = min(manager->num_channels, (unsigned)TEST_CONTENTION_MAX_CHANNELS);
+    NvU32 num_started = 0;
+    NvU32 i;
+
+    workers = uvm_kvmalloc_zero(num_workers * sizeof(*workers));
+    if (!workers)
+        return NV_ERR_NO_MEMORY;
+
+    for (i = 0; i < num_workers; ++i) {
+        test_contention_worker_t *worker = &workers[i];
+
+        worker->channel = manager->channels + i;
+
+        status = errno_to_nv_status(nv_kthread_q_init(&worker->q, "UVM pushbuffer contention"));
+        if (status != NV_OK)
+            break;
+
+        nv_kthread_q_item_init(&worker->q_item, test_contention_worker_entry, worker);
+        ++num_started;
+    }
+
+    for (i = 0; i < num_started; ++i)
+        nv_kthread_q_schedule_q_item(&workers[i].q, &workers[i].q_item);
+
+    // The workers give up on their own after TEST_CONTENTION_TIMEOUT_NS, so
+    // this can't wait forever
+    for (i = 0; i < num_started; ++i)
+        nv_kthread_q_stop(&workers[i].q);
+
+    if (status != NV_OK)
+        goto done;
+
+    for (i = 0; i < num_workers; ++i) {
+        test_contention_worker_t *worker = &workers[i];
+
+        if (worker->status != NV_OK || worker->num_pushes != TEST_CONTENTION_PUSHES_PER_CHANNEL) {
+            UVM_TEST_PRINT("Channel %s did %u pushes out of %u, longest push begin %llu ns: %s\n",
+                           worker->channel->name,
+                           worker->num_pushes,
+                           TEST_CONTENTION_PUSHES_PER_CHANNEL,
+                           worker->max_begin_ns,
+                           nvstatusToString(worker->status));
+            uvm_pushbuffer_print(manager->pushbuffer);
+            status = worker->status != NV_OK ? worker->status : NV_ERR_INVALID_STATE;
+            goto done;
+        }
+    }
+
+    // All the tickets were retired
+    TEST_CHECK_GOTO(atomic_read(&manager->pushbuffer->starving_next) ==
+                    atomic_read(&manager->pushbuffer->starving_serving), done);
+
+done:
+    uvm_kvfree(workers);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 static NV_STATUS test_pushbuffer(uvm_va_space_t *va_space)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     uvm_gpu_t *gpu;
@@ -577,6 +718,7 @@ static NV_STATUS test_pushbuffer(uvm_va_space_t *va_space)
     for_each_va_space_gpu(gpu, va_space) {
         TEST_CHECK_RET(test_max_pushes_on_gpu(gpu) == NV_OK);
         TEST_CHECK_RET(test_idle_chunks_on_gpu(gpu) == NV_OK);
+        TEST_CHECK_RET(test_contention_on_gpu(gpu) == NV_OK);
     }
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -793,6 +935,128 @@ static NV_STATUS test_push_gpu_to_gpu(uvm_va_space_t *va_space)
     return status;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Append a capture record of the methods in the fake push to the capture
+static NvU64 test_capture_push(char *capture, NvU64 offset, uvm_push_t *push, const char *filename, NvU32 line)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_push_capture_record_t *record = (uvm_push_capture_record_t *)(capture + offset);
+    NvU32 push_size = uvm_push_get_size(push);
+
+    memset(record, 0, sizeof(*record));
+    record->record_size = UVM_ALIGN_UP(sizeof(*record) + push_size, UVM_PUSH_CAPTURE_RECORD_ALIGNMENT);
+    record->push_size = push_size;
+    record->host_class = uvm_push_get_gpu(push)->rm_info.hostClass;
+    record->channel_type = UVM_CHANNEL_TYPE_ANY;
+    record->line = line;
+    snprintf(record->filename, sizeof(record->filename), "%s", filename);
+    snprintf(record->function, sizeof(record->function), "%s", __FUNCTION__);
+    memcpy(record + 1, push->begin, push_size);
+
+    return offset + record->record_size;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Push a known sequence of methods with the HALs of the GPU and check that the
+// decoder accounts for every one of them, both on its own and in a report of a
+// capture.
+static NV_STATUS test_push_decode_on_gpu(uvm_gpu_t *gpu)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+    uvm_push_t push;
+    uvm_gpu_semaphore_t sema;
+    uvm_gpu_address_t inline_address;
+    uvm_push_decode_stats_t stats;
+    uvm_push_decode_report_t report;
+    uvm_push_decode_site_t sites[2];
+    const size_t capture_size = 4 * UVM_ALIGN_UP(sizeof(uvm_push_capture_record_t) + UVM_PAGE_SIZE_4K, 8);
+    char *capture = NULL;
+    NvU64 capture_used = 0;
+    NvU32 *bad_method;
+    bool push_begun = false;
+
+    status = uvm_gpu_semaphore_alloc(gpu->semaphore_pool, &sema);
+    if (status != NV_OK)
+        return status;
+
+    status = uvm_push_begin_fake(gpu, &push);
+    TEST_CHECK_GOTO(status == NV_OK, done);
+    push_begun = true;
+
+    gpu->host_hal->semaphore_acquire(&push, &sema, 1);
+    gpu->host_hal->membar_sys(&push);
+    gpu->host_hal->tlb_invalidate_all(&push, uvm_gpu_phys_address(UVM_APERTURE_VID, 0), 0, UVM_MEMBAR_NONE);
+    uvm_push_get_single_inline_buffer(&push, 64, &inline_address);
+    gpu->ce_hal->memcopy(&push, uvm_gpu_address_virtual(0), inline_address, 64);
+    gpu->ce_hal->semaphore_release(&push, &sema, 2);
+
+    memset(&stats, 0, sizeof(stats));
+    TEST_CHECK_GOTO(uvm_push_decode(push.begin, uvm_push_get_size(&push), gpu->rm_info.hostClass, &stats), done);
+
+    TEST_CHECK_GOTO(stats.size == uvm_push_get_size(&push), done);
+    TEST_CHECK_GOTO(stats.undecoded_bytes == 0, done);
+    TEST_CHECK_GOTO(stats.methods == stats.engine_methods[UVM_PUSH_DECODE_ENGINE_HOST] +
+                                     stats.engine_methods[UVM_PUSH_DECODE_ENGINE_CE] +
+                                     stats.engine_methods[UVM_PUSH_DECODE_ENGINE_OTHER], done);
+    TEST_CHECK_GOTO(stats.inline_data_bytes == 64, done);
+    TEST_CHECK_GOTO(stats.semaphore_ops == 2, done);
+    TEST_CHECK_GOTO(stats.tlb_invalidates == 1, done);
+    TEST_CHECK_GOTO(stats.ce_transfers == 1, done);
+    TEST_CHECK_GOTO(stats.ce_launches == 2, done);
+
+    // The explicit host membar, the host membar the CE HAL adds after the
+    // memcopy and the flush of the CE semaphore release
+    TEST_CHECK_GOTO(stats.membars == 3, done);
+
+    capture = uvm_kvmalloc(capture_size);
+    if (!capture) {
+        status = NV_ERR_NO_MEMORY;
+        goto done;
+    }
+
+    // Two pushes from one call site, one from another and a malformed one
+    TEST_CHECK_GOTO(uvm_push_get_size(&push) <= UVM_PAGE_SIZE_4K, done);
+    capture_used = test_capture_push(capture, capture_used, &push, "a.c", 1);
+    capture_used = test_capture_push(capture, capture_used, &push, "a.c", 1);
+    capture_used = test_capture_push(capture, capture_used, &push, "b.c", 1);
+
+    bad_method = (NvU32 *)push.next;
+    gpu->host_hal->noop(&push, 4);
+    *bad_method = 0;
+    capture_used = test_capture_push(capture, capture_used, &push, "c.c", 1);
+
+    uvm_push_decode_report_init(&report, sites, ARRAY_SIZE(sites));
+    TEST_CHECK_GOTO(uvm_push_decode_report_capture(&report, capture, capture_used), done);
+
+    TEST_CHECK_GOTO(report.records == 3, done);
+    TEST_CHECK_GOTO(report.skipped_records == 1, done);
+    TEST_CHECK_GOTO(report.num_sites == 2, done);
+    TEST_CHECK_GOTO(sites[0].pushes == 2, done);
+    TEST_CHECK_GOTO(sites[1].pushes == 1, done);
+    TEST_CHECK_GOTO(strcmp(sites[1].filename, "b.c") == 0, done);
+    TEST_CHECK_GOTO(sites[0].stats.tlb_invalidates == 2 * stats.tlb_invalidates, done);
+    TEST_CHECK_GOTO(report.total.methods == 3 * stats.methods, done);
+    TEST_CHECK_GOTO(report.total.size == 3 * stats.size, done);
+
+    // A truncated capture ends with a malformed record
+    TEST_CHECK_GOTO(!uvm_push_decode_report_capture(&report, capture, capture_used - 4), done);
+
+done:
+    uvm_kvfree(capture);
+    if (push_begun)
+        uvm_push_end_fake(&push);
+    uvm_gpu_semaphore_free(&sema);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS test_push_decode(uvm_va_space_t *va_space)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_gpu_t *gpu;
+
+    for_each_va_space_gpu(gpu, va_space)
+        TEST_CHECK_RET(test_push_decode_on_gpu(gpu) == NV_OK);
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 NV_STATUS uvm8_test_push_sanity(UVM_TEST_PUSH_SANITY_PARAMS *params, struct file *filp)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NV_STATUS status;
@@ -831,6 +1095,10 @@ NV_STATUS uvm8_test_push_sanity(UVM_TEST_PUSH_SANITY_PARAMS *params, struct file
     if (status != NV_OK)
         goto done;
 
+    status = test_push_decode(va_space);
+    if (status != NV_OK)
+        goto done;
+
 done:
     uvm_va_space_up_read_rm(va_space);
     uvm_mutex_unlock(&g_uvm_global.global_lock);
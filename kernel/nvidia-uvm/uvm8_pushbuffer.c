@@ -87,12 +87,20 @@ NV_STATUS uvm_pushbuffer_create_common(uvm_channel_manager_t *channel_manager, b
         return NV_ERR_NO_MEMORY;
 
     pushbuffer->channel_manager = channel_manager;
+    pushbuffer->num_chunks = channel_manager->conf.num_pushbuffer_chunks;
+    pushbuffer->chunk_size = channel_manager->conf.pushbuffer_chunk_size;
 
-    uvm_spin_lock_init(&pushbuffer->lock, UVM_LOCK_ORDER_LEAF);
+    UVM_ASSERT(pushbuffer->num_chunks >= UVM_PUSHBUFFER_CHUNKS_MIN);
+    UVM_ASSERT(pushbuffer->num_chunks <= UVM_PUSHBUFFER_CHUNKS_MAX);
+    UVM_ASSERT(pushbuffer->chunk_size >= UVM_PUSHBUFFER_CHUNK_SIZE_MIN);
+    UVM_ASSERT(pushbuffer->chunk_size <= UVM_PUSHBUFFER_CHUNK_SIZE_MAX);
+    UVM_ASSERT(pushbuffer->chunk_size % UVM_MAX_PUSH_SIZE == 0);
 
-    // Currently the pushbuffer supports UVM_PUSHBUFFER_CHUNKS of concurrent
-    // pushes.
-    uvm_sema_init(&pushbuffer->concurrent_pushes_sema, UVM_PUSHBUFFER_CHUNKS, UVM_LOCK_ORDER_PUSH);
+    // Currently the pushbuffer supports as many concurrent pushes as it has
+    // chunks.
+    uvm_sema_init(&pushbuffer->concurrent_pushes_sema,
+                  uvm_pushbuffer_max_concurrent_pushes(pushbuffer),
+                  UVM_LOCK_ORDER_PUSH);
 
     UVM_ASSERT(channel_manager->conf.pushbuffer_loc == UVM_BUFFER_LOCATION_SYS ||
                channel_manager->conf.pushbuffer_loc == UVM_BUFFER_LOCATION_VID);
@@ -101,16 +109,20 @@ NV_STATUS uvm_pushbuffer_create_common(uvm_channel_manager_t *channel_manager, b
                                           (channel_manager->conf.pushbuffer_loc == UVM_BUFFER_LOCATION_SYS)?
                                               UVM_RM_MEM_TYPE_SYS:
                                               UVM_RM_MEM_TYPE_GPU,
-                                          UVM_PUSHBUFFER_SIZE,
+                                          uvm_pushbuffer_get_size(pushbuffer),
                                           &pushbuffer->memory);
     if (status != NV_OK)
         goto error;
 
-    bitmap_fill(pushbuffer->idle_chunks, UVM_PUSHBUFFER_CHUNKS);
-    bitmap_fill(pushbuffer->available_chunks, UVM_PUSHBUFFER_CHUNKS);
+    bitmap_fill(pushbuffer->idle_chunks, pushbuffer->num_chunks);
+    bitmap_fill(pushbuffer->available_chunks, pushbuffer->num_chunks);
 
-    for (i = 0; i < UVM_PUSHBUFFER_CHUNKS; ++i)
-        INIT_LIST_HEAD(&pushbuffer->chunks[i].pending_gpfifos);
+    for (i = 0; i < pushbuffer->num_chunks; ++i) {
+        uvm_pushbuffer_chunk_t *chunk = &pushbuffer->chunks[i];
+
+        INIT_LIST_HEAD(&chunk->pending_gpfifos);
+        uvm_spin_lock_init(&chunk->lock, UVM_LOCK_ORDER_LEAF);
+    }
 
     if (with_procfs) {
         status = create_procfs(pushbuffer);
@@ -127,91 +139,176 @@ error:
     return status;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-static uvm_pushbuffer_chunk_t *get_chunk_in_mask(uvm_pushbuffer_t *pushbuffer, unsigned long *mask)
-{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    NvU32 index = find_first_bit(mask, UVM_PUSHBUFFER_CHUNKS);
-
-    uvm_assert_spinlock_locked(&pushbuffer->lock);
-
-    if (index == UVM_PUSHBUFFER_CHUNKS)
-        return NULL;
-
-    return &pushbuffer->chunks[index];
-pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
-
-static uvm_pushbuffer_chunk_t *get_available_chunk(uvm_pushbuffer_t *pushbuffer)
-{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    return get_chunk_in_mask(pushbuffer, pushbuffer->available_chunks);
-pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
-
-static uvm_pushbuffer_chunk_t *get_idle_chunk(uvm_pushbuffer_t *pushbuffer)
-{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    return get_chunk_in_mask(pushbuffer, pushbuffer->idle_chunks);
-pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
-
 static NvU32 chunk_get_index(uvm_pushbuffer_t *pushbuffer, uvm_pushbuffer_chunk_t *chunk)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NvU32 index = chunk - pushbuffer->chunks;
-    UVM_ASSERT(index < UVM_PUSHBUFFER_CHUNKS);
+    UVM_ASSERT(index < pushbuffer->num_chunks);
     return index;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 static NvU32 chunk_get_offset(uvm_pushbuffer_t *pushbuffer, uvm_pushbuffer_chunk_t *chunk)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    return chunk_get_index(pushbuffer, chunk) * UVM_PUSHBUFFER_CHUNK_SIZE;
+    return chunk_get_index(pushbuffer, chunk) * pushbuffer->chunk_size;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// The chunk bitmaps are read locklessly when picking a chunk, but they are
+// only modified with the lock of the corresponding chunk held. Hence atomic
+// bit operations are required as different bits in the same word can be
+// modified concurrently under different chunk locks.
 static void set_chunk(uvm_pushbuffer_t *pushbuffer, uvm_pushbuffer_chunk_t *chunk, unsigned long *mask)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NvU32 index = chunk_get_index(pushbuffer, chunk);
 
-    uvm_assert_spinlock_locked(&pushbuffer->lock);
+    uvm_assert_spinlock_locked(&chunk->lock);
 
-    __set_bit(index, mask);
+    set_bit(index, mask);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 static void clear_chunk(uvm_pushbuffer_t *pushbuffer, uvm_pushbuffer_chunk_t *chunk, unsigned long *mask)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NvU32 index = chunk_get_index(pushbuffer, chunk);
 
-    uvm_assert_spinlock_locked(&pushbuffer->lock);
+    uvm_assert_spinlock_locked(&chunk->lock);
 
-    __clear_bit(index, mask);
+    clear_bit(index, mask);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-static uvm_pushbuffer_chunk_t *pick_chunk(uvm_pushbuffer_t *pushbuffer)
+// Index of the chunk where the search for an idle chunk starts for pushes on
+// the given channel. Spreading the starting points keeps pushes on different
+// channels from contending on the same chunk locks.
+static NvU32 channel_get_first_chunk_index(uvm_pushbuffer_t *pushbuffer, uvm_channel_t *channel)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    uvm_pushbuffer_chunk_t *chunk = get_idle_chunk(pushbuffer);
-
-    uvm_assert_spinlock_locked(&pushbuffer->lock);
+    NvU32 channel_index = channel - pushbuffer->channel_manager->channels;
 
-    if (chunk == NULL)
-        chunk = get_available_chunk(pushbuffer);
+    UVM_ASSERT(channel_index < pushbuffer->channel_manager->num_channels);
 
-    return chunk;
+    return channel_index % pushbuffer->num_chunks;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-static bool try_claim_chunk(uvm_pushbuffer_t *pushbuffer, uvm_push_t *push, uvm_pushbuffer_chunk_t **chunk_out)
+typedef enum
+{
+    // Only chunks without pending pushes
+    CHUNK_PICK_IDLE,
+
+    // Available chunks with pending pushes from the same channel only
+    CHUNK_PICK_AFFINE,
+
+    // Any available chunk
+    CHUNK_PICK_ANY,
+} chunk_pick_t;
+
+// Try claiming the chunk for the push. The bitmap bit that made the chunk a
+// candidate is checked again with the chunk lock held, as it could have
+// changed since the lockless scan.
+static bool try_claim_single_chunk(uvm_pushbuffer_t *pushbuffer,
+                                   uvm_pushbuffer_chunk_t *chunk,
+                                   uvm_push_t *push,
+                                   chunk_pick_t pick)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    uvm_pushbuffer_chunk_t *chunk;
+    NvU32 index = chunk_get_index(pushbuffer, chunk);
+    bool claimed = false;
 
-    uvm_spin_lock(&pushbuffer->lock);
+    uvm_spin_lock(&chunk->lock);
 
-    chunk = pick_chunk(pushbuffer);
-    if (!chunk)
-        goto done;
+    if (pick == CHUNK_PICK_IDLE) {
+        if (!test_bit(index, pushbuffer->idle_chunks))
+            goto done;
+    }
+    else {
+        if (!test_bit(index, pushbuffer->available_chunks))
+            goto done;
+
+        if (pick == CHUNK_PICK_AFFINE && chunk->affine_channel != push->channel)
+            goto done;
+    }
+
+    UVM_ASSERT(chunk->current_push == NULL);
+
+    if (chunk->affine_channel != push->channel) {
+        if (chunk->affine_channel != NULL)
+            atomic64_inc(&pushbuffer->stats.affinity_overrides);
+        chunk->affine_channel = push->channel;
+    }
 
     chunk->current_push = push;
     clear_chunk(pushbuffer, chunk, pushbuffer->idle_chunks);
     clear_chunk(pushbuffer, chunk, pushbuffer->available_chunks);
+    claimed = true;
 
 done:
-    uvm_spin_unlock(&pushbuffer->lock);
+    uvm_spin_unlock(&chunk->lock);
+
+    return claimed;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static uvm_pushbuffer_chunk_t *try_claim_chunk_in_mask(uvm_pushbuffer_t *pushbuffer,
+                                                       uvm_push_t *push,
+                                                       unsigned long *mask,
+                                                       chunk_pick_t pick)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 first = channel_get_first_chunk_index(pushbuffer, push->channel);
+    NvU32 i;
+
+    for (i = 0; i < pushbuffer->num_chunks; ++i) {
+        NvU32 index = (first + i) % pushbuffer->num_chunks;
+        uvm_pushbuffer_chunk_t *chunk = &pushbuffer->chunks[index];
+
+        if (!test_bit(index, mask))
+            continue;
+
+        if (pick == CHUNK_PICK_AFFINE && READ_ONCE(chunk->affine_channel) != push->channel)
+            continue;
+
+        if (try_claim_single_chunk(pushbuffer, chunk, push, pick))
+            return chunk;
+    }
+
+    return NULL;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Idle chunks are always preferred. Out of the available chunks, the ones
+// affine to the channel of the push are preferred over the rest. Pushes without
+// priority can't claim any chunk while a starving push is waiting for one.
+static bool try_claim_chunk(uvm_pushbuffer_t *pushbuffer,
+                            uvm_push_t *push,
+                            bool priority,
+                            uvm_pushbuffer_chunk_t **chunk_out)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_pushbuffer_chunk_t *chunk;
+
+    *chunk_out = NULL;
+
+    if (!priority &&
+        atomic_read(&pushbuffer->starving_next) != atomic_read(&pushbuffer->starving_serving))
+        return false;
+
+    chunk = try_claim_chunk_in_mask(pushbuffer, push, pushbuffer->idle_chunks, CHUNK_PICK_IDLE);
+    if (!chunk)
+        chunk = try_claim_chunk_in_mask(pushbuffer, push, pushbuffer->available_chunks, CHUNK_PICK_AFFINE);
+    if (!chunk)
+        chunk = try_claim_chunk_in_mask(pushbuffer, push, pushbuffer->available_chunks, CHUNK_PICK_ANY);
+
     *chunk_out = chunk;
 
     return chunk != NULL;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+static void record_stall(uvm_pushbuffer_t *pushbuffer, NvU64 stall_ns)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU64 max_stall_ns = atomic64_read(&pushbuffer->stats.max_stall_ns);
+
+    atomic64_inc(&pushbuffer->stats.stalls);
+    atomic64_add(stall_ns, &pushbuffer->stats.stall_ns);
+
+    while (stall_ns > max_stall_ns) {
+        NvU64 old = atomic64_cmpxchg(&pushbuffer->stats.max_stall_ns, max_stall_ns, stall_ns);
+        if (old == max_stall_ns)
+            break;
+
+        max_stall_ns = old;
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 static NvU32 *chunk_get_next_push_start_addr(uvm_pushbuffer_t *pushbuffer, uvm_pushbuffer_chunk_t *chunk)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     char *push_start = (char *)uvm_rm_mem_get_cpu_va(pushbuffer->memory);
@@ -228,19 +325,47 @@ static NV_STATUS claim_chunk(uvm_pushbuffer_t *pushbuffer, uvm_push_t *push, uvm
     NV_STATUS status = NV_OK;
     uvm_channel_manager_t *channel_manager = pushbuffer->channel_manager;
     uvm_spin_loop_t spin;
+    NvU64 stall_start;
+    NvU32 retries = 0;
+    bool starving = false;
+    int ticket = 0;
 
-    if (try_claim_chunk(pushbuffer, push, chunk_out))
+    if (try_claim_chunk(pushbuffer, push, false, chunk_out))
         return NV_OK;
 
+    stall_start = NV_GETTIME();
+
     uvm_channel_manager_update_progress(channel_manager);
 
     uvm_spin_loop_init(&spin);
-    while (!try_claim_chunk(pushbuffer, push, chunk_out) && status == NV_OK) {
+    while (status == NV_OK) {
+        bool priority = starving && atomic_read(&pushbuffer->starving_serving) == ticket;
+
+        if (try_claim_chunk(pushbuffer, push, priority, chunk_out))
+            break;
+
+        if (!starving && ++retries == UVM_PUSHBUFFER_STARVATION_RETRIES) {
+            ticket = atomic_inc_return(&pushbuffer->starving_next) - 1;
+            starving = true;
+            atomic64_inc(&pushbuffer->stats.starvations);
+        }
+
         UVM_SPIN_LOOP(&spin);
         status = uvm_channel_manager_check_errors(channel_manager);
         uvm_channel_manager_update_progress(channel_manager);
     }
 
+    if (starving) {
+        // Tickets have to be retired in order. On error, the pushes holding
+        // the earlier tickets hit the same error and retire theirs shortly.
+        while (atomic_read(&pushbuffer->starving_serving) != ticket)
+            UVM_SPIN_LOOP(&spin);
+
+        atomic_inc(&pushbuffer->starving_serving);
+    }
+
+    record_stall(pushbuffer, NV_GETTIME() - stall_start);
+
     return status;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
@@ -251,6 +376,7 @@ NV_STATUS uvm_pushbuffer_begin_push(uvm_pushbuffer_t *pushbuffer, uvm_push_t *pu
 
     UVM_ASSERT(pushbuffer);
     UVM_ASSERT(push);
+    UVM_ASSERT(push->channel);
 
     // Note that this semaphore is uvm_up()ed in end_push().
     uvm_down(&pushbuffer->concurrent_pushes_sema);
@@ -279,12 +405,12 @@ static uvm_gpfifo_entry_t *chunk_get_last_gpfifo(uvm_pushbuffer_chunk_t *chunk)
     return list_last_entry_or_null(&chunk->pending_gpfifos, uvm_gpfifo_entry_t, pending_list_node);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-// Get the cpu put within the chunk (in range [0, UVM_PUSHBUFFER_CHUNK_SIZE])
+// Get the cpu put within the chunk (in range [0, pushbuffer->chunk_size])
 static NvU32 chunk_get_cpu_put(uvm_pushbuffer_t *pushbuffer, uvm_pushbuffer_chunk_t *chunk)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     uvm_gpfifo_entry_t *gpfifo = chunk_get_last_gpfifo(chunk);
 
-    uvm_assert_spinlock_locked(&pushbuffer->lock);
+    uvm_assert_spinlock_locked(&chunk->lock);
 
     if (gpfifo != NULL)
         return gpfifo->pushbuffer_offset + gpfifo->pushbuffer_size - chunk_get_offset(pushbuffer, chunk);
@@ -292,12 +418,12 @@ static NvU32 chunk_get_cpu_put(uvm_pushbuffer_t *pushbuffer, uvm_pushbuffer_chun
         return 0;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-// Get the gpu get within the chunk (in range [0, UVM_PUSHBUFFER_CHUNK_SIZE))
+// Get the gpu get within the chunk (in range [0, pushbuffer->chunk_size))
 static NvU32 chunk_get_gpu_get(uvm_pushbuffer_t *pushbuffer, uvm_pushbuffer_chunk_t *chunk)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     uvm_gpfifo_entry_t *gpfifo = chunk_get_first_gpfifo(chunk);
 
-    uvm_assert_spinlock_locked(&pushbuffer->lock);
+    uvm_assert_spinlock_locked(&chunk->lock);
 
     if (gpfifo != NULL)
         return gpfifo->pushbuffer_offset - chunk_get_offset(pushbuffer, chunk);
@@ -310,7 +436,7 @@ static void update_chunk(uvm_pushbuffer_t *pushbuffer, uvm_pushbuffer_chunk_t *c
     NvU32 gpu_get = chunk_get_gpu_get(pushbuffer, chunk);
     NvU32 cpu_put = chunk_get_cpu_put(pushbuffer, chunk);
 
-    uvm_assert_spinlock_locked(&pushbuffer->lock);
+    uvm_assert_spinlock_locked(&chunk->lock);
 
     if (gpu_get == cpu_put) {
         // cpu_put can be equal to gpu_get both when the chunk is full and empty. We
@@ -324,6 +450,9 @@ static void update_chunk(uvm_pushbuffer_t *pushbuffer, uvm_pushbuffer_chunk_t *c
         set_chunk(pushbuffer, chunk, pushbuffer->available_chunks);
         UVM_ASSERT_MSG(cpu_put == 0, "cpu put %u\n", cpu_put);
 
+        // An idle chunk is not affine to any channel
+        chunk->affine_channel = NULL;
+
         // For a completely idle chunk, always start at the very beginning. This
         // helps avoid the waste that can happen at the very end of the chunk
         // described at the top of uvm8_pushbuffer.h.
@@ -336,7 +465,7 @@ static void update_chunk(uvm_pushbuffer_t *pushbuffer, uvm_pushbuffer_chunk_t *c
             chunk->next_push_start = cpu_put;
         }
     }
-    else if (UVM_PUSHBUFFER_CHUNK_SIZE >= cpu_put + UVM_MAX_PUSH_SIZE) {
+    else if (pushbuffer->chunk_size >= cpu_put + UVM_MAX_PUSH_SIZE) {
         UVM_ASSERT_MSG(gpu_get < cpu_put, "gpu_get %u cpu_put %u\n", gpu_get, cpu_put);
 
         // Enough space at the end
@@ -365,8 +494,8 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 static uvm_pushbuffer_chunk_t *offset_to_chunk(uvm_pushbuffer_t *pushbuffer, NvU32 offset)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    UVM_ASSERT(offset < UVM_PUSHBUFFER_SIZE);
-    return &pushbuffer->chunks[offset / UVM_PUSHBUFFER_CHUNK_SIZE];
+    UVM_ASSERT(offset < uvm_pushbuffer_get_size(pushbuffer));
+    return &pushbuffer->chunks[offset / pushbuffer->chunk_size];
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 static uvm_pushbuffer_chunk_t *gpfifo_to_chunk(uvm_pushbuffer_t *pushbuffer, uvm_gpfifo_entry_t *gpfifo)
@@ -388,7 +517,7 @@ void uvm_pushbuffer_mark_completed(uvm_pushbuffer_t *pushbuffer, uvm_gpfifo_entr
     push_info->on_complete = NULL;
     push_info->on_complete_data = NULL;
 
-    uvm_spin_lock(&pushbuffer->lock);
+    uvm_spin_lock(&chunk->lock);
 
     if (gpfifo == chunk_get_first_gpfifo(chunk))
         need_to_update_chunk = true;
@@ -402,7 +531,7 @@ void uvm_pushbuffer_mark_completed(uvm_pushbuffer_t *pushbuffer, uvm_gpfifo_entr
     if (need_to_update_chunk && chunk->current_push == NULL)
         update_chunk(pushbuffer, chunk);
 
-    uvm_spin_unlock(&pushbuffer->lock);
+    uvm_spin_unlock(&chunk->lock);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 NvU32 uvm_pushbuffer_get_offset_for_push(uvm_pushbuffer_t *pushbuffer, uvm_push_t *push)
@@ -426,7 +555,7 @@ void uvm_pushbuffer_end_push(uvm_pushbuffer_t *pushbuffer, uvm_push_t *push, uvm
 
     uvm_assert_spinlock_locked(&push->channel->pool->lock);
 
-    uvm_spin_lock(&pushbuffer->lock);
+    uvm_spin_lock(&chunk->lock);
 
     list_add_tail(&gpfifo->pending_list_node, &chunk->pending_gpfifos);
 
@@ -435,7 +564,7 @@ void uvm_pushbuffer_end_push(uvm_pushbuffer_t *pushbuffer, uvm_push_t *push, uvm
     UVM_ASSERT(chunk->current_push == push);
     chunk->current_push = NULL;
 
-    uvm_spin_unlock(&pushbuffer->lock);
+    uvm_spin_unlock(&chunk->lock);
 
     // uvm_pushbuffer_end_push() needs to be called with the channel lock held
     // while the concurrent pushes sema has a higher lock order. To keep the
@@ -445,15 +574,10 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 bool uvm_pushbuffer_has_space(uvm_pushbuffer_t *pushbuffer)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    bool has_space;
-
-    uvm_spin_lock(&pushbuffer->lock);
-
-    has_space = pick_chunk(pushbuffer) != NULL;
-
-    uvm_spin_unlock(&pushbuffer->lock);
-
-    return has_space;
+    // Idle chunks are always available too, so checking the available chunks
+    // is enough. This is only a snapshot as the chunks can be concurrently
+    // claimed and released.
+    return find_first_bit(pushbuffer->available_chunks, pushbuffer->num_chunks) < pushbuffer->num_chunks;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 void uvm_pushbuffer_print_common(uvm_pushbuffer_t *pushbuffer, struct seq_file *s)
@@ -462,22 +586,33 @@ void uvm_pushbuffer_print_common(uvm_pushbuffer_t *pushbuffer, struct seq_file *
 
     UVM_SEQ_OR_DBG_PRINT(s, "Pushbuffer for GPU %s\n", pushbuffer->channel_manager->gpu->name);
     UVM_SEQ_OR_DBG_PRINT(s, " has space: %d\n", uvm_pushbuffer_has_space(pushbuffer));
+    UVM_SEQ_OR_DBG_PRINT(s, " chunks %u chunk size %u\n", pushbuffer->num_chunks, pushbuffer->chunk_size);
+    UVM_SEQ_OR_DBG_PRINT(s, " stalls %llu stall time %llu ns max stall time %llu ns\n",
+                         (NvU64)atomic64_read(&pushbuffer->stats.stalls),
+                         (NvU64)atomic64_read(&pushbuffer->stats.stall_ns),
+                         (NvU64)atomic64_read(&pushbuffer->stats.max_stall_ns));
+    UVM_SEQ_OR_DBG_PRINT(s, " affinity overrides %llu starvations %llu\n",
+                         (NvU64)atomic64_read(&pushbuffer->stats.affinity_overrides),
+                         (NvU64)atomic64_read(&pushbuffer->stats.starvations));
+
+    for (i = 0; i < pushbuffer->num_chunks; ++i) {
+        uvm_pushbuffer_chunk_t *chunk = &pushbuffer->chunks[i];
+        NvU32 cpu_put;
+        NvU32 gpu_get;
 
-    uvm_spin_lock(&pushbuffer->lock);
+        uvm_spin_lock(&chunk->lock);
 
-    for (i = 0; i < UVM_PUSHBUFFER_CHUNKS; ++i) {
-        uvm_pushbuffer_chunk_t *chunk = &pushbuffer->chunks[i];
-        NvU32 cpu_put = chunk_get_cpu_put(pushbuffer, chunk);
-        NvU32 gpu_get = chunk_get_gpu_get(pushbuffer, chunk);
-        UVM_SEQ_OR_DBG_PRINT(s, " chunk %u put %u get %u next %u available %d idle %d\n",
+        cpu_put = chunk_get_cpu_put(pushbuffer, chunk);
+        gpu_get = chunk_get_gpu_get(pushbuffer, chunk);
+        UVM_SEQ_OR_DBG_PRINT(s, " chunk %u put %u get %u next %u available %d idle %d channel %s\n",
                 i,
                 cpu_put, gpu_get, chunk->next_push_start,
                 test_bit(i, pushbuffer->available_chunks) ? 1 : 0,
-                test_bit(i, pushbuffer->idle_chunks) ? 1 : 0);
+                test_bit(i, pushbuffer->idle_chunks) ? 1 : 0,
+                chunk->affine_channel ? chunk->affine_channel->name : "none");
 
+        uvm_spin_unlock(&chunk->lock);
     }
-
-    uvm_spin_unlock(&pushbuffer->lock);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 void uvm_pushbuffer_print(uvm_pushbuffer_t *pushbuffer)
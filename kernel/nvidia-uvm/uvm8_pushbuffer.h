@@ -55,15 +55,39 @@
 // With the above in mind, we can go through the implementation details of the
 // current solution.
 // The pushbuffer backing store is a single big allocation logically divided
-// into largely independent parts called chunks.
+// into largely independent parts called chunks. The number of chunks and their
+// size are configurable at module load time (see uvm_channel_pushbuffer_chunks
+// and uvm_channel_pushbuffer_chunk_size in uvm8_channel.c).
 // Each chunk is roughly a ringbuffer tracking multiple pending pushes being
 // processed by the GPU. The pushbuffer maintains two bitmaps, one tracking
 // completely idle (with no pending pushes) chunks and a second one tracking
 // available (with pending pushes, but still enough space for a new push)
-// chunks. When a new allocation is requested, idle chunks are always used
-// first and after that available chunks are consulted. If none are available,
-// the CPU spin waits on the GPU to complete some of the pending pushes making
-// space for a new one.
+// chunks. Each chunk has its own lock protecting its state, and the bitmaps
+// are only modified with atomic bit operations while holding the lock of the
+// corresponding chunk. Claiming a chunk for a new push scans the bitmaps
+// without any pushbuffer-wide lock and only takes the lock of the chunk being
+// claimed, so concurrent pushes on different chunks don't contend.
+//
+// When a new allocation is requested, idle chunks are always used first. The
+// scan starts at a position derived from the channel of the push, so pushes
+// on different channels tend to pick different chunks. After that, available
+// chunks that already hold pending pushes from the same channel (the chunk's
+// affine channel) are preferred, so that a busy channel tends to reuse the
+// space freed in its own chunks instead of the chunks used by other channels.
+// Any other available chunk is used right away if there is no affine one. Only
+// when no chunk can be claimed at all, the CPU spin waits on the GPU to
+// complete some of the pending pushes making space for a new one. The number
+// and duration of those stalls are reported in the pushbuffer procfs file.
+//
+// Claiming chunks without any waiting lets the pushes of busy channels keep
+// taking the space freed in all the chunks, including the ones other channels
+// were using, so a push could lose every race for a chunk and never make
+// progress. To bound that, a push that fails to claim a chunk
+// UVM_PUSHBUFFER_STARVATION_RETRIES times in a row takes a ticket. While the
+// oldest ticket is pending, no other push can claim any chunk, so the starving
+// push gets the next chunk that becomes available. Tickets are served in
+// order, so a push never waits for more than the pushes that started starving
+// before it.
 //
 // To explain how chunks track pending pushes we will go through an example
 // modifying a chunk's state. Let's start with a few pending pushes in the
@@ -145,16 +169,26 @@
 // Total                                                            Total= ~100k
 //
 #define UVM_MAX_PUSH_SIZE (128 * 1024)
-#define UVM_PUSHBUFFER_CHUNK_SIZE (8 * UVM_MAX_PUSH_SIZE)
-#define UVM_PUSHBUFFER_CHUNKS 16
 
-// Total size of the pushbuffer
-#define UVM_PUSHBUFFER_SIZE (UVM_PUSHBUFFER_CHUNK_SIZE * UVM_PUSHBUFFER_CHUNKS)
+// Size of each chunk. Must be a multiple of UVM_MAX_PUSH_SIZE.
+#define UVM_PUSHBUFFER_CHUNK_SIZE_DEFAULT (8 * UVM_MAX_PUSH_SIZE)
+#define UVM_PUSHBUFFER_CHUNK_SIZE_MIN     (2 * UVM_MAX_PUSH_SIZE)
+#define UVM_PUSHBUFFER_CHUNK_SIZE_MAX     (64 * UVM_MAX_PUSH_SIZE)
+
+// Number of chunks
+#define UVM_PUSHBUFFER_CHUNKS_DEFAULT 16
+#define UVM_PUSHBUFFER_CHUNKS_MIN     4
+#define UVM_PUSHBUFFER_CHUNKS_MAX     64
+
+// Number of failed attempts to claim a chunk after which a push gets priority
+// over all the pushes that are not starving
+#define UVM_PUSHBUFFER_STARVATION_RETRIES 16
 
 // The max number of concurrent pushes that can be happening at the same time.
 // Concurrent pushes are ones that are after uvm_push_begin*(), but before
-// uvm_push_end().
-#define UVM_PUSH_MAX_CONCURRENT_PUSHES UVM_PUSHBUFFER_CHUNKS
+// uvm_push_end(). The actual limit for a given pushbuffer is its number of
+// chunks, see uvm_pushbuffer_max_concurrent_pushes().
+#define UVM_PUSH_MAX_CONCURRENT_PUSHES UVM_PUSHBUFFER_CHUNKS_MAX
 
 typedef struct
 {
@@ -168,6 +202,13 @@ typedef struct
 
     // Currently on-going push in the chunk. There can be only one at a time.
     uvm_push_t *current_push;
+
+    // Channel whose pushes were placed in the chunk since it was last idle.
+    // NULL if the chunk is idle.
+    uvm_channel_t *affine_channel;
+
+    // Lock protecting the chunk state and its bits in the pushbuffer bitmaps
+    uvm_spinlock_t lock;
 } uvm_pushbuffer_chunk_t;
 
 struct uvm_pushbuffer_struct
@@ -177,18 +218,20 @@ struct uvm_pushbuffer_struct
     // Memory allocation backing the pushbuffer
     uvm_rm_mem_t *memory;
 
-    // Array of the pushbuffer chunks
-    uvm_pushbuffer_chunk_t chunks[UVM_PUSHBUFFER_CHUNKS];
+    // Number of chunks in use, and size of each of them. Set at creation time
+    // from the channel manager configuration.
+    NvU32 num_chunks;
+    NvU32 chunk_size;
+
+    // Array of the pushbuffer chunks. Only the first num_chunks are used.
+    uvm_pushbuffer_chunk_t chunks[UVM_PUSHBUFFER_CHUNKS_MAX];
 
     // Chunks that do not have an on-going push and have at least
     // UVM_MAX_PUSH_SIZE space free.
-    DECLARE_BITMAP(available_chunks, UVM_PUSHBUFFER_CHUNKS);
+    DECLARE_BITMAP(available_chunks, UVM_PUSHBUFFER_CHUNKS_MAX);
 
     // Chunks that do not have an on-going push nor any pending pushes.
-    DECLARE_BITMAP(idle_chunks, UVM_PUSHBUFFER_CHUNKS);
-
-    // Lock protecting chunk state and the bitmaps.
-    uvm_spinlock_t lock;
+    DECLARE_BITMAP(idle_chunks, UVM_PUSHBUFFER_CHUNKS_MAX);
 
     // Semaphore enforcing a limited number of concurrent pushes.
     // Decremented in uvm_pushbuffer_begin_push(), incremented in
@@ -197,6 +240,31 @@ struct uvm_pushbuffer_struct
     // are supported.
     uvm_semaphore_t concurrent_pushes_sema;
 
+    // Tickets of the starving pushes, see UVM_PUSHBUFFER_STARVATION_RETRIES.
+    // starving_next is the next ticket to hand out and starving_serving the
+    // ticket of the push that has priority. No push is starving if they are
+    // equal.
+    atomic_t starving_next;
+    atomic_t starving_serving;
+
+    struct
+    {
+        // Number of pushes that could not claim a chunk right away
+        atomic64_t stalls;
+
+        // Accumulated and maximum time spent waiting for a chunk by the
+        // stalled pushes
+        atomic64_t stall_ns;
+        atomic64_t max_stall_ns;
+
+        // Number of pushes that claimed a chunk affine to a different channel
+        // because no chunk affine to their channel was available
+        atomic64_t affinity_overrides;
+
+        // Number of pushes that took a starvation ticket
+        atomic64_t starvations;
+    } stats;
+
     struct
     {
         struct proc_dir_entry *info_file;
@@ -226,6 +294,7 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 void uvm_pushbuffer_destroy(uvm_pushbuffer_t *pushbuffer);
 
 // Get an allocation for a push from the pushbuffer
+// push->channel must be already set, as it is used to pick the chunk.
 // Waits until a chunk is available and claims it for the push. The chunk used
 // for the push will be unavailable for any new pushes until
 // uvm_pushbuffer_end_push() for the push is called.
@@ -250,6 +319,19 @@ void uvm_pushbuffer_end_push(uvm_pushbuffer_t *pushbuffer, uvm_push_t *push, uvm
 // Mostly useful in pushbuffer tests
 bool uvm_pushbuffer_has_space(uvm_pushbuffer_t *pushbuffer);
 
+// Total size of the pushbuffer allocation
+static NvU32 uvm_pushbuffer_get_size(uvm_pushbuffer_t *pushbuffer)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return pushbuffer->num_chunks * pushbuffer->chunk_size;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Max number of pushes that can be on-going at the same time on the
+// pushbuffer. Always smaller or equal to UVM_PUSH_MAX_CONCURRENT_PUSHES.
+static NvU32 uvm_pushbuffer_max_concurrent_pushes(uvm_pushbuffer_t *pushbuffer)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return pushbuffer->num_chunks;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 // Helper to print pushbuffer state for debugging
 void uvm_pushbuffer_print(uvm_pushbuffer_t *pushbuffer);
 
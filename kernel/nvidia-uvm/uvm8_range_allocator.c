@@ -25,26 +25,230 @@
 #include "uvm8_range_allocator.h"
 #include "uvm8_kvmalloc.h"
 
+#define FREE_LISTS_COUNT (UVM_RANGE_ALLOCATOR_FL_COUNT * UVM_RANGE_ALLOCATOR_SL_COUNT)
+
+// Free range tracked by the allocator. The tree node is the one handed out in
+// uvm_range_allocation_t, so that a freed allocation can be turned back into a
+// free range without allocating memory.
+typedef struct
+{
+    uvm_range_tree_node_t tree_node;
+
+    // Entry in the free list of the size class of the range
+    struct list_head free_list_node;
+} range_allocator_node_t;
+
+static range_allocator_node_t *range_node_from_tree_node(uvm_range_tree_node_t *tree_node)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return container_of(tree_node, range_allocator_node_t, tree_node);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static range_allocator_node_t *range_node_alloc(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return uvm_kvmalloc(sizeof(range_allocator_node_t));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void range_node_free(uvm_range_tree_node_t *tree_node)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_kvfree(range_node_from_tree_node(tree_node));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NvU64 range_node_size(uvm_range_tree_node_t *tree_node)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return tree_node->end - tree_node->start + 1;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Compute the class [fl, sl] of the given size. Ranges of the returned class
+// are not guaranteed to fit size, only ranges of the following classes are.
+static void size_to_class(NvU64 size, NvU32 *fl, NvU32 *sl)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 msb;
+
+    if (size < UVM_RANGE_ALLOCATOR_SL_COUNT) {
+        *fl = 0;
+        *sl = (NvU32)size;
+        return;
+    }
+
+    msb = fls64(size) - 1;
+    *fl = msb - UVM_RANGE_ALLOCATOR_SL_LOG2 + 1;
+    *sl = (size >> (msb - UVM_RANGE_ALLOCATOR_SL_LOG2)) & (UVM_RANGE_ALLOCATOR_SL_COUNT - 1);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Compute the first class whose ranges are all at least size bytes. Returns
+// false if no such class exists.
+static bool size_to_fitting_class(NvU64 size, NvU32 *fl, NvU32 *sl)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (size >= UVM_RANGE_ALLOCATOR_SL_COUNT) {
+        NvU64 round = (1ULL << (fls64(size) - 1 - UVM_RANGE_ALLOCATOR_SL_LOG2)) - 1;
+
+        if (size + round < size)
+            return false;
+
+        size += round;
+    }
+
+    size_to_class(size, fl, sl);
+
+    // Sizes rounded up to a class boundary fit all the ranges of the class
+    return true;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static struct list_head *free_list(uvm_range_allocator_t *range_allocator, NvU32 fl, NvU32 sl)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return &range_allocator->free_lists[fl * UVM_RANGE_ALLOCATOR_SL_COUNT + sl];
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void free_list_insert(uvm_range_allocator_t *range_allocator, uvm_range_tree_node_t *tree_node)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    range_allocator_node_t *node = range_node_from_tree_node(tree_node);
+    NvU32 fl, sl;
+
+    size_to_class(range_node_size(tree_node), &fl, &sl);
+
+    list_add(&node->free_list_node, free_list(range_allocator, fl, sl));
+    range_allocator->fl_bitmap |= 1ULL << fl;
+    range_allocator->sl_bitmap[fl] |= 1U << sl;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void free_list_remove(uvm_range_allocator_t *range_allocator, uvm_range_tree_node_t *tree_node)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    range_allocator_node_t *node = range_node_from_tree_node(tree_node);
+    NvU32 fl, sl;
+
+    size_to_class(range_node_size(tree_node), &fl, &sl);
+
+    list_del(&node->free_list_node);
+    if (!list_empty(free_list(range_allocator, fl, sl)))
+        return;
+
+    range_allocator->sl_bitmap[fl] &= ~(1U << sl);
+    if (range_allocator->sl_bitmap[fl] == 0)
+        range_allocator->fl_bitmap &= ~(1ULL << fl);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Find the first non-empty class starting at [fl, sl], in class order
+static bool find_non_empty_class(uvm_range_allocator_t *range_allocator, NvU32 *fl, NvU32 *sl)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 sl_map = range_allocator->sl_bitmap[*fl] & (~0U << *sl);
+
+    if (sl_map == 0) {
+        NvU64 fl_map;
+
+        if (*fl + 1 >= UVM_RANGE_ALLOCATOR_FL_COUNT)
+            return false;
+
+        fl_map = range_allocator->fl_bitmap & (~0ULL << (*fl + 1));
+        if (fl_map == 0)
+            return false;
+
+        *fl = __ffs64(fl_map);
+        sl_map = range_allocator->sl_bitmap[*fl];
+    }
+
+    *sl = __ffs(sl_map);
+
+    return true;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Check whether an allocation of the given size and alignment fits the free
+// range, and return its aligned start
+static bool range_fits(uvm_range_tree_node_t *tree_node, NvU64 size, NvU64 alignment, NvU64 *aligned_start)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU64 start = UVM_ALIGN_UP(tree_node->start, alignment);
+    NvU64 end = start + size - 1;
+
+    // Check for overflow of start and end
+    if (start < tree_node->start || end < start)
+        return false;
+
+    if (end > tree_node->end)
+        return false;
+
+    *aligned_start = start;
+    return true;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static uvm_range_tree_node_t *find_free_range(uvm_range_allocator_t *range_allocator,
+                                              NvU64 size,
+                                              NvU64 alignment,
+                                              NvU64 *aligned_start)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    range_allocator_node_t *node;
+    NvU64 search_size = size + alignment - 1;
+    NvU32 fl, sl;
+
+    // Fast path: any range of the first non-empty class fitting
+    // size + alignment - 1 fits the allocation regardless of its start.
+    if (search_size >= size && size_to_fitting_class(search_size, &fl, &sl)) {
+        if (find_non_empty_class(range_allocator, &fl, &sl)) {
+            node = list_first_entry(free_list(range_allocator, fl, sl), range_allocator_node_t, free_list_node);
+            if (range_fits(&node->tree_node, size, alignment, aligned_start))
+                return &node->tree_node;
+
+            UVM_ASSERT_MSG(false, "Range [0x%llx, 0x%llx] doesn't fit size 0x%llx alignment 0x%llx\n",
+                           node->tree_node.start,
+                           node->tree_node.end,
+                           size,
+                           alignment);
+        }
+    }
+
+    // Slow path: search the smaller classes, which contain ranges that may or
+    // may not fit depending on their size and start alignment.
+    size_to_class(size, &fl, &sl);
+    while (find_non_empty_class(range_allocator, &fl, &sl)) {
+        list_for_each_entry(node, free_list(range_allocator, fl, sl), free_list_node) {
+            if (range_fits(&node->tree_node, size, alignment, aligned_start))
+                return &node->tree_node;
+        }
+
+        if (++sl == UVM_RANGE_ALLOCATOR_SL_COUNT) {
+            if (++fl == UVM_RANGE_ALLOCATOR_FL_COUNT)
+                break;
+
+            sl = 0;
+        }
+    }
+
+    return NULL;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 NV_STATUS uvm_range_allocator_init(NvU64 size, uvm_range_allocator_t *range_allocator)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    range_allocator_node_t *node;
     NV_STATUS status;
-    uvm_range_tree_node_t *node;
+    size_t i;
 
     uvm_spin_lock_init(&range_allocator->lock, UVM_LOCK_ORDER_LEAF);
     uvm_range_tree_init(&range_allocator->range_tree);
 
     UVM_ASSERT(size > 0);
 
-    node = uvm_kvmalloc(sizeof(*node));
-    if (!node)
+    range_allocator->fl_bitmap = 0;
+    memset(range_allocator->sl_bitmap, 0, sizeof(range_allocator->sl_bitmap));
+
+    range_allocator->free_lists = uvm_kvmalloc(sizeof(*range_allocator->free_lists) * FREE_LISTS_COUNT);
+    if (!range_allocator->free_lists)
+        return NV_ERR_NO_MEMORY;
+
+    for (i = 0; i < FREE_LISTS_COUNT; ++i)
+        INIT_LIST_HEAD(&range_allocator->free_lists[i]);
+
+    node = range_node_alloc();
+    if (!node) {
+        uvm_kvfree(range_allocator->free_lists);
         return NV_ERR_NO_MEMORY;
+    }
 
-    node->start = 0;
-    node->end = size - 1;
+    node->tree_node.start = 0;
+    node->tree_node.end = size - 1;
 
-    status = uvm_range_tree_add(&range_allocator->range_tree, node);
+    status = uvm_range_tree_add(&range_allocator->range_tree, &node->tree_node);
     UVM_ASSERT(status == NV_OK);
 
+    free_list_insert(range_allocator, &node->tree_node);
+
     range_allocator->size = size;
 
     return NV_OK;
@@ -60,15 +264,24 @@ void uvm_range_allocator_deinit(uvm_range_allocator_t *range_allocator)
 
     // Remove the node for completeness even though after deinit the state of
     // tree doesn't matter anyway.
+    free_list_remove(range_allocator, node);
     uvm_range_tree_remove(&range_allocator->range_tree, node);
+    UVM_ASSERT(range_allocator->fl_bitmap == 0);
+
+    range_node_free(node);
 
-    uvm_kvfree(node);
+    uvm_kvfree(range_allocator->free_lists);
+    range_allocator->free_lists = NULL;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 NV_STATUS uvm_range_allocator_alloc(uvm_range_allocator_t *range_allocator, NvU64 size, NvU64 alignment, uvm_range_allocation_t *range_alloc)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     uvm_range_tree_node_t *node;
-    bool found = false;
+    range_allocator_node_t *alloc_node;
+    range_allocator_node_t *tail_node = NULL;
+    NvU64 aligned_start;
+    NvU64 aligned_end;
+    NV_STATUS status;
 
     UVM_ASSERT(size > 0);
 
@@ -82,59 +295,84 @@ NV_STATUS uvm_range_allocator_alloc(uvm_range_allocator_t *range_allocator, NvU6
 
     // Pre-allocate a tree node as part of the allocation so that freeing the
     // range won't require allocating memory and will always succeed.
-    range_alloc->node = uvm_kvmalloc(sizeof(*range_alloc->node));
-    if (!range_alloc->node)
+    alloc_node = range_node_alloc();
+    if (!alloc_node)
         return NV_ERR_NO_MEMORY;
 
     uvm_spin_lock(&range_allocator->lock);
 
-    // This is a very simple brute force going over all the free ranges in
-    // address order and returning the first one that's big enough.
-    // This could be improved by e.g. also maintaining a binary tree of free
-    // ranges ordered by their size.
-    uvm_range_tree_for_each_in(node, &range_allocator->range_tree, 0, range_allocator->size - size) {
-        NvU64 aligned_start = UVM_ALIGN_UP(node->start, alignment);
-        NvU64 aligned_end = aligned_start + size - 1;
+    node = find_free_range(range_allocator, size, alignment, &aligned_start);
+
+    // Aligned allocations can split a free range in three, with the space
+    // skipped for alignment kept free, which requires an extra node. That's
+    // only known once the free range is found, so allocate the node outside of
+    // the lock and search again, as the free ranges might have changed in the
+    // meantime.
+    while (node && !tail_node && aligned_start > node->start && aligned_start + size - 1 < node->end) {
+        uvm_spin_unlock(&range_allocator->lock);
+
+        tail_node = range_node_alloc();
+        if (!tail_node) {
+            range_node_free(&alloc_node->tree_node);
+            return NV_ERR_NO_MEMORY;
+        }
+
+        uvm_spin_lock(&range_allocator->lock);
+
+        node = find_free_range(range_allocator, size, alignment, &aligned_start);
+    }
+
+    if (node) {
+        aligned_end = aligned_start + size - 1;
 
-        // Check for overflow of aligned_start and aligned_end
-        if (aligned_start < node->start || aligned_end < aligned_start)
-            continue;
+        free_list_remove(range_allocator, node);
 
-        // Check whether it fits
-        if (aligned_end > node->end)
-            continue;
+        if (aligned_start > node->start && aligned_end < node->end) {
+            // Keep the head in the existing node and add the tail as a new one
+            UVM_ASSERT(tail_node);
 
-        // The allocation always wastes the [node->start, aligned_start) space,
-        // but it's expected that there will always be plenty of free space to
-        // allocate from and wasting that space should help avoid fragmentation.
+            tail_node->tree_node.start = aligned_end + 1;
+            tail_node->tree_node.end = node->end;
 
-        range_alloc->aligned_start = aligned_start;
-        range_alloc->node->start = node->start;
-        range_alloc->node->end = aligned_end;
+            uvm_range_tree_shrink_node(&range_allocator->range_tree, node, node->start, aligned_start - 1);
+            free_list_insert(range_allocator, node);
 
-        if (aligned_end < node->end) {
-            // Shrink the node if the claimed size is smaller than the node.
+            status = uvm_range_tree_add(&range_allocator->range_tree, &tail_node->tree_node);
+            UVM_ASSERT(status == NV_OK);
+            free_list_insert(range_allocator, &tail_node->tree_node);
+            tail_node = NULL;
+        }
+        else if (aligned_start > node->start) {
+            uvm_range_tree_shrink_node(&range_allocator->range_tree, node, node->start, aligned_start - 1);
+            free_list_insert(range_allocator, node);
+        }
+        else if (aligned_end < node->end) {
             uvm_range_tree_shrink_node(&range_allocator->range_tree, node, aligned_end + 1, node->end);
+            free_list_insert(range_allocator, node);
         }
         else {
-            // Otherwise just remove it. The removal is safe to do in the loop
-            // over nodes as a break is following immediately.
-            UVM_ASSERT(node->end == aligned_end);
             uvm_range_tree_remove(&range_allocator->range_tree, node);
-            uvm_kvfree(node);
+            range_node_free(node);
         }
-        found = true;
-        break;
+
+        alloc_node->tree_node.start = aligned_start;
+        alloc_node->tree_node.end = aligned_end;
     }
 
     uvm_spin_unlock(&range_allocator->lock);
 
-    if (!found) {
-        uvm_kvfree(range_alloc->node);
+    if (tail_node)
+        range_node_free(&tail_node->tree_node);
+
+    if (!node) {
+        range_node_free(&alloc_node->tree_node);
         range_alloc->node = NULL;
         return NV_ERR_UVM_ADDRESS_IN_USE;
     }
 
+    range_alloc->aligned_start = aligned_start;
+    range_alloc->node = &alloc_node->tree_node;
+
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
@@ -154,14 +392,23 @@ void uvm_range_allocator_free(uvm_range_allocator_t *range_allocator, uvm_range_
     status = uvm_range_tree_add(&range_allocator->range_tree, range_alloc->node);
     UVM_ASSERT(status == NV_OK);
 
-    // And try merging it with adjacent nodes
-    adjacent_node = uvm_range_tree_merge_prev(&range_allocator->range_tree, range_alloc->node);
-    if (adjacent_node)
-        uvm_kvfree(adjacent_node);
+    // And try merging it with adjacent free ranges, which need to be removed
+    // from their free lists first since their size class changes.
+    adjacent_node = uvm_range_tree_prev(&range_allocator->range_tree, range_alloc->node);
+    if (adjacent_node && adjacent_node->end + 1 == range_alloc->node->start) {
+        free_list_remove(range_allocator, adjacent_node);
+        adjacent_node = uvm_range_tree_merge_prev(&range_allocator->range_tree, range_alloc->node);
+        range_node_free(adjacent_node);
+    }
+
+    adjacent_node = uvm_range_tree_next(&range_allocator->range_tree, range_alloc->node);
+    if (adjacent_node && adjacent_node->start == range_alloc->node->end + 1) {
+        free_list_remove(range_allocator, adjacent_node);
+        adjacent_node = uvm_range_tree_merge_next(&range_allocator->range_tree, range_alloc->node);
+        range_node_free(adjacent_node);
+    }
 
-    adjacent_node = uvm_range_tree_merge_next(&range_allocator->range_tree, range_alloc->node);
-    if (adjacent_node)
-        uvm_kvfree(adjacent_node);
+    free_list_insert(range_allocator, range_alloc->node);
 
     uvm_spin_unlock(&range_allocator->lock);
 
@@ -27,6 +27,21 @@
 #include "uvm8_range_tree.h"
 #include "uvm8_lock.h"
 
+// The range allocator is a two-level segregated fit (TLSF) allocator. Free
+// ranges are kept in lists segregated by size class. The first level of the
+// class is the index of the most significant bit of the range size, and the
+// second level subdivides each power-of-two range linearly into
+// UVM_RANGE_ALLOCATOR_SL_COUNT classes. Sizes smaller than
+// UVM_RANGE_ALLOCATOR_SL_COUNT all belong to the first first-level class, one
+// second-level class per size.
+//
+// Bitmaps of the non-empty lists make finding a free range that is guaranteed
+// to fit the allocation O(1). The free ranges are also tracked in a range tree,
+// in address order, so that freed ranges can be merged with their neighbors.
+#define UVM_RANGE_ALLOCATOR_SL_LOG2  4
+#define UVM_RANGE_ALLOCATOR_SL_COUNT (1 << UVM_RANGE_ALLOCATOR_SL_LOG2)
+#define UVM_RANGE_ALLOCATOR_FL_COUNT (64 - UVM_RANGE_ALLOCATOR_SL_LOG2 + 1)
+
 typedef struct {
     // Lock protecting the state of the range allocator
     uvm_spinlock_t lock;
@@ -36,6 +51,17 @@ typedef struct {
 
     // Range tree tracking all the free ranges
     uvm_range_tree_t range_tree;
+
+    // Bitmap of the first-level classes with at least one free range
+    NvU64 fl_bitmap;
+
+    // Bitmaps of the second-level classes with at least one free range, for
+    // each first-level class
+    NvU16 sl_bitmap[UVM_RANGE_ALLOCATOR_FL_COUNT];
+
+    // Lists of free ranges, indexed by
+    // fl * UVM_RANGE_ALLOCATOR_SL_COUNT + sl
+    struct list_head *free_lists;
 } uvm_range_allocator_t;
 
 // A free range allocation
@@ -46,6 +72,8 @@ typedef struct {
     // A tree node allocated at the time of range allocation and used by the
     // range allocator when the range allocation is freed. This allows to
     // guarantee that uvm_range_allocator_free() always succeeds.
+    //
+    // The node covers exactly [aligned_start, aligned_start + size - 1].
     uvm_range_tree_node_t *node;
 } uvm_range_allocation_t;
 
@@ -64,7 +92,12 @@ void uvm_range_allocator_deinit(uvm_range_allocator_t *range_allocator);
 // alignment of 1.
 //
 // On success, the start of the allocated range is returned in
-// free_range_alloc->aligned_start.
+// free_range_alloc->aligned_start. Any space skipped to satisfy the alignment
+// is kept free.
+//
+// The allocation is O(1) when a free range in a size class large enough for
+// size + alignment - 1 exists. Otherwise the lists of the smaller classes that
+// may still fit the allocation are searched.
 NV_STATUS uvm_range_allocator_alloc(uvm_range_allocator_t *range_allocator, NvU64 size, NvU64 alignment, uvm_range_allocation_t *free_range_alloc);
 
 // Free a previously allocated range
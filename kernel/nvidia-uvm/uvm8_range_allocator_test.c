@@ -350,3 +350,96 @@ NV_STATUS uvm8_test_range_allocator_sanity(UVM_TEST_RANGE_ALLOCATOR_SANITY_PARAM
 
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Same as UVM_MEM_VA_SIZE, the size of the main user of the range allocator
+#define BENCHMARK_SIZE (1ull << 40)
+
+// Alloc/free churn benchmark. The allocator is first populated with
+// num_allocs allocations, and then each iteration frees a random allocation
+// and allocates a new one, so that the free space gets fragmented over time.
+// Allocation sizes are random in [min_size, max_size] with a log distribution,
+// and alignments are random powers of two up to max_alignment.
+//
+// Notably this test leaks memory on failure as it's hard to clean up correctly
+// if something goes wrong and uvm_range_allocator_deinit would likely hit
+// asserts.
+static NV_STATUS benchmark(UVM_TEST_RANGE_ALLOCATOR_BENCHMARK_PARAMS *params)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+    uvm_range_allocator_t range_allocator;
+    uvm_range_allocation_t *range_allocs;
+    uvm_test_rng_t rng;
+    NvU64 alloc_ns = 0;
+    NvU64 free_ns = 0;
+    NvU64 num_allocs = 0;
+    NvU64 num_frees = 0;
+    NvU32 allocated = 0;
+    NvU64 start;
+    NvU32 i;
+
+    uvm_test_rng_init(&rng, params->seed);
+
+    range_allocs = uvm_kvmalloc(sizeof(*range_allocs) * params->num_allocs);
+    if (!range_allocs)
+        return NV_ERR_NO_MEMORY;
+
+    status = uvm_range_allocator_init(BENCHMARK_SIZE, &range_allocator);
+    TEST_CHECK_RET(status == NV_OK);
+
+    for (i = 0; i < params->num_allocs + params->iters; ++i) {
+        NvU64 size = uvm_test_rng_range_log64(&rng, params->min_size, params->max_size);
+        NvU64 alignment = 1ull << uvm_test_rng_range_32(&rng, 0, params->max_alignment_log2);
+
+        if (allocated == params->num_allocs) {
+            NvU32 index = uvm_test_rng_range_32(&rng, 0, allocated - 1);
+
+            start = NV_GETTIME();
+            uvm_range_allocator_free(&range_allocator, &range_allocs[index]);
+            free_ns += NV_GETTIME() - start;
+            ++num_frees;
+
+            range_allocs[index] = range_allocs[--allocated];
+        }
+
+        start = NV_GETTIME();
+        status = uvm_range_allocator_alloc(&range_allocator, size, alignment, &range_allocs[allocated]);
+        alloc_ns += NV_GETTIME() - start;
+
+        if (status == NV_ERR_UVM_ADDRESS_IN_USE) {
+            ++params->failed_allocs;
+            continue;
+        }
+
+        TEST_CHECK_RET(status == NV_OK);
+        TEST_CHECK_RET(IS_ALIGNED(range_allocs[allocated].aligned_start, alignment));
+        ++allocated;
+        ++num_allocs;
+    }
+
+    while (allocated > 0)
+        uvm_range_allocator_free(&range_allocator, &range_allocs[--allocated]);
+
+    TEST_CHECK_RET(test_check_range_allocator_empty(&range_allocator) == NV_OK);
+
+    uvm_range_allocator_deinit(&range_allocator);
+    uvm_kvfree(range_allocs);
+
+    params->alloc_ns = num_allocs ? alloc_ns / num_allocs : 0;
+    params->free_ns = num_frees ? free_ns / num_frees : 0;
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NV_STATUS uvm8_test_range_allocator_benchmark(UVM_TEST_RANGE_ALLOCATOR_BENCHMARK_PARAMS *params, struct file *filp)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (params->num_allocs == 0 ||
+        params->min_size == 0 ||
+        params->min_size > params->max_size ||
+        params->max_size > BENCHMARK_SIZE ||
+        params->max_alignment_log2 > 32)
+        return NV_ERR_INVALID_PARAMETER;
+
+    params->failed_allocs = 0;
+
+    return benchmark(params);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
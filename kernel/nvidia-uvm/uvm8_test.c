@@ -306,6 +306,19 @@ long uvm8_test_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
         UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_TEST_VA_SPACE_REMOVE_DUMMY_THREAD_CONTEXTS, uvm8_test_va_space_remove_dummy_thread_contexts);
         UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_TEST_THREAD_CONTEXT_SANITY,        uvm8_test_thread_context_sanity);
         UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_TEST_THREAD_CONTEXT_PERF,          uvm8_test_thread_context_perf);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_TEST_THREAD_CONTEXT_SCALING,       uvm8_test_thread_context_scaling);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_TEST_TRACKER_PERF,                 uvm8_test_tracker_perf);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_TEST_PUSH_CAPTURE,                 uvm8_test_push_capture);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_TEST_PTE_BATCH,                    uvm8_test_pte_batch);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_TEST_PERF_HOTNESS_SANITY,          uvm8_test_perf_hotness_sanity);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_TEST_VA_BLOCK_PROMOTE_PTES,        uvm8_test_va_block_promote_ptes);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_TEST_VA_BLOCK_SCRATCH_POOL,        uvm8_test_va_block_scratch_pool);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_TEST_RANGE_ALLOCATOR_BENCHMARK,    uvm8_test_range_allocator_benchmark);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_TEST_TOOLS_EVENT_FORMAT,           uvm8_test_tools_event_format);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_TEST_MIGRATE_DEFERRED,             uvm8_test_migrate_deferred);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_TEST_MIGRATE_PAGEABLE_WINDOWS,     uvm8_test_migrate_pageable_windows);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_TEST_POPULATE_PAGEABLE_PARALLEL,   uvm8_test_populate_pageable_parallel);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_TEST_TOOLS_QUEUE_PRODUCERS,        uvm8_test_tools_queue_producers);
     }
 
     return -EINVAL;
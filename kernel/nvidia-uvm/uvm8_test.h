@@ -104,6 +104,7 @@ long uvm8_test_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
 NV_STATUS uvm8_test_range_tree_directed(UVM_TEST_RANGE_TREE_DIRECTED_PARAMS *params, struct file *filp);
 NV_STATUS uvm8_test_range_tree_random(UVM_TEST_RANGE_TREE_RANDOM_PARAMS *params, struct file *filp);
 NV_STATUS uvm8_test_range_allocator_sanity(UVM_TEST_RANGE_ALLOCATOR_SANITY_PARAMS *params, struct file *filp);
+NV_STATUS uvm8_test_range_allocator_benchmark(UVM_TEST_RANGE_ALLOCATOR_BENCHMARK_PARAMS *params, struct file *filp);
 NV_STATUS uvm8_test_page_tree(UVM_TEST_PAGE_TREE_PARAMS *params, struct file *filp);
 NV_STATUS uvm8_test_rm_mem_sanity(UVM_TEST_RM_MEM_SANITY_PARAMS *params, struct file *filp);
 NV_STATUS uvm8_test_mem_sanity(UVM_TEST_MEM_SANITY_PARAMS *params, struct file *filp);
@@ -184,4 +185,12 @@ NV_STATUS uvm8_test_va_space_add_dummy_thread_contexts(UVM_TEST_VA_SPACE_ADD_DUM
 NV_STATUS uvm8_test_va_space_remove_dummy_thread_contexts(UVM_TEST_VA_SPACE_REMOVE_DUMMY_THREAD_CONTEXTS_PARAMS *params, struct file *filp);
 NV_STATUS uvm8_test_thread_context_sanity(UVM_TEST_THREAD_CONTEXT_SANITY_PARAMS *params, struct file *filp);
 NV_STATUS uvm8_test_thread_context_perf(UVM_TEST_THREAD_CONTEXT_PERF_PARAMS *params, struct file *filp);
+NV_STATUS uvm8_test_thread_context_scaling(UVM_TEST_THREAD_CONTEXT_SCALING_PARAMS *params, struct file *filp);
+NV_STATUS uvm8_test_tracker_perf(UVM_TEST_TRACKER_PERF_PARAMS *params, struct file *filp);
+NV_STATUS uvm8_test_push_capture(UVM_TEST_PUSH_CAPTURE_PARAMS *params, struct file *filp);
+NV_STATUS uvm8_test_pte_batch(UVM_TEST_PTE_BATCH_PARAMS *params, struct file *filp);
+NV_STATUS uvm8_test_perf_hotness_sanity(UVM_TEST_PERF_HOTNESS_SANITY_PARAMS *params, struct file *filp);
+NV_STATUS uvm8_test_migrate_deferred(UVM_TEST_MIGRATE_DEFERRED_PARAMS *params, struct file *filp);
+NV_STATUS uvm8_test_migrate_pageable_windows(UVM_TEST_MIGRATE_PAGEABLE_WINDOWS_PARAMS *params, struct file *filp);
+NV_STATUS uvm8_test_populate_pageable_parallel(UVM_TEST_POPULATE_PAGEABLE_PARALLEL_PARAMS *params, struct file *filp);
 #endif
@@ -496,6 +496,9 @@ typedef struct
     UvmEventEntry entry; // contains only NvUxx types
     NvU32 count;
 
+    // Added to the address of each injected migration or GPU fault event
+    NvU64 address_stride NV_ALIGN_BYTES(8);
+
     // Out param
     NV_STATUS rmStatus;
 } UVM_TEST_INJECT_TOOLS_EVENT_PARAMS;
@@ -1024,6 +1027,19 @@ typedef struct
 {
     NvU64                           range_address1                   NV_ALIGN_BYTES(8); // In
     NvU64                           range_address2                   NV_ALIGN_BYTES(8); // In
+
+    // Number of UVM_VA_BLOCK_SIZE DMA mappings used to benchmark the reverse
+    // map with large physically-contiguous chunks. The benchmark is skipped if
+    // 0. range_address1 must point at a VA block of size UVM_VA_BLOCK_SIZE.
+    NvU32                           large_mappings;                                     // In
+
+    // Average time, in nanoseconds, spent in each reverse map operation on a
+    // UVM_VA_BLOCK_SIZE mapping during the benchmark.
+    NvU64                           large_add_ns                     NV_ALIGN_BYTES(8); // Out
+    NvU64                           large_split_ns                   NV_ALIGN_BYTES(8); // Out
+    NvU64                           large_merge_ns                   NV_ALIGN_BYTES(8); // Out
+    NvU64                           large_dma_to_virt_ns             NV_ALIGN_BYTES(8); // Out
+    NvU64                           large_remove_ns                  NV_ALIGN_BYTES(8); // Out
     NV_STATUS                       rmStatus;                                           // Out
 } UVM_TEST_PMM_SYSMEM_PARAMS;
 
@@ -1259,6 +1275,248 @@ typedef struct
     NV_STATUS                       rmStatus;                                           // Out
 } UVM_TEST_THREAD_CONTEXT_PERF_PARAMS;
 
+#define UVM_TEST_TRACKER_PERF                           UVM8_TEST_IOCTL_BASE(83)
+typedef struct
+{
+    // Iterations to run.
+    NvU32                           iterations;                                         // In
+
+    // Number of distinct channels tracked. Each iteration builds two trackers
+    // covering overlapping halves of the channels and merges them. Must be
+    // in the [2, 256] range.
+    NvU32                           num_channels;                                       // In
+
+    // Average time, in nanoseconds, of an iteration using uvm_tracker_t
+    NvU64                           tracker_ns NV_ALIGN_BYTES(8);                       // Out
+
+    // Average time, in nanoseconds, of an iteration using a reference
+    // implementation with a single static entry and linear deduplication
+    NvU64                           reference_ns NV_ALIGN_BYTES(8);                     // Out
+
+    NV_STATUS                       rmStatus;                                           // Out
+} UVM_TEST_TRACKER_PERF_PARAMS;
+
+// Copy the pushes captured so far into a user buffer. Only available if the
+// uvm_debug_push_capture_size_kb module parameter is set. The buffer receives
+// back to back uvm_push_capture_record_t records, see uvm8_push_decode.h.
+#define UVM_TEST_PUSH_CAPTURE                           UVM8_TEST_IOCTL_BASE(84)
+typedef struct
+{
+    // Buffer receiving the records. Only whole records are copied.
+    NvU64                           buffer NV_ALIGN_BYTES(8);                           // In
+    NvU64                           buffer_size NV_ALIGN_BYTES(8);                      // In
+
+    // Discard the captured records once copied. Ignored unless all of them
+    // fit in the buffer.
+    NvBool                          reset;                                              // In
+
+    // Size of all the captured records, and of the ones copied to the buffer
+    NvU64                           capture_size NV_ALIGN_BYTES(8);                     // Out
+    NvU64                           copied_size NV_ALIGN_BYTES(8);                      // Out
+
+    // Number of pushes that didn't fit in the capture buffer
+    NvU64                           dropped_pushes NV_ALIGN_BYTES(8);                   // Out
+
+    NV_STATUS                       rmStatus;                                           // Out
+} UVM_TEST_PUSH_CAPTURE_PARAMS;
+
+// PTE patterns reported by UVM_TEST_PTE_BATCH, each covering 2MB of VA mapped
+// with 4K PTEs:
+//  - 0: all PTEs mapped to consecutive physical pages
+//  - 1: all PTEs cleared one at a time, as done when unmapping
+//  - 2: alternating 256K chunks of mapped and cleared PTEs
+//  - 3: every other PTE mapped and the rest cleared
+#define UVM_TEST_PTE_BATCH_PATTERN_COUNT 4
+
+// Check that uvm_pte_batch_t writes the expected PTEs with different patterns
+// on all the GPUs registered in the VA space, and report the pushbuffer bytes
+// used per MB of mapped VA. The values reported are for the last GPU.
+#define UVM_TEST_PTE_BATCH                              UVM8_TEST_IOCTL_BASE(85)
+typedef struct
+{
+    // Pushbuffer bytes per mapped MB for each pattern, using uvm_pte_batch_t
+    NvU64                           bytes_per_mb[UVM_TEST_PTE_BATCH_PATTERN_COUNT] NV_ALIGN_BYTES(8); // Out
+
+    // Pushbuffer bytes per mapped MB for each pattern, using a reference
+    // implementation that queues up to 4 PTEs for memsets before switching to
+    // inline memcopy, and that writes each clear with a separate memset
+    NvU64                           reference_bytes_per_mb[UVM_TEST_PTE_BATCH_PATTERN_COUNT] NV_ALIGN_BYTES(8); // Out
+
+    NV_STATUS                       rmStatus;                                           // Out
+} UVM_TEST_PTE_BATCH_PARAMS;
+
+// Feed synthetic access counter notifications to a uvm_perf_hotness_map_t and
+// check the hotness estimates, the candidate table and the selection of
+// candidates under a bandwidth budget.
+#define UVM_TEST_PERF_HOTNESS_SANITY                    UVM8_TEST_IOCTL_BASE(86)
+typedef struct
+{
+    NvU32                           seed;                                               // In
+    NV_STATUS                       rmStatus;                                           // Out
+} UVM_TEST_PERF_HOTNESS_SANITY_PARAMS;
+
+// Re-map the VA block containing lookup_address on the given GPU with the
+// largest PTEs allowed by its current residency and mappings, as done by the
+// PTE promotion scanner. The number of big PTEs and 2M PTEs created by the
+// promotion is returned.
+#define UVM_TEST_VA_BLOCK_PROMOTE_PTES                  UVM8_TEST_IOCTL_BASE(87)
+typedef struct
+{
+    NvU64                           lookup_address NV_ALIGN_BYTES(8);                   // In
+    NvProcessorUuid                 gpu_uuid;                                           // In
+    NvU64                           num_big_promotions NV_ALIGN_BYTES(8);               // Out
+    NvU64                           num_2m_promotions NV_ALIGN_BYTES(8);                // Out
+    NV_STATUS                       rmStatus;                                           // Out
+} UVM_TEST_VA_BLOCK_PROMOTE_PTES_PARAMS;
+
+// Allocate and free VA block contexts and page masks iterations times, first
+// bypassing the per-CPU scratch pools and then using them. The number of
+// allocations that went to the kmem caches in each run is returned. Nothing is
+// run if the pools are disabled.
+#define UVM_TEST_VA_BLOCK_SCRATCH_POOL                  UVM8_TEST_IOCTL_BASE(88)
+typedef struct
+{
+    NvU32                           iterations;                                         // In
+    NvBool                          pools_enabled;                                      // Out
+    NvU64                           num_cache_allocs_no_pool NV_ALIGN_BYTES(8);         // Out
+    NvU64                           num_cache_allocs_pool NV_ALIGN_BYTES(8);            // Out
+    NV_STATUS                       rmStatus;                                           // Out
+} UVM_TEST_VA_BLOCK_SCRATCH_POOL_PARAMS;
+
+// Add, look up and remove thread contexts concurrently from num_threads kernel
+// threads. Used to measure how the thread context table scales with the number
+// of threads.
+#define UVM_TEST_THREAD_CONTEXT_SCALING                 UVM8_TEST_IOCTL_BASE(89)
+typedef struct
+{
+    // Number of concurrent threads, in [1, 512]
+    NvU32                           num_threads;                                        // In
+
+    // Iterations run by each thread. Each iteration adds a thread context,
+    // looks it up the given number of times, and removes it.
+    NvU32                           iterations;                                         // In
+    NvU32                           lookups;                                            // In
+
+    // Average and maximum, across threads, of the average iteration time in
+    // nanoseconds
+    NvU64                           ns NV_ALIGN_BYTES(8);                               // Out
+    NvU64                           max_ns NV_ALIGN_BYTES(8);                           // Out
+
+    NV_STATUS                       rmStatus;                                           // Out
+} UVM_TEST_THREAD_CONTEXT_SCALING_PARAMS;
+
+// Alloc/free churn benchmark of uvm_range_allocator_t. num_allocs allocations
+// are kept live, and each of the iters iterations frees a random one and
+// allocates a new one.
+#define UVM_TEST_RANGE_ALLOCATOR_BENCHMARK              UVM8_TEST_IOCTL_BASE(90)
+typedef struct
+{
+    NvU32                           seed;                                               // In
+    NvU32                           iters;                                              // In
+    NvU32                           num_allocs;                                         // In
+
+    // Allocation sizes are in [min_size, max_size], with a log distribution
+    NvU64                           min_size NV_ALIGN_BYTES(8);                         // In
+    NvU64                           max_size NV_ALIGN_BYTES(8);                         // In
+
+    // Alignments are powers of two up to 1 << max_alignment_log2, in [0, 32]
+    NvU32                           max_alignment_log2;                                 // In
+
+    // Average time of uvm_range_allocator_alloc and uvm_range_allocator_free
+    // in nanoseconds
+    NvU64                           alloc_ns NV_ALIGN_BYTES(8);                         // Out
+    NvU64                           free_ns NV_ALIGN_BYTES(8);                          // Out
+
+    // Allocations that failed because no free range fit them
+    NvU64                           failed_allocs NV_ALIGN_BYTES(8);                    // Out
+
+    NV_STATUS                       rmStatus;                                           // Out
+} UVM_TEST_RANGE_ALLOCATOR_BENCHMARK_PARAMS;
+
+// Set the default format on the default_queue_fd queue and the compact format
+// on the compact_queue_fd queue, enable the type of entry on both and inject
+// count copies of entry with UVM_TEST_INJECT_TOOLS_EVENT. Then check that both
+// queues describe the same events and return the number of queue buffer bytes
+// used by each format. The format of each queue is also checked to be locked
+// once events are enabled, and to stay locked after they are disabled again.
+//
+// Both fds must be tools queue event trackers of the calling VA space, with no
+// events enabled so far, which are not consumed during the test. Their queue
+// buffers must fit twice count entries, and at least 16 entries.
+// UvmEventTypeMigration and UvmEventTypeGpuFault events are recorded in
+// batches, like the driver does, and address_stride is added to the address
+// of each event to exercise the delta encoding.
+#define UVM_TEST_TOOLS_EVENT_FORMAT                     UVM8_TEST_IOCTL_BASE(91)
+typedef struct
+{
+    NvS32                           default_queue_fd;                                   // In
+    NvS32                           compact_queue_fd;                                   // In
+    UvmEventEntry                   entry;                                              // In
+    NvU32                           count;                                              // In
+    NvU64                           address_stride NV_ALIGN_BYTES(8);                   // In
+
+    NvU64                           default_bytes NV_ALIGN_BYTES(8);                    // Out
+    NvU64                           compact_bytes NV_ALIGN_BYTES(8);                    // Out
+
+    NV_STATUS                       rmStatus;                                           // Out
+} UVM_TEST_TOOLS_EVENT_FORMAT_PARAMS;
+
+// Exercise UVM_MIGRATE_FLAG_DEFERRED and UVM_MIGRATE_CANCEL on the VA space:
+// execution of deferred migrations, reporting of deferred errors, the
+// maximum queue depth and cancellation of pending migrations. Any deferred
+// migrations pending on the VA space are canceled first.
+#define UVM_TEST_MIGRATE_DEFERRED                       UVM8_TEST_IOCTL_BASE(92)
+typedef struct
+{
+    NV_STATUS                       rmStatus;                                           // Out
+} UVM_TEST_MIGRATE_DEFERRED_PARAMS;
+
+#define UVM_TEST_MIGRATE_PAGEABLE_WINDOWS               UVM8_TEST_IOCTL_BASE(93)
+typedef struct
+{
+    NV_STATUS                       rmStatus;                                           // Out
+} UVM_TEST_MIGRATE_PAGEABLE_WINDOWS_PARAMS;
+
+// Populate the given range with the UVM_POPULATE_PAGEABLE_FLAG_PARALLEL path
+// and check the accounting of the populated pages and of the threads used. The
+// range must be fully backed by writable pageable VMAs.
+#define UVM_TEST_POPULATE_PAGEABLE_PARALLEL             UVM8_TEST_IOCTL_BASE(94)
+typedef struct
+{
+    NvU64                           base NV_ALIGN_BYTES(8);                             // In
+    NvU64                           length NV_ALIGN_BYTES(8);                           // In
+
+    NvU64                           numPages NV_ALIGN_BYTES(8);                         // Out
+    NvU64                           pagesPerSec NV_ALIGN_BYTES(8);                      // Out
+    NvU32                           numThreads;                                         // Out
+    NV_STATUS                       rmStatus;                                           // Out
+} UVM_TEST_POPULATE_PAGEABLE_PARALLEL_PARAMS;
+
+// Record numProducers * eventsPerProducer events into the queue_fd queue from
+// the calling thread alone, and then the same number of events again from
+// numProducers threads recording eventsPerProducer events each at the same
+// time. Every event is checked to be in the queue exactly once and in the order
+// its producer recorded it. The time taken by each phase is returned, so that
+// the cost of the contention between concurrent producers can be compared to a
+// single producer.
+//
+// queue_fd must be a tools queue event tracker of the calling VA space in the
+// default format, with no events enabled and nothing recorded so far, which is
+// not consumed during the test. Its queue buffer must fit more than twice
+// numProducers * eventsPerProducer entries. numProducers is at most 64.
+#define UVM_TEST_TOOLS_QUEUE_PRODUCERS                  UVM8_TEST_IOCTL_BASE(95)
+typedef struct
+{
+    NvS32                           queue_fd;                                           // In
+    NvU32                           numProducers;                                       // In
+    NvU32                           eventsPerProducer;                                  // In
+
+    NvU64                           singleProducerNs NV_ALIGN_BYTES(8);                 // Out
+    NvU64                           multiProducerNs NV_ALIGN_BYTES(8);                  // Out
+
+    NV_STATUS                       rmStatus;                                           // Out
+} UVM_TEST_TOOLS_QUEUE_PRODUCERS_PARAMS;
+
 #ifdef __cplusplus
 }
 #endif
@@ -34,13 +34,14 @@
 // is a table of UVM_THREAD_CONTEXT_TABLE_SIZE entries of type
 // uvm_thread_context_table_entry_t.
 // Each entry contains a small array of UVM_THREAD_CONTEXT_ARRAY_SIZE entries,
-// a red-black tree, and a lock protecting the tree.
+// a singly-linked list of overflow segments, each one containing another array
+// of the same size, a red-black tree, and a lock protecting the tree.
 //
 // The thread_context_non_interrupt_table_entry() function maps the current task
 // (i.e. the current thread context) to a table entry. That function also
 // recommends a position within the entry's array, but that index can be safely
-// ignored: the thread context can be located in any array slot, or in the
-// red-black tree.
+// ignored: the thread context can be located in any array slot, in any of the
+// overflow segments, or in the red-black tree.
 //
 // The described global data structures try to minimize contention among
 // threads at two levels. First, thread_context_non_interrupt_table_entry()
@@ -48,8 +49,13 @@
 // Second, when several threads are mapped to the same table entry, the same
 // hash function spreads them evenly among the array entries, which can
 // be independently and atomically updated. If the array is full, the thread
-// context of the current task is stored in the red-black tree of the table
-// entry, which is protected by a single lock.
+// context of the current task is stored in the first overflow segment with a
+// free slot. A new segment is appended to the list when all the segments are
+// full. Segments are never freed until the global thread context exit, so the
+// list can be traversed without locking: an array slot is only claimed,
+// released, or updated by the task that owns it, so the lookup of the current
+// thread context never takes a lock. The red-black tree, which is protected by
+// a single lock, is only used if a segment allocation fails.
 //
 // Both the table and array entries are cache aligned to avoid false sharing
 // overheads due to cache thrashing between concurrent operations on separate
@@ -57,6 +63,10 @@
 
 #define UVM_THREAD_CONTEXT_ARRAY_SIZE 8
 
+// Value of uvm_thread_context_t::array_index when the context is not stored in
+// any array slot
+#define UVM_THREAD_CONTEXT_ARRAY_INDEX_NONE ((NvU32)-1)
+
 typedef struct  {
     void *acquired[UVM_LOCK_ORDER_COUNT];
 } uvm_thread_context_lock_acquired_t;
@@ -69,17 +79,32 @@ typedef struct  {
     uvm_thread_context_t *thread_context;
 } ____cacheline_aligned_in_smp uvm_thread_context_array_entry_t;
 
-// The thread's context information is stored in the array or the red-black
-// tree.
+// Overflow array, used when the array of the table entry is full. Segment k in
+// the list (starting at 1) covers the array indices in
+// [k * UVM_THREAD_CONTEXT_ARRAY_SIZE, (k + 1) * UVM_THREAD_CONTEXT_ARRAY_SIZE)
+typedef struct uvm_thread_context_segment_struct {
+    uvm_thread_context_array_entry_t array[UVM_THREAD_CONTEXT_ARRAY_SIZE];
+
+    // Only written once, when the next segment is appended
+    struct uvm_thread_context_segment_struct *next;
+} uvm_thread_context_segment_t;
+
+// The thread's context information is stored in the array, the overflow
+// segments, or the red-black tree.
 typedef struct  {
     // Small array where thread contexts are stored first. Each array entry
     // can be atomically claimed or released.
     uvm_thread_context_array_entry_t array[UVM_THREAD_CONTEXT_ARRAY_SIZE];
 
-    // Red-black tree, used when the array is full. A red-black tree is chosen
-    // because additions and removals are frequent operations: every time the
-    // UVM module is entered, there is one addition, one removal, and one
-    // lookup. The same UVM call may result on additional lookups.
+    // List of overflow segments. New segments are atomically appended at the
+    // tail.
+    uvm_thread_context_segment_t *segments;
+
+    // Number of thread contexts in the tree. Lookups skip the tree, and its
+    // lock, when zero.
+    atomic_t tree_count;
+
+    // Red-black tree, used when a new overflow segment cannot be allocated.
     struct rb_root tree;
 
     // Spinlock protecting the tree. A raw lock is chosen because UVM locks
@@ -102,14 +127,46 @@ static DEFINE_PER_CPU(uvm_thread_context_lock_acquired_t, interrupt_thread_conte
 static void thread_context_non_interrupt_remove(uvm_thread_context_t *thread_context,
                                                 uvm_thread_context_table_entry_t *thread_context_entry);
 
+// Return the array entry at the given index of the table entry. The index
+// covers both the array of the table entry and the overflow segments, which
+// must contain the index.
+static uvm_thread_context_array_entry_t *thread_context_array_entry(uvm_thread_context_table_entry_t *table_entry,
+                                                                    NvU32 array_index)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_thread_context_segment_t *segment;
+    NvU32 segment_index = array_index / UVM_THREAD_CONTEXT_ARRAY_SIZE;
+
+    if (segment_index == 0)
+        return table_entry->array + array_index;
+
+    segment = READ_ONCE(table_entry->segments);
+    while (--segment_index > 0)
+        segment = READ_ONCE(segment->next);
+
+    UVM_ASSERT(segment != NULL);
+
+    return segment->array + (array_index % UVM_THREAD_CONTEXT_ARRAY_SIZE);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Number of array entries in the table entry, including the ones in the
+// overflow segments
+static NvU32 thread_context_array_entry_count(uvm_thread_context_table_entry_t *table_entry)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_thread_context_segment_t *segment;
+    NvU32 count = UVM_THREAD_CONTEXT_ARRAY_SIZE;
+
+    for (segment = READ_ONCE(table_entry->segments); segment != NULL; segment = READ_ONCE(segment->next))
+        count += UVM_THREAD_CONTEXT_ARRAY_SIZE;
+
+    return count;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 bool uvm_thread_context_wrapper_is_used()
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    // The wrapper contains lock information. While uvm_record_lock_X
-    // routines are a no-op outside of debug mode, unit tests do invoke their
-    // internal counterparts __uvm_record_lock_X. To add coverage, lock
-    // information is made available in develop and release modes if the
-    // builtin tests are enabled.
-    return UVM_IS_DEBUG() || uvm_enable_builtin_tests;
+    // The wrapper contains lock information, which is only needed if lock
+    // tracking is enabled. Unit tests that invoke the internal
+    // __uvm_record_lock_X routines require lock tracking to be enabled.
+    return uvm_lock_tracking_enabled();
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 bool uvm_thread_context_global_initialized(void)
@@ -128,6 +185,8 @@ void uvm_thread_context_global_init(void)
 
         spin_lock_init(&table_entry->tree_lock);
         table_entry->tree = RB_ROOT;
+        table_entry->segments = NULL;
+        atomic_set(&table_entry->tree_count, 0);
     }
 
     g_thread_context_table_initialized = true;
@@ -151,9 +210,12 @@ void uvm_thread_context_global_exit(void)
         struct rb_node *node;
         uvm_thread_context_table_entry_t *table_entry = g_thread_context_table + table_index;
 
-        for (array_index = 0; array_index < UVM_THREAD_CONTEXT_ARRAY_SIZE; array_index++) {
+        uvm_thread_context_segment_t *segment;
+        size_t array_count = thread_context_array_entry_count(table_entry);
+
+        for (array_index = 0; array_index < array_count; array_index++) {
             uvm_thread_context_t *thread_context;
-            uvm_thread_context_array_entry_t *array_entry = table_entry->array + array_index;
+            uvm_thread_context_array_entry_t *array_entry = thread_context_array_entry(table_entry, array_index);
 
             NvU64 task = atomic64_read(&array_entry->task);
 
@@ -183,6 +245,16 @@ void uvm_thread_context_global_exit(void)
             thread_context_non_interrupt_remove(thread_context, table_entry);
             node = rb_first(&table_entry->tree);
         }
+
+        segment = table_entry->segments;
+        while (segment) {
+            uvm_thread_context_segment_t *next = segment->next;
+
+            kfree(segment);
+            segment = next;
+        }
+
+        table_entry->segments = NULL;
     }
 
     g_thread_context_table_initialized = false;
@@ -275,7 +347,7 @@ static void thread_context_non_interrupt_init(uvm_thread_context_t *thread_conte
     UVM_ASSERT(!in_interrupt());
 
     RB_CLEAR_NODE(&thread_context->node);
-    thread_context->array_index = UVM_THREAD_CONTEXT_ARRAY_SIZE;
+    thread_context->array_index = UVM_THREAD_CONTEXT_ARRAY_INDEX_NONE;
 
     if (uvm_thread_context_wrapper_is_used()) {
         uvm_thread_context_wrapper_t *thread_context_wrapper;
@@ -337,6 +409,7 @@ static uvm_thread_context_t *thread_context_non_interrupt(void)
     unsigned long flags;
     size_t i, array_index;
     uvm_thread_context_t *thread_context;
+    uvm_thread_context_segment_t *segment;
     uvm_thread_context_table_entry_t *table_entry = thread_context_non_interrupt_table_entry(&array_index);
 
     for (i = array_index; i < (UVM_THREAD_CONTEXT_ARRAY_SIZE + array_index); i++) {
@@ -353,6 +426,30 @@ static uvm_thread_context_t *thread_context_non_interrupt(void)
         }
     }
 
+    // Only the current task can claim or release an entry containing the
+    // current task, so the overflow segments can be searched without a lock.
+    array_index = UVM_THREAD_CONTEXT_ARRAY_SIZE;
+    for (segment = READ_ONCE(table_entry->segments); segment != NULL; segment = READ_ONCE(segment->next)) {
+        for (i = 0; i < UVM_THREAD_CONTEXT_ARRAY_SIZE; i++, array_index++) {
+            uvm_thread_context_array_entry_t *array_entry = segment->array + i;
+
+            if (atomic64_read(&array_entry->task) == (NvU64) current) {
+                thread_context = array_entry->thread_context;
+
+                UVM_ASSERT(thread_context != NULL);
+                UVM_ASSERT(thread_context->array_index == array_index);
+
+                return thread_context;
+            }
+        }
+    }
+
+    // The tree count is only incremented by the task inserting the thread
+    // context in the tree, so if the current task has a thread context in the
+    // tree, the count is not zero.
+    if (atomic_read(&table_entry->tree_count) == 0)
+        return NULL;
+
     spin_lock_irqsave(&table_entry->tree_lock, flags);
     thread_context = thread_context_non_interrupt_tree_search(&table_entry->tree, current);
     spin_unlock_irqrestore(&table_entry->tree_lock, flags);
@@ -396,21 +493,89 @@ uvm_thread_context_t *uvm_thread_context(void)
     return thread_context;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Speculatively claim the given array entry for thread_context, if no array
+// entry has been claimed yet. Returns false if the task of thread_context is
+// found to be already associated with a different thread context, in which
+// case any previous speculative claim is undone.
+static bool thread_context_array_entry_try_claim(uvm_thread_context_t *thread_context,
+                                                 uvm_thread_context_table_entry_t *table_entry,
+                                                 uvm_thread_context_array_entry_t *array_entry,
+                                                 NvU32 array_index)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU64 task = (NvU64) thread_context->task;
+
+    if (thread_context->array_index == UVM_THREAD_CONTEXT_ARRAY_INDEX_NONE) {
+        NvU64 old = atomic64_cmpxchg(&array_entry->task, 0, task);
+
+        // Task already added a different thread context. There is nothing
+        // to undo because the current thread context has not been inserted.
+        if (old == task)
+            return false;
+
+        // Speculatively add the current thread context.
+        if (old == 0)
+            thread_context->array_index = array_index;
+    }
+    else if (atomic64_read(&array_entry->task) == task) {
+
+        // Task already added a different thread context to the array, so
+        // undo the speculative insertion
+        atomic64_set(&thread_context_array_entry(table_entry, thread_context->array_index)->task, 0);
+
+        return false;
+    }
+
+    return true;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Allocate a new overflow segment, with its first array entry claimed for
+// thread_context, and append it to the table entry. If a different segment is
+// concurrently appended at the same position, the new segment is freed and the
+// appended one is returned, so the caller can search it.
+static uvm_thread_context_segment_t *thread_context_segment_append(uvm_thread_context_t *thread_context,
+                                                                   uvm_thread_context_segment_t **segment_ptr,
+                                                                   NvU32 array_index)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_thread_context_segment_t *old;
+    uvm_thread_context_segment_t *segment = kzalloc(sizeof(*segment), NV_UVM_GFP_FLAGS);
+
+    if (segment == NULL)
+        return NULL;
+
+    atomic64_set(&segment->array[0].task, (NvU64) thread_context->task);
+    segment->array[0].thread_context = thread_context;
+
+    // The cmpxchg is a full barrier, so the contents of the segment are
+    // visible before the segment is reachable from the table entry.
+    old = cmpxchg(segment_ptr, NULL, segment);
+    if (old != NULL) {
+        kfree(segment);
+        return old;
+    }
+
+    thread_context->array_index = array_index;
+
+    return segment;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 // The addition logic takes into account that there may be a different thread
 // context already associated with the given task. This happens in the uncommon
 // case of re-entering the UVM module. Therefore, it is worth approaching the
 // addition in a optimistic (speculative) fashion: if a slot is empty in the
-// array, it is immediately taken. Should we discover later on that the task
-// already has a thread context associated with it in the rest of the array or
-// the tree, the previously claimed array slot is released.
+// array or the overflow segments, it is immediately taken. Should we discover
+// later on that the task already has a thread context associated with it in the
+// rest of the array, the segments or the tree, the previously claimed array
+// slot is released.
 static bool thread_context_non_interrupt_add(uvm_thread_context_t *thread_context,
                                              uvm_thread_context_table_entry_t *table_entry,
                                              size_t array_index_hint)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     size_t i;
     NvU64 task;
+    NvU32 array_index;
     unsigned long flags;
     bool added;
+    uvm_thread_context_segment_t **segment_ptr;
 
     UVM_ASSERT(!in_interrupt());
     UVM_ASSERT(thread_context != NULL);
@@ -420,7 +585,7 @@ static bool thread_context_non_interrupt_add(uvm_thread_context_t *thread_contex
     UVM_ASSERT(array_index_hint < UVM_THREAD_CONTEXT_ARRAY_SIZE);
 
     thread_context_non_interrupt_init(thread_context);
-    UVM_ASSERT(thread_context->array_index == UVM_THREAD_CONTEXT_ARRAY_SIZE);
+    UVM_ASSERT(thread_context->array_index == UVM_THREAD_CONTEXT_ARRAY_INDEX_NONE);
 
     task = (NvU64) thread_context->task;
     UVM_ASSERT(task > 0);
@@ -429,50 +594,66 @@ static bool thread_context_non_interrupt_add(uvm_thread_context_t *thread_contex
         const size_t curr_array_index = i % UVM_THREAD_CONTEXT_ARRAY_SIZE;
         uvm_thread_context_array_entry_t *array_entry = table_entry->array + curr_array_index;
 
-        if (thread_context->array_index == UVM_THREAD_CONTEXT_ARRAY_SIZE) {
-            NvU64 old = atomic64_cmpxchg(&array_entry->task, 0, task);
+        if (!thread_context_array_entry_try_claim(thread_context, table_entry, array_entry, curr_array_index))
+            return false;
+    }
+
+    // Search the overflow segments, appending a new one if all of them are full
+    segment_ptr = &table_entry->segments;
+    array_index = UVM_THREAD_CONTEXT_ARRAY_SIZE;
+    while (true) {
+        uvm_thread_context_segment_t *segment = READ_ONCE(*segment_ptr);
 
-            // Task already added a different thread context. There is nothing
-            // to undo because the current thread context has not been inserted.
-            if (old == task)
-                return false;
+        if (segment == NULL) {
+            if (thread_context->array_index != UVM_THREAD_CONTEXT_ARRAY_INDEX_NONE)
+                break;
 
-            // Speculatively add the current thread context.
-            if (old == 0)
-                thread_context->array_index = curr_array_index;
+            // If the allocation fails, fall back to the tree
+            segment = thread_context_segment_append(thread_context, segment_ptr, array_index);
+            if (segment == NULL || thread_context->array_index != UVM_THREAD_CONTEXT_ARRAY_INDEX_NONE)
+                break;
         }
-        else if (atomic64_read(&array_entry->task) == task) {
 
-            // Task already added a different thread context to the array, so
-            // undo the speculative insertion
-            atomic64_set(&table_entry->array[thread_context->array_index].task, 0);
-
-            return false;
+        for (i = 0; i < UVM_THREAD_CONTEXT_ARRAY_SIZE; i++) {
+            if (!thread_context_array_entry_try_claim(thread_context, table_entry, segment->array + i, array_index + i))
+                return false;
         }
+
+        segment_ptr = &segment->next;
+        array_index += UVM_THREAD_CONTEXT_ARRAY_SIZE;
+    }
+
+    // Fast path: the task cannot have a thread context in the tree
+    if (thread_context->array_index != UVM_THREAD_CONTEXT_ARRAY_INDEX_NONE &&
+        atomic_read(&table_entry->tree_count) == 0) {
+        thread_context_array_entry(table_entry, thread_context->array_index)->thread_context = thread_context;
+        return true;
     }
 
     spin_lock_irqsave(&table_entry->tree_lock, flags);
 
-    if (thread_context->array_index == UVM_THREAD_CONTEXT_ARRAY_SIZE) {
+    if (thread_context->array_index == UVM_THREAD_CONTEXT_ARRAY_INDEX_NONE) {
 
         // If the task already added a different thread context to the tree,
         // there is nothing to undo because the current thread context has not
         // been inserted.
         added = thread_context_non_interrupt_tree_insert(&table_entry->tree, thread_context);
+        if (added)
+            atomic_inc(&table_entry->tree_count);
     }
     else if (thread_context_non_interrupt_tree_search(&table_entry->tree, thread_context->task) != NULL) {
 
         // Task already added a different thread context to the tree, so undo
         // the speculative insertion
-        atomic64_set(&table_entry->array[thread_context->array_index].task, 0);
+        atomic64_set(&thread_context_array_entry(table_entry, thread_context->array_index)->task, 0);
 
         added = false;
     }
     else {
 
         // Speculative insertion succeeded: a thread context associated with the
-        // same task has not been found in the array or the tree.
-        table_entry->array[thread_context->array_index].thread_context = thread_context;
+        // same task has not been found in the array, the segments or the tree.
+        thread_context_array_entry(table_entry, thread_context->array_index)->thread_context = thread_context;
         added = true;
     }
 
@@ -521,18 +702,16 @@ static void thread_context_non_interrupt_remove(uvm_thread_context_t *thread_con
     UVM_ASSERT(table_entry - g_thread_context_table < UVM_THREAD_CONTEXT_TABLE_SIZE);
 
     array_index = thread_context->array_index;
-    UVM_ASSERT(array_index <= UVM_THREAD_CONTEXT_ARRAY_SIZE);
 
     // We cannot use RB_EMPTY_NODE to determine if the thread context is in the
     // tree, because the tree lock is not held. If the thread context is indeed
     // in the tree, concurrent operations on the parent pointer/color of the
     // thread context's node could result on RB_EMPTY_NODE(thread_context->node)
     // being true.
-    if (array_index != UVM_THREAD_CONTEXT_ARRAY_SIZE) {
+    if (array_index != UVM_THREAD_CONTEXT_ARRAY_INDEX_NONE) {
 
-        uvm_thread_context_array_entry_t *array_entry = table_entry->array + array_index;
+        uvm_thread_context_array_entry_t *array_entry = thread_context_array_entry(table_entry, array_index);
 
-        UVM_ASSERT(array_index < UVM_THREAD_CONTEXT_ARRAY_SIZE);
         UVM_ASSERT(atomic64_read(&array_entry->task) == (NvU64) thread_context->task);
 
         // Clear the task. The memory barrier prevents the write from being
@@ -551,6 +730,7 @@ static void thread_context_non_interrupt_remove(uvm_thread_context_t *thread_con
 
         spin_lock_irqsave(&table_entry->tree_lock, flags);
         rb_erase(&thread_context->node, &table_entry->tree);
+        atomic_dec(&table_entry->tree_count);
         spin_unlock_irqrestore(&table_entry->tree_lock, flags);
     }
 
@@ -64,8 +64,9 @@ struct uvm_thread_context_struct
     // This field is ignored in interrupt paths
     struct task_struct *task;
 
-    // This context is present at the given array index if array_index is less
-    // than UVM_THREAD_CONTEXT_ARRAY_SIZE; otherwise is in the tree.
+    // This context is present at the given array index, which covers the array
+    // of its table entry and the overflow segments, unless array_index is
+    // UVM_THREAD_CONTEXT_ARRAY_INDEX_NONE; in that case it is in the tree.
     //
     // This field is ignored in interrupt paths
     NvU32 array_index;
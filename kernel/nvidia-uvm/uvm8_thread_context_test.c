@@ -138,3 +138,155 @@ NV_STATUS uvm8_test_thread_context_sanity(UVM_TEST_THREAD_CONTEXT_SANITY_PARAMS
 
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+#define THREAD_CONTEXT_SCALING_MAX_THREADS 512
+
+struct thread_context_scaling_struct;
+
+typedef struct
+{
+    nv_kthread_q_t q;
+
+    nv_kthread_q_item_t q_item;
+
+    struct thread_context_scaling_struct *scaling;
+
+    // Average time, in nanoseconds, of each iteration run by the worker
+    NvU64 ns;
+
+    NV_STATUS status;
+} thread_context_scaling_worker_t;
+
+typedef struct thread_context_scaling_struct
+{
+    NvU32 num_threads;
+
+    NvU32 iterations;
+
+    NvU32 lookups;
+
+    // Number of workers that are ready to start the measured loop
+    atomic_t num_ready;
+
+    // Number of workers that have not finished yet
+    atomic_t num_pending;
+
+    struct completion done;
+
+    thread_context_scaling_worker_t workers[];
+} thread_context_scaling_t;
+
+static void thread_context_scaling_lookups(NvU32 lookups, uvm_thread_context_t **thread_context)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 i;
+
+    for (i = 0; i < lookups; i++)
+        *thread_context = uvm_thread_context();
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void thread_context_scaling_worker(void *args)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    thread_context_scaling_worker_t *worker = (thread_context_scaling_worker_t *)args;
+    thread_context_scaling_t *scaling = worker->scaling;
+    uvm_thread_context_t *thread_context = NULL;
+    NvU64 start;
+    NvU32 i;
+
+    // Wait for all the workers, so their thread contexts are added, looked up
+    // and removed concurrently. There may be more workers than CPUs, so yield
+    // while waiting.
+    atomic_inc(&scaling->num_ready);
+    while (atomic_read(&scaling->num_ready) < scaling->num_threads)
+        schedule();
+
+    start = NV_GETTIME();
+
+    for (i = 0; i < scaling->iterations; i++) {
+        UVM_ENTRY_VOID(thread_context_scaling_lookups(scaling->lookups, &thread_context));
+
+        // The worker has no thread context of its own, so each iteration adds
+        // a new one and removes it
+        if (uvm_thread_context_present())
+            worker->status = NV_ERR_INVALID_STATE;
+    }
+
+    worker->ns = (NV_GETTIME() - start) / scaling->iterations;
+
+    if (scaling->lookups > 0 && thread_context == NULL)
+        worker->status = NV_ERR_INVALID_STATE;
+
+    if (atomic_dec_and_test(&scaling->num_pending))
+        complete(&scaling->done);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Measure the cost of adding, looking up and removing thread contexts from
+// num_threads concurrent threads. Each thread is a kthread that does not hold a
+// thread context, so every UVM_ENTRY_VOID invocation goes through the global
+// thread context table.
+NV_STATUS uvm8_test_thread_context_scaling(UVM_TEST_THREAD_CONTEXT_SCALING_PARAMS *params, struct file *filp)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    thread_context_scaling_t *scaling;
+    NV_STATUS status = NV_OK;
+    NvU64 total_ns = 0;
+    NvU32 num_started;
+    NvU32 i;
+
+    if (params->num_threads == 0 || params->num_threads > THREAD_CONTEXT_SCALING_MAX_THREADS)
+        return NV_ERR_INVALID_ARGUMENT;
+
+    if (params->iterations == 0)
+        return NV_ERR_INVALID_ARGUMENT;
+
+    scaling = uvm_kvmalloc_zero(sizeof(*scaling) + sizeof(scaling->workers[0]) * params->num_threads);
+    if (!scaling)
+        return NV_ERR_NO_MEMORY;
+
+    scaling->num_threads = params->num_threads;
+    scaling->iterations = params->iterations;
+    scaling->lookups = params->lookups;
+    atomic_set(&scaling->num_ready, 0);
+    atomic_set(&scaling->num_pending, params->num_threads);
+    init_completion(&scaling->done);
+
+    for (num_started = 0; num_started < params->num_threads; num_started++) {
+        thread_context_scaling_worker_t *worker = &scaling->workers[num_started];
+
+        worker->scaling = scaling;
+        worker->status = NV_OK;
+
+        status = errno_to_nv_status(nv_kthread_q_init(&worker->q, "UVM thread context scaling"));
+        if (status != NV_OK)
+            break;
+
+        nv_kthread_q_item_init(&worker->q_item, thread_context_scaling_worker, worker);
+    }
+
+    // Only schedule the workers once all of the queues exist, since the workers
+    // wait for each other
+    if (status == NV_OK) {
+        for (i = 0; i < params->num_threads; i++)
+            nv_kthread_q_schedule_q_item(&scaling->workers[i].q, &scaling->workers[i].q_item);
+
+        wait_for_completion(&scaling->done);
+
+        params->max_ns = 0;
+        for (i = 0; i < params->num_threads; i++) {
+            thread_context_scaling_worker_t *worker = &scaling->workers[i];
+
+            if (worker->status != NV_OK)
+                status = worker->status;
+
+            total_ns += worker->ns;
+            params->max_ns = max(params->max_ns, worker->ns);
+        }
+
+        params->ns = total_ns / params->num_threads;
+    }
+
+    for (i = 0; i < num_started; i++)
+        nv_kthread_q_stop(&scaling->workers[i].q);
+
+    uvm_kvfree(scaling);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -24,11 +24,33 @@
 
 #include "uvm8_tlb_batch.h"
 #include "uvm8_hal.h"
+#include "uvm8_gpu.h"
+
+#include <linux/sort.h>
+
+typedef enum
+{
+    // Targeted VA invalidates for each of the ranges
+    TLB_BATCH_FLUSH_VA,
+
+    // Invalidate all because targeted VA invalidates are not supported
+    TLB_BATCH_FLUSH_ALL_UNSUPPORTED,
+
+    // Invalidate all because the ranges didn't fit in the batch
+    TLB_BATCH_FLUSH_ALL_OVERFLOW,
+
+    // Invalidate all because it is cheaper than the targeted VA invalidates
+    TLB_BATCH_FLUSH_ALL_COST,
+} tlb_batch_flush_type_t;
 
 void uvm_tlb_batch_begin(uvm_page_tree_t *tree, uvm_tlb_batch_t *batch)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    memset(batch, 0, sizeof(*batch));
     batch->tree = tree;
+    batch->count = 0;
+    batch->total_invalidates = 0;
+    batch->overflow = false;
+    batch->biggest_page_size = 0;
+    batch->membar = UVM_MEMBAR_NONE;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 static NvU32 smallest_page_size(NvU32 page_sizes)
@@ -45,15 +67,100 @@ static NvU32 biggest_page_size(NvU32 page_sizes)
     return 1u << __fls(page_sizes);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-static void tlb_batch_flush_invalidate_per_va(uvm_tlb_batch_t *batch, uvm_push_t *push)
+static int tlb_batch_range_cmp(const void *a, const void *b)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    const uvm_tlb_batch_range_t *range_a = a;
+    const uvm_tlb_batch_range_t *range_b = b;
+
+    if (range_a->start < range_b->start)
+        return -1;
+
+    return range_a->start > range_b->start;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Sort the queued up ranges and merge the adjacent and overlapping ones. The
+// merged range invalidates all the page sizes of the original ranges, which is
+// always correct as the smallest page size determines the density of the
+// targeted invalidate and the biggest one its depth.
+static void tlb_batch_coalesce(uvm_tlb_batch_t *batch)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_tlb_batch_range_t *ranges = batch->ranges;
+    NvU32 new_count;
+    NvU32 i;
+
+    if (batch->count < 2)
+        return;
+
+    sort(ranges, batch->count, sizeof(ranges[0]), tlb_batch_range_cmp, NULL);
+
+    new_count = 1;
+    for (i = 1; i < batch->count; ++i) {
+        uvm_tlb_batch_range_t *last = &ranges[new_count - 1];
+        uvm_tlb_batch_range_t *range = &ranges[i];
+
+        if (range->start <= last->start + last->size) {
+            NvU64 end = max(last->start + last->size, range->start + range->size);
+
+            last->size = end - last->start;
+            last->page_sizes |= range->page_sizes;
+        }
+        else {
+            ranges[new_count++] = *range;
+        }
+    }
+
+    atomic64_add(batch->count - new_count, &batch->tree->gpu->tlb_batch.stats.merged_ranges);
+
+    batch->count = new_count;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Number of targeted invalidate methods needed for the ranges
+static NvU64 tlb_batch_va_invalidate_count(uvm_gpu_t *gpu, const uvm_tlb_batch_range_t *ranges, NvU32 count)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU64 invalidates = 0;
+    NvU32 i;
+
+    if (gpu->tlb_batch.va_range_invalidate_supported)
+        return count;
+
+    for (i = 0; i < count; ++i)
+        invalidates += uvm_div_pow2_64(ranges[i].size, smallest_page_size(ranges[i].page_sizes));
+
+    return invalidates;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static tlb_batch_flush_type_t tlb_batch_flush_type(uvm_gpu_t *gpu,
+                                                   const uvm_tlb_batch_range_t *ranges,
+                                                   NvU32 count,
+                                                   bool overflow)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU64 va_invalidates;
+
+    if (!gpu->tlb_batch.va_invalidate_supported)
+        return TLB_BATCH_FLUSH_ALL_UNSUPPORTED;
+
+    if (overflow)
+        return TLB_BATCH_FLUSH_ALL_OVERFLOW;
+
+    va_invalidates = tlb_batch_va_invalidate_count(gpu, ranges, count);
+    if (va_invalidates * gpu->tlb_batch.va_invalidate_cost > gpu->tlb_batch.invalidate_all_cost)
+        return TLB_BATCH_FLUSH_ALL_COST;
+
+    return TLB_BATCH_FLUSH_VA;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void tlb_batch_flush_invalidate_per_va(uvm_page_tree_t *tree,
+                                              const uvm_tlb_batch_range_t *ranges,
+                                              NvU32 count,
+                                              uvm_push_t *push,
+                                              uvm_membar_t tlb_membar)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    uvm_page_tree_t *tree = batch->tree;
     uvm_gpu_phys_address_t pdb_addr = uvm_page_tree_pdb(tree)->addr;
     uvm_membar_t membar = UVM_MEMBAR_NONE;
     NvU32 i;
 
-    for (i = 0; i < batch->count; ++i) {
-        uvm_tlb_batch_range_t *entry = &batch->ranges[i];
+    for (i = 0; i < count; ++i) {
+        const uvm_tlb_batch_range_t *entry = &ranges[i];
         NvU32 min_page_size = smallest_page_size(entry->page_sizes);
         NvU32 max_page_size = biggest_page_size(entry->page_sizes);
 
@@ -63,8 +170,8 @@ static void tlb_batch_flush_invalidate_per_va(uvm_tlb_batch_t *batch, uvm_push_t
         UVM_ASSERT(hweight32(entry->page_sizes) > 0);
 
         // Do the required membar only after the last invalidate
-        if (i == batch->count - 1)
-            membar = batch->membar;
+        if (i == count - 1)
+            membar = tlb_membar;
 
         // Use the min page size for the targeted VA invalidate as each page
         // needs to be invalidated separately.
@@ -73,40 +180,64 @@ static void tlb_batch_flush_invalidate_per_va(uvm_tlb_batch_t *batch, uvm_push_t
     }
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-static void tlb_batch_flush_invalidate_all(uvm_tlb_batch_t *batch, uvm_push_t *push)
+static void tlb_batch_flush_invalidate_all(uvm_page_tree_t *tree,
+                                           NvU32 max_page_size,
+                                           uvm_push_t *push,
+                                           uvm_membar_t tlb_membar)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    uvm_page_tree_t *tree = batch->tree;
     uvm_gpu_t *gpu = tree->gpu;
-    NvU32 page_table_depth = tree->hal->page_table_depth(batch->biggest_page_size);
+    NvU32 page_table_depth = tree->hal->page_table_depth(max_page_size);
 
-    gpu->host_hal->tlb_invalidate_all(push, uvm_page_tree_pdb(tree)->addr, page_table_depth, batch->membar);
+    gpu->host_hal->tlb_invalidate_all(push, uvm_page_tree_pdb(tree)->addr, page_table_depth, tlb_membar);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-static bool tlb_batch_should_invalidate_all(uvm_tlb_batch_t *batch)
+static void tlb_batch_flush(uvm_page_tree_t *tree,
+                            const uvm_tlb_batch_range_t *ranges,
+                            NvU32 count,
+                            bool overflow,
+                            NvU32 max_page_size,
+                            uvm_push_t *push,
+                            uvm_membar_t tlb_membar)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    if (!batch->tree->gpu->tlb_batch.va_invalidate_supported)
-        return true;
-
-    if (batch->count > UVM_TLB_BATCH_MAX_ENTRIES)
-        return true;
+    uvm_gpu_t *gpu = tree->gpu;
 
-    if (batch->tree->gpu->tlb_batch.va_range_invalidate_supported)
-        return batch->total_ranges > batch->tree->gpu->tlb_batch.max_ranges;
+    switch (tlb_batch_flush_type(gpu, ranges, count, overflow)) {
+        case TLB_BATCH_FLUSH_VA:
+            tlb_batch_flush_invalidate_per_va(tree, ranges, count, push, tlb_membar);
+            atomic64_inc(&gpu->tlb_batch.stats.va_flushes);
+            atomic64_add(count, &gpu->tlb_batch.stats.va_flush_ranges);
+            return;
+        case TLB_BATCH_FLUSH_ALL_UNSUPPORTED:
+            atomic64_inc(&gpu->tlb_batch.stats.all_flushes_unsupported);
+            break;
+        case TLB_BATCH_FLUSH_ALL_OVERFLOW:
+            atomic64_inc(&gpu->tlb_batch.stats.all_flushes_overflow);
+            break;
+        case TLB_BATCH_FLUSH_ALL_COST:
+            atomic64_inc(&gpu->tlb_batch.stats.all_flushes_cost);
+            break;
+    }
 
-    return batch->total_pages > batch->tree->gpu->tlb_batch.max_pages;
+    tlb_batch_flush_invalidate_all(tree, max_page_size, push, tlb_membar);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 void uvm_tlb_batch_end(uvm_tlb_batch_t *batch, uvm_push_t *push, uvm_membar_t tlb_membar)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    if (batch->count == 0)
+    if (batch->total_invalidates == 0)
         return;
 
     batch->membar = uvm_membar_max(tlb_membar, batch->membar);
 
-    if (tlb_batch_should_invalidate_all(batch))
-        tlb_batch_flush_invalidate_all(batch, push);
-    else
-        tlb_batch_flush_invalidate_per_va(batch, push);
+    if (!batch->overflow)
+        tlb_batch_coalesce(batch);
+
+    tlb_batch_flush(batch->tree,
+                    batch->ranges,
+                    batch->count,
+                    batch->overflow,
+                    batch->biggest_page_size,
+                    push,
+                    batch->membar);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 void uvm_tlb_batch_invalidate(uvm_tlb_batch_t *batch, NvU64 start, NvU64 size, NvU32 page_sizes, uvm_membar_t tlb_membar)
@@ -115,20 +246,37 @@ void uvm_tlb_batch_invalidate(uvm_tlb_batch_t *batch, NvU64 start, NvU64 size, N
 
     batch->membar = uvm_membar_max(tlb_membar, batch->membar);
 
-    ++batch->count;
-
-    if (batch->tree->gpu->tlb_batch.va_range_invalidate_supported)
-        batch->total_ranges++;
-    else
-        batch->total_pages += uvm_div_pow2_64(size, smallest_page_size(page_sizes));
+    ++batch->total_invalidates;
 
     batch->biggest_page_size = max(batch->biggest_page_size, biggest_page_size(page_sizes));
 
-    if (tlb_batch_should_invalidate_all(batch))
+    // Don't bother tracking the ranges if they will be ignored anyway
+    if (batch->overflow || !batch->tree->gpu->tlb_batch.va_invalidate_supported)
         return;
 
-    new_entry = &batch->ranges[batch->count - 1];
+    if (batch->count == UVM_TLB_BATCH_MAX_ENTRIES) {
+        tlb_batch_coalesce(batch);
+
+        if (batch->count == UVM_TLB_BATCH_MAX_ENTRIES) {
+            batch->overflow = true;
+            return;
+        }
+    }
+
+    new_entry = &batch->ranges[batch->count++];
     new_entry->start = start;
     new_entry->size = size;
     new_entry->page_sizes = page_sizes;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_tlb_batch_single_invalidate(uvm_page_tree_t *tree, uvm_push_t *push,
+        NvU64 start, NvU64 size, NvU32 page_sizes, uvm_membar_t tlb_membar)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_tlb_batch_range_t range;
+
+    range.start = start;
+    range.size = size;
+    range.page_sizes = page_sizes;
+
+    tlb_batch_flush(tree, &range, 1, false, biggest_page_size(page_sizes), push, tlb_membar);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -28,13 +28,14 @@
 #include "uvm8_forward_decl.h"
 #include "uvm8_hal_types.h"
 
-// Max number of separate VA ranges to track before falling back to invalidate all.
-// TLB batches take space on the stack so this number should be big enough to
-// cover our common cases, but not bigger.
+// Max number of separate VA ranges to track before falling back to invalidate
+// all. When the batch fills up, the queued up ranges are sorted and adjacent or
+// overlapping ones are merged to make room, so a batch can track many more
+// invalidates that cover only a few disjoint ranges.
 //
-// TODO: Bug 1767241: Once we have all the paths using TLB invalidates
-//       implemented, verify whether it makes sense.
-#define UVM_TLB_BATCH_MAX_ENTRIES 4
+// TLB batches are only embedded in heap allocated structures (the VA block
+// context and the GPU fault buffer info), never on the stack.
+#define UVM_TLB_BATCH_MAX_ENTRIES 32
 
 typedef struct
 {
@@ -49,20 +50,19 @@ struct uvm_tlb_batch_struct
 {
     uvm_page_tree_t *tree;
 
-    union
-    {
-        // Total number of pages covered by the queued up ranges so far
-        NvU32 total_pages;
-
-        // Total number of ranges that have been invalidated so far
-        // Each range can be invalidated using a single Host method on supported GPUs
-        NvU32 total_ranges;
-    };
-
-    // Queued up ranges to invalidate
+    // Queued up ranges to invalidate. They are kept in the order they were
+    // queued up until the batch is coalesced.
     uvm_tlb_batch_range_t ranges[UVM_TLB_BATCH_MAX_ENTRIES];
     NvU32 count;
 
+    // Total number of invalidates queued up, including the ones not tracked
+    // in ranges because the batch already needs an invalidate all
+    NvU32 total_invalidates;
+
+    // Set when the queued up ranges didn't fit in the batch even after
+    // merging them. The batch is then ended with an invalidate all.
+    bool overflow;
+
     // Biggest page size across all queued up invalidates
     NvU32 biggest_page_size;
 
@@ -87,7 +87,11 @@ void uvm_tlb_batch_invalidate(uvm_tlb_batch_t *batch, NvU64 start, NvU64 size, N
 // End a TLB invalidate batch
 //
 // This will push the required TLB invalidate to invalidate all the queued up
-// ranges.
+// ranges. Adjacent and overlapping ranges are merged first, and then the
+// per-architecture cost model in gpu->tlb_batch decides whether to push a
+// targeted VA invalidate per range (or per page, if range invalidates are not
+// supported) or a single invalidate all. Each decision is counted in
+// gpu->tlb_batch.stats.
 //
 // The tlb_membar argument has the same behavior as in uvm_tlb_batch_invalidate.
 // This allows callers which use the same membar for all calls to
@@ -97,15 +101,9 @@ void uvm_tlb_batch_end(uvm_tlb_batch_t *batch, uvm_push_t *push, uvm_membar_t tl
 
 // Helper for invalidating a single range immediately.
 //
-// Internally begins and ends a TLB batch.
-static void uvm_tlb_batch_single_invalidate(uvm_page_tree_t *tree, uvm_push_t *push,
-        NvU64 start, NvU64 size, NvU32 page_sizes, uvm_membar_t tlb_membar)
-{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    uvm_tlb_batch_t batch;
-
-    uvm_tlb_batch_begin(tree, &batch);
-    uvm_tlb_batch_invalidate(&batch, start, size, page_sizes, UVM_MEMBAR_NONE);
-    uvm_tlb_batch_end(&batch, push, tlb_membar);
-pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+// Makes the same decisions as a TLB batch with a single range, without
+// requiring a uvm_tlb_batch_t.
+void uvm_tlb_batch_single_invalidate(uvm_page_tree_t *tree, uvm_push_t *push,
+        NvU64 start, NvU64 size, NvU32 page_sizes, uvm_membar_t tlb_membar);
 
 #endif // __UVM8_TLB_BATCH_H__
@@ -35,6 +35,7 @@
 #include "uvm8_forward_decl.h"
 #include "uvm8_range_group.h"
 #include "uvm8_mem.h"
+#include "uvm8_test.h"
 #include "nv_speculation_barrier.h"
 
 // We limit the number of times a page can be retained by the kernel
@@ -50,9 +51,12 @@ typedef struct
     NvU32 put_behind;
 } uvm_tools_queue_snapshot_t;
 
+// Bit set in uvm_tools_queue_t::wakeup_get when the stored get_ahead value is
+// valid, i.e. when a wakeup was already issued for it.
+#define UVM_TOOLS_WAKEUP_GET_VALID 0x80000000u
+
 typedef struct
 {
-    uvm_spinlock_t lock;
     NvU64 subscribed_queues;
     struct list_head queue_nodes[UvmEventNumTypesAll];
 
@@ -61,14 +65,67 @@ typedef struct
     NvU32 queue_buffer_count;
     NvU32 notification_threshold;
 
+    // UvmToolsEventFormat of the records in the queue buffer
+    NvU32 format;
+
+    // Set the first time events are enabled on the queue. The format can't be
+    // changed after that: records of the current format can be in the buffer
+    // even once the events are disabled again or the put pointers wrap back
+    // to 0. Protected by the tools lock of the VA space.
+    bool format_locked;
+
+    // Size of the queue buffer in the units indexed by the get/put pointers:
+    // entries in the default format, 8-byte words in the compact format.
+    NvU32 ring_size;
+
     struct page **control_buffer_pages;
     UvmToolsEventControlData *control;
 
+    // Producer indices. Entries are reserved by advancing put_ahead with
+    // cmpxchg and committed in reservation order by advancing put_behind, so
+    // concurrent producers don't serialize on a lock while copying entries.
+    // These are kernel-private copies of the pointers in control: user space
+    // can write to control at any time, so its values are never used to
+    // decide how long a producer waits.
+    atomic_t put_ahead;
+    atomic_t put_behind;
+
     wait_queue_head_t wait_queue;
-    bool is_wakeup_get_valid;
-    NvU32 wakeup_get;
+
+    // get_ahead value for which a wakeup has already been issued, or'ed with
+    // UVM_TOOLS_WAKEUP_GET_VALID. Cleared by poll. Used to coalesce the wakeups
+    // of concurrent producers into a single one per consumer read.
+    atomic_t wakeup_get;
 } uvm_tools_queue_t;
 
+// Maximum number of delta items in a batch of events
+#define UVM_TOOLS_EVENT_BATCH_MAX_ITEMS 8
+
+// Smallest queue, in entries, that can use the compact format. It guarantees
+// that the largest record plus the padding before it always fit in the queue.
+#define UVM_TOOLS_COMPACT_QUEUE_MIN_ENTRIES 16
+
+typedef union
+{
+    UvmEventMigrationDeltaItem migration;
+    UvmEventGpuFaultDeltaItem gpuFault;
+} uvm_tools_event_delta_item_t;
+
+// Events of the same type recorded together, such as the per-page migration
+// events of a VA block. The compact format stores them in a single record, with
+// each event after the first one encoded as a delta item.
+typedef struct
+{
+    // First event of the batch
+    UvmEventEntry base;
+
+    // Last event added to the batch, which the next delta item is relative to
+    UvmEventEntry last;
+
+    NvU32 count;
+    uvm_tools_event_delta_item_t items[UVM_TOOLS_EVENT_BATCH_MAX_ITEMS];
+} uvm_tools_event_batch_t;
+
 typedef struct
 {
     struct list_head counter_nodes[UVM_TOTAL_COUNTERS];
@@ -189,6 +246,8 @@ static nv_kthread_q_t g_tools_queue;
 
 static NV_STATUS tools_update_status(uvm_va_space_t *va_space);
 
+static const struct file_operations uvm_tools_fops;
+
 static uvm_tools_event_tracker_t *tools_event_tracker(struct file *filp)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     long event_tracker = atomic_long_read((atomic_long_t *)&filp->private_data);
@@ -353,10 +412,13 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 static bool queue_needs_wakeup(uvm_tools_queue_t *queue, uvm_tools_queue_snapshot_t *sn)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    NvU32 queue_mask = queue->queue_buffer_count - 1;
+    NvU32 queue_mask = queue->ring_size - 1;
 
-    uvm_assert_spinlock_locked(&queue->lock);
-    return ((queue->queue_buffer_count + sn->put_behind - sn->get_ahead) & queue_mask) >= queue->notification_threshold;
+    // The notification threshold is in entries, also in the compact format
+    NvU32 units_per_entry = queue->ring_size / queue->queue_buffer_count;
+    NvU64 threshold = (NvU64)UVM_READ_ONCE(queue->notification_threshold) * units_per_entry;
+
+    return ((queue->ring_size + sn->put_behind - sn->get_ahead) & queue_mask) >= threshold;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 static void destroy_event_tracker(uvm_tools_event_tracker_t *event_tracker)
@@ -419,12 +481,123 @@ static void destroy_event_tracker(uvm_tools_event_tracker_t *event_tracker)
     kmem_cache_free(g_tools_event_tracker_cache, event_tracker);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Wake up the consumer if the queue is above the notification threshold. Only
+// one wakeup is issued per value of get_ahead, no matter how many producers
+// observe the same state.
+static void queue_wakeup_if_needed(uvm_tools_queue_t *queue, uvm_tools_queue_snapshot_t *sn)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    int wakeup_get = (int)(sn->get_ahead | UVM_TOOLS_WAKEUP_GET_VALID);
+    int old_wakeup_get;
+
+    if (!queue_needs_wakeup(queue, sn))
+        return;
+
+    old_wakeup_get = atomic_read(&queue->wakeup_get);
+    if (old_wakeup_get == wakeup_get)
+        return;
+
+    // Only the producer that installs the new value issues the wakeup
+    if (atomic_cmpxchg(&queue->wakeup_get, old_wakeup_get, wakeup_get) == old_wakeup_get)
+        wake_up_all(&queue->wait_queue);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Size of the event structure of the given type, which is all that the compact
+// format stores for an event
+static NvU32 tools_event_size(NvU8 eventType)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    static const NvU32 event_sizes[UvmEventNumTypesAll] = {
+        [UvmEventTypeCpuFault]                = sizeof(UvmEventCpuFaultInfo),
+        [UvmEventTypeMigration]               = sizeof(UvmEventMigrationInfo),
+        [UvmEventTypeGpuFault]                = sizeof(UvmEventGpuFaultInfo),
+        [UvmEventTypeGpuFaultReplay]          = sizeof(UvmEventGpuFaultReplayInfo),
+        [UvmEventTypeFatalFault]              = sizeof(UvmEventFatalFaultInfo),
+        [UvmEventTypeReadDuplicate]           = sizeof(UvmEventReadDuplicateInfo),
+        [UvmEventTypeReadDuplicateInvalidate] = sizeof(UvmEventReadDuplicateInvalidateInfo),
+        [UvmEventTypePageSizeChange]          = sizeof(UvmEventPageSizeChangeInfo),
+        [UvmEventTypeThrashingDetected]       = sizeof(UvmEventThrashingDetectedInfo),
+        [UvmEventTypeThrottlingStart]         = sizeof(UvmEventThrottlingStartInfo),
+        [UvmEventTypeThrottlingEnd]           = sizeof(UvmEventThrottlingEndInfo),
+        [UvmEventTypeMapRemote]               = sizeof(UvmEventMapRemoteInfo),
+        [UvmEventTypeEviction]                = sizeof(UvmEventEvictionInfo),
+        [UvmEventTypeTestAccessCounter]       = sizeof(UvmEventTestAccessCounterInfo),
+    };
+
+    UVM_ASSERT(eventType < UvmEventNumTypesAll);
+
+    if (event_sizes[eventType] == 0)
+        return sizeof(UvmEventEntry);
+
+    return event_sizes[eventType];
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Reserve size consecutive units of the queue ring, where a unit is an entry in
+// the default format and a word in the compact format. Since records cannot
+// wrap around the end of the ring, pad is set to the number of units skipped
+// before the reservation, which start at put. Returns false if the queue is
+// full.
+//
+// ctrl is mapped into user space with read and write permissions, so its values
+// cannot be trusted. A bogus get_behind can only cause entries to be dropped or
+// overwritten, never the producer to wait.
+static bool queue_reserve(uvm_tools_queue_t *queue, NvU32 size, NvU32 *put, NvU32 *pad)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UvmToolsEventControlData *ctrl = queue->control;
+    NvU32 queue_mask = queue->ring_size - 1;
+    NvU32 get_behind;
+
+    do {
+        *put = atomic_read(&queue->put_ahead);
+        get_behind = atomic_read((atomic_t *)&ctrl->get_behind) & queue_mask;
+
+        if (*put + size > queue->ring_size)
+            *pad = queue->ring_size - *put;
+        else
+            *pad = 0;
+
+        // One unit is always left free so that a full queue can be told apart
+        // from an empty one
+        if (((get_behind - *put - 1) & queue_mask) < *pad + size)
+            return false;
+    } while (atomic_cmpxchg(&queue->put_ahead, *put, (*put + *pad + size) & queue_mask) != *put);
+
+    return true;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Commit the size units reserved at put by queue_reserve, once they have been
+// written.
+static void queue_commit(uvm_tools_queue_t *queue, NvU32 put, NvU32 size)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UvmToolsEventControlData *ctrl = queue->control;
+    NvU32 put_behind = (put + size) & (queue->ring_size - 1);
+
+    // Commit in reservation order: the consumer reads every entry before
+    // put_behind, so it can only move past this entry once all the previous
+    // ones have been written.
+    while (atomic_read(&queue->put_behind) != put)
+        cpu_relax();
+
+    // Order the previous producer's stores to ctrl before ours
+    smp_mb();
+
+    // put_ahead and put_behind are published together and are always the same
+    // in ctrl. This allows the user-space consumer to choose either a 2 or 4
+    // pointer synchronization approach.
+    atomic_set((atomic_t *)&ctrl->put_ahead, put_behind);
+    atomic_set((atomic_t *)&ctrl->put_behind, put_behind);
+
+    // Pairs with the smp_mb() above in the next producer
+    smp_wmb();
+    atomic_set(&queue->put_behind, put_behind);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 static void enqueue_event(const UvmEventEntry *entry, uvm_tools_queue_t *queue)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     UvmToolsEventControlData *ctrl = queue->control;
     uvm_tools_queue_snapshot_t sn;
-    NvU32 queue_size = queue->queue_buffer_count;
-    NvU32 queue_mask = queue_size - 1;
+    NvU32 put;
+    NvU32 pad;
+
+    UVM_ASSERT(queue->format == UvmToolsEventFormatDefault);
 
     // Prevent processor speculation prior to accessing user-mapped memory to
     // avoid leaking information from side-channel attacks. There are many
@@ -434,38 +607,96 @@ static void enqueue_event(const UvmEventEntry *entry, uvm_tools_queue_t *queue)
     // safe side we'll just always block speculation.
     nv_speculation_barrier();
 
-    uvm_spin_lock(&queue->lock);
+    // Preemption is disabled between reserving a slot and committing it, since
+    // producers that reserved later slots wait for this one to be committed.
+    preempt_disable();
 
-    // ctrl is mapped into user space with read and write permissions,
-    // so its values cannot be trusted.
-    sn.get_behind = atomic_read((atomic_t *)&ctrl->get_behind) & queue_mask;
-    sn.put_behind = atomic_read((atomic_t *)&ctrl->put_behind) & queue_mask;
-    sn.put_ahead = (sn.put_behind + 1) & queue_mask;
-
-    // one free element means that the queue is full
-    if (((queue_size + sn.get_behind - sn.put_behind) & queue_mask) == 1) {
+    if (!queue_reserve(queue, 1, &put, &pad)) {
+        preempt_enable();
         atomic64_inc((atomic64_t *)&ctrl->dropped + entry->eventData.eventType);
-        goto unlock;
+        return;
     }
 
-    memcpy(queue->queue + sn.put_behind, entry, sizeof(*entry));
+    UVM_ASSERT(pad == 0);
+
+    memcpy(queue->queue + put, entry, sizeof(*entry));
 
-    sn.put_behind = sn.put_ahead;
-    // put_ahead and put_behind will always be the same outside of queue->lock
-    // this allows the user-space consumer to choose either a 2 or 4 pointer synchronization approach
-    atomic_set((atomic_t *)&ctrl->put_ahead, sn.put_behind);
-    atomic_set((atomic_t *)&ctrl->put_behind, sn.put_behind);
+    queue_commit(queue, put, 1);
 
+    preempt_enable();
+
+    sn.put_behind = atomic_read(&queue->put_behind);
     sn.get_ahead = atomic_read((atomic_t *)&ctrl->get_ahead);
-    // if the queue needs to be woken up, only signal if we haven't signaled before for this value of get_ahead
-    if (queue_needs_wakeup(queue, &sn) && !(queue->is_wakeup_get_valid && queue->wakeup_get == sn.get_ahead)) {
-        queue->is_wakeup_get_valid = true;
-        queue->wakeup_get = sn.get_ahead;
-        wake_up_all(&queue->wait_queue);
+    queue_wakeup_if_needed(queue, &sn);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Write a compact format record made of the event in base followed by count
+// delta items. See UvmEventCompactHeader.
+static void enqueue_compact_record(uvm_tools_queue_t *queue,
+                                   const UvmEventEntry *base,
+                                   NvU32 count,
+                                   const void *items,
+                                   size_t items_size)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UvmToolsEventControlData *ctrl = queue->control;
+    uvm_tools_queue_snapshot_t sn;
+    UvmEventCompactHeader header;
+    NvU64 *ring = (NvU64 *)queue->queue;
+    NvU8 eventType = base->eventData.eventType;
+    NvU32 event_size = UVM_ALIGN_UP(tools_event_size(eventType), sizeof(NvU64));
+    NvU8 *record;
+    NvU32 put;
+    NvU32 pad;
+
+    UVM_ASSERT(queue->format == UvmToolsEventFormatCompact);
+    UVM_ASSERT(IS_ALIGNED(items_size, sizeof(NvU64)));
+
+    memset(&header, 0, sizeof(header));
+    header.eventType = eventType;
+    header.count = count;
+    header.size = (sizeof(header) + event_size + items_size) / sizeof(NvU64);
+
+    // See the comment in enqueue_event
+    nv_speculation_barrier();
+
+    preempt_disable();
+
+    if (!queue_reserve(queue, header.size, &put, &pad)) {
+        preempt_enable();
+        atomic64_add(count + 1, (atomic64_t *)&ctrl->dropped + eventType);
+        return;
+    }
+
+    if (pad != 0) {
+        UvmEventCompactHeader pad_header;
+
+        memset(&pad_header, 0, sizeof(pad_header));
+        pad_header.eventType = UvmEventTypeInvalid;
+        pad_header.size = pad;
+        memcpy(ring + put, &pad_header, sizeof(pad_header));
     }
 
-unlock:
-    uvm_spin_unlock(&queue->lock);
+    record = (NvU8 *)(ring + ((put + pad) & (queue->ring_size - 1)));
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), base, event_size);
+    if (items_size != 0)
+        memcpy(record + sizeof(header) + event_size, items, items_size);
+
+    queue_commit(queue, put, pad + header.size);
+
+    preempt_enable();
+
+    sn.put_behind = atomic_read(&queue->put_behind);
+    sn.get_ahead = atomic_read((atomic_t *)&ctrl->get_ahead);
+    queue_wakeup_if_needed(queue, &sn);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void queue_record_event(uvm_tools_queue_t *queue, const UvmEventEntry *entry)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (queue->format == UvmToolsEventFormatCompact)
+        enqueue_compact_record(queue, entry, 0, NULL, 0);
+    else
+        enqueue_event(entry, queue);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 static void uvm_tools_record_event(uvm_va_space_t *va_space, const UvmEventEntry *entry)
@@ -478,7 +709,203 @@ static void uvm_tools_record_event(uvm_va_space_t *va_space, const UvmEventEntry
     uvm_assert_rwsem_locked(&va_space->tools.lock);
 
     list_for_each_entry(queue, va_space->tools.queues + eventType, queue_nodes[eventType])
-        enqueue_event(entry, queue);
+        queue_record_event(queue, entry);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static bool fits_in_s32(NvU64 delta)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return (NvS64)delta == (NvS32)delta;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Encode entry as a delta item relative to prev, the previous event of the
+// batch started by base. Returns false if entry cannot be delta-encoded.
+static bool event_batch_encode_delta(const UvmEventEntry *base,
+                                     const UvmEventEntry *prev,
+                                     const UvmEventEntry *entry,
+                                     void *item)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (entry->eventData.eventType == UvmEventTypeMigration) {
+        const UvmEventMigrationInfo *info = &entry->eventData.migration;
+        const UvmEventMigrationInfo *base_info = &base->eventData.migration;
+        const UvmEventMigrationInfo *prev_info = &prev->eventData.migration;
+        UvmEventMigrationDeltaItem *delta = item;
+
+        if (info->srcIndex != base_info->srcIndex ||
+            info->dstIndex != base_info->dstIndex ||
+            info->migrationCause != base_info->migrationCause ||
+            info->beginTimeStamp != base_info->beginTimeStamp ||
+            info->endTimeStamp != base_info->endTimeStamp ||
+            info->rangeGroupId != base_info->rangeGroupId)
+            return false;
+
+        if (!fits_in_s32(info->address - prev_info->address) ||
+            info->migratedBytes > UINT_MAX ||
+            !fits_in_s32(info->beginTimeStampGpu - prev_info->beginTimeStampGpu) ||
+            info->endTimeStampGpu < info->beginTimeStampGpu ||
+            info->endTimeStampGpu - info->beginTimeStampGpu > UINT_MAX)
+            return false;
+
+        delta->addressDelta = (NvS32)(info->address - prev_info->address);
+        delta->migratedBytes = (NvU32)info->migratedBytes;
+        delta->beginTimeStampGpuDelta = (NvS32)(info->beginTimeStampGpu - prev_info->beginTimeStampGpu);
+        delta->durationGpu = (NvU32)(info->endTimeStampGpu - info->beginTimeStampGpu);
+
+        return true;
+    }
+    else if (entry->eventData.eventType == UvmEventTypeGpuFault) {
+        const UvmEventGpuFaultInfo *info = &entry->eventData.gpuFault;
+        const UvmEventGpuFaultInfo *base_info = &base->eventData.gpuFault;
+        const UvmEventGpuFaultInfo *prev_info = &prev->eventData.gpuFault;
+        UvmEventGpuFaultDeltaItem *delta = item;
+
+        if (info->gpuIndex != base_info->gpuIndex ||
+            info->timeStamp != base_info->timeStamp ||
+            info->batchId != base_info->batchId)
+            return false;
+
+        if (!fits_in_s32(info->address - prev_info->address) ||
+            !fits_in_s32(info->timeStampGpu - prev_info->timeStampGpu))
+            return false;
+
+        memset(delta, 0, sizeof(*delta));
+        delta->addressDelta = (NvS32)(info->address - prev_info->address);
+        delta->timeStampGpuDelta = (NvS32)(info->timeStampGpu - prev_info->timeStampGpu);
+        delta->gpcId = info->gpcId;
+        delta->clientId = info->clientId;
+        delta->faultType = info->faultType;
+        delta->accessType = info->accessType;
+        delta->clientType = info->clientType;
+
+        return true;
+    }
+
+    return false;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Turn entry, which contains the previous event of a batch, into the event
+// described by the delta item.
+static void event_batch_decode_delta(UvmEventEntry *entry, const void *item)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (entry->eventData.eventType == UvmEventTypeMigration) {
+        UvmEventMigrationInfo *info = &entry->eventData.migration;
+        const UvmEventMigrationDeltaItem *delta = item;
+
+        info->address += (NvS64)delta->addressDelta;
+        info->migratedBytes = delta->migratedBytes;
+        info->beginTimeStampGpu += (NvS64)delta->beginTimeStampGpuDelta;
+        info->endTimeStampGpu = info->beginTimeStampGpu + delta->durationGpu;
+    }
+    else {
+        UvmEventGpuFaultInfo *info = &entry->eventData.gpuFault;
+        const UvmEventGpuFaultDeltaItem *delta = item;
+
+        UVM_ASSERT(entry->eventData.eventType == UvmEventTypeGpuFault);
+
+        info->address += (NvS64)delta->addressDelta;
+        info->timeStampGpu += (NvS64)delta->timeStampGpuDelta;
+        info->gpcId = delta->gpcId;
+        info->clientId = delta->clientId;
+        info->faultType = delta->faultType;
+        info->accessType = delta->accessType;
+        info->clientType = delta->clientType;
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static bool tools_event_is_batchable(NvU8 eventType)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return eventType == UvmEventTypeMigration || eventType == UvmEventTypeGpuFault;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void tools_event_batch_init(uvm_tools_event_batch_t *batch)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    batch->count = 0;
+    batch->base.eventData.eventType = UvmEventTypeInvalid;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static bool tools_event_batch_is_empty(uvm_tools_event_batch_t *batch)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return batch->base.eventData.eventType == UvmEventTypeInvalid;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Add entry to the batch. Returns false if the batch is full or if entry cannot
+// be delta-encoded relative to the events in the batch, in which case the batch
+// needs to be recorded before entry is added.
+static bool tools_event_batch_add(uvm_tools_event_batch_t *batch, const UvmEventEntry *entry)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ASSERT(tools_event_is_batchable(entry->eventData.eventType));
+
+    if (tools_event_batch_is_empty(batch)) {
+        batch->base = *entry;
+        batch->last = *entry;
+        return true;
+    }
+
+    if (batch->count == UVM_TOOLS_EVENT_BATCH_MAX_ITEMS ||
+        entry->eventData.eventType != batch->base.eventData.eventType)
+        return false;
+
+    if (!event_batch_encode_delta(&batch->base, &batch->last, entry, &batch->items[batch->count]))
+        return false;
+
+    batch->last = *entry;
+    batch->count++;
+
+    return true;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void queue_record_event_batch(uvm_tools_queue_t *queue, const uvm_tools_event_batch_t *batch)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UvmEventEntry entry;
+    NvU32 i;
+
+    if (queue->format == UvmToolsEventFormatCompact) {
+        enqueue_compact_record(queue,
+                               &batch->base,
+                               batch->count,
+                               batch->items,
+                               batch->count * sizeof(batch->items[0]));
+        return;
+    }
+
+    entry = batch->base;
+    enqueue_event(&entry, queue);
+
+    for (i = 0; i < batch->count; i++) {
+        event_batch_decode_delta(&entry, &batch->items[i]);
+        enqueue_event(&entry, queue);
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Record the events in the batch in all the queues of the VA space, and empty
+// the batch
+static void uvm_tools_record_event_batch(uvm_va_space_t *va_space, uvm_tools_event_batch_t *batch)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU8 eventType = batch->base.eventData.eventType;
+    uvm_tools_queue_t *queue;
+
+    uvm_assert_rwsem_locked(&va_space->tools.lock);
+
+    if (tools_event_batch_is_empty(batch))
+        return;
+
+    list_for_each_entry(queue, va_space->tools.queues + eventType, queue_nodes[eventType])
+        queue_record_event_batch(queue, batch);
+
+    tools_event_batch_init(batch);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Add entry to the batch, recording the batch first if entry doesn't fit in
+// it. The caller must record the batch after its last event is added.
+static void uvm_tools_record_event_batched(uvm_va_space_t *va_space,
+                                           uvm_tools_event_batch_t *batch,
+                                           const UvmEventEntry *entry)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (tools_event_batch_add(batch, entry))
+        return;
+
+    uvm_tools_record_event_batch(va_space, batch);
+
+    tools_event_batch_add(batch, entry);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 static void uvm_tools_broadcast_event(const UvmEventEntry *entry)
@@ -625,6 +1052,7 @@ static long uvm_tools_unlocked_ioctl(struct file *filp, unsigned int cmd, unsign
         UVM_ROUTE_CMD_STACK_NO_INIT_CHECK(UVM_TOOLS_SET_NOTIFICATION_THRESHOLD, uvm_api_tools_set_notification_threshold);
         UVM_ROUTE_CMD_STACK_NO_INIT_CHECK(UVM_TOOLS_EVENT_QUEUE_ENABLE_EVENTS,  uvm_api_tools_event_queue_enable_events);
         UVM_ROUTE_CMD_STACK_NO_INIT_CHECK(UVM_TOOLS_EVENT_QUEUE_DISABLE_EVENTS, uvm_api_tools_event_queue_disable_events);
+        UVM_ROUTE_CMD_STACK_NO_INIT_CHECK(UVM_TOOLS_EVENT_QUEUE_SET_FORMAT,     uvm_api_tools_event_queue_set_format);
         UVM_ROUTE_CMD_STACK_NO_INIT_CHECK(UVM_TOOLS_ENABLE_COUNTERS,            uvm_api_tools_enable_counters);
         UVM_ROUTE_CMD_STACK_NO_INIT_CHECK(UVM_TOOLS_DISABLE_COUNTERS,           uvm_api_tools_disable_counters);
     }
@@ -653,18 +1081,14 @@ static unsigned uvm_tools_poll(struct file *filp, poll_table *wait)
     if (!tracker_is_queue(event_tracker))
         return POLLERR;
 
-    uvm_spin_lock(&event_tracker->queue.lock);
-
-    event_tracker->queue.is_wakeup_get_valid = false;
+    atomic_set(&event_tracker->queue.wakeup_get, 0);
     ctrl = event_tracker->queue.control;
     sn.get_ahead = atomic_read((atomic_t *)&ctrl->get_ahead);
-    sn.put_behind = atomic_read((atomic_t *)&ctrl->put_behind);
+    sn.put_behind = atomic_read(&event_tracker->queue.put_behind);
 
     if (queue_needs_wakeup(&event_tracker->queue, &sn))
         flags = POLLIN | POLLRDNORM;
 
-    uvm_spin_unlock(&event_tracker->queue.lock);
-
     poll_wait(filp, &event_tracker->queue.wait_queue, wait);
     return flags;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -721,6 +1145,7 @@ static UvmEventFaultClientType g_hal_to_tools_fault_client_type_table[UVM_FAULT_
 
 static void record_gpu_fault_instance(uvm_gpu_t *gpu,
                                       uvm_va_space_t *va_space,
+                                      uvm_tools_event_batch_t *batch,
                                       const uvm_fault_buffer_entry_t *fault_entry,
                                       NvU64 batch_id,
                                       NvU64 timestamp)
@@ -744,7 +1169,7 @@ static void record_gpu_fault_instance(uvm_gpu_t *gpu,
     info->timeStampGpu  = fault_entry->timestamp;
     info->batchId       = batch_id;
 
-    uvm_tools_record_event(va_space, &entry);
+    uvm_tools_record_event_batched(va_space, batch, &entry);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 static void uvm_tools_record_fault(uvm_perf_event_t event_id, uvm_perf_event_data_t *event_data)
@@ -808,11 +1233,16 @@ static void uvm_tools_record_fault(uvm_perf_event_t event_id, uvm_perf_event_dat
             NvU64 timestamp = NV_GETTIME();
             uvm_fault_buffer_entry_t *fault_entry = event_data->fault.gpu.buffer_entry;
             uvm_fault_buffer_entry_t *fault_instance;
+            uvm_tools_event_batch_t batch;
+
+            tools_event_batch_init(&batch);
 
-            record_gpu_fault_instance(gpu, va_space, fault_entry, event_data->fault.gpu.batch_id, timestamp);
+            record_gpu_fault_instance(gpu, va_space, &batch, fault_entry, event_data->fault.gpu.batch_id, timestamp);
 
             list_for_each_entry(fault_instance, &fault_entry->merged_instances_list, merged_instances_list)
-                record_gpu_fault_instance(gpu, va_space, fault_instance, event_data->fault.gpu.batch_id, timestamp);
+                record_gpu_fault_instance(gpu, va_space, &batch, fault_instance, event_data->fault.gpu.batch_id, timestamp);
+
+            uvm_tools_record_event_batch(va_space, &batch);
         }
 
         if (tools_is_counter_enabled(va_space, UvmCounterNameGpuPageFaultCount))
@@ -846,6 +1276,7 @@ static void record_migration_events(void *args)
     UvmEventEntry entry;
     UvmEventMigrationInfo *info = &entry.eventData.migration;
     uvm_va_space_t *va_space = block_mig->va_space;
+    uvm_tools_event_batch_t batch;
 
     NvU64 gpu_timestamp = block_mig->start_timestamp_gpu;
 
@@ -858,6 +1289,8 @@ static void record_migration_events(void *args)
     info->endTimeStamp   = block_mig->end_timestamp_cpu;
     info->rangeGroupId   = block_mig->range_group_id;
 
+    tools_event_batch_init(&batch);
+
     uvm_down_read(&va_space->tools.lock);
     list_for_each_entry_safe(mig, next, &block_mig->events, events_node) {
         UVM_ASSERT(mig->bytes > 0);
@@ -871,8 +1304,9 @@ static void record_migration_events(void *args)
         gpu_timestamp = mig->end_timestamp_gpu;
         kmem_cache_free(g_tools_migration_data_cache, mig);
 
-        uvm_tools_record_event(va_space, &entry);
+        uvm_tools_record_event_batched(va_space, &batch, &entry);
     }
+    uvm_tools_record_event_batch(va_space, &batch);
     uvm_up_read(&va_space->tools.lock);
 
     UVM_ASSERT(list_empty(&block_mig->events));
@@ -1613,8 +2047,10 @@ NV_STATUS uvm_api_tools_init_event_tracker(UVM_TOOLS_INIT_EVENT_TRACKER_PARAMS *
     event_tracker->is_queue = params->queueBufferSize != 0;
     if (event_tracker->is_queue) {
         uvm_tools_queue_t *queue = &event_tracker->queue;
-        uvm_spin_lock_init(&queue->lock, UVM_LOCK_ORDER_LEAF);
         init_waitqueue_head(&queue->wait_queue);
+        atomic_set(&queue->put_ahead, 0);
+        atomic_set(&queue->put_behind, 0);
+        atomic_set(&queue->wakeup_get, 0);
 
         if (params->queueBufferSize > UINT_MAX) {
             status = NV_ERR_INVALID_ARGUMENT;
@@ -1623,6 +2059,8 @@ NV_STATUS uvm_api_tools_init_event_tracker(UVM_TOOLS_INIT_EVENT_TRACKER_PARAMS *
 
         queue->queue_buffer_count = (NvU32)params->queueBufferSize;
         queue->notification_threshold = queue->queue_buffer_count / 2;
+        queue->format = UvmToolsEventFormatDefault;
+        queue->ring_size = queue->queue_buffer_count;
 
         // queue_buffer_count must be a power of 2, of at least 2
         if (!is_power_of_2(queue->queue_buffer_count) || queue->queue_buffer_count < 2) {
@@ -1678,19 +2116,15 @@ NV_STATUS uvm_api_tools_set_notification_threshold(UVM_TOOLS_SET_NOTIFICATION_TH
     if (!tracker_is_queue(event_tracker))
         return NV_ERR_INVALID_ARGUMENT;
 
-    uvm_spin_lock(&event_tracker->queue.lock);
-
-    event_tracker->queue.notification_threshold = params->notificationThreshold;
+    UVM_WRITE_ONCE(event_tracker->queue.notification_threshold, params->notificationThreshold);
 
     ctrl = event_tracker->queue.control;
-    sn.put_behind = atomic_read((atomic_t *)&ctrl->put_behind);
+    sn.put_behind = atomic_read(&event_tracker->queue.put_behind);
     sn.get_ahead = atomic_read((atomic_t *)&ctrl->get_ahead);
 
     if (queue_needs_wakeup(&event_tracker->queue, &sn))
         wake_up_all(&event_tracker->queue.wait_queue);
 
-    uvm_spin_unlock(&event_tracker->queue.lock);
-
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
@@ -1842,6 +2276,9 @@ NV_STATUS uvm_api_tools_event_queue_enable_events(UVM_TOOLS_EVENT_QUEUE_ENABLE_E
                              inserted_lists,
                              &event_tracker->queue.subscribed_queues);
     }
+    else if (event_tracker->queue.subscribed_queues != 0) {
+        event_tracker->queue.format_locked = true;
+    }
 
     uvm_up_write(&va_space->tools.lock);
     uvm_up_write(&va_space->perf_events.lock);
@@ -1880,6 +2317,51 @@ NV_STATUS uvm_api_tools_event_queue_disable_events(UVM_TOOLS_EVENT_QUEUE_DISABLE
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+NV_STATUS uvm_api_tools_event_queue_set_format(UVM_TOOLS_EVENT_QUEUE_SET_FORMAT_PARAMS *params, struct file *filp)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_va_space_t *va_space;
+    uvm_tools_event_tracker_t *event_tracker = tools_event_tracker(filp);
+    uvm_tools_queue_t *queue;
+    NV_STATUS status = NV_OK;
+
+    if (!tracker_is_queue(event_tracker))
+        return NV_ERR_INVALID_ARGUMENT;
+
+    if (params->format >= UvmToolsNumEventFormats)
+        return NV_ERR_INVALID_ARGUMENT;
+
+    queue = &event_tracker->queue;
+
+    // The ring is indexed in 8-byte words in the compact format
+    BUILD_BUG_ON(sizeof(UvmEventEntry) % sizeof(NvU64) != 0);
+    BUILD_BUG_ON((sizeof(UvmEventEntry) & (sizeof(UvmEventEntry) - 1)) != 0);
+
+    if (params->format == UvmToolsEventFormatCompact &&
+        queue->queue_buffer_count < UVM_TOOLS_COMPACT_QUEUE_MIN_ENTRIES)
+        return NV_ERR_INVALID_ARGUMENT;
+
+    va_space = tools_event_tracker_va_space(event_tracker);
+
+    uvm_down_write(&va_space->tools.lock);
+
+    // The meaning of the queue pointers changes with the format, so it can only
+    // be changed before events are enabled for the first time
+    if (queue->format_locked) {
+        status = NV_ERR_INVALID_STATE;
+    }
+    else {
+        queue->format = params->format;
+        if (queue->format == UvmToolsEventFormatCompact)
+            queue->ring_size = queue->queue_buffer_count * (sizeof(UvmEventEntry) / sizeof(NvU64));
+        else
+            queue->ring_size = queue->queue_buffer_count;
+    }
+
+    uvm_up_write(&va_space->tools.lock);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 NV_STATUS uvm_api_tools_enable_counters(UVM_TOOLS_ENABLE_COUNTERS_PARAMS *params, struct file *filp)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     uvm_va_space_t *va_space;
@@ -2083,17 +2565,494 @@ NV_STATUS uvm8_test_inject_tools_event(UVM_TEST_INJECT_TOOLS_EVENT_PARAMS *param
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NvU32 i;
     uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    uvm_tools_event_batch_t batch;
+    UvmEventEntry entry = params->entry;
 
-    if (params->entry.eventData.eventType >= UvmEventNumTypesAll)
+    if (entry.eventData.eventType >= UvmEventNumTypesAll)
         return NV_ERR_INVALID_ARGUMENT;
 
+    tools_event_batch_init(&batch);
+
     uvm_down_read(&va_space->tools.lock);
-    for (i = 0; i < params->count; i++)
-        uvm_tools_record_event(va_space, &params->entry);
+    for (i = 0; i < params->count; i++) {
+        // Batch the event types that the driver records in batches
+        if (tools_event_is_batchable(entry.eventData.eventType))
+            uvm_tools_record_event_batched(va_space, &batch, &entry);
+        else
+            uvm_tools_record_event(va_space, &entry);
+
+        if (entry.eventData.eventType == UvmEventTypeMigration)
+            entry.eventData.migration.address += params->address_stride;
+        else if (entry.eventData.eventType == UvmEventTypeGpuFault)
+            entry.eventData.gpuFault.address += params->address_stride;
+    }
+    uvm_tools_record_event_batch(va_space, &batch);
     uvm_up_read(&va_space->tools.lock);
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Maximum number of events recorded by UVM_TEST_TOOLS_EVENT_FORMAT
+#define UVM_TOOLS_TEST_EVENT_FORMAT_MAX_COUNT 4096
+
+// Get the tools file of a queue event tracker of the given VA space
+static NV_STATUS test_tools_queue_fget(int fd, uvm_va_space_t *va_space, struct file **file_out)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    struct file *file = fget(fd);
+    uvm_tools_event_tracker_t *event_tracker;
+
+    if (!file)
+        return NV_ERR_INVALID_ARGUMENT;
+
+    if (file->f_op != &uvm_tools_fops) {
+        fput(file);
+        return NV_ERR_INVALID_ARGUMENT;
+    }
+
+    event_tracker = tools_event_tracker(file);
+    if (!tracker_is_queue(event_tracker) || tools_event_tracker_va_space(event_tracker) != va_space) {
+        fput(file);
+        return NV_ERR_INVALID_ARGUMENT;
+    }
+
+    *file_out = file;
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Check that the records in the compact queue describe the same events as the
+// entries in the default queue, and return the number of records
+static NV_STATUS test_tools_compact_queue(uvm_tools_queue_t *default_queue,
+                                          uvm_tools_queue_t *compact_queue,
+                                          NvU8 eventType,
+                                          NvU32 count,
+                                          NvU32 *num_records)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU64 *ring = (NvU64 *)compact_queue->queue;
+    NvU32 put_behind = atomic_read(&compact_queue->put_behind);
+    NvU32 event_size = tools_event_size(eventType);
+    NvU32 aligned_event_size = UVM_ALIGN_UP(event_size, sizeof(NvU64));
+    NvU32 num_events = 0;
+    NvU32 pos = 0;
+
+    *num_records = 0;
+
+    TEST_CHECK_RET(atomic_read(&default_queue->put_behind) == count);
+
+    while (pos < put_behind) {
+        UvmEventCompactHeader *header = (UvmEventCompactHeader *)(ring + pos);
+        uvm_tools_event_delta_item_t *items;
+        UvmEventEntry entry;
+        NvU32 i;
+
+        TEST_CHECK_RET(header->eventType == eventType);
+        TEST_CHECK_RET(header->size * sizeof(NvU64) ==
+                       sizeof(*header) + aligned_event_size + header->count * sizeof(*items));
+        TEST_CHECK_RET(pos + header->size <= put_behind);
+
+        memset(&entry, 0, sizeof(entry));
+        memcpy(&entry, header + 1, event_size);
+        items = (uvm_tools_event_delta_item_t *)((NvU8 *)(header + 1) + aligned_event_size);
+
+        for (i = 0; i <= header->count; i++) {
+            if (i > 0)
+                event_batch_decode_delta(&entry, &items[i - 1]);
+
+            TEST_CHECK_RET(num_events < count);
+            TEST_CHECK_RET(memcmp(&entry, default_queue->queue + num_events, event_size) == 0);
+            ++num_events;
+        }
+
+        pos += header->size;
+        ++*num_records;
+    }
+
+    TEST_CHECK_RET(num_events == count);
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NV_STATUS uvm8_test_tools_event_format(UVM_TEST_TOOLS_EVENT_FORMAT_PARAMS *params, struct file *filp)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    struct file *queue_files[2] = {NULL, NULL};
+    uvm_tools_queue_t *queues[2];
+    UVM_TOOLS_EVENT_QUEUE_SET_FORMAT_PARAMS set_format_params;
+    UVM_TOOLS_EVENT_QUEUE_ENABLE_EVENTS_PARAMS enable_params;
+    UVM_TOOLS_EVENT_QUEUE_DISABLE_EVENTS_PARAMS disable_params;
+    UVM_TEST_INJECT_TOOLS_EVENT_PARAMS inject_params;
+    NvU8 eventType = params->entry.eventData.eventType;
+    NvU32 queue_buffer_count;
+    NvU32 num_records;
+    NvU32 i;
+    NvU32 j;
+
+    if (eventType == UvmEventTypeInvalid || eventType >= UvmEventNumTypesAll)
+        return NV_ERR_INVALID_ARGUMENT;
+
+    if (params->count == 0 || params->count > UVM_TOOLS_TEST_EVENT_FORMAT_MAX_COUNT)
+        return NV_ERR_INVALID_ARGUMENT;
+
+    // Twice the events, so that neither queue wraps around. The compact record
+    // of an event that is not batched can be larger than an entry.
+    queue_buffer_count = max((NvU32)roundup_pow_of_two(2 * params->count), (NvU32)UVM_TOOLS_COMPACT_QUEUE_MIN_ENTRIES);
+
+    memset(&set_format_params, 0, sizeof(set_format_params));
+    memset(&enable_params, 0, sizeof(enable_params));
+    memset(&disable_params, 0, sizeof(disable_params));
+    enable_params.eventTypeFlags = 1ULL << eventType;
+    disable_params.eventTypeFlags = 1ULL << eventType;
+
+    // queues[0] uses the default format and queues[1] the compact format
+    status = test_tools_queue_fget(params->default_queue_fd, va_space, &queue_files[0]);
+    if (status != NV_OK)
+        goto done;
+
+    status = test_tools_queue_fget(params->compact_queue_fd, va_space, &queue_files[1]);
+    if (status != NV_OK)
+        goto done;
+
+    if (queue_files[0] == queue_files[1]) {
+        status = NV_ERR_INVALID_ARGUMENT;
+        goto done;
+    }
+
+    for (i = 0; i < 2; i++) {
+        queues[i] = &tools_event_tracker(queue_files[i])->queue;
+        if (queues[i]->queue_buffer_count < queue_buffer_count) {
+            status = NV_ERR_INVALID_ARGUMENT;
+            goto done;
+        }
+    }
+
+    for (i = 0; i < 2; i++) {
+        set_format_params.format = (i == 0) ? UvmToolsEventFormatDefault : UvmToolsEventFormatCompact;
+        TEST_NV_CHECK_GOTO(uvm_api_tools_event_queue_set_format(&set_format_params, queue_files[i]), done);
+        TEST_NV_CHECK_GOTO(uvm_api_tools_event_queue_enable_events(&enable_params, queue_files[i]), done);
+
+        // The format is locked once events are enabled, before anything is
+        // recorded in the queue
+        TEST_CHECK_GOTO(atomic_read(&queues[i]->put_ahead) == 0, done);
+        set_format_params.format = (i == 0) ? UvmToolsEventFormatCompact : UvmToolsEventFormatDefault;
+        TEST_CHECK_GOTO(uvm_api_tools_event_queue_set_format(&set_format_params, queue_files[i]) ==
+                        NV_ERR_INVALID_STATE, done);
+    }
+
+    memset(&inject_params, 0, sizeof(inject_params));
+    inject_params.entry = params->entry;
+    inject_params.count = params->count;
+    inject_params.address_stride = params->address_stride;
+    TEST_NV_CHECK_GOTO(uvm8_test_inject_tools_event(&inject_params, filp), done);
+
+    // The format stays locked after the events are disabled
+    for (i = 0; i < 2; i++) {
+        TEST_NV_CHECK_GOTO(uvm_api_tools_event_queue_disable_events(&disable_params, queue_files[i]), done);
+
+        set_format_params.format = (i == 0) ? UvmToolsEventFormatCompact : UvmToolsEventFormatDefault;
+        TEST_CHECK_GOTO(uvm_api_tools_event_queue_set_format(&set_format_params, queue_files[i]) ==
+                        NV_ERR_INVALID_STATE, done);
+        TEST_CHECK_GOTO(queues[i]->format == ((i == 0) ? UvmToolsEventFormatDefault : UvmToolsEventFormatCompact),
+                        done);
+
+        for (j = 0; j < UvmEventNumTypesAll; j++)
+            TEST_CHECK_GOTO(queues[i]->control->dropped[j] == 0, done);
+    }
+
+    status = test_tools_compact_queue(queues[0], queues[1], eventType, params->count, &num_records);
+    if (status != NV_OK)
+        goto done;
+
+    params->default_bytes = atomic_read(&queues[0]->put_behind) * sizeof(UvmEventEntry);
+    params->compact_bytes = atomic_read(&queues[1]->put_behind) * sizeof(NvU64);
+
+    // Batched events are stored as delta items, which are a fraction of the
+    // size of an entry. Events are only batched if they can be delta-encoded,
+    // which depends on address_stride.
+    if (num_records < params->count)
+        TEST_CHECK_GOTO(params->compact_bytes < params->default_bytes, done);
+
+done:
+    for (i = 0; i < 2; i++) {
+        if (!queue_files[i])
+            continue;
+
+        // Disabling events which aren't enabled is a no-op
+        if (status != NV_OK)
+            uvm_api_tools_event_queue_disable_events(&disable_params, queue_files[i]);
+
+        fput(queue_files[i]);
+    }
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Maximum number of producer threads of UVM_TEST_TOOLS_QUEUE_PRODUCERS
+#define UVM_TOOLS_TEST_QUEUE_MAX_PRODUCERS 64
+
+#define UVM_TOOLS_TEST_QUEUE_TIMEOUT_NS (10ull * 1000 * 1000 * 1000)
+
+typedef struct test_tools_queue_producers_struct test_tools_queue_producers_t;
+
+typedef struct
+{
+    test_tools_queue_producers_t *test;
+    NvU32 index;
+
+    // Time at which the producer was done recording its events
+    NvU64 end_ns;
+
+    nv_kthread_q_t q;
+    nv_kthread_q_item_t q_item;
+} test_tools_queue_producer_t;
+
+struct test_tools_queue_producers_struct
+{
+    uvm_tools_queue_t *queue;
+
+    NvU32 events_per_producer;
+
+    // Producers that are waiting for start to be set
+    atomic_t num_ready;
+
+    // Set to 1 once all the producers are ready, so that they all record
+    // their events at the same time, or to -1 if the test is aborted before
+    // that
+    atomic_t start;
+
+    // Producers that are done recording their events
+    atomic_t num_done;
+
+    // First error found by any of the producers
+    atomic_t status;
+
+    test_tools_queue_producer_t producers[];
+};
+
+// Record count events into the queue, with the producer index and the sequence
+// number of each event encoded in its address
+static void test_tools_queue_produce(uvm_tools_queue_t *queue, NvU32 index, NvU32 count)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UvmEventEntry entry;
+    NvU32 i;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.eventData.migration.eventType = UvmEventTypeMigration;
+
+    for (i = 0; i < count; i++) {
+        entry.eventData.migration.address = ((NvU64)index << 32) | i;
+        enqueue_event(&entry, queue);
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Wait for value to be at least expected, for UVM_TOOLS_TEST_QUEUE_TIMEOUT_NS
+// at most
+static NV_STATUS test_tools_queue_wait(atomic_t *value, int expected)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_spin_loop_t spin;
+
+    uvm_spin_loop_init(&spin);
+    while (atomic_read(value) < expected) {
+        if (uvm_spin_loop_elapsed(&spin) > UVM_TOOLS_TEST_QUEUE_TIMEOUT_NS)
+            return NV_ERR_TIMEOUT;
+
+        uvm_spin_loop(&spin);
+    }
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void test_tools_queue_producer(test_tools_queue_producer_t *producer)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    test_tools_queue_producers_t *test = producer->test;
+    uvm_spin_loop_t spin;
+
+    atomic_inc(&test->num_ready);
+
+    uvm_spin_loop_init(&spin);
+    while (atomic_read(&test->start) == 0) {
+        if (uvm_spin_loop_elapsed(&spin) > UVM_TOOLS_TEST_QUEUE_TIMEOUT_NS) {
+            atomic_cmpxchg(&test->status, NV_OK, NV_ERR_TIMEOUT);
+            break;
+        }
+
+        uvm_spin_loop(&spin);
+    }
+
+    if (atomic_read(&test->start) > 0) {
+        test_tools_queue_produce(test->queue, producer->index, test->events_per_producer);
+        producer->end_ns = NV_GETTIME();
+    }
+
+    atomic_inc(&test->num_done);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void test_tools_queue_producer_entry(void *args)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ENTRY_VOID(test_tools_queue_producer((test_tools_queue_producer_t *)args));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Check that the count events recorded by each of the num_producers producers
+// are in the queue entries starting at first, in the order they were recorded
+static NV_STATUS test_tools_queue_check(uvm_tools_queue_t *queue, NvU32 first, NvU32 num_producers, NvU32 count)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    NvU32 *next_seq;
+    NvU32 i;
+
+    next_seq = uvm_kvmalloc_zero(num_producers * sizeof(*next_seq));
+    if (!next_seq)
+        return NV_ERR_NO_MEMORY;
+
+    for (i = 0; i < num_producers * count; i++) {
+        UvmEventMigrationInfo *info = &queue->queue[first + i].eventData.migration;
+        NvU32 index = info->address >> 32;
+        NvU32 seq = info->address & 0xffffffff;
+
+        TEST_CHECK_GOTO(info->eventType == UvmEventTypeMigration, done);
+        TEST_CHECK_GOTO(index < num_producers, done);
+        TEST_CHECK_GOTO(seq == next_seq[index], done);
+        ++next_seq[index];
+    }
+
+    for (i = 0; i < num_producers; i++)
+        TEST_CHECK_GOTO(next_seq[i] == count, done);
+
+done:
+    uvm_kvfree(next_seq);
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NV_STATUS uvm8_test_tools_queue_producers(UVM_TEST_TOOLS_QUEUE_PRODUCERS_PARAMS *params, struct file *filp)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    struct file *queue_file = NULL;
+    test_tools_queue_producers_t *test = NULL;
+    uvm_tools_queue_t *queue;
+    NvU32 num_events;
+    NvU32 num_producers = 0;
+    NvU64 start;
+    NvU32 i;
+
+    if (params->numProducers == 0 ||
+        params->numProducers > UVM_TOOLS_TEST_QUEUE_MAX_PRODUCERS ||
+        params->eventsPerProducer == 0)
+        return NV_ERR_INVALID_ARGUMENT;
+
+    num_events = params->numProducers * params->eventsPerProducer;
+
+    status = test_tools_queue_fget(params->queue_fd, va_space, &queue_file);
+    if (status != NV_OK)
+        return status;
+
+    // The tools lock keeps the queue format from changing while the events
+    // are recorded
+    uvm_down_read(&va_space->tools.lock);
+
+    queue = &tools_event_tracker(queue_file)->queue;
+
+    // The queue must be unused so far, and the events of both phases must fit
+    // in it along with the entry which is always kept free
+    if (queue->format != UvmToolsEventFormatDefault ||
+        queue->subscribed_queues != 0 ||
+        atomic_read(&queue->put_ahead) != 0 ||
+        atomic_read((atomic_t *)&queue->control->get_behind) != 0 ||
+        num_events / params->eventsPerProducer != params->numProducers ||
+        (NvU64)num_events * 2 >= queue->ring_size) {
+        status = NV_ERR_INVALID_ARGUMENT;
+        goto done;
+    }
+
+    test = uvm_kvmalloc_zero(sizeof(*test) + params->numProducers * sizeof(test->producers[0]));
+    if (!test) {
+        status = NV_ERR_NO_MEMORY;
+        goto done;
+    }
+
+    test->queue = queue;
+    test->events_per_producer = params->eventsPerProducer;
+    atomic_set(&test->num_ready, 0);
+    atomic_set(&test->start, 0);
+    atomic_set(&test->num_done, 0);
+    atomic_set(&test->status, NV_OK);
+
+    // Single producer: the calling thread records all the events
+    start = NV_GETTIME();
+    test_tools_queue_produce(queue, 0, num_events);
+    params->singleProducerNs = NV_GETTIME() - start;
+
+    // Multiple producers: the same number of events is split among the
+    // producer threads, which all contend on the queue
+    for (i = 0; i < params->numProducers; i++) {
+        test_tools_queue_producer_t *producer = &test->producers[i];
+        char name[TASK_COMM_LEN + 1];
+
+        snprintf(name, sizeof(name), "UVM tools test %u", i);
+
+        producer->test = test;
+        producer->index = i;
+
+        status = errno_to_nv_status(nv_kthread_q_init(&producer->q, name));
+        if (status != NV_OK) {
+            // nv_kthread_q_stop can be called on queues that failed
+            // initialization
+            nv_kthread_q_stop(&producer->q);
+            goto done;
+        }
+
+        ++num_producers;
+
+        nv_kthread_q_item_init(&producer->q_item, test_tools_queue_producer_entry, producer);
+        nv_kthread_q_schedule_q_item(&producer->q, &producer->q_item);
+    }
+
+    status = test_tools_queue_wait(&test->num_ready, num_producers);
+    if (status != NV_OK)
+        goto done;
+
+    start = NV_GETTIME();
+    atomic_set(&test->start, 1);
+
+    status = test_tools_queue_wait(&test->num_done, num_producers);
+    if (status != NV_OK)
+        goto done;
+
+    status = atomic_read(&test->status);
+    if (status != NV_OK)
+        goto done;
+
+    params->multiProducerNs = 0;
+    for (i = 0; i < num_producers; i++)
+        params->multiProducerNs = max(params->multiProducerNs, test->producers[i].end_ns - start);
+
+    // No event was dropped, and all of them were committed
+    TEST_CHECK_GOTO(queue->control->dropped[UvmEventTypeMigration] == 0, done);
+    TEST_CHECK_GOTO(atomic_read(&queue->put_ahead) == 2 * num_events, done);
+    TEST_CHECK_GOTO(atomic_read(&queue->put_behind) == 2 * num_events, done);
+    TEST_CHECK_GOTO(queue->control->put_behind == 2 * num_events, done);
+
+    status = test_tools_queue_check(queue, 0, 1, num_events);
+    if (status != NV_OK)
+        goto done;
+
+    status = test_tools_queue_check(queue, num_events, params->numProducers, params->eventsPerProducer);
+
+done:
+    if (test) {
+        // Release the producers still waiting if the test failed before they
+        // were started. Stopping the queues flushes the pending work.
+        atomic_cmpxchg(&test->start, 0, -1);
+        for (i = 0; i < num_producers; i++)
+            nv_kthread_q_stop(&test->producers[i].q);
+
+        uvm_kvfree(test);
+    }
+
+    uvm_up_read(&va_space->tools.lock);
+    fput(queue_file);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 NV_STATUS uvm8_test_increment_tools_counter(UVM_TEST_INCREMENT_TOOLS_COUNTER_PARAMS *params, struct file *filp)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NvU32 i;
@@ -34,6 +34,8 @@
 
 NV_STATUS uvm8_test_inject_tools_event(UVM_TEST_INJECT_TOOLS_EVENT_PARAMS *params, struct file *filp);
 NV_STATUS uvm8_test_increment_tools_counter(UVM_TEST_INCREMENT_TOOLS_COUNTER_PARAMS *params, struct file *filp);
+NV_STATUS uvm8_test_tools_event_format(UVM_TEST_TOOLS_EVENT_FORMAT_PARAMS *params, struct file *filp);
+NV_STATUS uvm8_test_tools_queue_producers(UVM_TEST_TOOLS_QUEUE_PRODUCERS_PARAMS *params, struct file *filp);
 
 NV_STATUS uvm_api_tools_read_process_memory(UVM_TOOLS_READ_PROCESS_MEMORY_PARAMS *params, struct file *filp);
 NV_STATUS uvm_api_tools_write_process_memory(UVM_TOOLS_WRITE_PROCESS_MEMORY_PARAMS *params, struct file *filp);
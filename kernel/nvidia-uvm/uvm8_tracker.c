@@ -30,6 +30,7 @@
 #include "uvm8_global.h"
 #include "uvm_common.h"
 #include "uvm_linux.h"
+#include <linux/hash.h>
 
 static bool tracker_is_using_static_entries(uvm_tracker_t *tracker)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
@@ -54,14 +55,100 @@ uvm_tracker_entry_t *uvm_tracker_get_entries(uvm_tracker_t *tracker)
     }
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-static uvm_tracker_entry_t *get_new_entry(uvm_tracker_t *tracker)
+// The hash index of the dynamic entries has twice as many slots as there are
+// entries, so it's never more than half full. Each slot holds the index of an
+// entry plus one, or 0 if it's free.
+typedef NvU16 tracker_index_slot_t;
+
+#define TRACKER_MAX_DYNAMIC_ENTRIES 0x4000
+
+static size_t dynamic_entries_alloc_size(NvU32 max_size)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    NV_STATUS status = uvm_tracker_reserve(tracker, 1);
-    if (status != NV_OK)
+    return max_size * (sizeof(uvm_tracker_entry_t) + 2 * sizeof(tracker_index_slot_t));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static tracker_index_slot_t *tracker_index(uvm_tracker_t *tracker)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ASSERT(!tracker_is_using_static_entries(tracker));
+
+    return (tracker_index_slot_t *)(tracker->dynamic_entries + tracker->max_size);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Find the index slot of the channel's entry, or the free slot where it would
+// be inserted
+static tracker_index_slot_t *tracker_index_find_slot(uvm_tracker_t *tracker, uvm_channel_t *channel)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    tracker_index_slot_t *index = tracker_index(tracker);
+    NvU32 num_slots = 2 * tracker->max_size;
+    NvU32 slot = hash_ptr(channel, ilog2(num_slots));
+
+    while (index[slot] != 0 && tracker->dynamic_entries[index[slot] - 1].channel != channel)
+        slot = (slot + 1) & (num_slots - 1);
+
+    return &index[slot];
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void tracker_index_rebuild(uvm_tracker_t *tracker)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU32 i;
+
+    if (tracker_is_using_static_entries(tracker))
+        return;
+
+    memset(tracker_index(tracker), 0, 2 * tracker->max_size * sizeof(tracker_index_slot_t));
+
+    for (i = 0; i < tracker->size; ++i) {
+        tracker_index_slot_t *slot = tracker_index_find_slot(tracker, tracker->dynamic_entries[i].channel);
+
+        UVM_ASSERT(*slot == 0);
+        *slot = i + 1;
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Find the entry for the channel, if any
+static uvm_tracker_entry_t *find_entry(uvm_tracker_t *tracker, uvm_channel_t *channel)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_tracker_entry_t *entry;
+    tracker_index_slot_t *slot;
+
+    if (tracker_is_using_static_entries(tracker)) {
+        for_each_tracker_entry(entry, tracker) {
+            if (entry->channel == channel)
+                return entry;
+        }
+
+        return NULL;
+    }
+
+    slot = tracker_index_find_slot(tracker, channel);
+    if (*slot == 0)
         return NULL;
+
+    return &tracker->dynamic_entries[*slot - 1];
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Append an entry for a channel known not to be tracked yet. The caller is
+// required to have reserved space for it.
+static void append_entry(uvm_tracker_t *tracker, uvm_tracker_entry_t *new_entry)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     UVM_ASSERT(tracker->size < tracker->max_size);
 
-    return &uvm_tracker_get_entries(tracker)[tracker->size++];
+    if (!tracker_is_using_static_entries(tracker)) {
+        tracker_index_slot_t *slot = tracker_index_find_slot(tracker, new_entry->channel);
+
+        UVM_ASSERT(*slot == 0);
+        *slot = tracker->size + 1;
+    }
+
+    uvm_tracker_get_entries(tracker)[tracker->size++] = *new_entry;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_tracker_clear(uvm_tracker_t *tracker)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    tracker->size = 0;
+
+    if (!tracker_is_using_static_entries(tracker))
+        memset(tracker_index(tracker), 0, 2 * tracker->max_size * sizeof(tracker_index_slot_t));
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 NV_STATUS uvm_tracker_init_from(uvm_tracker_t *dst, uvm_tracker_t *src)
@@ -96,6 +183,7 @@ NV_STATUS uvm_tracker_overwrite(uvm_tracker_t *dst, uvm_tracker_t *src)
     memcpy(uvm_tracker_get_entries(dst),
            uvm_tracker_get_entries(src),
            src->size * sizeof(*uvm_tracker_get_entries(dst)));
+    tracker_index_rebuild(dst);
 
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -103,24 +191,29 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 NV_STATUS uvm_tracker_reserve(uvm_tracker_t *tracker, NvU32 min_free_entries)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     if (tracker->size + min_free_entries > tracker->max_size) {
-        // Special case the first resize to jump from 1 all the way to 8.
-        // This is based on a guess that if a tracker needs more than 1
-        // entry it likely needs much more.
-        // TODO: Bug 1764961: Verify that guess.
-        NvU32 new_max_size = max((NvU32)8, (NvU32)roundup_pow_of_two(tracker->size + min_free_entries));
+        // Special case the first resize to at least double the static
+        // storage. The hash index relies on the size being a power of 2.
+        NvU32 new_max_size = max((NvU32)(2 * UVM_TRACKER_STATIC_ENTRIES),
+                                 (NvU32)roundup_pow_of_two(tracker->size + min_free_entries));
         uvm_tracker_entry_t *new_entries;
 
+        if (new_max_size > TRACKER_MAX_DYNAMIC_ENTRIES)
+            return NV_ERR_NO_MEMORY;
+
         if (tracker_is_using_static_entries(tracker)) {
-            new_entries = uvm_kvmalloc(sizeof(*new_entries) * new_max_size);
+            new_entries = uvm_kvmalloc(dynamic_entries_alloc_size(new_max_size));
             if (new_entries)
                 memcpy(new_entries, tracker->static_entries, sizeof(*new_entries) * tracker->size);
         } else {
-            new_entries = uvm_kvrealloc(tracker->dynamic_entries, sizeof(*new_entries) * new_max_size);
+            new_entries = uvm_kvrealloc(tracker->dynamic_entries, dynamic_entries_alloc_size(new_max_size));
         }
         if (!new_entries)
             return NV_ERR_NO_MEMORY;
         tracker->dynamic_entries = new_entries;
         tracker->max_size = new_max_size;
+
+        // The index follows the entries, so it moved with max_size
+        tracker_index_rebuild(tracker);
     }
     UVM_ASSERT(tracker->size + min_free_entries <= tracker->max_size);
     return NV_OK;
@@ -137,20 +230,19 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 NV_STATUS uvm_tracker_add_entry(uvm_tracker_t *tracker, uvm_tracker_entry_t *new_entry)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    uvm_tracker_entry_t *tracker_entry;
+    NV_STATUS status;
+    uvm_tracker_entry_t *tracker_entry = find_entry(tracker, new_entry->channel);
 
-    for_each_tracker_entry(tracker_entry, tracker) {
-        if (tracker_entry->channel == new_entry->channel) {
-            tracker_entry->value = max(tracker_entry->value, new_entry->value);
-            return NV_OK;
-        }
+    if (tracker_entry) {
+        tracker_entry->value = max(tracker_entry->value, new_entry->value);
+        return NV_OK;
     }
 
-    tracker_entry = get_new_entry(tracker);
-    if (tracker_entry == NULL)
-        return NV_ERR_NO_MEMORY;
+    status = uvm_tracker_reserve(tracker, 1);
+    if (status != NV_OK)
+        return status;
 
-    *tracker_entry = *new_entry;
+    append_entry(tracker, new_entry);
 
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -179,17 +271,10 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 static NV_STATUS reserve_for_entries_from_tracker(uvm_tracker_t *dst, uvm_tracker_t *src)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NvU32 needed_free_entries = 0;
-    uvm_tracker_entry_t *src_entry, *dst_entry;
+    uvm_tracker_entry_t *src_entry;
 
     for_each_tracker_entry(src_entry, src) {
-        bool found = false;
-        for_each_tracker_entry(dst_entry, dst) {
-            if (dst_entry->channel == src_entry->channel) {
-                found = true;
-                break;
-            }
-        }
-        if (!found)
+        if (!find_entry(dst, src_entry->channel))
             needed_free_entries++;
     }
 
@@ -409,6 +494,8 @@ void uvm_tracker_remove_completed(uvm_tracker_t *tracker)
 
     uvm_tracker_entry_t *entries = uvm_tracker_get_entries(tracker);
 
+    NvU32 old_size = tracker->size;
+
     // Keep removing completed entries until we run out of entries
     while (i < tracker->size) {
         if (uvm_tracker_is_entry_completed(&entries[i])) {
@@ -420,6 +507,9 @@ void uvm_tracker_remove_completed(uvm_tracker_t *tracker)
             ++i;
         }
     }
+
+    if (tracker->size != old_size)
+        tracker_index_rebuild(tracker);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 bool uvm_tracker_is_completed(uvm_tracker_t *tracker)
@@ -434,3 +524,122 @@ uvm_gpu_t *uvm_tracker_entry_gpu(uvm_tracker_entry_t *entry)
     return uvm_channel_get_gpu(entry->channel);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+static uvm_tracker_completion_waiter_t *completion_get_waiters(uvm_tracker_completion_t *completion)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (completion->num_waiters <= ARRAY_SIZE(completion->static_waiters))
+        return completion->static_waiters;
+
+    return completion->dynamic_waiters;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void completion_put(uvm_tracker_completion_t *completion)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ASSERT(atomic_read(&completion->pending) > 0);
+
+    if (!atomic_dec_and_test(&completion->pending))
+        return;
+
+    completion->func(completion->data, atomic_read(&completion->status));
+
+    // Order the callback and all the accesses to the completion above before
+    // publishing done. The owner can free the completion as soon as it
+    // observes done, so it must not be touched after the atomic_set().
+    smp_mb();
+    atomic_set(&completion->done, 1);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_tracker_completion_waiter_done(uvm_tracker_completion_waiter_t *waiter, NV_STATUS status)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_tracker_completion_t *completion = waiter->completion;
+
+    // Only the first error is reported
+    if (status != NV_OK)
+        atomic_cmpxchg(&completion->status, NV_OK, status);
+
+    // The waiter cannot be touched after this as the callback might free it
+    completion_put(completion);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NV_STATUS uvm_tracker_add_completion(uvm_tracker_t *tracker,
+                                     uvm_tracker_completion_t *completion,
+                                     uvm_tracker_completion_func_t func,
+                                     void *data)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_tracker_entry_t *entry;
+    uvm_tracker_completion_waiter_t *waiters;
+    NvU32 i = 0;
+
+    UVM_ASSERT(func);
+
+    uvm_tracker_remove_completed(tracker);
+
+    memset(completion, 0, sizeof(*completion));
+    completion->func = func;
+    completion->data = data;
+    completion->num_waiters = tracker->size;
+
+    if (completion->num_waiters > ARRAY_SIZE(completion->static_waiters)) {
+        completion->dynamic_waiters = uvm_kvmalloc(sizeof(*waiters) * completion->num_waiters);
+        if (!completion->dynamic_waiters)
+            return NV_ERR_NO_MEMORY;
+    }
+
+    waiters = completion_get_waiters(completion);
+
+    atomic_set(&completion->status, NV_OK);
+    atomic_set(&completion->done, 0);
+    atomic_set(&completion->pending, completion->num_waiters + 1);
+
+    for_each_tracker_entry(entry, tracker) {
+        uvm_tracker_completion_waiter_t *waiter = &waiters[i++];
+
+        waiter->entry = *entry;
+        waiter->completion = completion;
+
+        // The entry could have completed since the tracker was pruned above
+        if (!uvm_channel_add_completion_waiter(entry->channel, waiter))
+            uvm_tracker_completion_waiter_done(waiter, NV_OK);
+    }
+
+    completion_put(completion);
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NV_STATUS uvm_tracker_completion_wait(uvm_tracker_completion_t *completion)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    uvm_tracker_completion_waiter_t *waiters = completion_get_waiters(completion);
+    uvm_spin_loop_t spin;
+    NvU32 i;
+
+    uvm_spin_loop_init(&spin);
+    while (!uvm_tracker_completion_is_done(completion) && status == NV_OK) {
+        // The waiters array stays valid until uvm_tracker_completion_deinit()
+        // so it's safe to look at the tracked channels even after some of them
+        // completed.
+        for (i = 0; i < completion->num_waiters; ++i)
+            uvm_channel_update_progress(waiters[i].entry.channel);
+
+        if (uvm_tracker_completion_is_done(completion))
+            break;
+
+        UVM_SPIN_LOOP(&spin);
+        status = uvm_global_get_status();
+    }
+
+    if (status != NV_OK)
+        return status;
+
+    return atomic_read(&completion->status);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+void uvm_tracker_completion_deinit(uvm_tracker_completion_t *completion)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    UVM_ASSERT(uvm_tracker_completion_is_done(completion));
+
+    if (completion->num_waiters > ARRAY_SIZE(completion->static_waiters))
+        uvm_kvfree(completion->dynamic_waiters);
+
+    completion->num_waiters = 0;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -42,17 +42,27 @@ typedef struct
     NvU64 value;
 } uvm_tracker_entry_t;
 
+// Number of entries that fit in the static storage of a tracker. Trackers are
+// embedded in pushes, VA blocks and per-GPU state, so the static storage is
+// kept small and covers the common case of work on one or two channels. Larger
+// trackers use a dynamic allocation, which also holds a hash index of the
+// entries by channel.
+#define UVM_TRACKER_STATIC_ENTRIES 2
+
 typedef struct
 {
     union
     {
-        // The default static storage can fit a single entry as that's likely
-        // the most common use-case. If the tracker ever needs more space, a
-        // dynamic allocation will be made as part of adding an entry and
-        // dynamic_entries below will be used.
-        uvm_tracker_entry_t static_entries[1];
-
-        // Pointer to the array with dynamically allocated entries
+        // The default static storage can fit UVM_TRACKER_STATIC_ENTRIES
+        // entries. If the tracker ever needs more space, a dynamic allocation
+        // will be made as part of adding an entry and dynamic_entries below
+        // will be used.
+        uvm_tracker_entry_t static_entries[UVM_TRACKER_STATIC_ENTRIES];
+
+        // Pointer to the array with dynamically allocated entries. The same
+        // allocation holds an open-addressing hash index of the entries by
+        // channel after the max_size entries, so that the entry of a channel
+        // is found without searching the entries.
         uvm_tracker_entry_t *dynamic_entries;
     };
 
@@ -96,10 +106,7 @@ NV_STATUS uvm_tracker_init_from(uvm_tracker_t *dst, uvm_tracker_t *src);
 // Remove all entries from tracker
 //
 // This won't change the max size of the tracker.
-static void uvm_tracker_clear(uvm_tracker_t *tracker)
-{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    tracker->size = 0;
-pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+void uvm_tracker_clear(uvm_tracker_t *tracker);
 
 // Reserve enough space so min_free_entries can be added to the tracker
 // without requiring memory allocation.
@@ -211,6 +218,115 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 uvm_gpu_t *uvm_tracker_entry_gpu(uvm_tracker_entry_t *entry);
 
+// Asynchronous tracker completion
+//
+// Instead of waiting for a tracker to complete, a callback can be registered
+// with uvm_tracker_add_completion() to be called once all the entries that are
+// in the tracker at the time of the registration are completed. Completion is
+// detected by uvm_channel_update_progress() on the tracked channels, which
+// keep a list of the pending waiters sorted by the tracking value. Notably the
+// callback is only called once something updates the progress of the
+// channels. That happens regularly as part of beginning new pushes and waiting
+// for work, and can be forced with uvm_tracker_completion_wait().
+typedef struct uvm_tracker_completion_struct uvm_tracker_completion_t;
+
+// Completion callback
+// status is NV_OK if all the tracked work completed successfully, or an error
+// if some of the tracked channels were torn down or hit an error before the
+// work completed.
+//
+// The callback can be called from uvm_channel_update_progress() and hence from
+// any context updating channel progress, possibly with spinlocks held. It must
+// not sleep and should defer any heavier work, e.g. to a kthread queue.
+typedef void (*uvm_tracker_completion_func_t)(void *data, NV_STATUS status);
+
+typedef struct
+{
+    // Node in the list of completion waiters of the tracked channel, protected
+    // by the channel pool lock
+    struct list_head channel_list_node;
+
+    // Tracker entry being waited on
+    uvm_tracker_entry_t entry;
+
+    // Completion owning the waiter
+    uvm_tracker_completion_t *completion;
+} uvm_tracker_completion_waiter_t;
+
+struct uvm_tracker_completion_struct
+{
+    uvm_tracker_completion_func_t func;
+    void *data;
+
+    // Number of waiters not completed yet, plus one reference held by
+    // uvm_tracker_add_completion() while adding the waiters.
+    atomic_t pending;
+
+    // First error reported by any of the waiters
+    atomic_t status;
+
+    // Set once the callback has returned. Until then the completion is still
+    // accessed by the thread calling the callback, even after pending dropped
+    // to 0.
+    atomic_t done;
+
+    // One waiter per tracker entry that was not completed at registration
+    // time. Same as for the tracker, the common case of a single entry uses
+    // the static storage.
+    union
+    {
+        uvm_tracker_completion_waiter_t static_waiters[1];
+        uvm_tracker_completion_waiter_t *dynamic_waiters;
+    };
+
+    NvU32 num_waiters;
+};
+
+// Register func to be called with data once all the entries currently in the
+// tracker complete. The tracker itself is not modified other than removing
+// its completed entries and can be reused or deinitialized right away.
+//
+// If all the entries are already completed, func is called before this
+// function returns.
+//
+// This may require allocating memory for the waiters. On error func is never
+// called.
+//
+// The completion needs to stay valid until uvm_tracker_completion_is_done()
+// returns true, after which uvm_tracker_completion_deinit() needs to be called.
+// It cannot be called from the callback itself.
+NV_STATUS uvm_tracker_add_completion(uvm_tracker_t *tracker,
+                                     uvm_tracker_completion_t *completion,
+                                     uvm_tracker_completion_func_t func,
+                                     void *data);
+
+// Query whether the completion callback has already been called and returned.
+// Once this returns true, the completion can be deinitialized and freed.
+static bool uvm_tracker_completion_is_done(uvm_tracker_completion_t *completion)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (!atomic_read(&completion->done))
+        return false;
+
+    // Pairs with the smp_mb() in completion_put()
+    smp_rmb();
+
+    return true;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Update the progress of the channels tracked by the completion until its
+// callback is called. Returns the status the callback was called with, or the
+// global error if one is hit while waiting, in which case the callback may not
+// have been called yet.
+NV_STATUS uvm_tracker_completion_wait(uvm_tracker_completion_t *completion);
+
+// Free the resources of a completion whose callback has already been called
+void uvm_tracker_completion_deinit(uvm_tracker_completion_t *completion);
+
+// Called by the channel code once the entry tracked by the waiter is completed
+// or won't ever complete. The waiter must have been removed from the channel's
+// list of waiters already.
+void uvm_tracker_completion_waiter_done(uvm_tracker_completion_waiter_t *waiter, NV_STATUS status);
+
 // Helper to iterate over all tracker entries
 #define for_each_tracker_entry(entry, tracker)                          \
     for (entry = &uvm_tracker_get_entries(tracker)[0];                  \
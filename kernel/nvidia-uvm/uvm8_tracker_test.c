@@ -25,6 +25,7 @@
 #include "uvm8_channel.h"
 #include "uvm8_global.h"
 #include "uvm8_hal.h"
+#include "uvm8_kvmalloc.h"
 #include "uvm8_push.h"
 #include "uvm8_test.h"
 #include "uvm8_tracker.h"
@@ -390,11 +391,461 @@ done:
     return status;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Mock channel not backed by any GPU. Its tracking semaphore payload lives in
+// CPU memory and is advanced by the test, which allows exercising the tracker
+// completion callbacks deterministically.
+typedef struct
+{
+    uvm_channel_pool_t pool;
+    uvm_channel_t channel;
+    NvU32 payload;
+} test_mock_channel_t;
+
+static void mock_channel_init(test_mock_channel_t *mock)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    memset(mock, 0, sizeof(*mock));
+
+    uvm_spin_lock_init(&mock->pool.lock, UVM_LOCK_ORDER_CHANNEL);
+
+    mock->channel.pool = &mock->pool;
+    snprintf(mock->channel.name, sizeof(mock->channel.name), "mock");
+    INIT_LIST_HEAD(&mock->channel.completion_waiters);
+
+    mock->channel.tracking_sem.semaphore.payload = &mock->payload;
+    uvm_spin_lock_init(&mock->channel.tracking_sem.lock, UVM_LOCK_ORDER_LEAF);
+    atomic64_set(&mock->channel.tracking_sem.completed_value, 0);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Complete the given value on the mock channel and update its progress, which
+// notifies the completion waiters.
+static void mock_channel_complete(test_mock_channel_t *mock, NvU32 value)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_gpu_semaphore_set_payload(&mock->channel.tracking_sem.semaphore, value);
+    uvm_channel_update_progress(&mock->channel);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static uvm_tracker_entry_t mock_channel_entry(test_mock_channel_t *mock, NvU64 value)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_tracker_entry_t entry = { &mock->channel, value };
+    return entry;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+typedef struct
+{
+    uvm_tracker_completion_t completion;
+    atomic_t calls;
+    NV_STATUS status;
+} test_completion_t;
+
+static void test_completion_callback(void *data, NV_STATUS status)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    test_completion_t *test_completion = (test_completion_t *)data;
+
+    test_completion->status = status;
+    atomic_inc(&test_completion->calls);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS test_completion_add(test_completion_t *test_completion, uvm_tracker_t *tracker)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    atomic_set(&test_completion->calls, 0);
+    test_completion->status = NV_ERR_INVALID_STATE;
+
+    return uvm_tracker_add_completion(tracker, &test_completion->completion, test_completion_callback, test_completion);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static bool test_completion_called(test_completion_t *test_completion)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return atomic_read(&test_completion->calls) != 0;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS test_completion_check_done(test_completion_t *test_completion)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    TEST_CHECK_RET(atomic_read(&test_completion->calls) == 1);
+    TEST_CHECK_RET(test_completion->status == NV_OK);
+    TEST_CHECK_RET(uvm_tracker_completion_is_done(&test_completion->completion));
+
+    uvm_tracker_completion_deinit(&test_completion->completion);
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+#define TEST_COMPLETION_MANY 32
+
+// Test tracker completion callbacks using mock channels, so that no GPU is
+// required.
+static NV_STATUS test_tracker_completion_callbacks(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    test_mock_channel_t *mocks;
+    test_completion_t *completions;
+    uvm_tracker_t tracker = UVM_TRACKER_INIT();
+    uvm_tracker_entry_t entry;
+    NvU32 i;
+
+    mocks = uvm_kvmalloc_zero(sizeof(*mocks) * 2);
+    completions = uvm_kvmalloc_zero(sizeof(*completions) * TEST_COMPLETION_MANY);
+    if (!mocks || !completions) {
+        status = NV_ERR_NO_MEMORY;
+        goto done;
+    }
+
+    mock_channel_init(&mocks[0]);
+    mock_channel_init(&mocks[1]);
+
+    // An empty tracker completes right away
+    TEST_NV_CHECK_GOTO(test_completion_add(&completions[0], &tracker), done);
+    TEST_NV_CHECK_GOTO(test_completion_check_done(&completions[0]), done);
+
+    // Single entry, using the static waiter storage
+    entry = mock_channel_entry(&mocks[0], 1);
+    TEST_NV_CHECK_GOTO(uvm_tracker_add_entry(&tracker, &entry), done);
+    TEST_NV_CHECK_GOTO(test_completion_add(&completions[0], &tracker), done);
+    TEST_CHECK_GOTO(!test_completion_called(&completions[0]), done);
+
+    // Two entries on different channels, using dynamic waiters
+    entry = mock_channel_entry(&mocks[0], 2);
+    TEST_NV_CHECK_GOTO(uvm_tracker_add_entry(&tracker, &entry), done);
+    entry = mock_channel_entry(&mocks[1], 1);
+    TEST_NV_CHECK_GOTO(uvm_tracker_add_entry(&tracker, &entry), done);
+    TEST_NV_CHECK_GOTO(test_completion_add(&completions[1], &tracker), done);
+
+    // The registration doesn't need the tracker to stay around
+    uvm_tracker_clear(&tracker);
+
+    mock_channel_complete(&mocks[0], 1);
+    TEST_NV_CHECK_GOTO(test_completion_check_done(&completions[0]), done);
+    TEST_CHECK_GOTO(!test_completion_called(&completions[1]), done);
+
+    mock_channel_complete(&mocks[1], 1);
+    TEST_CHECK_GOTO(!test_completion_called(&completions[1]), done);
+
+    // Setting the payload without updating the channel progress doesn't call
+    // the callback, but uvm_tracker_completion_wait() does.
+    uvm_gpu_semaphore_set_payload(&mocks[0].channel.tracking_sem.semaphore, 2);
+    TEST_CHECK_GOTO(!test_completion_called(&completions[1]), done);
+    TEST_NV_CHECK_GOTO(uvm_tracker_completion_wait(&completions[1].completion), done);
+    TEST_NV_CHECK_GOTO(test_completion_check_done(&completions[1]), done);
+
+    // Registering for already completed values calls the callback right away
+    entry = mock_channel_entry(&mocks[0], 2);
+    uvm_tracker_overwrite_with_entry(&tracker, &entry);
+    TEST_NV_CHECK_GOTO(test_completion_add(&completions[0], &tracker), done);
+    TEST_NV_CHECK_GOTO(test_completion_check_done(&completions[0]), done);
+
+    // Add waiters out of order and check that each of them is notified exactly
+    // when its value completes.
+    for (i = 0; i < TEST_COMPLETION_MANY; ++i) {
+        NvU64 value = 3 + ((i * 7) % TEST_COMPLETION_MANY);
+
+        entry = mock_channel_entry(&mocks[0], value);
+        uvm_tracker_overwrite_with_entry(&tracker, &entry);
+        TEST_NV_CHECK_GOTO(test_completion_add(&completions[i], &tracker), done);
+    }
+
+    for (i = 0; i < TEST_COMPLETION_MANY; ++i) {
+        NvU32 value = 3 + i;
+        NvU32 j;
+
+        mock_channel_complete(&mocks[0], value);
+
+        for (j = 0; j < TEST_COMPLETION_MANY; ++j) {
+            NvU64 waited_value = 3 + ((j * 7) % TEST_COMPLETION_MANY);
+            TEST_CHECK_GOTO(test_completion_called(&completions[j]) == (waited_value <= value), done);
+        }
+    }
+
+    for (i = 0; i < TEST_COMPLETION_MANY; ++i)
+        TEST_NV_CHECK_GOTO(test_completion_check_done(&completions[i]), done);
+
+    TEST_CHECK_GOTO(list_empty(&mocks[0].channel.completion_waiters), done);
+    TEST_CHECK_GOTO(list_empty(&mocks[1].channel.completion_waiters), done);
+
+done:
+    uvm_tracker_deinit(&tracker);
+    uvm_kvfree(completions);
+    uvm_kvfree(mocks);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+#define TEST_COMPLETION_RACE_ITERS 10000
+
+// Bound on every wait of the race test, so that a completion which is never
+// done or a stuck worker fails the test instead of hanging it
+#define TEST_COMPLETION_RACE_TIMEOUT_NS (10 * 1000 * 1000 * 1000ULL)
+
+typedef struct
+{
+    test_mock_channel_t mock;
+
+    // Last tracking value the test registered a completion for
+    atomic_t registered;
+
+    // Set by the worker if it gave up waiting for the test
+    NV_STATUS worker_status;
+
+    nv_kthread_q_t q;
+    nv_kthread_q_item_t q_item;
+} test_completion_race_t;
+
+// Complete each tracking value on the mock channel as soon as the test
+// registered a completion for it.
+static void test_completion_race_worker(void *args)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    test_completion_race_t *race = (test_completion_race_t *)args;
+    NvU32 value = 1;
+    uvm_spin_loop_t spin;
+
+    uvm_spin_loop_init(&spin);
+
+    while (value <= TEST_COMPLETION_RACE_ITERS) {
+        if (atomic_read(&race->registered) < value) {
+            if (uvm_spin_loop_elapsed(&spin) > TEST_COMPLETION_RACE_TIMEOUT_NS) {
+                race->worker_status = NV_ERR_TIMEOUT;
+                return;
+            }
+
+            uvm_spin_loop(&spin);
+            continue;
+        }
+
+        mock_channel_complete(&race->mock, value);
+        ++value;
+
+        uvm_spin_loop_init(&spin);
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Free each completion as soon as uvm_tracker_completion_is_done() returns true
+// while another thread is calling its callback. Any access to the completion
+// by the completing thread after publishing the completion as done would be a
+// use-after-free.
+static NV_STATUS test_tracker_completion_free_race(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    test_completion_race_t *race;
+    uvm_tracker_t tracker = UVM_TRACKER_INIT();
+    uvm_tracker_entry_t entry;
+    test_completion_t *pending = NULL;
+    uvm_spin_loop_t spin;
+    NvU32 i;
+
+    race = uvm_kvmalloc_zero(sizeof(*race));
+    if (!race)
+        return NV_ERR_NO_MEMORY;
+
+    mock_channel_init(&race->mock);
+    atomic_set(&race->registered, 0);
+
+    status = errno_to_nv_status(nv_kthread_q_init(&race->q, "UVM tracker completion race"));
+    if (status != NV_OK) {
+        uvm_kvfree(race);
+        return status;
+    }
+
+    nv_kthread_q_item_init(&race->q_item, test_completion_race_worker, race);
+    nv_kthread_q_schedule_q_item(&race->q, &race->q_item);
+
+    for (i = 1; i <= TEST_COMPLETION_RACE_ITERS; ++i) {
+        test_completion_t *test_completion = uvm_kvmalloc(sizeof(*test_completion));
+        if (!test_completion) {
+            status = NV_ERR_NO_MEMORY;
+            break;
+        }
+
+        entry = mock_channel_entry(&race->mock, i);
+        uvm_tracker_overwrite_with_entry(&tracker, &entry);
+        status = test_completion_add(test_completion, &tracker);
+        if (status != NV_OK) {
+            uvm_kvfree(test_completion);
+            break;
+        }
+
+        atomic_set(&race->registered, i);
+
+        uvm_spin_loop_init(&spin);
+        while (!uvm_tracker_completion_is_done(&test_completion->completion)) {
+            if (uvm_spin_loop_elapsed(&spin) > TEST_COMPLETION_RACE_TIMEOUT_NS) {
+                UVM_TEST_PRINT("Completion %u not done after %llu ns\n", i, uvm_spin_loop_elapsed(&spin));
+                status = NV_ERR_TIMEOUT;
+                break;
+            }
+
+            uvm_spin_loop(&spin);
+        }
+
+        // The completion can't be freed before it's done, which is handled
+        // once the worker is stopped
+        if (status != NV_OK) {
+            pending = test_completion;
+            break;
+        }
+
+        status = test_completion_check_done(test_completion);
+        uvm_kvfree(test_completion);
+        if (status != NV_OK)
+            break;
+    }
+
+    // Let the worker run to completion even if the test failed early
+    atomic_set(&race->registered, TEST_COMPLETION_RACE_ITERS);
+    nv_kthread_q_stop(&race->q);
+
+    if (pending) {
+        // Complete everything registered on the mock channel. If the
+        // completion is still not done, it and the mock channel it waits on
+        // are leaked rather than freed under it.
+        mock_channel_complete(&race->mock, TEST_COMPLETION_RACE_ITERS);
+        if (!uvm_tracker_completion_is_done(&pending->completion)) {
+            uvm_tracker_deinit(&tracker);
+            return status;
+        }
+
+        uvm_kvfree(pending);
+    }
+
+    if (status == NV_OK)
+        status = race->worker_status;
+
+    if (status == NV_OK && !list_empty(&race->mock.channel.completion_waiters))
+        status = NV_ERR_INVALID_STATE;
+
+    uvm_tracker_deinit(&tracker);
+    uvm_kvfree(race);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+#define TEST_MANY_CHANNELS 64
+
+static NvU32 mock_channel_index(test_mock_channel_t *mocks, uvm_channel_t *channel)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return container_of(channel, test_mock_channel_t, channel) - mocks;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS check_many_channels_tracker(uvm_tracker_t *tracker,
+                                             test_mock_channel_t *mocks,
+                                             NvU32 expected_size,
+                                             NvU64 value_base)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_tracker_entry_t *entry;
+    DECLARE_BITMAP(seen, TEST_MANY_CHANNELS);
+
+    bitmap_zero(seen, TEST_MANY_CHANNELS);
+
+    TEST_CHECK_RET(tracker->size == expected_size);
+
+    for_each_tracker_entry(entry, tracker) {
+        NvU32 i = mock_channel_index(mocks, entry->channel);
+
+        TEST_CHECK_RET(i < TEST_MANY_CHANNELS);
+        TEST_CHECK_RET(!test_bit(i, seen));
+        TEST_CHECK_RET(entry->value == value_base + i);
+        __set_bit(i, seen);
+    }
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Trackers with more entries than the static storage use the hash index of
+// the dynamic entries. Exercise adding, merging and removing entries of many
+// channels, checking that every channel keeps a single entry with the latest
+// value.
+static NV_STATUS test_tracker_many_channels(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    test_mock_channel_t *mocks;
+    uvm_tracker_t tracker = UVM_TRACKER_INIT();
+    uvm_tracker_t other = UVM_TRACKER_INIT();
+    uvm_tracker_entry_t entry;
+    NvU32 i;
+
+    mocks = uvm_kvmalloc(sizeof(*mocks) * TEST_MANY_CHANNELS);
+    if (!mocks)
+        return NV_ERR_NO_MEMORY;
+
+    for (i = 0; i < TEST_MANY_CHANNELS; ++i)
+        mock_channel_init(&mocks[i]);
+
+    for (i = 0; i < TEST_MANY_CHANNELS; ++i) {
+        entry = mock_channel_entry(&mocks[i], 100 + i);
+        TEST_NV_CHECK_GOTO(uvm_tracker_add_entry(&tracker, &entry), done);
+    }
+    TEST_NV_CHECK_GOTO(check_many_channels_tracker(&tracker, mocks, TEST_MANY_CHANNELS, 100), done);
+
+    // Newer values for the same channels update the existing entries. Older
+    // ones are ignored.
+    for (i = 0; i < TEST_MANY_CHANNELS; ++i) {
+        entry = mock_channel_entry(&mocks[i], 200 + i);
+        TEST_NV_CHECK_GOTO(uvm_tracker_add_entry(&tracker, &entry), done);
+        entry = mock_channel_entry(&mocks[i], 150 + i);
+        TEST_NV_CHECK_GOTO(uvm_tracker_add_entry(&tracker, &entry), done);
+    }
+    TEST_NV_CHECK_GOTO(check_many_channels_tracker(&tracker, mocks, TEST_MANY_CHANNELS, 200), done);
+
+    // Complete every other channel and remove its entry, then add all the
+    // channels back. The entries of the channels still in the tracker are
+    // found through the rebuilt index.
+    for (i = 0; i < TEST_MANY_CHANNELS; i += 2)
+        mock_channel_complete(&mocks[i], 300);
+
+    uvm_tracker_remove_completed(&tracker);
+    TEST_CHECK_GOTO(tracker.size == TEST_MANY_CHANNELS / 2, done);
+
+    for (i = 0; i < TEST_MANY_CHANNELS; ++i) {
+        entry = mock_channel_entry(&mocks[i], 400 + i);
+        TEST_NV_CHECK_GOTO(uvm_tracker_add_entry(&tracker, &entry), done);
+    }
+    TEST_NV_CHECK_GOTO(check_many_channels_tracker(&tracker, mocks, TEST_MANY_CHANNELS, 400), done);
+
+    // Merge a tracker with half of the channels, with newer values
+    for (i = 0; i < TEST_MANY_CHANNELS; i += 2) {
+        entry = mock_channel_entry(&mocks[i], 500 + i);
+        TEST_NV_CHECK_GOTO(uvm_tracker_add_entry(&other, &entry), done);
+    }
+    TEST_NV_CHECK_GOTO(uvm_tracker_add_tracker(&other, &tracker), done);
+    for (i = 0; i < TEST_MANY_CHANNELS; i += 2) {
+        entry = mock_channel_entry(&mocks[i + 1], 500 + i + 1);
+        TEST_NV_CHECK_GOTO(uvm_tracker_add_entry(&other, &entry), done);
+    }
+    TEST_NV_CHECK_GOTO(check_many_channels_tracker(&other, mocks, TEST_MANY_CHANNELS, 500), done);
+
+    TEST_NV_CHECK_GOTO(uvm_tracker_overwrite(&tracker, &other), done);
+    TEST_NV_CHECK_GOTO(check_many_channels_tracker(&tracker, mocks, TEST_MANY_CHANNELS, 500), done);
+
+    // A cleared tracker keeps its dynamic storage and has an empty index
+    uvm_tracker_clear(&tracker);
+    for (i = 0; i < 3; ++i) {
+        entry = mock_channel_entry(&mocks[i], 500 + i);
+        TEST_NV_CHECK_GOTO(uvm_tracker_add_entry(&tracker, &entry), done);
+    }
+    TEST_NV_CHECK_GOTO(check_many_channels_tracker(&tracker, mocks, 3, 500), done);
+
+done:
+    uvm_tracker_deinit(&other);
+    uvm_tracker_deinit(&tracker);
+    uvm_kvfree(mocks);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 NV_STATUS uvm8_test_tracker_sanity(UVM_TEST_TRACKER_SANITY_PARAMS *params, struct file *filp)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     NV_STATUS status;
     uvm_va_space_t *va_space = uvm_va_space_get(filp);
 
+    status = test_tracker_completion_callbacks();
+    if (status != NV_OK)
+        return status;
+
+    status = test_tracker_completion_free_race();
+    if (status != NV_OK)
+        return status;
+
+    status = test_tracker_many_channels();
+    if (status != NV_OK)
+        return status;
+
     uvm_va_space_down_read_rm(va_space);
 
     status = test_tracker_basic(va_space);
@@ -418,3 +869,165 @@ done:
 
     return status;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Reference tracker implementation used to evaluate uvm_tracker_t. It has a
+// single static entry, grows through uvm_kvrealloc() and deduplicates channels
+// with a linear search.
+typedef struct
+{
+    uvm_tracker_entry_t static_entry;
+    uvm_tracker_entry_t *dynamic_entries;
+    NvU32 size;
+    NvU32 max_size;
+} test_reference_tracker_t;
+
+static uvm_tracker_entry_t *reference_tracker_entries(test_reference_tracker_t *tracker)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return tracker->max_size == 1 ? &tracker->static_entry : tracker->dynamic_entries;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS reference_tracker_add_entry(test_reference_tracker_t *tracker, uvm_tracker_entry_t *new_entry)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_tracker_entry_t *entries = reference_tracker_entries(tracker);
+    NvU32 i;
+
+    for (i = 0; i < tracker->size; ++i) {
+        if (entries[i].channel == new_entry->channel) {
+            entries[i].value = max(entries[i].value, new_entry->value);
+            return NV_OK;
+        }
+    }
+
+    if (tracker->size == tracker->max_size) {
+        NvU32 new_max_size = max((NvU32)8, (NvU32)roundup_pow_of_two(tracker->size + 1));
+        uvm_tracker_entry_t *new_entries;
+
+        if (tracker->max_size == 1) {
+            new_entries = uvm_kvmalloc(sizeof(*new_entries) * new_max_size);
+            if (new_entries)
+                memcpy(new_entries, &tracker->static_entry, sizeof(*new_entries) * tracker->size);
+        }
+        else {
+            new_entries = uvm_kvrealloc(tracker->dynamic_entries, sizeof(*new_entries) * new_max_size);
+        }
+        if (!new_entries)
+            return NV_ERR_NO_MEMORY;
+
+        tracker->dynamic_entries = new_entries;
+        tracker->max_size = new_max_size;
+        entries = new_entries;
+    }
+
+    entries[tracker->size++] = *new_entry;
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS reference_tracker_add_tracker(test_reference_tracker_t *dst, test_reference_tracker_t *src)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_tracker_entry_t *entries = reference_tracker_entries(src);
+    NvU32 i;
+
+    for (i = 0; i < src->size; ++i) {
+        NV_STATUS status = reference_tracker_add_entry(dst, &entries[i]);
+        if (status != NV_OK)
+            return status;
+    }
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void reference_tracker_deinit(test_reference_tracker_t *tracker)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (tracker->max_size != 1)
+        uvm_kvfree(tracker->dynamic_entries);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Build a tracker for the channels in [first, first + count) and merge it into
+// one for the channels in [0, count).
+static NV_STATUS tracker_perf_iteration(test_mock_channel_t *mocks, NvU32 count, NvU32 first, NvU64 value)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    uvm_tracker_t dst = UVM_TRACKER_INIT();
+    uvm_tracker_t src = UVM_TRACKER_INIT();
+    uvm_tracker_entry_t entry;
+    NvU32 i;
+
+    for (i = 0; i < count; ++i) {
+        entry = mock_channel_entry(&mocks[i], value);
+        TEST_NV_CHECK_GOTO(uvm_tracker_add_entry(&dst, &entry), done);
+
+        entry = mock_channel_entry(&mocks[first + i], value + 1);
+        TEST_NV_CHECK_GOTO(uvm_tracker_add_entry(&src, &entry), done);
+    }
+
+    TEST_NV_CHECK_GOTO(uvm_tracker_add_tracker(&dst, &src), done);
+    TEST_CHECK_GOTO(dst.size == first + count, done);
+
+done:
+    uvm_tracker_deinit(&src);
+    uvm_tracker_deinit(&dst);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static NV_STATUS reference_tracker_perf_iteration(test_mock_channel_t *mocks, NvU32 count, NvU32 first, NvU64 value)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    test_reference_tracker_t dst = { { 0 }, NULL, 0, 1 };
+    test_reference_tracker_t src = { { 0 }, NULL, 0, 1 };
+    uvm_tracker_entry_t entry;
+    NvU32 i;
+
+    for (i = 0; i < count; ++i) {
+        entry = mock_channel_entry(&mocks[i], value);
+        TEST_NV_CHECK_GOTO(reference_tracker_add_entry(&dst, &entry), done);
+
+        entry = mock_channel_entry(&mocks[first + i], value + 1);
+        TEST_NV_CHECK_GOTO(reference_tracker_add_entry(&src, &entry), done);
+    }
+
+    TEST_NV_CHECK_GOTO(reference_tracker_add_tracker(&dst, &src), done);
+    TEST_CHECK_GOTO(dst.size == first + count, done);
+
+done:
+    reference_tracker_deinit(&src);
+    reference_tracker_deinit(&dst);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NV_STATUS uvm8_test_tracker_perf(UVM_TEST_TRACKER_PERF_PARAMS *params, struct file *filp)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    test_mock_channel_t *mocks;
+    NvU32 count = params->num_channels / 2;
+    NvU32 first = params->num_channels / 4;
+    NvU64 start;
+    NvU32 i;
+
+    if (params->iterations == 0 || params->num_channels < 2 || params->num_channels > 256)
+        return NV_ERR_INVALID_ARGUMENT;
+
+    mocks = uvm_kvmalloc(sizeof(*mocks) * params->num_channels);
+    if (!mocks)
+        return NV_ERR_NO_MEMORY;
+
+    for (i = 0; i < params->num_channels; ++i)
+        mock_channel_init(&mocks[i]);
+
+    start = NV_GETTIME();
+    for (i = 0; i < params->iterations; ++i)
+        TEST_NV_CHECK_GOTO(tracker_perf_iteration(mocks, count, first, i), done);
+    params->tracker_ns = (NV_GETTIME() - start) / params->iterations;
+
+    start = NV_GETTIME();
+    for (i = 0; i < params->iterations; ++i)
+        TEST_NV_CHECK_GOTO(reference_tracker_perf_iteration(mocks, count, first, i), done);
+    params->reference_ns = (NV_GETTIME() - start) / params->iterations;
+
+done:
+    uvm_kvfree(mocks);
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -38,6 +38,7 @@
 #include "uvm8_perf_prefetch.h"
 #include "uvm8_mem.h"
 #include "uvm8_gpu_access_counters.h"
+#include "uvm8_test.h"
 #include "uvm8_test_ioctl.h"
 
 typedef enum
@@ -54,6 +55,46 @@ static struct kmem_cache *g_uvm_va_block_gpu_state_cache __read_mostly;
 static struct kmem_cache *g_uvm_page_mask_cache __read_mostly;
 static struct kmem_cache *g_uvm_va_block_context_cache __read_mostly;
 
+// Per-CPU pools of scratch objects. A uvm_va_block_context_t and the temporary
+// page masks are allocated and freed on every migrate, populate and fault
+// servicing call. Freed objects are kept in a small stack of the CPU doing the
+// free, and handed out again by the next allocation on that CPU without going
+// through the kmem cache. Preemption is only disabled while the per-CPU stack
+// is manipulated, so an object may be freed to the pool of a different CPU
+// than the one it was allocated from.
+#define UVM_VA_BLOCK_SCRATCH_POOL_SIZE_DEFAULT 4
+#define UVM_VA_BLOCK_SCRATCH_POOL_SIZE_MAX     16
+
+static unsigned uvm_va_block_scratch_pool_size = UVM_VA_BLOCK_SCRATCH_POOL_SIZE_DEFAULT;
+module_param(uvm_va_block_scratch_pool_size, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_va_block_scratch_pool_size,
+                 "Number of freed VA block contexts and page masks cached per CPU. 0 disables the pools.");
+
+static unsigned g_uvm_va_block_scratch_pool_size __read_mostly;
+
+typedef struct
+{
+    void *objects[UVM_VA_BLOCK_SCRATCH_POOL_SIZE_MAX];
+
+    NvU32 count;
+
+    // Number of allocations served by the kmem cache and by the pool on this
+    // CPU. Only updated with preemption disabled.
+    NvU64 num_cache_allocs;
+    NvU64 num_pool_allocs;
+} va_block_scratch_cpu_pool_t;
+
+typedef struct
+{
+    struct kmem_cache *cache;
+
+    // Per-CPU pools. NULL if the pools are disabled.
+    va_block_scratch_cpu_pool_t __percpu *cpu_pools;
+} va_block_scratch_pool_t;
+
+static va_block_scratch_pool_t g_uvm_va_block_context_pool;
+static va_block_scratch_pool_t g_uvm_page_mask_pool;
+
 static int uvm_fault_force_sysmem __read_mostly = 0;
 module_param(uvm_fault_force_sysmem, int, S_IRUGO|S_IWUSR);
 MODULE_PARM_DESC(uvm_fault_force_sysmem, "Force (1) using sysmem storage for pages that faulted. Default: 0.");
@@ -213,8 +254,106 @@ static block_phys_page_t block_phys_page(uvm_processor_id_t processor, uvm_page_
     return (block_phys_page_t){ processor, page_index };
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+static NV_STATUS scratch_pool_init(va_block_scratch_pool_t *pool, struct kmem_cache *cache)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    pool->cache = cache;
+
+    if (g_uvm_va_block_scratch_pool_size == 0)
+        return NV_OK;
+
+    pool->cpu_pools = alloc_percpu(va_block_scratch_cpu_pool_t);
+    if (!pool->cpu_pools)
+        return NV_ERR_NO_MEMORY;
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void scratch_pool_deinit(va_block_scratch_pool_t *pool)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    unsigned cpu;
+
+    if (!pool->cpu_pools)
+        return;
+
+    for_each_possible_cpu(cpu) {
+        va_block_scratch_cpu_pool_t *cpu_pool = per_cpu_ptr(pool->cpu_pools, cpu);
+
+        while (cpu_pool->count > 0)
+            kmem_cache_free(pool->cache, cpu_pool->objects[--cpu_pool->count]);
+    }
+
+    free_percpu(pool->cpu_pools);
+    pool->cpu_pools = NULL;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void *scratch_pool_alloc(va_block_scratch_pool_t *pool, bool use_pool)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    va_block_scratch_cpu_pool_t *cpu_pool;
+    void *object = NULL;
+
+    if (!pool->cpu_pools)
+        return kmem_cache_alloc(pool->cache, NV_UVM_GFP_FLAGS);
+
+    cpu_pool = per_cpu_ptr(pool->cpu_pools, get_cpu());
+
+    if (use_pool && cpu_pool->count > 0) {
+        object = cpu_pool->objects[--cpu_pool->count];
+        ++cpu_pool->num_pool_allocs;
+    }
+    else {
+        ++cpu_pool->num_cache_allocs;
+    }
+
+    put_cpu();
+
+    if (!object)
+        object = kmem_cache_alloc(pool->cache, NV_UVM_GFP_FLAGS);
+
+    return object;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static void scratch_pool_free(va_block_scratch_pool_t *pool, void *object, bool use_pool)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    va_block_scratch_cpu_pool_t *cpu_pool;
+
+    if (!object)
+        return;
+
+    if (pool->cpu_pools && use_pool) {
+        cpu_pool = per_cpu_ptr(pool->cpu_pools, get_cpu());
+
+        if (cpu_pool->count < g_uvm_va_block_scratch_pool_size) {
+            cpu_pool->objects[cpu_pool->count++] = object;
+            object = NULL;
+        }
+
+        put_cpu();
+    }
+
+    if (object)
+        kmem_cache_free(pool->cache, object);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Sum of the kmem cache allocations done by all CPUs for the given pool. Only
+// used in testing.
+static NvU64 scratch_pool_num_cache_allocs(va_block_scratch_pool_t *pool)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU64 num_cache_allocs = 0;
+    unsigned cpu;
+
+    if (!pool->cpu_pools)
+        return 0;
+
+    for_each_possible_cpu(cpu)
+        num_cache_allocs += READ_ONCE(per_cpu_ptr(pool->cpu_pools, cpu)->num_cache_allocs);
+
+    return num_cache_allocs;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 NV_STATUS uvm_va_block_init(void)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+
     if (uvm_enable_builtin_tests)
         g_uvm_va_block_cache = NV_KMEM_CACHE_CREATE("uvm_va_block_wrapper_t", uvm_va_block_wrapper_t);
     else
@@ -235,30 +374,51 @@ NV_STATUS uvm_va_block_init(void)
     if (!g_uvm_va_block_context_cache)
         return NV_ERR_NO_MEMORY;
 
-    return NV_OK;
+    if (uvm_va_block_scratch_pool_size > UVM_VA_BLOCK_SCRATCH_POOL_SIZE_MAX) {
+        pr_info("Invalid value %u for uvm_va_block_scratch_pool_size, using %u instead\n",
+                uvm_va_block_scratch_pool_size,
+                UVM_VA_BLOCK_SCRATCH_POOL_SIZE_MAX);
+        g_uvm_va_block_scratch_pool_size = UVM_VA_BLOCK_SCRATCH_POOL_SIZE_MAX;
+    }
+    else {
+        g_uvm_va_block_scratch_pool_size = uvm_va_block_scratch_pool_size;
+    }
+
+    status = scratch_pool_init(&g_uvm_page_mask_pool, g_uvm_page_mask_cache);
+    if (status != NV_OK)
+        return status;
+
+    return scratch_pool_init(&g_uvm_va_block_context_pool, g_uvm_va_block_context_cache);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 void uvm_va_block_exit(void)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    scratch_pool_deinit(&g_uvm_va_block_context_pool);
+    scratch_pool_deinit(&g_uvm_page_mask_pool);
+
     kmem_cache_destroy_safe(&g_uvm_va_block_context_cache);
     kmem_cache_destroy_safe(&g_uvm_page_mask_cache);
     kmem_cache_destroy_safe(&g_uvm_va_block_gpu_state_cache);
     kmem_cache_destroy_safe(&g_uvm_va_block_cache);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
-uvm_va_block_context_t *uvm_va_block_context_alloc(void)
+static uvm_va_block_context_t *block_context_alloc(bool use_pool)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    uvm_va_block_context_t *block_context = kmem_cache_alloc(g_uvm_va_block_context_cache, NV_UVM_GFP_FLAGS);
+    uvm_va_block_context_t *block_context = scratch_pool_alloc(&g_uvm_va_block_context_pool, use_pool);
     if (block_context)
         uvm_va_block_context_init(block_context);
 
     return block_context;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+uvm_va_block_context_t *uvm_va_block_context_alloc(void)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    return block_context_alloc(true);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 void uvm_va_block_context_free(uvm_va_block_context_t *va_block_context)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
-    if (va_block_context)
-        kmem_cache_free(g_uvm_va_block_context_cache, va_block_context);
+    scratch_pool_free(&g_uvm_va_block_context_pool, va_block_context, true);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
 static uvm_va_block_gpu_state_t *block_gpu_state_get(uvm_va_block_t *block, uvm_gpu_id_t gpu_id)
@@ -1653,7 +1813,7 @@ static NV_STATUS block_zero_new_gpu_chunk(uvm_va_block_t *block,
         return NV_OK;
 
     gpu_state = block_gpu_state_get(block, gpu->id);
-    zero_mask = kmem_cache_alloc(g_uvm_page_mask_cache, NV_UVM_GFP_FLAGS);
+    zero_mask = scratch_pool_alloc(&g_uvm_page_mask_pool, true);
 
     if (!zero_mask)
         return NV_ERR_NO_MEMORY;
@@ -1771,8 +1931,7 @@ out:
                    (size_t)uvm_div_pow2_64(uvm_va_block_region_size(chunk_region), big_page_size));
     }
 
-    if (zero_mask)
-        kmem_cache_free(g_uvm_page_mask_cache, zero_mask);
+    scratch_pool_free(&g_uvm_page_mask_pool, zero_mask, true);
 
     return status;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -2129,6 +2288,267 @@ static NV_STATUS block_copy_begin_push(uvm_va_block_t *va_block,
                                   va_block->end);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Channel type used for copies from src_id processor to dst_id processor, see
+// block_copy_begin_push
+static uvm_channel_type_t block_copy_channel_type(uvm_processor_id_t dst_id, uvm_processor_id_t src_id)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (UVM_ID_IS_CPU(src_id))
+        return UVM_CHANNEL_TYPE_CPU_TO_GPU;
+    else if (UVM_ID_IS_CPU(dst_id))
+        return UVM_CHANNEL_TYPE_GPU_TO_CPU;
+
+    return UVM_CHANNEL_TYPE_GPU_TO_GPU;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Reset the stripe state for a new copy from src_id to dst_id done by push.
+// See block_copy_stripes_memcopy.
+static void block_copy_stripes_init(uvm_va_block_context_t *block_context,
+                                    uvm_push_t *push,
+                                    uvm_processor_id_t dst_id,
+                                    uvm_processor_id_t src_id,
+                                    uvm_va_block_transfer_mode_t transfer_mode,
+                                    uvm_make_resident_cause_t cause)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_va_block_copy_stripes_t *stripes = &block_context->make_resident.copy_stripes;
+
+    stripes->count = 0;
+    stripes->ce_mask = 1UL << uvm_channel_get_ce_index(push->channel);
+    stripes->exhausted = uvm_push_get_gpu(push)->copy_stripes.stripe_size == 0;
+    stripes->copies[0] = 0;
+    stripes->current = 0;
+    stripes->current_bytes = 0;
+    stripes->split = false;
+    stripes->dst_id = dst_id;
+    stripes->src_id = src_id;
+    stripes->transfer_mode = transfer_mode;
+    stripes->cause = cause;
+    stripes->pending_migration.bytes = 0;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+static uvm_push_t *block_copy_stripes_get_push(uvm_va_block_context_t *block_context, uvm_push_t *push, NvU32 index)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    if (index == 0)
+        return push;
+
+    return &block_context->make_resident.copy_stripes.pushes[index - 1];
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Begin a push for stripes on a CE which is not used by the copy yet. The push
+// is registered with tools like the main copy push, address being the first
+// address copied by it. Returns false if no such push could be started, in
+// which case no more attempts are made for the copy.
+static bool block_copy_stripes_add_push(uvm_va_block_t *block,
+                                        uvm_va_block_context_t *block_context,
+                                        uvm_gpu_t *copying_gpu,
+                                        NvU64 address)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+    uvm_push_t *push;
+    uvm_va_block_copy_stripes_t *stripes = &block_context->make_resident.copy_stripes;
+    uvm_channel_type_t channel_type = block_copy_channel_type(stripes->dst_id, stripes->src_id);
+
+    if (stripes->exhausted)
+        return false;
+
+    if (stripes->count == UVM_VA_BLOCK_COPY_STRIPE_PUSHES_MAX) {
+        stripes->exhausted = true;
+        return false;
+    }
+
+    push = &stripes->pushes[stripes->count];
+
+    // The stripes depend on the same work as the main copy push. Like the main
+    // copy push, peer copies can use the CE recommended for the peer, see
+    // block_copy_begin_push.
+    if (channel_type == UVM_CHANNEL_TYPE_GPU_TO_GPU) {
+        status = uvm_push_try_begin_acquire_gpu_to_gpu_excluding_ce(copying_gpu->channel_manager,
+                                                                    block_get_gpu(block, stripes->dst_id),
+                                                                    stripes->ce_mask,
+                                                                    &block->tracker,
+                                                                    push,
+                                                                    "Copy stripes from %s to %s for block [0x%llx, 0x%llx]",
+                                                                    block_processor_name(block, stripes->src_id),
+                                                                    block_processor_name(block, stripes->dst_id),
+                                                                    block->start,
+                                                                    block->end);
+    }
+    else {
+        status = uvm_push_try_begin_acquire_excluding_ce(copying_gpu->channel_manager,
+                                                         channel_type,
+                                                         stripes->ce_mask,
+                                                         &block->tracker,
+                                                         push,
+                                                         "Copy stripes from %s to %s for block [0x%llx, 0x%llx]",
+                                                         block_processor_name(block, stripes->src_id),
+                                                         block_processor_name(block, stripes->dst_id),
+                                                         block->start,
+                                                         block->end);
+    }
+    if (status != NV_OK) {
+        stripes->exhausted = true;
+        return false;
+    }
+
+    stripes->ce_mask |= 1UL << uvm_channel_get_ce_index(push->channel);
+    ++stripes->count;
+    stripes->copies[stripes->count] = 0;
+
+    uvm_tools_record_block_migration_begin(block, push, stripes->dst_id, stripes->src_id, address, stripes->cause);
+
+    atomic64_inc(&copying_gpu->copy_stripes.stats.stripe_pushes);
+
+    return true;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Notify the perf events of the pending migration of the copy, if any
+static void block_copy_stripes_flush_migration(uvm_va_block_t *block,
+                                               uvm_va_block_context_t *block_context,
+                                               uvm_push_t *push)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_va_block_copy_stripes_t *stripes = &block_context->make_resident.copy_stripes;
+
+    if (stripes->pending_migration.bytes == 0)
+        return;
+
+    uvm_perf_event_notify_migration(&block->va_range->va_space->perf_events,
+                                    block_copy_stripes_get_push(block_context, push, stripes->pending_migration.push_index),
+                                    block,
+                                    stripes->dst_id,
+                                    stripes->src_id,
+                                    stripes->pending_migration.address,
+                                    stripes->pending_migration.bytes,
+                                    stripes->transfer_mode,
+                                    stripes->pending_migration.cause,
+                                    &block_context->make_resident);
+
+    stripes->pending_migration.bytes = 0;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Record the migration of the VA range [address, address + size) on the push
+// with the given index. It's merged into the pending migration if it extends
+// it, and the pending migration is notified otherwise. The notification must
+// happen before the push gets any other work, as it timestamps the migration.
+static void block_copy_stripes_add_migration(uvm_va_block_t *block,
+                                             uvm_va_block_context_t *block_context,
+                                             uvm_push_t *push,
+                                             NvU32 index,
+                                             NvU64 address,
+                                             NvU64 size,
+                                             uvm_make_resident_cause_t cause)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_va_block_copy_stripes_t *stripes = &block_context->make_resident.copy_stripes;
+
+    if (stripes->pending_migration.bytes != 0 &&
+        stripes->pending_migration.push_index == index &&
+        stripes->pending_migration.address + stripes->pending_migration.bytes == address &&
+        stripes->pending_migration.cause == cause) {
+        stripes->pending_migration.bytes += size;
+        return;
+    }
+
+    block_copy_stripes_flush_migration(block, block_context, push);
+
+    stripes->pending_migration.push_index = index;
+    stripes->pending_migration.address = address;
+    stripes->pending_migration.bytes = size;
+    stripes->pending_migration.cause = cause;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Pick the push for the next bytes of the copy, at the given address, and
+// return its index. Each stripe is issued on a single push, round-robin over
+// the main copy push and the stripe pushes, which are started on demand.
+static NvU32 block_copy_stripes_next_push(uvm_va_block_t *block,
+                                          uvm_va_block_context_t *block_context,
+                                          uvm_push_t *push,
+                                          NvU64 address)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_va_block_copy_stripes_t *stripes = &block_context->make_resident.copy_stripes;
+    NvU64 stripe_size = uvm_push_get_gpu(push)->copy_stripes.stripe_size;
+    NvU32 index;
+
+    if (stripe_size == 0 || stripes->current_bytes < stripe_size)
+        return stripes->current;
+
+    index = stripes->current + 1;
+    if (index > stripes->count && !block_copy_stripes_add_push(block, block_context, uvm_push_get_gpu(push), address))
+        index = 0;
+
+    if (index != 0 && !stripes->split) {
+        atomic64_inc(&uvm_push_get_gpu(push)->copy_stripes.stats.split_copies);
+        stripes->split = true;
+    }
+
+    stripes->current = index;
+    stripes->current_bytes = 0;
+
+    return index;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Copy size bytes backing the VA range starting at address, as part of the copy
+// started with block_copy_stripes_init. All the memcopies of the copy, both the
+// per-page ones and the ones of physically-contiguous runs, are spread in
+// stripes of the copying GPU's stripe size across the main copy push and pushes
+// on other CEs. The stripe pushes must be ended with
+// block_copy_stripes_end.
+static void block_copy_stripes_memcopy(uvm_va_block_t *block,
+                                       uvm_va_block_context_t *block_context,
+                                       uvm_push_t *push,
+                                       uvm_gpu_address_t dst_address,
+                                       uvm_gpu_address_t src_address,
+                                       NvU64 address,
+                                       size_t size,
+                                       uvm_make_resident_cause_t cause)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_va_block_copy_stripes_t *stripes = &block_context->make_resident.copy_stripes;
+    uvm_gpu_t *copying_gpu = uvm_push_get_gpu(push);
+
+    while (size > 0) {
+        NvU32 index = block_copy_stripes_next_push(block, block_context, push, address);
+        uvm_push_t *stripe_push = block_copy_stripes_get_push(block_context, push, index);
+        size_t copy_size = size;
+
+        if (copying_gpu->copy_stripes.stripe_size != 0)
+            copy_size = min(copy_size, (size_t)(copying_gpu->copy_stripes.stripe_size - stripes->current_bytes));
+
+        block_copy_stripes_add_migration(block, block_context, push, index, address, copy_size, cause);
+
+        // Copies on the same push don't depend on each other
+        if (stripes->copies[index]++ != 0)
+            uvm_push_set_flag(stripe_push, UVM_PUSH_FLAG_CE_NEXT_PIPELINED);
+
+        uvm_push_set_flag(stripe_push, UVM_PUSH_FLAG_CE_NEXT_MEMBAR_NONE);
+        copying_gpu->ce_hal->memcopy(stripe_push, dst_address, src_address, copy_size);
+
+        stripes->current_bytes += copy_size;
+        dst_address.address += copy_size;
+        src_address.address += copy_size;
+        address += copy_size;
+        size -= copy_size;
+    }
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// End the stripe pushes of the copy and add them to tracker
+static NV_STATUS block_copy_stripes_end(uvm_va_block_context_t *block_context, uvm_tracker_t *tracker)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    uvm_va_block_copy_stripes_t *stripes = &block_context->make_resident.copy_stripes;
+    NvU32 i;
+
+    for (i = 0; i < stripes->count; ++i) {
+        NV_STATUS tracker_status;
+
+        uvm_push_end(&stripes->pushes[i]);
+
+        tracker_status = uvm_tracker_add_push_safe(tracker, &stripes->pushes[i]);
+        if (status == NV_OK)
+            status = tracker_status;
+    }
+
+    stripes->count = 0;
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 // A page is clean iff...
 // the destination is the preferred location and
 // the source is the CPU and
@@ -2413,6 +2833,7 @@ static NV_STATUS block_copy_resident_pages_between(uvm_va_block_t *block,
             if (status != NV_OK)
                 break;
             copying_gpu = uvm_push_get_gpu(&push);
+            block_copy_stripes_init(block_context, &push, dst_id, src_id, block_transfer_mode, cause);
 
             // Record all processors involved in the copy
             uvm_processor_mask_set(&block_context->make_resident.all_involved_processors, copying_gpu->id);
@@ -2425,9 +2846,6 @@ static NV_STATUS block_copy_resident_pages_between(uvm_va_block_t *block,
             // of contig_cause
             uvm_tools_record_block_migration_begin(block, &push, dst_id, src_id, page_start, cause);
         }
-        else {
-            uvm_push_set_flag(&push, UVM_PUSH_FLAG_CE_NEXT_PIPELINED);
-        }
 
         block_update_page_dirty_state(block, dst_id, src_id, page_index);
 
@@ -2459,21 +2877,16 @@ static NV_STATUS block_copy_resident_pages_between(uvm_va_block_t *block,
                 src_address.address += contig_start_index * PAGE_SIZE;
                 dst_address.address += contig_start_index * PAGE_SIZE;
 
-                uvm_push_set_flag(&push, UVM_PUSH_FLAG_CE_NEXT_MEMBAR_NONE);
-                copying_gpu->ce_hal->memcopy(&push, dst_address, src_address, contig_region_size);
+                block_copy_stripes_memcopy(block,
+                                           block_context,
+                                           &push,
+                                           dst_address,
+                                           src_address,
+                                           uvm_va_block_region_start(block, contig_region),
+                                           contig_region_size,
+                                           contig_cause);
             }
 
-            uvm_perf_event_notify_migration(&va_space->perf_events,
-                                            &push,
-                                            block,
-                                            dst_id,
-                                            src_id,
-                                            uvm_va_block_region_start(block, contig_region),
-                                            contig_region_size,
-                                            block_transfer_mode,
-                                            contig_cause,
-                                            &block_context->make_resident);
-
             contig_start_index = page_index;
             contig_cause = page_cause;
         }
@@ -2503,8 +2916,14 @@ static NV_STATUS block_copy_resident_pages_between(uvm_va_block_t *block,
                 dst_address = block_phys_page_copy_address(block, block_phys_page(dst_id, page_index), copying_gpu);
             }
 
-            uvm_push_set_flag(&push, UVM_PUSH_FLAG_CE_NEXT_MEMBAR_NONE);
-            copying_gpu->ce_hal->memcopy(&push, dst_address, src_address, PAGE_SIZE);
+            block_copy_stripes_memcopy(block,
+                                       block_context,
+                                       &push,
+                                       dst_address,
+                                       src_address,
+                                       page_start,
+                                       PAGE_SIZE,
+                                       page_cause);
         }
 
         last_index = page_index;
@@ -2523,20 +2942,17 @@ static NV_STATUS block_copy_resident_pages_between(uvm_va_block_t *block,
             src_address.address += contig_start_index * PAGE_SIZE;
             dst_address.address += contig_start_index * PAGE_SIZE;
 
-            uvm_push_set_flag(&push, UVM_PUSH_FLAG_CE_NEXT_MEMBAR_NONE);
-            copying_gpu->ce_hal->memcopy(&push, dst_address, src_address, contig_region_size);
+            block_copy_stripes_memcopy(block,
+                                       block_context,
+                                       &push,
+                                       dst_address,
+                                       src_address,
+                                       uvm_va_block_region_start(block, contig_region),
+                                       contig_region_size,
+                                       contig_cause);
         }
 
-        uvm_perf_event_notify_migration(&va_space->perf_events,
-                                        &push,
-                                        block,
-                                        dst_id,
-                                        src_id,
-                                        uvm_va_block_region_start(block, contig_region),
-                                        contig_region_size,
-                                        block_transfer_mode,
-                                        contig_cause,
-                                        &block_context->make_resident);
+        block_copy_stripes_flush_migration(block, block_context, &push);
 
         // TODO: Bug 1766424: If the destination is a GPU and the copy was done
         //       by that GPU, use a GPU-local membar if no peer can currently
@@ -2546,6 +2962,10 @@ static NV_STATUS block_copy_resident_pages_between(uvm_va_block_t *block,
         tracker_status = uvm_tracker_add_push_safe(copy_tracker, &push);
         if (status == NV_OK)
             status = tracker_status;
+
+        tracker_status = block_copy_stripes_end(block_context, copy_tracker);
+        if (status == NV_OK)
+            status = tracker_status;
     }
 
     // Update VA block status bits
@@ -4706,6 +5126,7 @@ static void block_gpu_map_split_2m(uvm_va_block_t *block,
     tlb_membar = block_pte_op_membar(pte_op, gpu, resident_id);
     block_gpu_pte_finish_split_2m(block, gpu, push, pte_batch, tlb_batch, tlb_membar);
 
+    atomic64_inc(&gpu->pte_size_stats.num_2m_demotions);
     gpu_state->pte_is_2m = false;
     bitmap_copy(gpu_state->big_ptes, new_pte_state->big_ptes, MAX_BIG_PAGES_PER_UVM_VA_BLOCK);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -4793,6 +5214,7 @@ static void block_gpu_split_2m(uvm_va_block_t *block,
     // changing permissions.
     block_gpu_pte_finish_split_2m(block, gpu, push, pte_batch, tlb_batch, UVM_MEMBAR_NONE);
 
+    atomic64_inc(&gpu->pte_size_stats.num_2m_demotions);
     gpu_state->pte_is_2m = false;
     bitmap_copy(gpu_state->big_ptes, new_big_ptes_local, MAX_BIG_PAGES_PER_UVM_VA_BLOCK);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -4885,6 +5307,7 @@ static void block_gpu_split_big(uvm_va_block_t *block,
 
     uvm_tlb_batch_end(tlb_batch, push, UVM_MEMBAR_NONE);
 
+    atomic64_add(bitmap_weight(big_ptes_to_split, MAX_BIG_PAGES_PER_UVM_VA_BLOCK), &gpu->pte_size_stats.num_big_demotions);
     bitmap_andnot(gpu_state->big_ptes, gpu_state->big_ptes, big_ptes_to_split, MAX_BIG_PAGES_PER_UVM_VA_BLOCK);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
@@ -4940,6 +5363,7 @@ static void block_gpu_map_big_and_4k(uvm_va_block_t *block,
     //
     // Mask computation: big_before && !big_after
     bitmap_andnot(big_ptes_split, gpu_state->big_ptes, new_pte_state->big_ptes, MAX_BIG_PAGES_PER_UVM_VA_BLOCK);
+    atomic64_add(bitmap_weight(big_ptes_split, MAX_BIG_PAGES_PER_UVM_VA_BLOCK), &gpu->pte_size_stats.num_big_demotions);
 
     block_gpu_pte_big_split_write_4k(block,
                                      block_context,
@@ -5196,6 +5620,7 @@ static void block_gpu_unmap_split_2m(uvm_va_block_t *block,
     // invalidate for the 2M entry.
     block_gpu_pte_finish_split_2m(block, gpu, push, pte_batch, tlb_batch, tlb_membar);
 
+    atomic64_inc(&gpu->pte_size_stats.num_2m_demotions);
     gpu_state->pte_is_2m = false;
     bitmap_copy(gpu_state->big_ptes, new_pte_state->big_ptes, MAX_BIG_PAGES_PER_UVM_VA_BLOCK);
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
@@ -5242,6 +5667,7 @@ static void block_gpu_unmap_big_and_4k(uvm_va_block_t *block,
     //
     // Mask computation: big_before && !big_after
     bitmap_andnot(big_ptes_split, gpu_state->big_ptes, new_pte_state->big_ptes, MAX_BIG_PAGES_PER_UVM_VA_BLOCK);
+    atomic64_add(bitmap_weight(big_ptes_split, MAX_BIG_PAGES_PER_UVM_VA_BLOCK), &gpu->pte_size_stats.num_big_demotions);
 
     block_gpu_pte_big_split_write_4k(block,
                                      block_context,
@@ -6918,6 +7344,154 @@ NV_STATUS uvm_va_block_map(uvm_va_block_t *va_block,
     return NV_OK;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+// Returns whether new_pte_state, computed for pages which are already mapped,
+// uses larger PTEs than the current ones for any of them.
+static bool block_gpu_new_pte_state_is_promotion(uvm_va_block_gpu_state_t *gpu_state,
+                                                 uvm_va_block_new_pte_state_t *new_pte_state)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    DECLARE_BITMAP(big_ptes_promoted, MAX_BIG_PAGES_PER_UVM_VA_BLOCK);
+
+    if (gpu_state->pte_is_2m)
+        return false;
+
+    if (new_pte_state->pte_is_2m)
+        return true;
+
+    // Mask computation: !big_before && big_after && covered
+    bitmap_and(big_ptes_promoted, new_pte_state->big_ptes, new_pte_state->big_ptes_covered, MAX_BIG_PAGES_PER_UVM_VA_BLOCK);
+    return bitmap_andnot(big_ptes_promoted, big_ptes_promoted, gpu_state->big_ptes, MAX_BIG_PAGES_PER_UVM_VA_BLOCK);
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NV_STATUS uvm_va_block_promote_gpu_ptes(uvm_va_block_t *va_block,
+                                        uvm_va_block_context_t *va_block_context,
+                                        uvm_gpu_t *gpu,
+                                        uvm_tracker_t *out_tracker)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_va_block_gpu_state_t *gpu_state = block_gpu_state_get(va_block, gpu->id);
+    uvm_va_range_t *va_range = va_block->va_range;
+    uvm_va_space_t *va_space = va_range->va_space;
+    uvm_page_mask_t *pages_to_promote = &va_block_context->mapping.page_mask;
+    uvm_page_mask_t *pages_left = &va_block_context->mapping.map_running_page_mask;
+    uvm_va_block_new_pte_state_t *new_pte_state = &va_block_context->mapping.new_pte_state;
+    uvm_processor_mask_t resident_procs;
+    uvm_processor_id_t resident_id;
+    uvm_prot_t prot;
+    uvm_push_t push;
+    NV_STATUS status;
+
+    uvm_assert_mutex_locked(&va_block->lock);
+    uvm_assert_rwsem_locked(&va_space->lock);
+
+    // GPUs which swizzle can only use big PTEs if the peer mappings match, and
+    // blocks in which fault cancel forced 4k PTEs must keep them.
+    if (!gpu_state || gpu_state->force_4k_ptes || gpu->big_page.swizzling)
+        return NV_OK;
+
+    if (gpu_state->pte_is_2m || !block_gpu_has_page_tables(va_block, gpu))
+        return NV_OK;
+
+    uvm_page_mask_copy(pages_left, &gpu_state->pte_bits[UVM_PTE_BITS_GPU_READ]);
+    if (uvm_page_mask_empty(pages_left))
+        return NV_OK;
+
+    // Each page is mapped to the closest processor it is resident on (see
+    // block_gpu_get_processor_to_map), so the mappings are grouped by
+    // destination in the same order as uvm_va_block_map.
+    if (uvm_processor_mask_test(&va_range->uvm_lite_gpus, gpu->id)) {
+        uvm_processor_mask_zero(&resident_procs);
+        uvm_processor_mask_set(&resident_procs, va_range->preferred_location);
+    }
+    else {
+        uvm_processor_mask_copy(&resident_procs, &va_block->resident);
+    }
+
+    for_each_closest_id(resident_id, &resident_procs, gpu->id, va_space) {
+        const uvm_page_mask_t *resident_mask = uvm_va_block_resident_mask_get(va_block, resident_id);
+
+        for (prot = UVM_PROT_READ_WRITE_ATOMIC; prot > UVM_PROT_NONE; --prot) {
+            uvm_pte_bits_gpu_t pte_bit = get_gpu_pte_bit_index(prot);
+
+            // Pages mapped to resident_id with exactly prot
+            uvm_page_mask_and(pages_to_promote, pages_left, &gpu_state->pte_bits[pte_bit]);
+            if (pte_bit < UVM_PTE_BITS_GPU_ATOMIC)
+                uvm_page_mask_andnot(pages_to_promote, pages_to_promote, &gpu_state->pte_bits[pte_bit + 1]);
+            if (!uvm_page_mask_and(pages_to_promote, pages_to_promote, resident_mask))
+                continue;
+
+            UVM_ASSERT(block_check_mapping_residency(va_block, gpu, resident_id, pages_to_promote));
+
+            // The pages are re-mapped with the same attributes, so the mask
+            // of pages changing is also the mask of pages with the same
+            // attributes after the operation.
+            block_gpu_compute_new_pte_state(va_block,
+                                            gpu,
+                                            resident_id,
+                                            pages_to_promote,
+                                            pages_to_promote,
+                                            new_pte_state);
+
+            if (!block_gpu_new_pte_state_is_promotion(gpu_state, new_pte_state))
+                continue;
+
+            status = block_alloc_ptes_new_state(va_block, gpu, new_pte_state, out_tracker);
+            if (status != NV_OK)
+                return status;
+
+            status = uvm_push_begin_acquire(gpu->channel_manager,
+                                            UVM_CHANNEL_TYPE_MEMOPS,
+                                            &va_block->tracker,
+                                            &push,
+                                            "Promoting PTEs in block [0x%llx, 0x%llx) mapped as %s",
+                                            va_block->start,
+                                            va_block->end + 1,
+                                            uvm_prot_string(prot));
+            if (status != NV_OK)
+                return status;
+
+            if (new_pte_state->pte_is_2m) {
+                block_gpu_map_to_2m(va_block, va_block_context, gpu, resident_id, prot, &push, BLOCK_PTE_OP_MAP);
+                atomic64_inc(&gpu->pte_size_stats.num_2m_promotions);
+            }
+            else {
+                DECLARE_BITMAP(big_ptes_promoted, MAX_BIG_PAGES_PER_UVM_VA_BLOCK);
+
+                bitmap_and(big_ptes_promoted,
+                           new_pte_state->big_ptes,
+                           new_pte_state->big_ptes_covered,
+                           MAX_BIG_PAGES_PER_UVM_VA_BLOCK);
+                bitmap_andnot(big_ptes_promoted, big_ptes_promoted, gpu_state->big_ptes, MAX_BIG_PAGES_PER_UVM_VA_BLOCK);
+                atomic64_add(bitmap_weight(big_ptes_promoted, MAX_BIG_PAGES_PER_UVM_VA_BLOCK),
+                             &gpu->pte_size_stats.num_big_promotions);
+
+                block_gpu_map_big_and_4k(va_block,
+                                         va_block_context,
+                                         gpu,
+                                         resident_id,
+                                         pages_to_promote,
+                                         prot,
+                                         &push,
+                                         BLOCK_PTE_OP_MAP);
+            }
+
+            uvm_push_end(&push);
+
+            UVM_ASSERT(block_check_mappings(va_block));
+
+            status = uvm_tracker_add_push_safe(out_tracker, &push);
+            if (status != NV_OK)
+                return status;
+
+            // A 2M PTE covers all the pages, nothing else can be promoted
+            if (gpu_state->pte_is_2m)
+                return NV_OK;
+        }
+
+        uvm_page_mask_andnot(pages_left, pages_left, resident_mask);
+    }
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 // Revokes the given pages mapped by cpu. This is implemented by unmapping all
 // pages and mapping them later with the lower permission. This is required
 // because vm_insert_page can only be used for upgrades from Invalid.
@@ -10585,6 +11159,188 @@ NV_STATUS uvm_va_block_set_cancel(uvm_va_block_t *va_block, uvm_gpu_t *gpu)
     return status;
 pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
 
+NV_STATUS uvm8_test_va_block_promote_ptes(UVM_TEST_VA_BLOCK_PROMOTE_PTES_PARAMS *params, struct file *filp)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    uvm_va_block_t *va_block;
+    uvm_va_block_retry_t va_block_retry;
+    uvm_va_block_context_t *block_context;
+    uvm_tracker_t local_tracker = UVM_TRACKER_INIT();
+    uvm_gpu_t *gpu;
+    NvU64 num_big_promotions;
+    NvU64 num_2m_promotions;
+    NV_STATUS status;
+
+    block_context = uvm_va_block_context_alloc();
+    if (!block_context)
+        return NV_ERR_NO_MEMORY;
+
+    uvm_va_space_down_read(va_space);
+
+    gpu = uvm_va_space_get_gpu_by_uuid_with_gpu_va_space(va_space, &params->gpu_uuid);
+    if (!gpu) {
+        status = NV_ERR_INVALID_DEVICE;
+        goto out;
+    }
+
+    status = uvm_va_block_find(va_space, params->lookup_address, &va_block);
+    if (status != NV_OK)
+        goto out;
+
+    // The counters are global to the GPU, so the values reported are only
+    // accurate if nothing else changes the PTEs of the GPU concurrently.
+    num_big_promotions = atomic64_read(&gpu->pte_size_stats.num_big_promotions);
+    num_2m_promotions = atomic64_read(&gpu->pte_size_stats.num_2m_promotions);
+
+    uvm_mutex_lock(&va_block->lock);
+
+    status = UVM_VA_BLOCK_RETRY_LOCKED(va_block, &va_block_retry,
+                                       uvm_va_block_promote_gpu_ptes(va_block, block_context, gpu, &va_block->tracker));
+    if (status == NV_OK)
+        status = uvm_tracker_init_from(&local_tracker, &va_block->tracker);
+
+    uvm_mutex_unlock(&va_block->lock);
+
+    if (status == NV_OK)
+        status = uvm_tracker_wait_deinit(&local_tracker);
+
+    params->num_big_promotions = atomic64_read(&gpu->pte_size_stats.num_big_promotions) - num_big_promotions;
+    params->num_2m_promotions = atomic64_read(&gpu->pte_size_stats.num_2m_promotions) - num_2m_promotions;
+
+out:
+    uvm_va_space_up_read(va_space);
+    uvm_va_block_context_free(block_context);
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Allocate and free a VA block context and a page mask iterations times,
+// returning the number of allocations that went to the kmem caches.
+static NV_STATUS scratch_pool_test_run(NvU32 iterations, bool use_pool, NvU64 *num_cache_allocs)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NvU64 start = scratch_pool_num_cache_allocs(&g_uvm_va_block_context_pool) +
+                  scratch_pool_num_cache_allocs(&g_uvm_page_mask_pool);
+    NV_STATUS status = NV_OK;
+    NvU32 i;
+
+    for (i = 0; i < iterations && status == NV_OK; ++i) {
+        uvm_va_block_context_t *block_context = block_context_alloc(use_pool);
+        uvm_page_mask_t *page_mask = scratch_pool_alloc(&g_uvm_page_mask_pool, use_pool);
+
+        if (!block_context || !page_mask)
+            status = NV_ERR_NO_MEMORY;
+        else if (block_context->mm != current->mm)
+            status = NV_ERR_INVALID_STATE;
+
+        scratch_pool_free(&g_uvm_page_mask_pool, page_mask, use_pool);
+        scratch_pool_free(&g_uvm_va_block_context_pool, block_context, use_pool);
+    }
+
+    *num_cache_allocs = scratch_pool_num_cache_allocs(&g_uvm_va_block_context_pool) +
+                        scratch_pool_num_cache_allocs(&g_uvm_page_mask_pool) -
+                        start;
+
+    return status;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+// Upper bound on the iterations run with preemption disabled
+#define SCRATCH_POOL_TEST_PINNED_MAX_ITERATIONS 256
+
+// Allocate and free a VA block context and a page mask iterations times on a
+// single CPU, with preemption disabled. The pools of the CPU are first seeded
+// with an object each, after which every allocation must be served by them.
+static NV_STATUS scratch_pool_test_pinned(NvU32 iterations)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status = NV_OK;
+    va_block_scratch_cpu_pool_t *context_cpu_pool;
+    va_block_scratch_cpu_pool_t *mask_cpu_pool;
+    uvm_va_block_context_t *block_context;
+    uvm_page_mask_t *page_mask;
+    NvU64 num_cache_allocs;
+    NvU64 num_pool_allocs;
+    NvU32 i;
+
+    // The seed objects come from the caches, which may sleep
+    block_context = block_context_alloc(false);
+    page_mask = scratch_pool_alloc(&g_uvm_page_mask_pool, false);
+    if (!block_context || !page_mask) {
+        scratch_pool_free(&g_uvm_page_mask_pool, page_mask, false);
+        scratch_pool_free(&g_uvm_va_block_context_pool, block_context, false);
+        return NV_ERR_NO_MEMORY;
+    }
+
+    preempt_disable();
+
+    context_cpu_pool = this_cpu_ptr(g_uvm_va_block_context_pool.cpu_pools);
+    mask_cpu_pool = this_cpu_ptr(g_uvm_page_mask_pool.cpu_pools);
+
+    // If the pools of the CPU are already full, the seed objects go back to
+    // the caches, but then the pools aren't empty either
+    scratch_pool_free(&g_uvm_page_mask_pool, page_mask, true);
+    scratch_pool_free(&g_uvm_va_block_context_pool, block_context, true);
+
+    num_cache_allocs = context_cpu_pool->num_cache_allocs + mask_cpu_pool->num_cache_allocs;
+    num_pool_allocs = context_cpu_pool->num_pool_allocs + mask_cpu_pool->num_pool_allocs;
+
+    for (i = 0; i < iterations; ++i) {
+        // Never fall back to the caches with preemption disabled
+        if (context_cpu_pool->count == 0 || mask_cpu_pool->count == 0) {
+            status = NV_ERR_INVALID_STATE;
+            break;
+        }
+
+        block_context = block_context_alloc(true);
+        page_mask = scratch_pool_alloc(&g_uvm_page_mask_pool, true);
+
+        scratch_pool_free(&g_uvm_page_mask_pool, page_mask, true);
+        scratch_pool_free(&g_uvm_va_block_context_pool, block_context, true);
+    }
+
+    num_cache_allocs = context_cpu_pool->num_cache_allocs + mask_cpu_pool->num_cache_allocs - num_cache_allocs;
+    num_pool_allocs = context_cpu_pool->num_pool_allocs + mask_cpu_pool->num_pool_allocs - num_pool_allocs;
+
+    preempt_enable();
+
+    if (status != NV_OK) {
+        UVM_TEST_PRINT("Scratch pools of the CPU emptied after %u iterations\n", i);
+        return status;
+    }
+
+    TEST_CHECK_RET(num_cache_allocs == 0);
+    TEST_CHECK_RET(num_pool_allocs == 2 * (NvU64)iterations);
+
+    return NV_OK;
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
+NV_STATUS uvm8_test_va_block_scratch_pool(UVM_TEST_VA_BLOCK_SCRATCH_POOL_PARAMS *params, struct file *filp)
+{pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
+    NV_STATUS status;
+
+    params->pools_enabled = g_uvm_va_block_context_pool.cpu_pools != NULL;
+    params->num_cache_allocs_no_pool = 0;
+    params->num_cache_allocs_pool = 0;
+
+    if (!params->pools_enabled)
+        return NV_OK;
+
+    status = scratch_pool_test_run(params->iterations, false, &params->num_cache_allocs_no_pool);
+    if (status != NV_OK)
+        return status;
+
+    status = scratch_pool_test_run(params->iterations, true, &params->num_cache_allocs_pool);
+    if (status != NV_OK)
+        return status;
+
+    // The counters are global, so concurrent UVM operations may only add to
+    // them. For the same reason, and because the thread can migrate between
+    // the allocation and the free, the run with the pools is not guaranteed to
+    // hit them, so its count is only reported.
+    TEST_CHECK_RET(params->num_cache_allocs_no_pool >= 2 * (NvU64)params->iterations);
+
+    // With preemption disabled, nothing else can use the pools of the CPU, so
+    // once they are warm they must serve every allocation.
+    return scratch_pool_test_pinned(min(params->iterations, (NvU32)SCRATCH_POOL_TEST_PINNED_MAX_ITERATIONS));
+pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
+
 NV_STATUS uvm8_test_va_block_inject_error(UVM_TEST_VA_BLOCK_INJECT_ERROR_PARAMS *params, struct file *filp)
 {pr_info("UVM entering %s in %s(LINE:%s) dumping stack\n",__func__,__FILE__,__LINE__);dump_stack();pr_info("UVM entering %s in %s(LINE:%s) dumped stack\n",__func__,__FILE__,__LINE__);
     uvm_va_space_t *va_space = uvm_va_space_get(filp);
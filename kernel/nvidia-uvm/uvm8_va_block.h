@@ -698,6 +698,21 @@ NV_STATUS uvm_va_block_map(uvm_va_block_t *va_block,
                            UvmEventMapRemoteCause cause,
                            uvm_tracker_t *out_tracker);
 
+// Re-map the pages of va_block mapped by gpu with the largest PTEs allowed by
+// their current residency and permissions. This is needed when the mappings of
+// a block become uniform through operations which don't merge PTEs eagerly.
+// The permissions and destinations of the mappings are not changed.
+//
+// The pushed work is added to out_tracker, following the same rules as
+// uvm_va_block_map. This can also return NV_ERR_MORE_PROCESSING_REQUIRED if
+// page table allocation required to drop the block lock.
+//
+// LOCKING: The caller must hold the va_block lock and the VA space lock.
+NV_STATUS uvm_va_block_promote_gpu_ptes(uvm_va_block_t *va_block,
+                                        uvm_va_block_context_t *va_block_context,
+                                        uvm_gpu_t *gpu,
+                                        uvm_tracker_t *out_tracker);
+
 // Like uvm_va_block_map, except it maps all processors in the input mask. The
 // VA block tracker contains all map operations on return.
 //
@@ -1151,6 +1166,8 @@ NV_STATUS uvm_va_block_evict_chunks(uvm_va_block_t *va_block,
                                     uvm_tracker_t *tracker);
 
 NV_STATUS uvm8_test_va_block_inject_error(UVM_TEST_VA_BLOCK_INJECT_ERROR_PARAMS *params, struct file *filp);
+NV_STATUS uvm8_test_va_block_promote_ptes(UVM_TEST_VA_BLOCK_PROMOTE_PTES_PARAMS *params, struct file *filp);
+NV_STATUS uvm8_test_va_block_scratch_pool(UVM_TEST_VA_BLOCK_SCRATCH_POOL_PARAMS *params, struct file *filp);
 NV_STATUS uvm8_test_change_pte_mapping(UVM_TEST_CHANGE_PTE_MAPPING_PARAMS *params, struct file *filp);
 NV_STATUS uvm8_test_va_block_info(UVM_TEST_VA_BLOCK_INFO_PARAMS *params, struct file *filp);
 NV_STATUS uvm8_test_va_residency_info(UVM_TEST_VA_RESIDENCY_INFO_PARAMS *params, struct file *filp);
@@ -169,6 +169,63 @@ typedef struct
     unsigned count;
 } uvm_prot_page_mask_array_t[UVM_PROT_MAX - 1];
 
+typedef enum
+{
+    UVM_VA_BLOCK_TRANSFER_MODE_MOVE = 1,
+    UVM_VA_BLOCK_TRANSFER_MODE_COPY = 2
+} uvm_va_block_transfer_mode_t;
+
+// Maximum number of pushes, besides the main copy push, that a VA block copy
+// can spread its stripes across. See block_copy_stripes_memcopy in
+// uvm8_va_block.c.
+#define UVM_VA_BLOCK_COPY_STRIPE_PUSHES_MAX 3
+
+// State of a VA block copy whose memcopies are spread in stripes across the
+// main copy push and pushes on other CEs. Push indices are 0 for the main copy
+// push and i for pushes[i - 1].
+typedef struct
+{
+    uvm_push_t pushes[UVM_VA_BLOCK_COPY_STRIPE_PUSHES_MAX];
+
+    // Number of pushes in use
+    NvU32 count;
+
+    // CEs of the main copy push and of the pushes in use
+    long unsigned ce_mask;
+
+    // Set when no more pushes can be started on other CEs
+    bool exhausted;
+
+    // Number of memcopies issued on each push
+    NvU32 copies[UVM_VA_BLOCK_COPY_STRIPE_PUSHES_MAX + 1];
+
+    // Index of the push the current stripe is issued on, and the number of
+    // bytes issued to the current stripe so far
+    NvU32 current;
+    NvU64 current_bytes;
+
+    // Whether the copy has been split across pushes yet
+    bool split;
+
+    uvm_processor_id_t dst_id;
+    uvm_processor_id_t src_id;
+    uvm_va_block_transfer_mode_t transfer_mode;
+
+    // Cause of the whole copy, reported when beginning the pushes
+    uvm_make_resident_cause_t cause;
+
+    // Migration of the VA range [address, address + bytes) on push push_index
+    // which has not been notified to the perf events yet. Consecutive
+    // memcopies on the same push are notified as a single migration.
+    struct
+    {
+        NvU32 push_index;
+        NvU64 address;
+        NvU64 bytes;
+        uvm_make_resident_cause_t cause;
+    } pending_migration;
+} uvm_va_block_copy_stripes_t;
+
 // In the worst case some VA block operations require more state than we should
 // reasonably store on the stack. Instead, we dynamically allocate VA block
 // contexts. These are used for almost all operations on VA blocks.
@@ -207,6 +264,10 @@ typedef struct
 
         // Event that triggered the call
         uvm_make_resident_cause_t cause;
+
+        // Stripe pushes of the copy being done by
+        // block_copy_resident_pages_between
+        uvm_va_block_copy_stripes_t copy_stripes;
     } make_resident;
 
     // State used by the mapping APIs (unmap, map, revoke). This could be used
@@ -259,12 +320,6 @@ typedef struct
     char page_mask_string_buffer[UVM_PAGE_MASK_PRINT_MIN_BUFFER_SIZE];
 } uvm_va_block_context_t;
 
-typedef enum
-{
-    UVM_VA_BLOCK_TRANSFER_MODE_MOVE = 1,
-    UVM_VA_BLOCK_TRANSFER_MODE_COPY = 2
-} uvm_va_block_transfer_mode_t;
-
 struct uvm_reverse_map_struct
 {
     // VA block where the VA region of this Phys/DMA -> Virt translation
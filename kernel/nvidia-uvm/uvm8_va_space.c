@@ -36,6 +36,7 @@
 #include "uvm8_map_external.h"
 #include "uvm8_ats_ibm.h"
 #include "uvm8_gpu_access_counters.h"
+#include "uvm8_migrate.h"
 #include "uvm8_test.h"
 #include "uvm_common.h"
 #include "nv_uvm_interface.h"
@@ -181,6 +182,8 @@ NV_STATUS uvm_va_space_create(struct inode *inode, struct file *filp)
 
     init_waitqueue_head(&va_space->gpu_va_space_deferred_free.wait_queue);
 
+    uvm_migrate_va_space_init(va_space);
+
     filp->private_data = va_space;
     filp->f_mapping = &va_space->mapping;
 
@@ -358,6 +361,10 @@ void uvm_va_space_destroy(uvm_va_space_t *va_space)
     list_del(&va_space->list_node);
     uvm_mutex_unlock(&g_uvm_global.va_spaces.lock);
 
+    // Deferred migrations take the VA space lock, so they have to be drained
+    // before the VA space is torn down.
+    uvm_migrate_va_space_destroy(va_space);
+
     uvm_perf_heuristics_stop(va_space);
 
     // Stop all channels before unmapping anything. This kills the channels and
@@ -305,6 +305,36 @@ struct uvm_va_space_struct
         wait_queue_head_t wait_queue;
     } gpu_va_space_deferred_free;
 
+    // UVM_MIGRATE requests with UVM_MIGRATE_FLAG_DEFERRED pending execution,
+    // in submission order. They are executed by q_item, which is scheduled in
+    // the global deferred migration queue. See uvm8_migrate.c.
+    struct
+    {
+        // Protects the fields below, except q_item
+        uvm_spinlock_t lock;
+
+        // List of uvm_migrate_deferred_t
+        struct list_head pending;
+
+        // Number of entries in pending
+        NvU32 depth;
+
+        // First error returned by a deferred migration since the last
+        // UVM_MIGRATE_CANCEL call
+        NV_STATUS first_error;
+
+        // Whether q_item is scheduled or running and hasn't observed an empty
+        // pending list yet
+        bool scheduled;
+
+        // Completed by q_item once it observes an empty pending list, as the
+        // last access it makes to the VA space. Re-armed when q_item is
+        // scheduled again.
+        struct completion idle;
+
+        nv_kthread_q_item_t q_item;
+    } deferred_migrations;
+
     // Per-va_space event notification information for performance heuristics
     uvm_perf_va_space_events_t perf_events;
 
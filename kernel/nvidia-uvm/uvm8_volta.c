@@ -35,8 +35,16 @@ void uvm_hal_volta_arch_init_properties(uvm_gpu_t *gpu)
 
     gpu->tlb_batch.va_range_invalidate_supported = true;
 
-    // TODO: Bug 1767241: Run benchmarks to figure out a good number
-    gpu->tlb_batch.max_ranges = 8;
+    // Each range is invalidated with a single method, so prefer targeted
+    // invalidates for up to 8 ranges.
+    // TODO: Bug 1767241: Run benchmarks to figure out good costs
+    gpu->tlb_batch.va_invalidate_cost = 4;
+    gpu->tlb_batch.invalidate_all_cost = 32;
+
+    // More CEs are usable for each copy direction and NVLINK2 has more links
+    // than a single CE can drive, so use smaller stripes than on Pascal.
+    // TODO: Bug 1767241: Run benchmarks to figure out good stripe sizes
+    gpu->copy_stripes.stripe_size = 512 * 1024;
 
     gpu->utlb_per_gpc_count = uvm_volta_get_utlbs_per_gpc(gpu);
 
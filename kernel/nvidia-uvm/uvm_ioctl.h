@@ -768,10 +768,28 @@ typedef struct
 // The UVM driver must have builtin tests enabled for the API to use this flag.
 #define UVM_MIGRATE_FLAG_NO_GPU_VA_SPACE    0x00000004
 
+// If UVM_MIGRATE_FLAG_DEFERRED is 1, the ioctl only validates the arguments
+// and queues the migration to the VA space's migration worker, returning
+// before any work has been started. UVM_MIGRATE_FLAG_ASYNC must also be set.
+// Deferred migrations of a VA space are executed in submission order. If
+// semaphoreAddress is non-zero, semaphorePayload is written to it once the
+// migration is complete, even if the migration fails or is canceled with
+// UVM_MIGRATE_CANCEL. Errors of deferred migrations are reported by
+// UVM_MIGRATE_CANCEL.
+//
+// Deferred migrations do not create CPU mappings, which are instead created on
+// demand by CPU faults. Migrations of pageable memory are not deferred, they
+// are performed as if UVM_MIGRATE_FLAG_DEFERRED was not set.
+//
+// If too many deferred migrations are pending in the VA space, the ioctl
+// returns NV_ERR_BUSY_RETRY without queueing the migration.
+#define UVM_MIGRATE_FLAG_DEFERRED           0x00000008
+
 #define UVM_MIGRATE_FLAGS_TEST_ALL              (UVM_MIGRATE_FLAG_SKIP_CPU_MAP      | \
                                                  UVM_MIGRATE_FLAG_NO_GPU_VA_SPACE)
 
-#define UVM_MIGRATE_FLAGS_ALL                   (UVM_MIGRATE_FLAG_ASYNC | \
+#define UVM_MIGRATE_FLAGS_ALL                   (UVM_MIGRATE_FLAG_ASYNC    | \
+                                                 UVM_MIGRATE_FLAG_DEFERRED | \
                                                  UVM_MIGRATE_FLAGS_TEST_ALL)
 
 // For pageable migrations, cpuNumaNode is used as the destination NUMA node if
@@ -1014,10 +1032,22 @@ typedef struct
 // does not have R/W permission. This flag skips that check.
 #define UVM_POPULATE_PAGEABLE_FLAG_SKIP_PROT_CHECK            0x00000002
 
+// Split the range in chunks that are populated concurrently by the calling
+// thread and by kernel threads created for the call, which run on the CPUs of
+// the NUMA node of the calling thread. Pages follow the memory policies of the
+// VMAs, and are otherwise allocated on that node. If the calling thread has a
+// memory policy of its own, or its cpuset doesn't allow allocating memory from
+// its node, the kernel threads couldn't place the pages as the caller would, so
+// the range is populated by the calling thread only. The same applies to
+// ranges that are too small to be split, and to drivers loaded with
+// uvm_populate_pageable_max_threads=1.
+#define UVM_POPULATE_PAGEABLE_FLAG_PARALLEL                   0x00000004
+
 #define UVM_POPULATE_PAGEABLE_FLAGS_TEST_ALL    (UVM_POPULATE_PAGEABLE_FLAG_ALLOW_MANAGED | \
                                                  UVM_POPULATE_PAGEABLE_FLAG_SKIP_PROT_CHECK)
 
-#define UVM_POPULATE_PAGEABLE_FLAGS_ALL         UVM_POPULATE_PAGEABLE_FLAGS_TEST_ALL
+#define UVM_POPULATE_PAGEABLE_FLAGS_ALL         (UVM_POPULATE_PAGEABLE_FLAGS_TEST_ALL | \
+                                                 UVM_POPULATE_PAGEABLE_FLAG_PARALLEL)
 
 typedef struct
 {
@@ -1038,6 +1068,38 @@ typedef struct
     NV_STATUS       rmStatus;                    // OUT
 } UVM_VALIDATE_VA_RANGE_PARAMS;
 
+//
+// UvmMigrateCancel
+//
+// Cancel all the UVM_MIGRATE_FLAG_DEFERRED migrations of the VA space that have
+// not been started yet, releasing their semaphores. The ioctl returns once the
+// migration being executed by the worker, if any, is done. canceledCount is the
+// number of canceled migrations. deferredStatus is the first error returned by
+// a deferred migration since the previous UVM_MIGRATE_CANCEL call.
+//
+#define UVM_MIGRATE_CANCEL                                            UVM_IOCTL_BASE(73)
+typedef struct
+{
+    NvU64           canceledCount  NV_ALIGN_BYTES(8); // OUT
+    NV_STATUS       deferredStatus;                   // OUT
+    NV_STATUS       rmStatus;                         // OUT
+} UVM_MIGRATE_CANCEL_PARAMS;
+
+//
+// UvmToolsEventQueueSetFormat
+//
+// Select the UvmToolsEventFormat of the records written to the queue. The
+// format can only be set before events are enabled on the queue for the first
+// time. After that the ioctl fails with NV_ERR_INVALID_STATE, even if the
+// events are disabled again.
+//
+#define UVM_TOOLS_EVENT_QUEUE_SET_FORMAT                              UVM_IOCTL_BASE(74)
+typedef struct
+{
+    NvU32     format;                                      // IN, UvmToolsEventFormat
+    NV_STATUS rmStatus;                                    // OUT
+} UVM_TOOLS_EVENT_QUEUE_SET_FORMAT_PARAMS;
+
 //
 // Temporary ioctls which should be removed before UVM 8 release
 // Number backwards from 2047 - highest custom ioctl function number
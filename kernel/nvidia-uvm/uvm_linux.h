@@ -188,6 +188,28 @@ pr_info("UVM leaving %s in %s(LINE:%s)\n",__func__,__FILE__,__LINE__);}
     #define pr_debug_ratelimited UVM_NO_PRINT
 #endif
 
+// Static keys with the static_branch_* interface were added in kernel 4.3.
+// Older kernels fall back to a read-mostly flag.
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0)
+    #include <linux/jump_label.h>
+
+    #define UVM_DEFINE_STATIC_KEY_FALSE(name)   DEFINE_STATIC_KEY_FALSE(name)
+    #define UVM_DECLARE_STATIC_KEY_FALSE(name)  DECLARE_STATIC_KEY_FALSE(name)
+    #define uvm_static_branch_unlikely(key)     static_branch_unlikely(key)
+    #define uvm_static_branch_enable(key)       static_branch_enable(key)
+#else
+    #define UVM_DEFINE_STATIC_KEY_FALSE(name)   bool name __read_mostly = false
+    #define UVM_DECLARE_STATIC_KEY_FALSE(name)  extern bool name
+    #define uvm_static_branch_unlikely(key)     unlikely(*(key))
+    #define uvm_static_branch_enable(key)       (*(key) = true)
+#endif
+
+// reinit_completion() was added in kernel 3.13 and replaced the INIT_COMPLETION
+// macro, which takes the completion itself instead of a pointer to it.
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3,13,0)
+    #define reinit_completion(x) INIT_COMPLETION(*(x))
+#endif
+
 #if defined(NVCPU_X86) || defined(NVCPU_X86_64)
 #if !defined(pmd_large)
 #define pmd_large(_pmd) \